@@ -58,6 +58,11 @@ struct CanBeAtomic<uint64_t> {
   static const bool value = true;
 };
 
+template <typename T>
+struct CanBeAtomic<T*> {
+  static const bool value = true;
+};
+
 // Provides a minimal atomic counter, required to implement SharedPtr.
 // If std::atomic is present, delegates to it. Otherwise(when compiling against
 // STLPort on Android) delegates to gcc- and clang-provided atomic built-ins.
@@ -93,6 +98,15 @@ class Atomic {
   // Returns the value as observed before the operation.
   T fetch_sub(T arg);
 
+  // Atomically replaces the stored value with desired.
+  // Returns the value as observed before the operation.
+  T exchange(T desired);
+
+  // Atomically replaces the stored value with desired if it is equal to
+  // *expected, and returns true.  Otherwise loads the stored value into
+  // *expected and returns false.
+  bool compare_exchange(T* expected, T desired);
+
  private:
 #if defined(_STLPORT_VERSION)
   T value_;
@@ -123,6 +137,17 @@ T Atomic<T>::fetch_sub(T arg) {
   return __atomic_fetch_sub(&value_, arg, __ATOMIC_SEQ_CST);
 }
 
+template <typename T>
+T Atomic<T>::exchange(T desired) {
+  return __atomic_exchange_n(&value_, desired, __ATOMIC_SEQ_CST);
+}
+
+template <typename T>
+bool Atomic<T>::compare_exchange(T* expected, T desired) {
+  return __atomic_compare_exchange_n(&value_, expected, desired, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
 #else  // defined(_STLPORT_VERSION)
 
 template <typename T>
@@ -145,6 +170,16 @@ T Atomic<T>::fetch_sub(T arg) {
   return value_.fetch_sub(arg);
 }
 
+template <typename T>
+T Atomic<T>::exchange(T desired) {
+  return value_.exchange(desired);
+}
+
+template <typename T>
+bool Atomic<T>::compare_exchange(T* expected, T desired) {
+  return value_.compare_exchange_strong(*expected, desired);
+}
+
 #endif  // defined(_STLPORT_VERSION)
 
 }  // namespace compat
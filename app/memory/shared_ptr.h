@@ -89,14 +89,16 @@ class SharedPtr final {
   SharedPtr(SharedPtr<U>&& other);  // NOLINT
 
   SharedPtr& operator=(const SharedPtr& other) {
+    if (ctrl_ == other.ctrl_) return *this;
     MaybeDestroy();
     ptr_ = other.ptr_;
     ctrl_ = other.ctrl_;
-    ctrl_->ref();
+    if (ctrl_) ctrl_->ref();
     return *this;
   }
 
   SharedPtr& operator=(SharedPtr&& other) {
+    if (this == &other) return *this;
     MaybeDestroy();
     ptr_ = other.ptr_;
     ctrl_ = other.ctrl_;
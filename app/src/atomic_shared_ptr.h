@@ -0,0 +1,97 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FIREBASE_APP_CLIENT_CPP_SRC_ATOMIC_SHARED_PTR_H_
+#define FIREBASE_APP_CLIENT_CPP_SRC_ATOMIC_SHARED_PTR_H_
+
+#include <cstdint>
+
+#include "app/memory/atomic.h"
+#include "app/memory/shared_ptr.h"
+#include "app/src/mutex.h"
+#include "app/src/time.h"
+
+#if !defined(FIREBASE_NAMESPACE)
+#define FIREBASE_NAMESPACE firebase
+#endif
+
+namespace FIREBASE_NAMESPACE {
+
+// A SharedPtr which can be replaced from one thread while other threads take
+// copies of it.  Meant for data which is read much more often than it changes:
+// writers publish a new immutable object instead of modifying the current one,
+// and readers keep using the object they got for as long as they need it.
+//
+// load() takes no lock.  The pointer lives in one of two slots, each counting
+// the readers copying out of it.  store() fills the slot readers are not
+// using, points readers at it, then waits for the readers of the other slot,
+// which only ever hold it while copying the SharedPtr, before clearing it.
+// Calls to store() are serialized with a mutex.
+template <typename T>
+class AtomicSharedPtr {
+ public:
+  AtomicSharedPtr() : current_(0) {}
+
+  // AtomicSharedPtr is neither copyable nor movable.
+  AtomicSharedPtr(const AtomicSharedPtr&) = delete;
+  AtomicSharedPtr& operator=(const AtomicSharedPtr&) = delete;
+
+  // Get a reference to the current object.
+  SharedPtr<T> load() const {
+    for (;;) {
+      uint32_t index = current_.load();
+      readers_[index].fetch_add(1);
+      // If the slot changed in the meantime, store() may be about to clear
+      // it without having seen this reader.
+      if (current_.load() == index) {
+        SharedPtr<T> value = slots_[index];
+        readers_[index].fetch_sub(1);
+        return value;
+      }
+      readers_[index].fetch_sub(1);
+    }
+  }
+
+  // Replace the current object.  The previous one is deleted once the last
+  // reference to it goes away.
+  void store(const SharedPtr<T>& value) {
+    MutexLock lock(mutex_);
+    uint32_t previous = current_.load();
+    uint32_t next = 1 - previous;
+    slots_[next] = value;
+    current_.store(next);
+    WaitForReaders(previous);
+    slots_[previous].reset();
+  }
+
+ private:
+  void WaitForReaders(uint32_t index) {
+    while (readers_[index].load() != 0) {
+      internal::Sleep(0);
+    }
+  }
+
+  SharedPtr<T> slots_[2];
+  mutable compat::Atomic<uint32_t> readers_[2];
+  // Index of the slot readers should copy from.
+  compat::Atomic<uint32_t> current_;
+  Mutex mutex_;
+};
+
+// NOLINTNEXTLINE - allow namespace overridden
+}  // namespace FIREBASE_NAMESPACE
+
+#endif  // FIREBASE_APP_CLIENT_CPP_SRC_ATOMIC_SHARED_PTR_H_
@@ -16,8 +16,10 @@
 
 #include "app/src/callback.h"
 
-#include <list>
+#include <cstdint>
 
+#include "app/memory/atomic.h"
+#include "app/src/lock_free_pool.h"
 #include "app/src/log.h"
 #include "app/src/mutex.h"
 #include "app/src/semaphore.h"
@@ -30,23 +32,19 @@
 namespace FIREBASE_NAMESPACE {
 namespace callback {
 
-class CallbackEntry;
-
-class CallbackQueue : public std::list<CallbackEntry*> {
- public:
-  CallbackQueue() {}
-  ~CallbackQueue() {}
-
-  // Get the mutex that controls access to this queue.
-  Mutex* mutex() { return &mutex_; }
-
- private:
-  Mutex mutex_;
-};
+// Number of entries preallocated per dispatcher.
+static const uint32_t kPoolSize = 512;
+// Maximum number of entries taken off the queue at once.
+static const int kDispatchBatchSize = 64;
 
 // Entry within the callback queue.
+//
+// Entries are linked into the dispatcher's queue through next_, and recycled
+// through the dispatcher's pool once dispatched.
 class CallbackEntry {
  public:
+  CallbackEntry() : callback_(nullptr), mutex_(nullptr) {}
+
   // Construct a entry with a reference to the specified callback object.
   // callback_mutex_ is used to enforce a critical section for callback
   // execution and destruction.
@@ -57,6 +55,13 @@ class CallbackEntry {
   // executing.
   ~CallbackEntry() { DisableCallback(); }
 
+  // Attach a callback to an unused entry.
+  void Reset(Callback* callback, Mutex* callback_mutex) {
+    callback_ = callback;
+    mutex_ = callback_mutex;
+    next_.store(nullptr);
+  }
+
   // Execute the callback associated with this entry.
   // Returns true if a callback was associated with this entry and was executed,
   // false otherwise.
@@ -76,6 +81,7 @@ class CallbackEntry {
 
   // Remove the callback method from this entry.
   bool DisableCallback() {
+    if (!mutex_) return false;
     MutexLock lock(*mutex_);
     if (callback_) {
       delete callback_;
@@ -90,33 +96,39 @@ class CallbackEntry {
   Callback* callback_;
   // Mutex that is held when modifying callback_.
   Mutex* mutex_;
+  // Next entry in the dispatcher's queue.
+  compat::Atomic<CallbackEntry*> next_;
+
+  friend class CallbackDispatcher;
 };
 
 // Dispatches a queue of callbacks.
+//
+// Callbacks can be added from any number of threads without taking a lock.
+// The queue is an intrusive multi-producer/single-consumer linked list: a
+// producer links its entry in with a single atomic exchange of the head, and
+// the consumer walks the list from the tail.  Entries come from a fixed
+// lock-free pool, and fall back to the heap when the pool runs dry.
 class CallbackDispatcher {
  public:
-  CallbackDispatcher() {}
+  CallbackDispatcher()
+      : head_(&stub_), tail_(&stub_), flush_count_(0), pool_(kPoolSize) {}
 
   ~CallbackDispatcher() {
-    MutexLock lock(*queue_.mutex());
     // Destroy all callbacks in this dispatcher's queue.
-    size_t remaining_callbacks = queue_.size();
+    int remaining_callbacks = FlushCallbacks();
     if (remaining_callbacks) {
       LogWarning("Callback dispatcher shut down with %d pending callbacks",
                  remaining_callbacks);
     }
-    while (!queue_.empty()) {
-      delete queue_.back();
-      queue_.pop_back();
-    }
   }
 
   // Add a callback to the dispatch queue returning a reference
   // to the entry which can be optionally be removed prior to dispatch.
   void* AddCallback(Callback* callback) {
-    CallbackEntry* entry = new CallbackEntry(callback, &execution_mutex_);
-    MutexLock lock(*queue_.mutex());
-    queue_.push_back(entry);
+    CallbackEntry* entry = AllocateEntry();
+    entry->Reset(callback, &execution_mutex_);
+    Push(entry);
     return entry;
   }
 
@@ -126,7 +138,6 @@ class CallbackDispatcher {
   // NOTE: This does not remove the callback from the execution queue.
   // The queue is flushed on a call to DispatchCallbacks().
   bool DisableCallback(void* callback_reference) {
-    MutexLock lock(*queue_.mutex());
     CallbackEntry* callback_entry =
         static_cast<CallbackEntry*>(callback_reference);
     return callback_entry->DisableCallback();
@@ -136,65 +147,178 @@ class CallbackDispatcher {
   // dispatched and removed from the queue.
   int DispatchCallbacks() {
     int dispatched = 0;
-    Mutex* queue_mutex = queue_.mutex();
-    MutexLock lock(*queue_mutex);
-    while (!queue_.empty()) {
-      CallbackEntry* callback_entry = queue_.front();
-      queue_.pop_front();
-      queue_mutex->Release();
-      callback_entry->Execute();
-      dispatched++;
-      queue_mutex->Acquire();
-      delete callback_entry;
+    CallbackEntry* batch[kDispatchBatchSize];
+    for (;;) {
+      // Take a batch of entries off the queue, then run them without holding
+      // the consumer lock so that callbacks are free to add more callbacks or
+      // to terminate the module.
+      int flush_count;
+      int batch_size = PopBatch(batch, kDispatchBatchSize, &flush_count);
+      if (batch_size == 0) break;
+      for (int i = 0; i < batch_size; ++i) {
+        {
+          // A flush since the batch was taken discards the rest of it, as it
+          // would have if the entries were still in the queue.
+          MutexLock lock(execution_mutex_);
+          if (flush_count == flush_count_) {
+            batch[i]->Execute();
+          } else {
+            batch[i]->DisableCallback();
+          }
+        }
+        ReleaseEntry(batch[i]);
+      }
+      dispatched += batch_size;
     }
     return dispatched;
   }
 
-  // Flush pending callbacks from the queue without executing them.
+  // Flush pending callbacks from the queue without executing them, including
+  // those a dispatching thread already took off the queue.  Waits for the
+  // callback being executed, if any, so none runs once this returns.
   int FlushCallbacks() {
+    // Lock order is execution_mutex_ then consumer_mutex_, as a callback can
+    // dispatch callbacks.
+    MutexLock execution_lock(execution_mutex_);
+    {
+      MutexLock lock(consumer_mutex_);
+      flush_count_++;
+    }
     int flushed = 0;
-    MutexLock lock(*queue_.mutex());
-    while (!queue_.empty()) {
-      delete queue_.front();
-      queue_.pop_front();
-      flushed++;
+    CallbackEntry* batch[kDispatchBatchSize];
+    for (;;) {
+      int batch_size = PopBatch(batch, kDispatchBatchSize, nullptr);
+      if (batch_size == 0) break;
+      for (int i = 0; i < batch_size; ++i) {
+        batch[i]->DisableCallback();
+        ReleaseEntry(batch[i]);
+      }
+      flushed += batch_size;
     }
     return flushed;
   }
 
  private:
-  CallbackQueue queue_;
+  // Take an entry from the pool, or from the heap if the pool is empty.
+  CallbackEntry* AllocateEntry() {
+    CallbackEntry* entry = pool_.Allocate();
+    return entry ? entry : new CallbackEntry();
+  }
+
+  // Return a dispatched entry to the pool, or delete it if it came from the
+  // heap.
+  void ReleaseEntry(CallbackEntry* entry) {
+    if (!pool_.Release(entry)) delete entry;
+  }
+
+  // Link an entry at the head of the queue.  Can be called from any thread.
+  void Push(CallbackEntry* entry) {
+    entry->next_.store(nullptr);
+    CallbackEntry* previous = head_.exchange(entry);
+    // Until this store, the consumer sees the queue as ending at previous.
+    previous->next_.store(entry);
+  }
+
+  // Take the entry at the tail of the queue, or nullptr if none is ready.
+  // Must be called with consumer_mutex_ held.
+  CallbackEntry* Pop() {
+    CallbackEntry* tail = tail_;
+    CallbackEntry* next = tail->next_.load();
+    if (tail == &stub_) {
+      if (next == nullptr) return nullptr;
+      tail_ = next;
+      tail = next;
+      next = next->next_.load();
+    }
+    if (next != nullptr) {
+      tail_ = next;
+      return tail;
+    }
+    // tail is the last linked entry.  If a producer has swapped the head but
+    // not linked its entry yet, leave tail in place: the entry will be picked
+    // up on the next dispatch.
+    if (tail != head_.load()) return nullptr;
+    // Re-insert the stub so that tail can be taken without leaving the queue
+    // empty of nodes.
+    Push(&stub_);
+    next = tail->next_.load();
+    if (next != nullptr) {
+      tail_ = next;
+      return tail;
+    }
+    return nullptr;
+  }
+
+  // Take up to max_entries entries off the queue, along with the number of
+  // flushes so far if flush_count is not null.
+  int PopBatch(CallbackEntry** entries, int max_entries, int* flush_count) {
+    MutexLock lock(consumer_mutex_);
+    if (flush_count) *flush_count = flush_count_;
+    int count = 0;
+    while (count < max_entries) {
+      CallbackEntry* entry = Pop();
+      if (entry == nullptr) break;
+      entries[count++] = entry;
+    }
+    return count;
+  }
+
+  // Placeholder entry which keeps the queue non-empty.
+  CallbackEntry stub_;
+  // Most recently added entry.  Swapped by producers.
+  compat::Atomic<CallbackEntry*> head_;
+  // Oldest entry still in the queue.  Only accessed by the consumer.
+  CallbackEntry* tail_;
+  // Serializes consumers.  Callbacks are normally dispatched from a single
+  // thread, but the queue can also be flushed from the thread terminating the
+  // module.
+  Mutex consumer_mutex_;
+  // Number of calls to FlushCallbacks(), which discard the entries taken off
+  // the queue before them.  Modified with both execution_mutex_ and
+  // consumer_mutex_ held, so it can be read with either.
+  int flush_count_;
+
   // Mutex that is held for the duration of each callback.  This prevents the
   // destruction of a callback until execution is complete.
   Mutex execution_mutex_;
+
+  // Preallocated entries.  Declared after execution_mutex_, which the entries
+  // lock when they are destroyed.
+  LockFreePool<CallbackEntry> pool_;
 };
 
 static CallbackDispatcher* g_callback_dispatcher = nullptr;
-// Mutex that controls access to g_callback_dispatcher and g_callback_ref_count.
+// Mutex that controls the creation and destruction of g_callback_dispatcher.
 static Mutex g_callback_mutex;  // NOLINT
-static int g_callback_ref_count = 0;
+// Number of references to g_callback_dispatcher.  Only modified atomically so
+// that references can be added without g_callback_mutex while the dispatcher
+// exists.  g_callback_dispatcher does not change while this is above 0.
+static compat::Atomic<int32_t> g_callback_ref_count;  // NOLINT
 static Thread::Id g_callback_thread_id;
 static bool g_callback_thread_id_initialized = false;
 
 void Initialize() {
   MutexLock lock(g_callback_mutex);
-  if (g_callback_ref_count == 0) {
+  if (g_callback_ref_count.load() == 0) {
     g_callback_dispatcher = new CallbackDispatcher();
   }
-  ++g_callback_ref_count;
+  g_callback_ref_count.fetch_add(1);
 }
 
-// Add a reference to the module if it's already initialized.
+// Add a reference to the module if it's already initialized.  This does not
+// take g_callback_mutex since the reference count is only incremented from a
+// non-zero value, which guarantees g_callback_dispatcher stays alive.
 static bool InitializeIfInitialized() {
-  MutexLock lock(g_callback_mutex);
-  if (IsInitialized()) {
-    Initialize();
-    return true;
+  int32_t ref_count = g_callback_ref_count.load();
+  while (ref_count > 0) {
+    if (g_callback_ref_count.compare_exchange(&ref_count, ref_count + 1)) {
+      return true;
+    }
   }
   return false;
 }
 
-bool IsInitialized() { return g_callback_ref_count > 0; }
+bool IsInitialized() { return g_callback_ref_count.load() > 0; }
 
 // Remove number_of_references_to_remove from the module, clean up if the
 // reference count reaches 0, do nothing if the reference count is already 0.
@@ -202,17 +326,20 @@ static void Terminate(int number_of_references_to_remove) {
   CallbackDispatcher* dispatcher_to_destroy = nullptr;
   {
     MutexLock lock(g_callback_mutex);
-    if (!g_callback_ref_count) {
-      LogWarning("Callback module already shut down");
-      return;
-    }
-    g_callback_ref_count =
-        g_callback_ref_count - number_of_references_to_remove;
-    if (g_callback_ref_count < 0) {
-      LogDebug("WARNING: Callback module ref count = %d", g_callback_ref_count);
-    }
-    g_callback_ref_count = g_callback_ref_count < 0 ? 0 : g_callback_ref_count;
-    if (g_callback_ref_count == 0) {
+    int32_t ref_count = g_callback_ref_count.load();
+    int32_t new_ref_count;
+    do {
+      if (!ref_count) {
+        LogWarning("Callback module already shut down");
+        return;
+      }
+      new_ref_count = ref_count - number_of_references_to_remove;
+      if (new_ref_count < 0) {
+        LogDebug("WARNING: Callback module ref count = %d", new_ref_count);
+        new_ref_count = 0;
+      }
+    } while (!g_callback_ref_count.compare_exchange(&ref_count, new_ref_count));
+    if (new_ref_count == 0) {
       dispatcher_to_destroy = g_callback_dispatcher;
       g_callback_dispatcher = nullptr;
     }
@@ -235,8 +362,8 @@ void Terminate(bool flush_all) {
 }
 
 void* AddCallback(Callback* callback) {
-  MutexLock lock(g_callback_mutex);
-  Initialize();
+  // Only take g_callback_mutex if the dispatcher needs to be created.
+  if (!InitializeIfInitialized()) Initialize();
   return g_callback_dispatcher->AddCallback(callback);
 }
 
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FIREBASE_APP_CLIENT_CPP_SRC_LOCK_FREE_POOL_H_
+#define FIREBASE_APP_CLIENT_CPP_SRC_LOCK_FREE_POOL_H_
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+
+#include "app/memory/atomic.h"
+
+#if !defined(FIREBASE_NAMESPACE)
+#define FIREBASE_NAMESPACE firebase
+#endif
+
+namespace FIREBASE_NAMESPACE {
+
+// A fixed number of preallocated objects which can be taken and given back
+// from any thread without taking a lock.
+//
+// The free objects form a stack.  Its head packs the index of the first free
+// object with a counter bumped on every change, so that a compare-and-swap
+// cannot succeed on a head which was popped and pushed back in the meantime
+// (ABA).
+//
+// Objects are default-constructed once, when the pool is created, and are not
+// reset when they are given back.  Callers which run out of pooled objects are
+// expected to fall back to the heap; Release() tells the two apart.
+template <typename T>
+class LockFreePool {
+ public:
+  explicit LockFreePool(uint32_t size)
+      : items_(new T[size]), next_free_(new compat::Atomic<uint32_t>[size]),
+        size_(size) {
+    assert(size < kEndOfFreeList);
+    // Chain all the objects into the free list.
+    for (uint32_t i = 0; i < size_; ++i) {
+      next_free_[i].store(i + 1 < size_ ? i + 1 : kEndOfFreeList);
+    }
+    free_list_.store(MakeHead(size_ > 0 ? 0 : kEndOfFreeList, 0));
+  }
+
+  // All objects should have been given back before the pool is destroyed.
+  ~LockFreePool() {
+    delete[] next_free_;
+    delete[] items_;
+  }
+
+  // LockFreePool is neither copyable nor movable.
+  LockFreePool(const LockFreePool&) = delete;
+  LockFreePool& operator=(const LockFreePool&) = delete;
+
+  // Take a free object, or return nullptr if they are all in use.
+  T* Allocate() {
+    uint64_t head = free_list_.load();
+    for (;;) {
+      uint32_t index = HeadIndex(head);
+      if (index == kEndOfFreeList) return nullptr;
+      uint64_t new_head = MakeHead(next_free_[index].load(), HeadTag(head) + 1);
+      if (free_list_.compare_exchange(&head, new_head)) return &items_[index];
+    }
+  }
+
+  // Give back an object taken with Allocate().  Returns false, and does
+  // nothing, if the object does not belong to this pool.
+  bool Release(T* item) {
+    if (!Owns(item)) return false;
+    uint32_t index = static_cast<uint32_t>(item - items_);
+    uint64_t head = free_list_.load();
+    for (;;) {
+      next_free_[index].store(HeadIndex(head));
+      uint64_t new_head = MakeHead(index, HeadTag(head) + 1);
+      if (free_list_.compare_exchange(&head, new_head)) return true;
+    }
+  }
+
+  // Whether the object is one of this pool's.
+  bool Owns(const T* item) const {
+    std::less<const T*> less;
+    return !less(item, items_) && less(item, items_ + size_);
+  }
+
+ private:
+  // Marks the end of the free list.
+  static const uint32_t kEndOfFreeList = 0xffffffff;
+
+  static uint64_t MakeHead(uint32_t index, uint32_t tag) {
+    return (static_cast<uint64_t>(tag) << 32) | index;
+  }
+  static uint32_t HeadIndex(uint64_t head) {
+    return static_cast<uint32_t>(head & 0xffffffff);
+  }
+  static uint32_t HeadTag(uint64_t head) {
+    return static_cast<uint32_t>(head >> 32);
+  }
+
+  T* items_;
+  // Index of the next free object, for each object in the free list.
+  compat::Atomic<uint32_t>* next_free_;
+  uint32_t size_;
+  compat::Atomic<uint64_t> free_list_;
+};
+
+template <typename T>
+const uint32_t LockFreePool<T>::kEndOfFreeList;
+
+// NOLINTNEXTLINE - allow namespace overridden
+}  // namespace FIREBASE_NAMESPACE
+
+#endif  // FIREBASE_APP_CLIENT_CPP_SRC_LOCK_FREE_POOL_H_
@@ -19,7 +19,9 @@
 #include <cstdint>
 #include <string>
 
+#include "app/memory/atomic.h"
 #include "app/src/assert.h"
+#include "app/src/callback.h"
 #include "app/src/log.h"
 
 // Set this to 1 to enable verbose logging in this module.
@@ -44,7 +46,10 @@ static_assert(sizeof(FutureBase) == sizeof(Future<int>),
               "Future should not introduce virtual functions or data members.");
 
 typedef void DataDeleteFn(void* data_to_delete);
-typedef std::pair<FutureHandle, FutureBackingData*> BackingPair;
+
+// Number of slots in the first chunk of slots.  Each chunk is twice as large
+// as the previous one.
+static const uint32_t kFirstSlotChunkSizeBits = 4;
 
 namespace {
 
@@ -113,25 +118,65 @@ class FutureProxyManager {
   FutureHandle subject_;
 };
 
+// Runs a continuation through an executor.  Holds a reference to the Future
+// until it has run.
+class ContinuationCallback : public callback::Callback {
+ public:
+  ContinuationCallback(const FutureBase& future,
+                       FutureBase::CompletionCallback function,
+                       void* user_data)
+      : future_(future), function_(function), user_data_(user_data) {}
+  ~ContinuationCallback() override {}
+
+  void Run() override { function_(future_, user_data_); }
+
+ private:
+  FutureBase future_;
+  FutureBase::CompletionCallback function_;
+  void* user_data_;
+};
+
 }  // namespace
 
+// A function to run once a Future completes.  See
+// ReferenceCountedFutureImpl::Then().
+struct FutureContinuation {
+  FutureContinuation()
+      : function(nullptr), user_data(nullptr), executor(nullptr),
+        next(nullptr) {}
+
+  FutureBase::CompletionCallback function;
+  void* user_data;
+  ReferenceCountedFutureImpl::Executor* executor;
+  // Continuations added after this one.
+  FutureContinuation* next;
+};
+
 struct FutureBackingData {
-  // Create with type-specific data.
-  explicit FutureBackingData(void* data, DataDeleteFn* delete_data_fn)
+  // Create an empty slot.
+  FutureBackingData()
       : status(kFutureStatusPending),
         error(0),
         reference_count(0),
-        data(data),
-        data_delete_fn(delete_data_fn),
+        data(nullptr),
+        data_delete_fn(nullptr),
         context_data(nullptr),
         context_data_delete_fn(nullptr),
         completion_callback(nullptr),
         callback_user_data(nullptr),
         callback_user_data_delete_fn(nullptr),
-        proxy(nullptr) {}
-
-  // Call the type-specific destructor on data.
-  ~FutureBackingData() {
+        proxy(nullptr),
+        more_continuations(nullptr),
+        index(0),
+        generation(1),
+        in_use(false),
+        next_free(ReferenceCountedFutureImpl::kNoFreeSlot) {}
+
+  ~FutureBackingData() { Clear(); }
+
+  // Call the type-specific destructor on data, and reset the slot so that it
+  // can be used by another Future.
+  void Clear() {
     if (callback_user_data_delete_fn) {
       callback_user_data_delete_fn(callback_user_data);
       callback_user_data_delete_fn = nullptr;
@@ -141,14 +186,31 @@ struct FutureBackingData {
       data_delete_fn(data);
       data = nullptr;
     }
+    data_delete_fn = nullptr;
 
     if (context_data != nullptr) {
       FIREBASE_ASSERT(context_data_delete_fn != nullptr);
       context_data_delete_fn(context_data);
       context_data = nullptr;
     }
+    context_data_delete_fn = nullptr;
 
     delete proxy;
+    proxy = nullptr;
+
+    // Continuations of a Future which never completed.
+    while (more_continuations) {
+      FutureContinuation* next = more_continuations->next;
+      delete more_continuations;
+      more_continuations = next;
+    }
+    continuation = FutureContinuation();
+
+    status = kFutureStatusPending;
+    error = 0;
+    error_msg.clear();
+    completion_callback = nullptr;
+    callback_user_data = nullptr;
   }
 
   // Status of the asynchronous call.
@@ -161,12 +223,14 @@ struct FutureBackingData {
   std::string error_msg;
 
   // Number of outstanding futures referencing this asynchronous call.
-  // When this count reaches zero, this class is removed from the `backings_`
-  // map and deleted.
-  uint32_t reference_count;
+  // When this count reaches zero, this backing is cleared and its slot is
+  // reused.  Only needs the lock to go from zero to one, which is how the
+  // backing is kept alive while its completion callback runs.
+  compat::Atomic<uint32_t> reference_count;
 
   // The call-specific result that is returned in Future<T>,
-  // or nullptr if return value is Future<void>.
+  // or nullptr if return value is Future<void>.  Either points to
+  // inline_result or to the heap.
   void* data;
 
   // A function that can deletes data by calling its destructor.
@@ -192,6 +256,28 @@ struct FutureBackingData {
   void (*callback_user_data_delete_fn)(void*);
 
   FutureProxyManager* proxy;
+
+  // The first continuation added with Then(), which is all most Futures
+  // need, and a list of the ones added after it.  Each continuation holds a
+  // reference to the Future until it has run.
+  FutureContinuation continuation;
+  FutureContinuation* more_continuations;
+
+  // Storage for small results, so that they don't need to be allocated.
+  ReferenceCountedFutureImpl::InlineResult inline_result;
+
+  // Index of this slot, in the lower bits of handles to it.
+  uint32_t index;
+
+  // Changed every time this slot is released, in the upper bits of handles
+  // to it.
+  FutureHandle generation;
+
+  // Whether this slot holds a Future which is still referenced.
+  bool in_use;
+
+  // Index of the next free slot, if this slot is free.
+  uint32_t next_free;
 };
 
 namespace detail {
@@ -214,41 +300,120 @@ ReferenceCountedFutureImpl::~ReferenceCountedFutureImpl() {
   // Invalidate any externally-held futures.
   cleanup_.CleanupAll();
 
-  // TODO(jsanmiya): Change this to use unique_ptr so deletion is automatic.
-  while (!backings_.empty()) {
-    auto it = backings_.begin();
+  MutexLock lock(mutex_);
+  for (uint32_t i = 0; i < slot_count_; ++i) {
+    FutureBackingData* backing = SlotAt(i);
+    if (!backing->in_use) continue;
     LogWarning(
         "Future with handle %d still exists though its backing API"
         " 0x%X is being deleted. Please call Future::Release() before"
         " deleting the backing API.",
-        it->first, static_cast<int>(reinterpret_cast<uintptr_t>(this)));
-
-    FutureBackingData* backing = it->second;
-    backings_.erase(it);
-    delete backing;
+        static_cast<int>(backing->generation << kHandleIndexBits | i),
+        static_cast<int>(reinterpret_cast<uintptr_t>(this)));
+    FreeBacking(backing);
+  }
+  for (int i = 0; i < kMaxSlotChunks; ++i) {
+    delete[] slot_chunks_[i];
+    slot_chunks_[i] = nullptr;
   }
 }
 
-FutureHandle ReferenceCountedFutureImpl::AllocInternal(
-    int fn_idx, void* data, void (*delete_data_fn)(void* data_to_delete)) {
-  // Backings get deleted in ReleaseFuture() and ~ReferenceCountedFutureImpl().
-  FutureBackingData* backing = new FutureBackingData(data, delete_data_fn);
+FutureBackingData* ReferenceCountedFutureImpl::SlotAt(uint32_t index) const {
+  // Chunk k holds the slots from (2^k - 1) * kFirstSlotChunkSize to
+  // (2^(k+1) - 1) * kFirstSlotChunkSize.
+  const uint32_t position = (index >> kFirstSlotChunkSizeBits) + 1;
+  int chunk = 0;
+  while (position >> (chunk + 1)) ++chunk;
+  const uint32_t chunk_start = ((1U << chunk) - 1) << kFirstSlotChunkSizeBits;
+  return &slot_chunks_[chunk][index - chunk_start];
+}
 
-  // Allocate a unique handle and insert the new backing into the map.
-  // Note that it's theoretically possible to have a handle collision if we
-  // allocate four billion more handles before releasing one. We ignore this
-  // possibility.
-  MutexLock lock(mutex_);
-  const FutureHandle handle = AllocHandle();
-  FIREBASE_FUTURE_TRACE("API: Allocated handle %d", handle);
-  backings_.insert(BackingPair(handle, backing));
+FutureBackingData* ReferenceCountedFutureImpl::AllocBacking(
+    FutureHandle* handle) {
+  uint32_t index;
+  if (free_slot_ != kNoFreeSlot) {
+    index = free_slot_;
+    free_slot_ = SlotAt(index)->next_free;
+  } else {
+    const uint32_t max_slots = ((1U << kMaxSlotChunks) - 1)
+                               << kFirstSlotChunkSizeBits;
+    if (slot_count_ >= max_slots) return nullptr;
+    index = slot_count_;
+    const uint32_t position = (index >> kFirstSlotChunkSizeBits) + 1;
+    int chunk = 0;
+    while (position >> (chunk + 1)) ++chunk;
+    if (slot_chunks_[chunk] == nullptr) {
+      slot_chunks_[chunk] =
+          new FutureBackingData[(1U << chunk) << kFirstSlotChunkSizeBits];
+    }
+    slot_count_++;
+    SlotAt(index)->index = index;
+  }
+
+  FutureBackingData* backing = SlotAt(index);
+  backing->in_use = true;
+  backing->next_free = kNoFreeSlot;
+  backing->reference_count.store(0);
+  *handle = backing->generation << kHandleIndexBits | index;
+  return backing;
+}
+
+void ReferenceCountedFutureImpl::FreeBacking(FutureBackingData* backing) {
+  // Invalidate the handles to the backing before clearing it, in case the
+  // delete functions look it up.
+  backing->in_use = false;
+  const FutureHandle max_generation =
+      ~static_cast<FutureHandle>(0) >> kHandleIndexBits;
+  backing->generation =
+      backing->generation == max_generation ? 1 : backing->generation + 1;
+  backing->Clear();
+  backing->next_free = free_slot_;
+  free_slot_ = backing->index;
+}
 
+void ReferenceCountedFutureImpl::SetLastResult(int fn_idx,
+                                               FutureHandle handle) {
   // Update the most recent Future for this function.
   if (0 <= fn_idx && fn_idx < static_cast<int>(last_results_.size())) {
     FIREBASE_FUTURE_TRACE("API: Future handle %d (fn %d) --> %08x", handle,
                           fn_idx, &last_results_[fn_idx]);
     last_results_[fn_idx] = FutureBase(this, handle);
   }
+}
+
+FutureHandle ReferenceCountedFutureImpl::AllocInternal(
+    int fn_idx, void* data, void (*delete_data_fn)(void* data_to_delete)) {
+  // Backings get released in ReleaseFuture() and
+  // ~ReferenceCountedFutureImpl().
+  MutexLock lock(mutex_);
+  FutureHandle handle;
+  FutureBackingData* backing = AllocBacking(&handle);
+  FIREBASE_ASSERT_MESSAGE_RETURN(kInvalidHandle, backing != nullptr,
+                                 "Too many Futures allocated at once");
+  FIREBASE_FUTURE_TRACE("API: Allocated handle %d", handle);
+  backing->data = data;
+  backing->data_delete_fn = delete_data_fn;
+
+  SetLastResult(fn_idx, handle);
+  FIREBASE_FUTURE_TRACE("API: Alloc complete.");
+  return handle;
+}
+
+FutureHandle ReferenceCountedFutureImpl::AllocInternalInline(
+    int fn_idx, void (*construct_data_fn)(void* storage,
+                                          const void* initial_data),
+    const void* initial_data, void (*destruct_data_fn)(void* data)) {
+  MutexLock lock(mutex_);
+  FutureHandle handle;
+  FutureBackingData* backing = AllocBacking(&handle);
+  FIREBASE_ASSERT_MESSAGE_RETURN(kInvalidHandle, backing != nullptr,
+                                 "Too many Futures allocated at once");
+  FIREBASE_FUTURE_TRACE("API: Allocated handle %d", handle);
+  construct_data_fn(&backing->inline_result, initial_data);
+  backing->data = &backing->inline_result;
+  backing->data_delete_fn = destruct_data_fn;
+
+  SetLastResult(fn_idx, handle);
   FIREBASE_FUTURE_TRACE("API: Alloc complete.");
   return handle;
 }
@@ -292,6 +457,12 @@ void ReferenceCountedFutureImpl::ReleaseMutexAndRunCallback(
   FutureBackingData* backing = BackingFromHandle(handle);
   FIREBASE_ASSERT(backing != nullptr);
 
+  // Consume the continuations, so they are only run once.
+  const FutureContinuation continuation = backing->continuation;
+  FutureContinuation* more_continuations = backing->more_continuations;
+  backing->continuation = FutureContinuation();
+  backing->more_continuations = nullptr;
+
   // Call callback, if one has been registered.
   if (backing->completion_callback != nullptr) {
     FutureBase future_base(this, handle);
@@ -318,6 +489,71 @@ void ReferenceCountedFutureImpl::ReleaseMutexAndRunCallback(
   } else {
     mutex_.Release();
   }
+
+  // Then the continuations, in the order they were added.
+  if (continuation.function != nullptr) {
+    FutureBase future_base(this, handle);
+    RunContinuation(handle, future_base, continuation);
+    while (more_continuations) {
+      FutureContinuation* next = more_continuations->next;
+      RunContinuation(handle, future_base, *more_continuations);
+      delete more_continuations;
+      more_continuations = next;
+    }
+  }
+}
+
+void ReferenceCountedFutureImpl::RunContinuation(
+    FutureHandle handle, const FutureBase& future,
+    const FutureContinuation& continuation) {
+  if (continuation.executor) {
+    continuation.executor->Execute(new ContinuationCallback(
+        future, continuation.function, continuation.user_data));
+  } else {
+    continuation.function(future, continuation.user_data);
+  }
+  // Release the reference taken when the continuation was added.
+  ReleaseFuture(handle);
+}
+
+bool ReferenceCountedFutureImpl::Then(
+    FutureHandle handle, FutureBase::CompletionCallback continuation,
+    void* user_data, Executor* executor) {
+  FIREBASE_ASSERT_RETURN(false, continuation != nullptr);
+  mutex_.Acquire();
+
+  // If the handle is no longer valid, don't do anything.
+  FutureBackingData* backing = BackingFromHandle(handle);
+  if (backing == nullptr) {
+    mutex_.Release();
+    return false;
+  }
+
+  FutureContinuation new_continuation;
+  new_continuation.function = continuation;
+  new_continuation.user_data = user_data;
+  new_continuation.executor = executor;
+
+  // Keep the Future alive until the continuation has run.
+  ReferenceFuture(handle);
+
+  // If the future was already completed, run the continuation now.
+  if (backing->status == kFutureStatusComplete) {
+    mutex_.Release();
+    FutureBase future_base(this, handle);
+    RunContinuation(handle, future_base, new_continuation);
+    return true;
+  }
+
+  if (backing->continuation.function == nullptr) {
+    backing->continuation = new_continuation;
+  } else {
+    FutureContinuation** last = &backing->more_continuations;
+    while (*last) last = &(*last)->next;
+    *last = new FutureContinuation(new_continuation);
+  }
+  mutex_.Release();
+  return true;
 }
 
 static void CleanupFuture(FutureBase* future) { future->Release(); }
@@ -332,35 +568,35 @@ void ReferenceCountedFutureImpl::UnregisterFutureForCleanup(
 }
 
 void ReferenceCountedFutureImpl::ReferenceFuture(FutureHandle handle) {
-  MutexLock lock(mutex_);
-  BackingFromHandle(handle)->reference_count++;
+  // The caller holds a reference to the Future already, or the lock, so the
+  // backing can't be released concurrently.
+  FutureBackingData* backing = SlotAt(handle & kHandleIndexMask);
+  backing->reference_count.fetch_add(1);
   FIREBASE_FUTURE_TRACE("API: Reference handle %d, ref count %d", handle,
-                        BackingFromHandle(handle)->reference_count);
+                        backing->reference_count.load());
 }
 
 void ReferenceCountedFutureImpl::ReleaseFuture(FutureHandle handle) {
-  MutexLock lock(mutex_);
   FIREBASE_FUTURE_TRACE("API: Release future %d", (int)handle);
 
-  // Assert if the handle isn't registered.
+  // Decrement the reference count.
   // If a Future exists with a handle, then the backing should still exist for
   // it, too.
-  auto it = backings_.find(handle);
-  FIREBASE_ASSERT(it != backings_.end());
-
-  // Decrement the reference count.
-  FutureBackingData* backing = it->second;
-  FIREBASE_ASSERT(backing->reference_count > 0);
-  backing->reference_count--;
+  FutureBackingData* backing = SlotAt(handle & kHandleIndexMask);
+  const uint32_t previous_count = backing->reference_count.fetch_sub(1);
+  FIREBASE_ASSERT(previous_count > 0);
 
   FIREBASE_FUTURE_TRACE("API: Release handle %d, ref count %d", handle,
-                        BackingFromHandle(handle)->reference_count);
+                        previous_count - 1);
+  if (previous_count != 1) return;
 
-  // If asynchronous call is no longer referenced, delete the backing struct.
-  if (backing->reference_count == 0) {
-    backings_.erase(it);
-    delete backing;
-    backing = nullptr;
+  // If asynchronous call is no longer referenced, release the backing.  A
+  // completion callback may have referenced it again before the lock was
+  // taken, in which case the last reference to go will release it.
+  MutexLock lock(mutex_);
+  if (BackingFromHandle(handle) == backing &&
+      backing->reference_count.load() == 0) {
+    FreeBacking(backing);
   }
 }
 
@@ -397,8 +633,13 @@ const void* ReferenceCountedFutureImpl::GetFutureResult(
 FutureBackingData* ReferenceCountedFutureImpl::BackingFromHandle(
     FutureHandle handle) {
   MutexLock lock(mutex_);
-  auto it = backings_.find(handle);
-  return it == backings_.end() ? nullptr : it->second;
+  const uint32_t index = static_cast<uint32_t>(handle & kHandleIndexMask);
+  if (handle == kInvalidHandle || index >= slot_count_) return nullptr;
+  FutureBackingData* backing = SlotAt(index);
+  return backing->in_use &&
+                 backing->generation == handle >> kHandleIndexBits
+             ? backing
+             : nullptr;
 }
 
 void ReferenceCountedFutureImpl::SetCompletionCallback(
@@ -492,11 +733,13 @@ bool ReferenceCountedFutureImpl::IsSafeToDelete() const {
   // Check if any Futures we have are still pending.
   int total_references = 0;
   int internal_references = 0;
-  for (auto i = backings_.begin(); i != backings_.end(); ++i) {
+  for (uint32_t i = 0; i < slot_count_; ++i) {
+    const FutureBackingData* backing = SlotAt(i);
+    if (!backing->in_use) continue;
     // If any Future is still pending, not safe to delete.
-    if (i->second->status == kFutureStatusPending) return false;
+    if (backing->status == kFutureStatusPending) return false;
     // Count the total number of references to all valid Futures.
-    total_references += i->second->reference_count;
+    total_references += backing->reference_count.load();
   }
   for (int i = 0; i < last_results_.size(); i++) {
     if (last_results_[i].status() != kFutureStatusInvalid) {
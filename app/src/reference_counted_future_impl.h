@@ -17,8 +17,10 @@
 #ifndef FIREBASE_APP_CLIENT_CPP_SRC_REFERENCE_COUNTED_FUTURE_IMPL_H_
 #define FIREBASE_APP_CLIENT_CPP_SRC_REFERENCE_COUNTED_FUTURE_IMPL_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <functional>
-#include <map>
+#include <new>
 #include <vector>
 
 #include "app/src/cleanup_notifier.h"
@@ -34,6 +36,10 @@ namespace FIREBASE_NAMESPACE {
 
 // Predeclarations.
 struct FutureBackingData;
+struct FutureContinuation;
+namespace callback {
+class Callback;
+}  // namespace callback
 
 const FutureHandle kInvalidFutureHandle = 0;
 
@@ -109,8 +115,11 @@ class ReferenceCountedFutureImpl : public detail::FutureApiInterface {
   static const int kNoFunctionIndex = -1;
 
   explicit ReferenceCountedFutureImpl(size_t last_result_count)
-      : next_future_handle_(kInvalidHandle + 1),
-        last_results_(last_result_count) {}
+      : slot_count_(0),
+        free_slot_(kNoFreeSlot),
+        last_results_(last_result_count) {
+    for (int i = 0; i < kMaxSlotChunks; ++i) slot_chunks_[i] = nullptr;
+  }
   ~ReferenceCountedFutureImpl() override;
 
   // Implementation of detail::FutureApiInterface.
@@ -375,21 +384,92 @@ class ReferenceCountedFutureImpl : public detail::FutureApiInterface {
   /// are held by outside code, when this is deleted.
   TypedCleanupNotifier<FutureBase>& cleanup() { return cleanup_; }
 
+  /// Runs continuations elsewhere than on the thread completing the Future.
+  class Executor {
+   public:
+    virtual ~Executor() {}
+    /// Run `callback` at some point, and delete it afterwards.
+    virtual void Execute(callback::Callback* callback) = 0;
+  };
+
+  /// Runs `continuation` with the Future for `handle` once it completes, or
+  /// right away if it is already complete. Unlike the completion callback,
+  /// which belongs to whoever holds the Future and is replaced by every
+  /// OnCompletion, any number of continuations can be added to a Future and
+  /// they run in order after the completion callback. This is meant for
+  /// chaining the steps of an operation internally.
+  ///
+  /// Without an `executor` the continuation runs inline on the thread which
+  /// completes the Future, without the lock held, so the next step can start
+  /// straight away. The Future is kept alive until its continuations have run.
+  ///
+  /// Returns false, and does nothing, if the handle is no longer valid.
+  bool Then(FutureHandle handle, FutureBase::CompletionCallback continuation,
+            void* user_data, Executor* executor = nullptr);
+
+  /// Type-safe version of the above.
+  template <typename T>
+  bool Then(SafeFutureHandle<T> handle,
+            typename Future<T>::TypedCompletionCallback continuation,
+            void* user_data, Executor* executor = nullptr) {
+    return Then(handle.get(),
+                reinterpret_cast<FutureBase::CompletionCallback>(continuation),
+                user_data, executor);
+  }
+
  private:
+  // Uses InlineResult and kNoFreeSlot.
+  friend struct FutureBackingData;
+
   template <typename T>
   static void DeleteT(void* ptr_to_delete) {
     delete static_cast<T*>(ptr_to_delete);
   }
 
-  /// Allocate a new handle. It's unlikely that we'll ever allocate four
-  /// billion of these to loop back to the start, but just in case, skip over
-  /// the one marked as kInvalidHandle.
-  FutureHandle AllocHandle() {
-    const FutureHandle handle = next_future_handle_++;
-    if (next_future_handle_ == kInvalidHandle) next_future_handle_++;
-    return handle;
+  /// Storage for results small enough to be kept in the backing itself rather
+  /// than on the heap. Backings are reused, so this storage is too.
+  union InlineResult {
+    void* pointer;
+    double number;
+    uint64_t integer;
+    char bytes[4 * sizeof(void*)];
+  };
+
+  template <typename T>
+  static bool FitsInlineResult() {
+    return sizeof(T) <= sizeof(InlineResult) &&
+           alignof(T) <= alignof(InlineResult);
   }
 
+  template <typename T>
+  static void ConstructT(void* storage, const void* initial_data) {
+    if (initial_data) {
+      new (storage) T(*static_cast<const T*>(initial_data));
+    } else {
+      new (storage) T();
+    }
+  }
+
+  template <typename T>
+  static void DestructT(void* ptr_to_destruct) {
+    static_cast<T*>(ptr_to_destruct)->~T();
+  }
+
+  /// A handle is the index of its backing in the slots, with the generation of
+  /// the slot in the upper bits. The generation changes every time the slot is
+  /// reused, so that handles to a released backing stay invalid.
+  static const int kHandleIndexBits = sizeof(FutureHandle) >= 8 ? 24 : 16;
+  static const FutureHandle kHandleIndexMask =
+      (static_cast<FutureHandle>(1) << kHandleIndexBits) - 1;
+
+  /// Slots are allocated in chunks, each twice as large as the previous one,
+  /// so that they never move once allocated. This is enough chunks to cover
+  /// all the indices a handle can hold.
+  static const int kMaxSlotChunks = kHandleIndexBits - 4;
+
+  /// Marks the end of the list of free slots.
+  static const uint32_t kNoFreeSlot = 0xffffffff;
+
   /// Return the backing data for the previously allocated `handle`, if it
   /// is still valid, or nullptr otherwise.
   /// The backing data is an internal object that holds the reference count,
@@ -410,16 +490,46 @@ class ReferenceCountedFutureImpl : public detail::FutureApiInterface {
   FutureHandle AllocInternal(int fn_idx, void* data,
                              void (*delete_data_fn)(void* data_to_delete));
 
+  /// Same as above, but constructs the data with `construct_data_fn` in the
+  /// backing's InlineResult, and destroys it with `destruct_data_fn`.
+  FutureHandle AllocInternalInline(
+      int fn_idx, void (*construct_data_fn)(void* storage,
+                                            const void* initial_data),
+      const void* initial_data, void (*destruct_data_fn)(void* data));
+
   template <typename T>
   FutureHandle AllocInternal(int fn_idx) {
-    return AllocInternal(fn_idx, new T, DeleteT<T>);
+    return FitsInlineResult<T>()
+               ? AllocInternalInline(fn_idx, ConstructT<T>, nullptr,
+                                     DestructT<T>)
+               : AllocInternal(fn_idx, new T, DeleteT<T>);
   }
 
   template <typename T>
   FutureHandle AllocInternal(int fn_idx, const T& initial_data) {
-    return AllocInternal(fn_idx, new T(initial_data), DeleteT<T>);
+    return FitsInlineResult<T>()
+               ? AllocInternalInline(fn_idx, ConstructT<T>, &initial_data,
+                                     DestructT<T>)
+               : AllocInternal(fn_idx, new T(initial_data), DeleteT<T>);
   }
 
+  /// Take a free slot, or a new one, and return its backing with a handle to
+  /// it. Returns nullptr if all the slots are in use.
+  /// Assumes that mutex_ is held.
+  FutureBackingData* AllocBacking(FutureHandle* handle);
+
+  /// Register a newly allocated backing as the most recent Future for
+  /// `fn_idx`. Assumes that mutex_ is held.
+  void SetLastResult(int fn_idx, FutureHandle handle);
+
+  /// Return the backing in the slot with the given index, which must have
+  /// been allocated.
+  FutureBackingData* SlotAt(uint32_t index) const;
+
+  /// Destroy the contents of `backing` and put its slot back in the list of
+  /// free slots. Assumes that mutex_ is held.
+  void FreeBacking(FutureBackingData* backing);
+
   /// Return the data for the backing. Requires a function since
   /// FutureBackingData is only defined in the header, but the data is
   /// accessed in template class @ref Complete.
@@ -492,22 +602,31 @@ class ReferenceCountedFutureImpl : public detail::FutureApiInterface {
   }
 
   /// Releases the mutex, calling the Future's completion callback if there is
-  /// one. (The mutex is released before calling the callback.)
+  /// one, then its continuations. (The mutex is released before calling the
+  /// callback.)
   void ReleaseMutexAndRunCallback(FutureHandle handle);
 
+  /// Run or dispatch a continuation for the completed Future, and release the
+  /// reference it held. Assumes that mutex_ is not held.
+  void RunContinuation(FutureHandle handle, const FutureBase& future,
+                       const FutureContinuation& continuation);
+
   /// Mutex protecting all asynchronous data operations.
   /// Marked as `mutable` so that const functions can still be protected.
   mutable Mutex mutex_;
 
-  /// Hold backing data for all Futures.
-  /// Indexed by the FutureHandle, which is a unique integer used by the
-  /// Future to access the backing data. The backing data is deleted once no
-  /// more Futures reference it.
-  // TODO(jsanmiya): Use unordered_map when available (i.e. when not stlport).
-  std::map<FutureHandle, FutureBackingData*> backings_;
+  /// Hold backing data for all Futures, in chunks of slots indexed by the
+  /// lower bits of the FutureHandle. The backing data is destroyed once no
+  /// more Futures reference it, and its slot is reused by a later Future.
+  /// Chunks are only added, and never move, so a backing can be found from a
+  /// handle which is referenced without taking the lock.
+  FutureBackingData* slot_chunks_[kMaxSlotChunks];
+
+  /// Number of slots which have been handed out at least once.
+  uint32_t slot_count_;
 
-  /// A unique int that is incremented by one after every call to @ref Alloc.
-  FutureHandle next_future_handle_;
+  /// Index of the first free slot, or kNoFreeSlot if there is none.
+  uint32_t free_slot_;
 
   /// Optionally keep a future around for the most recent call to a function.
   /// The functions are specified in `fn_idx` of @ref Alloc.
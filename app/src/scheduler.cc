@@ -16,6 +16,7 @@
 
 #include "app/src/scheduler.h"
 #include <cassert>
+#include <climits>
 #include "app/src/time.h"
 
 #if !defined(FIREBASE_NAMESPACE)
@@ -25,6 +26,24 @@
 namespace FIREBASE_NAMESPACE {
 namespace scheduler {
 
+// Number of requests preallocated per scheduler.
+static const uint32_t kRequestPoolSize = 256;
+
+// Maximum number of callbacks a worker triggers on a strand before giving the
+// other strands queued on it a turn.
+static const int kStrandBatchSize = 32;
+
+// Index of the lowest bit set in a non-zero value.
+static int LowestBitSet(uint64_t value) {
+  assert(value);
+  int index = 0;
+  while ((value & 1) == 0) {
+    value >>= 1;
+    ++index;
+  }
+  return index;
+}
+
 bool RequestHandle::Cancel() {
   assert(status_);
 
@@ -32,51 +51,121 @@ bool RequestHandle::Cancel() {
     return false;
   }
 
-  MutexLock lock(status_->mutex);
-  if (status_->cancelled || (!status_->repeat && status_->triggered)) {
-    return false;
+  uint32_t flags = status_->flags.load();
+  for (;;) {
+    if ((flags & RequestStatusBlock::kFlagCancelled) ||
+        (!status_->repeat && (flags & RequestStatusBlock::kFlagTriggered))) {
+      return false;
+    }
+    if (status_->flags.compare_exchange(
+            &flags, flags | RequestStatusBlock::kFlagCancelled)) {
+      return true;
+    }
   }
-
-  status_->cancelled = true;
-  return true;
 }
 
 bool RequestHandle::IsCancelled() const {
   assert(status_);
-  MutexLock lock(status_->mutex);
-  return status_->cancelled;
+  return (status_->flags.load() & RequestStatusBlock::kFlagCancelled) != 0;
 }
 
 bool RequestHandle::IsTriggered() const {
   assert(status_);
-  MutexLock lock(status_->mutex);
-  return status_->triggered;
+  return (status_->flags.load() & RequestStatusBlock::kFlagTriggered) != 0;
 }
 
-Scheduler::RequestData::RequestData(RequestId id, callback::Callback* cb,
-                                    ScheduleTimeMs delay, ScheduleTimeMs repeat)
-    : id(id),
-      cb(cb),
-      delay_ms(delay),
-      repeat_ms(repeat),
+Scheduler::RequestData::RequestData()
+    : id(0),
+      cb(nullptr),
+      repeat_ms(0),
       due_timestamp(0),
-      status(new RequestStatusBlock(repeat > 0)) {}
+      status(),
+      next_submitted(nullptr),
+      prev(nullptr),
+      next(nullptr) {}
+
+void Scheduler::RequestList::PushBack(RequestData* request) {
+  request->prev = tail;
+  request->next = nullptr;
+  if (tail) {
+    tail->next = request;
+  } else {
+    head = request;
+  }
+  tail = request;
+}
 
-Scheduler::Scheduler()
+void Scheduler::RequestList::InsertOrdered(RequestData* request) {
+  // Requests mostly come in order, so look for the spot from the back.
+  RequestData* after = tail;
+  while (after && (after->due_timestamp > request->due_timestamp ||
+                   (after->due_timestamp == request->due_timestamp &&
+                    after->id > request->id))) {
+    after = after->prev;
+  }
+  request->prev = after;
+  request->next = after ? after->next : head;
+  if (request->next) {
+    request->next->prev = request;
+  } else {
+    tail = request;
+  }
+  if (after) {
+    after->next = request;
+  } else {
+    head = request;
+  }
+}
+
+Scheduler::RequestData* Scheduler::RequestList::PopFront() {
+  RequestData* request = head;
+  if (request) {
+    head = request->next;
+    if (head) {
+      head->prev = nullptr;
+    } else {
+      tail = nullptr;
+    }
+    request->next = nullptr;
+  }
+  return request;
+}
+
+Scheduler::Scheduler() : Scheduler(0) {}
+
+Scheduler::Scheduler(int worker_count)
     : thread_(nullptr),
       next_request_id_(0),
-      terminating_(false),
-      request_mutex_(Mutex::kModeRecursive),
-      sleep_sem_(0) {
+      terminating_(0),
+      submitted_(nullptr),
+      worker_sleeping_(0),
+      sleep_sem_(0),
+      request_pool_(kRequestPoolSize),
+      workers_(nullptr),
+      worker_count_(worker_count > 0 ? worker_count : 0),
+      default_strand_(),
+      work_sem_(0),
+      wheel_time_(internal::GetTimestamp()),
+      wheel_count_(0),
+      next_worker_(0) {
+  for (int level = 0; level < kWheelLevels; ++level) {
+    occupied_[level] = 0;
+  }
+  if (worker_count_ > 0) {
+    default_strand_ = SharedPtr<StrandQueue>(new StrandQueue());
+    workers_ = new Worker[worker_count_];
+    for (int i = 0; i < worker_count_; ++i) {
+      workers_[i].scheduler = this;
+      workers_[i].index = i;
+      workers_[i].thread = MakeUnique<Thread>(PoolWorkerRoutine, &workers_[i]);
+    }
+  }
   thread_ = new Thread(WorkerThreadRoutine, this);
 }
 
 Scheduler::~Scheduler() {
-  {
-    // Notify the worker thread to stop processing anymore request
-    MutexLock lock(request_mutex_);
-    terminating_ = true;
-  }
+  // Notify the worker thread to stop processing anymore request
+  terminating_.store(1);
 
   // Signal the thread to wake if it is sleeping due to no callbacks in queue
   sleep_sem_.Post();
@@ -86,114 +175,430 @@ Scheduler::~Scheduler() {
     delete thread_;
     thread_ = nullptr;
   }
+
+  // Stop the pool once the timer thread can no longer queue strands on it.
+  for (int i = 0; i < worker_count_; ++i) {
+    work_sem_.Post();
+  }
+  for (int i = 0; i < worker_count_; ++i) {
+    workers_[i].thread->Join();
+  }
+
+  // Discard the requests which were never triggered.
+  TakeSubmittedRequests();
+  for (int level = 0; level < kWheelLevels; ++level) {
+    for (int slot = 0; slot < kWheelSlots; ++slot) {
+      while (RequestData* request = wheel_[level][slot].PopFront()) {
+        ReleaseRequest(request);
+      }
+    }
+  }
+  for (int i = 0; i < worker_count_; ++i) {
+    for (auto& strand : workers_[i].strands) {
+      MutexLock lock(strand->mutex);
+      while (RequestData* request = strand->pending.PopFront()) {
+        ReleaseRequest(request);
+      }
+      strand->scheduled = false;
+    }
+  }
+  delete[] workers_;
+  workers_ = nullptr;
 }
 
 RequestHandle Scheduler::Schedule(callback::Callback* callback,
                                    ScheduleTimeMs delay /* = 0 */,
                                    ScheduleTimeMs repeat /* = 0 */) {
-  assert(callback);
+  return Schedule(callback, delay, repeat, default_strand_);
+}
 
-  MutexLock lock(request_mutex_);
+#ifdef FIREBASE_USE_STD_FUNCTION
+RequestHandle Scheduler::Schedule(const std::function<void(void)>& callback,
+                                   ScheduleTimeMs delay /* = 0 */,
+                                   ScheduleTimeMs repeat /* = 0 */) {
+  return Schedule(new callback::CallbackStdFunction(callback), delay, repeat);
+}
+#endif
+
+RequestHandle Scheduler::ScheduleUnordered(callback::Callback* callback,
+                                            ScheduleTimeMs delay /* = 0 */) {
+  // A strand of its own does not hold up, and is not held up by, any other
+  // callback.
+  SharedPtr<StrandQueue> strand;
+  if (workers_) strand = SharedPtr<StrandQueue>(new StrandQueue());
+  return Schedule(callback, delay, 0, strand);
+}
 
-  RequestDataPtr request(
-      new RequestData(++next_request_id_, callback, delay, repeat));
+RequestHandle Scheduler::Schedule(callback::Callback* callback,
+                                   ScheduleTimeMs delay, ScheduleTimeMs repeat,
+                                   const SharedPtr<StrandQueue>& strand) {
+  assert(callback);
 
+  RequestData* request = AllocateRequest();
+  request->id = next_request_id_.fetch_add(1) + 1;
+  request->cb = callback;
+  request->repeat_ms = repeat;
+  request->due_timestamp = internal::GetTimestamp() + delay;
+  request->status =
+      SharedPtr<RequestStatusBlock>(new RequestStatusBlock(repeat > 0));
+  request->strand = strand;
+
+  // The request may be triggered and recycled as soon as it is submitted.
   RequestHandle handler(request->status);
+  Submit(request);
+  return handler;
+}
 
-  AddToQueue(Move(request), internal::GetTimestamp(), delay);
+void Scheduler::Submit(RequestData* request) {
+  RequestData* head = submitted_.load();
+  do {
+    request->next_submitted = head;
+  } while (!submitted_.compare_exchange(&head, request));
 
-  // Increase semaphore count by one for unfinished request
-  sleep_sem_.Post();
+  // Wake the worker thread if it is waiting for a request.
+  if (worker_sleeping_.exchange(0)) {
+    sleep_sem_.Post();
+  }
+}
 
-  return handler;
+Scheduler::RequestData* Scheduler::AllocateRequest() {
+  RequestData* request = request_pool_.Allocate();
+  return request ? request : new RequestData();
 }
 
-#ifdef FIREBASE_USE_STD_FUNCTION
-RequestHandle Scheduler::Schedule(const std::function<void(void)>& callback,
-                                   ScheduleTimeMs delay /* = 0 */,
-                                   ScheduleTimeMs repeat /* = 0 */) {
-  return Schedule(new callback::CallbackStdFunction(callback), delay, repeat);
+void Scheduler::ReleaseRequest(RequestData* request) {
+  delete request->cb;
+  request->cb = nullptr;
+  request->status = SharedPtr<RequestStatusBlock>();
+  request->strand = SharedPtr<StrandQueue>();
+  if (!request_pool_.Release(request)) {
+    delete request;
+  }
 }
-#endif
 
 void Scheduler::WorkerThreadRoutine(void* data) {
   Scheduler* scheduler = static_cast<Scheduler*>(data);
   assert(scheduler);
 
-  while (true) {
+  while (!scheduler->terminating_.load()) {
     uint64_t current = internal::GetTimestamp();
 
-    uint64_t sleep_time = 0;
-    RequestDataPtr request;
+    // An empty wheel can jump straight to now, instead of cascading through
+    // the time it has been idle.
+    if (scheduler->wheel_count_ == 0 && current > scheduler->wheel_time_) {
+      scheduler->wheel_time_ = current;
+    }
 
-    // Check if the top request in the queue is due.
-    {
-      MutexLock lock(scheduler->request_mutex_);
-      if (!scheduler->request_queue_.empty()) {
-        auto due = scheduler->request_queue_.top()->due_timestamp;
-        if (due <= current) {
-          request = Move(scheduler->request_queue_.top());
-          scheduler->request_queue_.pop();
-        } else {
-          sleep_time = due - current;
+    scheduler->TakeSubmittedRequests();
+    scheduler->AdvanceWheel(current);
+
+    // Announce that the thread is going to sleep, then check once more for
+    // requests submitted in the meantime, which would not have woken it up.
+    scheduler->worker_sleeping_.store(1);
+    if (!scheduler->submitted_.load() && !scheduler->terminating_.load()) {
+      // If there is no request to process now, there can be 2 cases
+      // 1. The wheel is empty -> Wait forever
+      // 2. The next slot with requests is not due yet.
+      uint64_t next = scheduler->GetNextSlotTimestamp();
+      if (next == 0) {
+        scheduler->sleep_sem_.Wait();
+      } else {
+        current = internal::GetTimestamp();
+        if (next > current) {
+          uint64_t sleep_time = next - current;
+          scheduler->sleep_sem_.TimedWait(
+              static_cast<int>(sleep_time < INT_MAX ? sleep_time : INT_MAX));
         }
       }
     }
+    scheduler->worker_sleeping_.store(0);
 
-    // If there is no request to process now, there can be 2 cases
-    // 1. The queue is empty -> Wait forever
-    // 2. The top request in the queue is not due yet.
-    if (!request) {
-      if (sleep_time > 0) {
-        scheduler->sleep_sem_.TimedWait(sleep_time);
-      } else {
-        scheduler->sleep_sem_.Wait();
-      }
+    // Drain the semaphore after wake
+    while (scheduler->sleep_sem_.TryWait()) {}
+  }
+}
+
+void Scheduler::TakeSubmittedRequests() {
+  // The stack holds the most recent request first.  Reverse it so that
+  // requests are placed in the order they were submitted.
+  RequestData* request = submitted_.exchange(nullptr);
+  RequestData* reversed = nullptr;
+  while (request) {
+    RequestData* next = request->next_submitted;
+    request->next_submitted = reversed;
+    reversed = request;
+    request = next;
+  }
+  while (reversed) {
+    RequestData* next = reversed->next_submitted;
+    reversed->next_submitted = nullptr;
+    AddToWheel(reversed);
+    reversed = next;
+  }
+}
+
+void Scheduler::AddToWheel(RequestData* request) {
+  // Requests which are already due go in the next slot to be processed.
+  uint64_t due = request->due_timestamp;
+  if (due < wheel_time_) due = wheel_time_;
+
+  // Pick the lowest level which reaches the due time.  Requests beyond the
+  // last level are parked in its farthest slot.
+  uint64_t delta = due - wheel_time_;
+  int level = 0;
+  while (level + 1 < kWheelLevels &&
+         delta >= (1ULL << ((level + 1) * kWheelBits))) {
+    ++level;
+  }
+  const uint64_t wheel_span = 1ULL << (kWheelLevels * kWheelBits);
+  if (delta >= wheel_span) due = wheel_time_ + wheel_span - 1;
+
+  int slot = static_cast<int>((due >> (level * kWheelBits)) & kWheelSlotMask);
+  if (level == 0) {
+    // The requests of a slot in the first level are triggered in order.
+    wheel_[0][slot].InsertOrdered(request);
+  } else {
+    wheel_[level][slot].PushBack(request);
+  }
+  occupied_[level] |= 1ULL << slot;
+  ++wheel_count_;
+}
+
+void Scheduler::AdvanceWheel(uint64_t current) {
+  while (wheel_time_ <= current) {
+    // Nothing happens on the wheel until the next slot with requests, so skip
+    // right to it.
+    uint64_t next = GetNextSlotTimestamp();
+    if (next == 0 || next > current) {
+      wheel_time_ = current + 1;
+      break;
+    }
+    wheel_time_ = next;
+    ProcessTick();
+  }
+}
+
+void Scheduler::ProcessTick() {
+  // A slot of level n is cascaded when the indices of all the lower levels
+  // wrap around to 0.  Cascade from the highest level, so that requests can
+  // move down more than one level at once.
+  int level = 0;
+  while (level + 1 < kWheelLevels &&
+         ((wheel_time_ >> (level * kWheelBits)) & kWheelSlotMask) == 0) {
+    ++level;
+  }
+  for (; level > 0; --level) {
+    Cascade(level);
+  }
+
+  int slot = static_cast<int>(wheel_time_ & kWheelSlotMask);
+  RequestList due = wheel_[0][slot];
+  wheel_[0][slot] = RequestList();
+  occupied_[0] &= ~(1ULL << slot);
+
+  uint64_t current = wheel_time_++;
+
+  while (RequestData* request = due.PopFront()) {
+    --wheel_count_;
+    Dispatch(request, current);
+  }
+}
+
+void Scheduler::Dispatch(RequestData* request, uint64_t current) {
+  // If the request is due, trigger the callback.  If the repeat interval is
+  // non-zero, move it back to the wheel.
+  if (!workers_) {
+    if (TriggerCallback(request)) {
+      request->due_timestamp = current + request->repeat_ms;
+      AddToWheel(request);
+    } else {
+      ReleaseRequest(request);
+    }
+    return;
+  }
+
+  // Otherwise queue it on its strand, and queue the strand on a worker unless
+  // it is already waiting for or running on one.  The request may be triggered
+  // as soon as it is queued, so keep a reference to the strand.
+  request->due_timestamp = current;
+  SharedPtr<StrandQueue> strand = request->strand;
+  assert(strand);
+  {
+    MutexLock lock(strand->mutex);
+    strand->pending.PushBack(request);
+    if (strand->scheduled) return;
+    strand->scheduled = true;
+  }
+  QueueStrand(Move(strand), next_worker_);
+  next_worker_ = (next_worker_ + 1) % worker_count_;
+}
+
+void Scheduler::PoolWorkerRoutine(void* data) {
+  Worker* worker = static_cast<Worker*>(data);
+  assert(worker);
+  Scheduler* scheduler = worker->scheduler;
+
+  while (true) {
+    // The semaphore counts the queued strands, so there is one to take after
+    // each wake, though another worker may have got to it first.
+    scheduler->work_sem_.Wait();
+    if (scheduler->terminating_.load()) {
+      return;
+    }
+    SharedPtr<StrandQueue> strand;
+    while (!strand) {
+      strand = scheduler->TakeStrand(worker->index);
+    }
+    scheduler->RunStrand(Move(strand), worker->index);
+  }
+}
 
-      // Drain the semaphore after wake
-      while (scheduler->sleep_sem_.TryWait()) {}
+void Scheduler::QueueStrand(SharedPtr<StrandQueue> strand, int worker_index) {
+  {
+    Worker& worker = workers_[worker_index];
+    MutexLock lock(worker.mutex);
+    worker.strands.push_back(Move(strand));
+  }
+  work_sem_.Post();
+}
 
-      // Check if the scheduler is terminating after sleep.
-      MutexLock lock(scheduler->request_mutex_);
-      if (scheduler->terminating_) {
+SharedPtr<Scheduler::StrandQueue> Scheduler::TakeStrand(int worker_index) {
+  for (int i = 0; i < worker_count_; ++i) {
+    Worker& worker = workers_[(worker_index + i) % worker_count_];
+    MutexLock lock(worker.mutex);
+    if (worker.strands.empty()) continue;
+
+    SharedPtr<StrandQueue> strand;
+    if (i == 0) {
+      strand = Move(worker.strands.front());
+      worker.strands.pop_front();
+    } else {
+      // Steal from the other end of the queue than its owner takes from.
+      strand = Move(worker.strands.back());
+      worker.strands.pop_back();
+    }
+    return strand;
+  }
+  return SharedPtr<StrandQueue>();
+}
+
+void Scheduler::RunStrand(SharedPtr<StrandQueue> strand, int worker_index) {
+  for (int i = 0; i < kStrandBatchSize; ++i) {
+    RequestData* request;
+    {
+      MutexLock lock(strand->mutex);
+      request = strand->pending.PopFront();
+      if (!request) {
+        strand->scheduled = false;
         return;
       }
     }
+    // A repeating request goes back to the timer thread.
+    if (TriggerCallback(request)) {
+      request->due_timestamp += request->repeat_ms;
+      Submit(request);
+    } else {
+      ReleaseRequest(request);
+    }
+  }
 
-    // If the top request is due, trigger the callback.  If the repeat interval
-    // is non-zero, move it back to queue.
-    if (request && scheduler->TriggerCallback(request)) {
-      MutexLock lock(scheduler->request_mutex_);
-      ScheduleTimeMs repeat = request->repeat_ms;
-      scheduler->AddToQueue(Move(request), current, repeat);
+  // Give the other strands a turn before triggering the rest.
+  {
+    MutexLock lock(strand->mutex);
+    if (strand->pending.empty()) {
+      strand->scheduled = false;
+      return;
     }
   }
+  QueueStrand(Move(strand), worker_index);
 }
 
-void Scheduler::AddToQueue(RequestDataPtr request,
-                           uint64_t current, ScheduleTimeMs after) {
-  // Calculate the future timestamp
-  request->due_timestamp = current + after;
+void Scheduler::Cascade(int level) {
+  int slot = static_cast<int>((wheel_time_ >> (level * kWheelBits)) &
+                              kWheelSlotMask);
+  RequestList cascaded = wheel_[level][slot];
+  wheel_[level][slot] = RequestList();
+  occupied_[level] &= ~(1ULL << slot);
 
-  // Push the request to the priority queue
-  request_queue_.push(Move(request));
+  while (RequestData* request = cascaded.PopFront()) {
+    --wheel_count_;
+    AddToWheel(request);
+  }
 }
 
-bool Scheduler::TriggerCallback(const RequestDataPtr& request) {
-  MutexLock lock(request->status->mutex);
-  if (request->cb && !request->status->cancelled) {
-    request->cb->Run();
-    request->status->triggered = true;
+uint64_t Scheduler::GetNextSlotTimestamp() const {
+  uint64_t next = 0;
+  for (int level = 0; level < kWheelLevels; ++level) {
+    if (!occupied_[level]) continue;
+
+    // Rotate the bitmap so that bit 0 is the current slot of this level.
+    int shift = level * kWheelBits;
+    uint64_t block = wheel_time_ >> shift;
+    int current_slot = static_cast<int>(block & kWheelSlotMask);
+    uint64_t rotated = occupied_[level];
+    if (current_slot) {
+      rotated = (rotated >> current_slot) |
+                (rotated << (kWheelSlots - current_slot));
+    }
+    int offset = LowestBitSet(rotated);
+
+    uint64_t timestamp;
+    if (level == 0) {
+      timestamp = wheel_time_ + offset;
+    } else {
+      // The current slot of a higher level comes up again only after a full
+      // turn, unless wheel_time_ is right at its start.
+      if (offset == 0 && (block << shift) != wheel_time_) {
+        offset = kWheelSlots;
+      }
+      timestamp = (block + offset) << shift;
+    }
+    if (next == 0 || timestamp < next) next = timestamp;
+  }
+  return next;
+}
 
-    // return true if this callback repeats and should be push back to the queue
-    if (request->repeat_ms > 0) {
-      return true;
+bool Scheduler::TriggerCallback(RequestData* request) {
+  RequestStatusBlock* status = request->status.get();
+  uint32_t flags = status->flags.load();
+  for (;;) {
+    if (flags & RequestStatusBlock::kFlagCancelled) {
+      return false;
+    }
+    // Mark the request as triggered first, so that it can no longer be
+    // cancelled once it is running, unless it repeats.
+    if (status->flags.compare_exchange(
+            &flags, flags | RequestStatusBlock::kFlagTriggered)) {
+      break;
     }
   }
 
-  return false;
+  request->cb->Run();
+
+  // return true if this callback repeats and should be push back to the wheel
+  return request->repeat_ms > 0 &&
+         (status->flags.load() & RequestStatusBlock::kFlagCancelled) == 0;
 }
 
+Strand::Strand(Scheduler* scheduler)
+    : scheduler_(scheduler), queue_(new Scheduler::StrandQueue()) {
+  assert(scheduler_);
+}
+
+RequestHandle Strand::Schedule(callback::Callback* callback,
+                                ScheduleTimeMs delay /* = 0 */,
+                                ScheduleTimeMs repeat /* = 0 */) {
+  return scheduler_->Schedule(callback, delay, repeat, queue_);
+}
+
+#ifdef FIREBASE_USE_STD_FUNCTION
+RequestHandle Strand::Schedule(const std::function<void(void)>& callback,
+                                ScheduleTimeMs delay /* = 0 */,
+                                ScheduleTimeMs repeat /* = 0 */) {
+  return Schedule(new callback::CallbackStdFunction(callback), delay, repeat);
+}
+#endif
+
 }  // namespace scheduler
 // NOLINTNEXTLINE - allow namespace overridden
 }  // namespace FIREBASE_NAMESPACE
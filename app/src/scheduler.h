@@ -17,9 +17,13 @@
 #ifndef FIREBASE_APP_CLIENT_CPP_SRC_SCHEDULER_H_
 #define FIREBASE_APP_CLIENT_CPP_SRC_SCHEDULER_H_
 
-#include <queue>
+#include <deque>
+
+#include "app/memory/atomic.h"
 #include "app/memory/shared_ptr.h"
+#include "app/memory/unique_ptr.h"
 #include "app/src/callback.h"
+#include "app/src/lock_free_pool.h"
 #include "app/src/mutex.h"
 #include "app/src/semaphore.h"
 #include "app/src/thread.h"
@@ -35,24 +39,21 @@ namespace scheduler {
 typedef uint64_t ScheduleTimeMs;
 
 // RequestStatusBlock contains the status of a request.  References to this
-// block are shared by the queued request and the request handle.  The contents
-// of this structure are potentially modified from different thread, hence
-// guarded by mutex.
+// block are shared by the queued request and the request handle.  The status
+// is potentially modified from different threads, hence kept in a single
+// atomic word so that it can be updated with compare-and-swap.
 struct RequestStatusBlock {
-  explicit RequestStatusBlock(bool repeat)
-      : mutex(Mutex::kModeNonRecursive),
-        cancelled(false),
-        triggered(false),
-        repeat(repeat) {}
-
-  // Guard both "cancelled" and "triggered"
-  Mutex mutex;
+  // Bits of "flags".
+  enum Flag {
+    // Whether the callback is properly cancelled
+    kFlagCancelled = 1 << 0,
+    // Whether the callback has been triggered.
+    kFlagTriggered = 1 << 1,
+  };
 
-  // Whether the callback is properly cancelled
-  bool cancelled;
+  explicit RequestStatusBlock(bool repeat) : flags(0), repeat(repeat) {}
 
-  // Whether the callback has been triggered.
-  bool triggered;
+  compat::Atomic<uint32_t> flags;
 
   // Whether this callback will repeat itself again after first trigger.
   const bool repeat;
@@ -69,7 +70,9 @@ class RequestHandle {
       : status_(status) {}
 
   // Attempt to cancel the scheduled task.  return true if success or false if
-  // it is cancelled or complete already.
+  // it is cancelled or complete already.  This does not wait for a repeating
+  // callback which is running at the same time, but it will not be triggered
+  // again.
   bool Cancel();
 
   // Return true if the handler is pointing to a request
@@ -85,14 +88,33 @@ class RequestHandle {
   SharedPtr<RequestStatusBlock> status_;
 };
 
+class Strand;
+
 // Scheduler can be used to trigger a callback from the same worker thread.
 // Currently it supports to trigger a callback ASAP using Execute() or with
 // a delay using Schedule().
 // All the public functions are safe to be called from different thread
+//
+// Requests are handed to the worker thread through a lock-free submission
+// stack, and kept by the worker in a hierarchical timer wheel: scheduling and
+// cancelling a request are O(1), and so is finding the due requests on each
+// tick.  Cancelled requests are dropped from the wheel when they come due.
+//
+// A scheduler can also trigger its callbacks on a pool of worker threads.  In
+// that case callbacks are ordered per Strand: the callbacks of one strand are
+// triggered one at a time, in order, while different strands run in parallel.
+// Callbacks scheduled directly on the Scheduler all belong to one default
+// strand.  Each worker has its own queue of strands ready to run, and an idle
+// worker steals from the others.
 class Scheduler {
  public:
+  // Trigger all the callbacks on a single thread.
   Scheduler();
 
+  // Trigger the callbacks on worker_count threads.  A worker_count of 0 is the
+  // same as the default constructor.
+  explicit Scheduler(int worker_count);
+
   // When a scheduler is deleted, all the future callback will be discarded.
   // The scheduler does not guarentee to trigger any callback scheduled before
   // the deletion or any the potentially due callback
@@ -123,89 +145,230 @@ class Scheduler {
                           ScheduleTimeMs delay = 0, ScheduleTimeMs repeat = 0);
 #endif  // FIREBASE_USE_STD_FUNCTION
 
+  // Schedule a callback which is not ordered with any other callback.  When
+  // the scheduler has worker threads, it can run in parallel with any of them.
+  RequestHandle ScheduleUnordered(callback::Callback* callback,
+                                  ScheduleTimeMs delay = 0);
+
  private:
   typedef uint64_t RequestId;
-  // The request data for all scheduled callback.
+  struct StrandQueue;
+
+  // Each level of the timer wheel has 2^kWheelBits slots.  A slot of level n
+  // spans 2^(n * kWheelBits) milliseconds, so the wheel covers 2^24ms (about
+  // 4.6 hours) ahead.  Requests due later are parked in the last level and
+  // placed again when their slot comes up.
+  static const int kWheelBits = 6;
+  static const int kWheelSlots = 1 << kWheelBits;
+  static const int kWheelLevels = 4;
+  static const uint64_t kWheelSlotMask = kWheelSlots - 1;
+
+  // The request data for all scheduled callback.  Requests are recycled
+  // through a pool, so that scheduling does not allocate in the common case.
   struct RequestData {
-    explicit RequestData(RequestId id, callback::Callback* cb,
-                         ScheduleTimeMs delay, ScheduleTimeMs repeat);
+    RequestData();
 
     // Unique id per scheduler.
     RequestId id;
 
-    // The callback to be triggered.
-    SharedPtr<callback::Callback> cb;
-
-    // Delay to trigger in milliseconds
-    ScheduleTimeMs delay_ms;
+    // The callback to be triggered.  Owned by the request.
+    callback::Callback* cb;
 
     // Repeat interval after first trigger.  Will not repeat if value is 0
     ScheduleTimeMs repeat_ms;
 
-    // The timestamp after the delay in milliseconds.  Used for priority_queue
+    // The timestamp after the delay in milliseconds.
     uint64_t due_timestamp;
 
     // Status block shared with handlers
     SharedPtr<RequestStatusBlock> status;
+
+    // Strand to trigger the callback on, when there are worker threads.
+    SharedPtr<StrandQueue> strand;
+
+    // Next request in the submission stack.
+    RequestData* next_submitted;
+
+    // Neighbors in the timer wheel slot, or in the strand queue once due.
+    RequestData* prev;
+    RequestData* next;
   };
 
-  // SharedPtr of request data.  Ideally this should be UniquePtr and there
-  // should only have one copy of it in request_queue_ .  However, STLPort queue
-  // uses copy instead of move() while reordering heap element, and UniquePtr is
-  // not copyable.  Therefore, use SharedPtr here.
-  typedef SharedPtr<RequestData> RequestDataPtr;
-
-  // Comparer struct for priority_queue.  If the operator return true, lhs will
-  // output later than rhs, due to the implementation of std::priority_queue.
-  // http://en.cppreference.com/w/cpp/container/priority_queue
-  // That is, the request with lowest timestamp is on the top of the queue.
-  // If multiple requests have the same due timestamp, it would be sorted based
-  // on request id, i.e. creation time.
-  struct RequestDataPtrComparer {
-    bool operator()(const RequestDataPtr& lhs,
-                    const RequestDataPtr& rhs) const {
-      return lhs->due_timestamp > rhs->due_timestamp ||
-          (lhs->due_timestamp == rhs->due_timestamp && lhs->id > rhs->id);
-    }
+  // A doubly-linked list of requests, for the slots of the timer wheel.
+  struct RequestList {
+    RequestList() : head(nullptr), tail(nullptr) {}
+    bool empty() const { return head == nullptr; }
+    void PushBack(RequestData* request);
+    // Insert a request after the last request with a lower id.
+    void InsertOrdered(RequestData* request);
+    RequestData* PopFront();
+
+    RequestData* head;
+    RequestData* tail;
   };
 
-  // The worker thread to process scheduled callback.
+  // The due requests of a strand, waiting for a worker.
+  struct StrandQueue {
+    StrandQueue() : mutex(Mutex::kModeNonRecursive), scheduled(false) {}
+
+    // Guard both "pending" and "scheduled"
+    Mutex mutex;
+
+    RequestList pending;
+
+    // Whether the strand is queued for, or running on, a worker.
+    bool scheduled;
+  };
+
+  // A worker thread and the strands queued for it.
+  struct Worker {
+    Worker() : scheduler(nullptr), index(0), thread(), mutex() {}
+
+    Scheduler* scheduler;
+    int index;
+    UniquePtr<Thread> thread;
+
+    // Guard "strands"
+    Mutex mutex;
+    std::deque<SharedPtr<StrandQueue>> strands;
+  };
+
+  // Schedule a callback on the given strand.
+  RequestHandle Schedule(callback::Callback* callback, ScheduleTimeMs delay,
+                         ScheduleTimeMs repeat,
+                         const SharedPtr<StrandQueue>& strand);
+
+  // Hand a request to the timer thread.
+  void Submit(RequestData* request);
+
+  // Take a request from the pool, or the heap if the pool is empty.
+  RequestData* AllocateRequest();
+  // Destroy the callback of a request and give it back.
+  void ReleaseRequest(RequestData* request);
+
+  // The worker thread to process scheduled callback.  When there is a pool of
+  // worker threads, it only runs the timer wheel and passes the due callbacks
+  // on to the pool.
   Thread* thread_;
 
   // Generate next available request id.
-  RequestId next_request_id_;
+  compat::Atomic<RequestId> next_request_id_;
 
   // Whether the scheduler is terminating.  Only be changed in destructor and
   // referenced in worker thread.
-  bool terminating_;
+  compat::Atomic<uint32_t> terminating_;
 
-  // Priority queue for all scheduled callback, ordered by due timestamp and
-  // request id
-  std::priority_queue<RequestDataPtr, std::vector<RequestDataPtr>,
-                      RequestDataPtrComparer>
-      request_queue_;
+  // Most recently submitted request, linked to the previous ones through
+  // next_submitted.  Pushed by any thread and emptied by the worker thread.
+  compat::Atomic<RequestData*> submitted_;
 
-  // Mutex to guard next_request_id_, terminating_ and request_queue_
-  Mutex request_mutex_;
+  // Non-zero while the worker thread is about to sleep or sleeping.  Schedule()
+  // only wakes up the worker thread when it is set.
+  compat::Atomic<uint32_t> worker_sleeping_;
 
-  // A semaphore with its count equivalent to the number of unfinished
-  // requests.  Used to sleep the thread when there are no more unfinished
-  // requests.  Also, it's used to wake the thread when new requests is added
-  // or when the scheduler is terminating.
+  // Used to wake the thread when new requests is added or when the scheduler is
+  // terminating.
   Semaphore sleep_sem_;
 
+  // Preallocated requests.
+  LockFreePool<RequestData> request_pool_;
+
+  // The worker threads, if any, and the default strand.
+  Worker* workers_;
+  int worker_count_;
+  SharedPtr<StrandQueue> default_strand_;
+
+  // The number of strands queued on all the workers.  Used to wake workers.
+  Semaphore work_sem_;
+
+  // Runs on the worker threads of the pool.
+  static void PoolWorkerRoutine(void* data);
+
+  // Queue a strand with due requests on the given worker.
+  void QueueStrand(SharedPtr<StrandQueue> strand, int worker_index);
+
+  // Take a strand from the worker's queue, or steal one from another worker.
+  SharedPtr<StrandQueue> TakeStrand(int worker_index);
+
+  // Trigger some of the due requests of a strand, and queue it again if it has
+  // more.
+  void RunStrand(SharedPtr<StrandQueue> strand, int worker_index);
+
   // Everything below runs on worker thread
   // The main worker thread routine
   static void WorkerThreadRoutine(void* data);
 
-  // Move the request to the priority queue that will be triggered in given
-  // milliseconds since now
-  void AddToQueue(RequestDataPtr request, uint64_t current,
-                  ScheduleTimeMs after);
+  // Trigger a due request, or pass it on to its strand when there are worker
+  // threads.
+  void Dispatch(RequestData* request, uint64_t current);
+
+  // Move the submitted requests into the timer wheel.
+  void TakeSubmittedRequests();
+
+  // Place a request in the timer wheel according to its due timestamp.
+  void AddToWheel(RequestData* request);
+
+  // Advance the wheel up to the given timestamp, triggering the due requests.
+  void AdvanceWheel(uint64_t current);
+
+  // Cascade the higher levels and trigger the due requests at wheel_time_,
+  // then move on to the next millisecond.
+  void ProcessTick();
+
+  // Re-place the requests of the current slot of the given level in the lower
+  // levels.
+  void Cascade(int level);
+
+  // The first timestamp from wheel_time_ at which a slot with requests comes
+  // up, or 0 if the wheel is empty.
+  uint64_t GetNextSlotTimestamp() const;
 
   // Trigger the callback.  Return true if this callback repeats and is not
   // cancelled yet.
-  bool TriggerCallback(const RequestDataPtr& request);
+  bool TriggerCallback(RequestData* request);
+
+  // Next timestamp to be processed by the wheel.  Every earlier millisecond
+  // has been processed.
+  uint64_t wheel_time_;
+
+  // Number of requests in the wheel.
+  uint64_t wheel_count_;
+
+  // The slots of each level, and a bitmap of the non-empty slots per level.
+  RequestList wheel_[kWheelLevels][kWheelSlots];
+  uint64_t occupied_[kWheelLevels];
+
+  // Worker which gets the next strand to run.
+  int next_worker_;
+
+  friend class Strand;
+};
+
+// A serial queue of callbacks on a Scheduler.  Callbacks scheduled on the same
+// strand are triggered one at a time, in order, even if the scheduler has
+// worker threads.  Callbacks still pending when the strand is deleted are
+// triggered regardless.
+class Strand {
+ public:
+  explicit Strand(Scheduler* scheduler);
+
+  // Strand is neither copyable nor movable.
+  Strand(const Strand&) = delete;
+  Strand& operator=(const Strand&) = delete;
+
+  // Same as Scheduler::Schedule(), on this strand.
+  RequestHandle Schedule(callback::Callback* callback, ScheduleTimeMs delay = 0,
+                         ScheduleTimeMs repeat = 0);
+
+#ifdef FIREBASE_USE_STD_FUNCTION
+  // std::function version of Schedule(callback, delay, repeat)
+  RequestHandle Schedule(const std::function<void(void)>& callback,
+                         ScheduleTimeMs delay = 0, ScheduleTimeMs repeat = 0);
+#endif  // FIREBASE_USE_STD_FUNCTION
+
+ private:
+  Scheduler* scheduler_;
+  SharedPtr<Scheduler::StrandQueue> queue_;
 };
 
 }  // namespace scheduler
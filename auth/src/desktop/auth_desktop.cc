@@ -14,7 +14,9 @@
 
 #include "auth/src/desktop/auth_desktop.h"
 
+#include <ctime>
 #include <memory>
+#include <random>
 #include <string>
 #include <utility>
 
@@ -79,6 +81,31 @@ Future<ResultT> DoSignInWithCredential(Promise<ResultT> promise,
   return promise.LastResult();
 }
 
+// Returns how many milliseconds are left until the refresh thread should renew
+// the current user's ID token, or a negative number if it is overdue.
+// token_timestamp is when the refresh thread last got a token, and jitter_ms
+// is how much earlier than kMinutesTokenRefreshMargin to renew it.
+int64_t GetMsUntilTokenRefresh(AuthData* const auth_data,
+                               const uint64_t token_timestamp,
+                               const int64_t jitter_ms) {
+  // The refresh thread has never got a token, so it should get one now.
+  if (token_timestamp == 0) return 0;
+
+  std::time_t expiration_date = 0;
+  UserView::TryRead(auth_data, [&](const UserView::Reader& user) {
+    expiration_date = user->access_token_expiration_date;
+  });
+  const int64_t now = static_cast<int64_t>(internal::GetTimestampEpoch());
+  if (expiration_date == 0) {
+    return kMsPerTokenRefresh - (now - static_cast<int64_t>(token_timestamp));
+  }
+  return static_cast<int64_t>(expiration_date) *
+             internal::kMillisecondsPerSecond -
+         now -
+         kMinutesTokenRefreshMargin * internal::kMillisecondsPerMinute -
+         jitter_ms;
+}
+
 }  // namespace
 
 void* CreatePlatformAuth(App* const app, void* const /*app_impl*/) {
@@ -120,7 +147,8 @@ void IdTokenRefreshListener::OnIdTokenChanged(Auth* auth) {
             auto listener = static_cast<IdTokenRefreshListener*>(ptr);
             MutexLock lock(listener->mutex_);
             if (result.status() == kFutureStatusComplete) {
-              listener->current_token_ = *result.result();
+              listener->current_token_.store(SharedPtr<const std::string>(
+                  new std::string(*result.result())));
               listener->token_timestamp_ = internal::GetTimestampEpoch();
             }
             listener->get_token_semaphore_.Post();
@@ -131,17 +159,13 @@ void IdTokenRefreshListener::OnIdTokenChanged(Auth* auth) {
       // be cached.)
     }
   } else {
-    current_token_ = "";
+    current_token_.store(SharedPtr<const std::string>());
   }
 }
 
 std::string IdTokenRefreshListener::GetCurrentToken() {
-  std::string current_token;
-  {
-    MutexLock lock(mutex_);
-    current_token = current_token_;
-  }
-  return current_token;
+  const SharedPtr<const std::string> current_token = current_token_.load();
+  return current_token ? *current_token : std::string();
 }
 
 uint64_t IdTokenRefreshListener::GetTokenTimestamp() {
@@ -162,7 +186,6 @@ bool Auth::GetAuthTokenForRegistry(App* app, void* /*unused*/, void* out) {
   Auth* auth = Auth::GetAuth(app, &init_result);
   if (auth) {
     auto result = static_cast<std::string*>(out);
-    MutexLock lock(auth->auth_data_->token_listener_mutex);
     auto auth_impl = static_cast<AuthImpl*>(auth->auth_data_->auth_impl);
     *result = auth_impl->token_refresh_thread.CurrentAuthToken();
     return true;
@@ -196,6 +219,7 @@ bool Auth::StopTokenRefreshThreadForRegistry(App* app, void* /*unused*/,
 
 void Auth::InitPlatformAuth(AuthData* const auth_data) {
   firebase::rest::InitTransportCurl();
+  InitializeAsyncExecutor();
   auth_data->app->function_registry()->RegisterFunction(
       internal::FnAuthGetCurrentToken, Auth::GetAuthTokenForRegistry);
   auth_data->app->function_registry()->RegisterFunction(
@@ -241,6 +265,7 @@ void Auth::DestroyPlatformAuth(AuthData* const auth_data) {
 
   delete static_cast<AuthImpl*>(auth_data->auth_impl);
   auth_data->auth_impl = nullptr;
+  TerminateAsyncExecutor();
   firebase::rest::CleanupTransportCurl();
 }
 
@@ -456,7 +481,13 @@ void IdTokenRefreshThread::Initialize(AuthData* auth_data) {
   thread_ = firebase::Thread(
       [](IdTokenRefreshThread* refresh_thread) {
         Auth* auth = refresh_thread->auth;
+        std::random_device random_device;
+        std::uniform_int_distribution<int64_t> jitter_in_range(
+            0, kMinutesTokenRefreshJitter * internal::kMillisecondsPerMinute);
         while (!refresh_thread->is_shutting_down()) {
+          // Pick when to renew the next token.
+          const int64_t jitter_ms = jitter_in_range(random_device);
+
           // Note:  Make sure to always make future_impl.mutex the innermost
           // lock, to prevent deadlocks!
           refresh_thread->ref_count_mutex_.Acquire();
@@ -466,11 +497,12 @@ void IdTokenRefreshThread::Initialize(AuthData* auth_data) {
             // ensures that we won't mess with the LastResult for the
             // user-facing one.
 
-            uint64_t ms_since_last_refresh =
-                internal::GetTimestampEpoch() -
-                refresh_thread->token_refresh_listener_.GetTokenTimestamp();
+            int64_t ms_until_refresh = GetMsUntilTokenRefresh(
+                auth->auth_data_,
+                refresh_thread->token_refresh_listener_.GetTokenTimestamp(),
+                jitter_ms);
 
-            if (ms_since_last_refresh >= kMsPerTokenRefresh) {
+            if (ms_until_refresh <= 0) {
               Future<std::string> future =
                   refresh_thread->auth->current_user()->GetTokenInternal(
                       true, kInternalFn_GetTokenForRefresher);
@@ -503,15 +535,17 @@ void IdTokenRefreshThread::Initialize(AuthData* auth_data) {
                 if (refresh_thread->ref_count_ <= 0) break;
               }
 
-              ms_since_last_refresh =
-                  internal::GetTimestampEpoch() -
-                  refresh_thread->token_refresh_listener_.GetTokenTimestamp();
+              ms_until_refresh = GetMsUntilTokenRefresh(
+                  auth->auth_data_,
+                  refresh_thread->token_refresh_listener_.GetTokenTimestamp(),
+                  jitter_ms);
+              if (ms_until_refresh <= 0) break;
 
               // If the timed-wait returns true, then it means we were
               // interrupted early - either it's time to shut down, or we
               // got a new token and should restart the clock.
               if (!refresh_thread->wakeup_sem_.TimedWait(
-                      kMsPerTokenRefresh - ms_since_last_refresh)) {
+                      static_cast<int>(ms_until_refresh))) {
                 break;
               }
             }
@@ -16,7 +16,10 @@
 #define FIREBASE_AUTH_CLIENT_CPP_SRC_DESKTOP_AUTH_DESKTOP_H_
 
 #include <memory>
+#include "app/memory/shared_ptr.h"
 #include "app/rest/request.h"
+#include "app/src/atomic_shared_ptr.h"
+#include "app/src/mutex.h"
 #include "app/src/semaphore.h"
 #include "app/src/thread.h"
 #include "app/src/time.h"
@@ -30,7 +33,8 @@ namespace auth {
 
 // Token listener used by the IdTokenRefreshThread object.  Basically just
 // listens for changes, and when one occurs, caches the result, along with a
-// timestamp.  All functions are thread-safe and locked with the mutex.
+// timestamp.  All functions are thread-safe and locked with the mutex, except
+// GetCurrentToken which reads the cached token without a lock.
 class IdTokenRefreshListener : public IdTokenListener {
  public:
   IdTokenRefreshListener();
@@ -41,10 +45,10 @@ class IdTokenRefreshListener : public IdTokenListener {
   uint64_t GetTokenTimestamp();
 
  private:
-  // Guards all members of this class.
+  // Guards all members of this class.  current_token_ can be read without it.
   Mutex mutex_;
   uint64_t token_timestamp_;
-  std::string current_token_;
+  AtomicSharedPtr<const std::string> current_token_;
   // Acquired (decremented) when a GetToken() is in progress, signaled
   // incremented when GetToken() completes().
   Semaphore get_token_semaphore_;
@@ -100,6 +104,21 @@ class IdTokenRefreshThread {
   Auth* auth;
 };
 
+// A secure token request in progress.  All the callers which need a new ID
+// token while it runs wait for it and share its result, instead of each
+// sending their own request.
+struct TokenRefreshFlight {
+  TokenRefreshFlight() : done(0), error(kAuthErrorNone) {}
+
+  // The refresh token the request was sent with.  Only callers holding the
+  // same refresh token can share the result.
+  std::string refresh_token;
+  // Posted once the result below is set.
+  Semaphore done;
+  AuthError error;
+  std::string id_token;
+};
+
 // The desktop-specific Auth implementation.
 struct AuthImpl {
   AuthImpl() : async_sem(0), active_async_calls(0) {}
@@ -120,14 +139,33 @@ struct AuthImpl {
   Semaphore async_sem;
   Mutex async_mutex;
   int active_async_calls;
+
+  // Copy of the currently signed-in user, read without a lock by
+  // UserView::GetSnapshot.
+  AtomicSharedPtr<const UserData> user_snapshot;
+
+  // The secure token request in progress, if any.  Guarded by
+  // token_refresh_mutex.
+  Mutex token_refresh_mutex;
+  SharedPtr<TokenRefreshFlight> token_refresh_flight;
 };
 
 // Constant, describing how often we automatically fetch a new auth token.
-// Auth tokens expire after 60 minutes so we refresh slightly before.
+// Auth tokens expire after 60 minutes so we refresh slightly before.  This is
+// only used when the expiration date of the token is not known.
 const int kMinutesPerTokenRefresh = 58;
 const int kMsPerTokenRefresh =
     kMinutesPerTokenRefresh * internal::kMillisecondsPerMinute;
 
+// How long before its expiration the refresh thread renews the auth token.
+// GetToken() only fetches a new token once the current one has less than 5
+// minutes left, so refreshing earlier than that means it never has to wait
+// for the network.  A random delay of up to kMinutesTokenRefreshJitter is
+// taken off the margin, so that many clients started at the same time do not
+// all refresh at the same time.
+const int kMinutesTokenRefreshMargin = 10;
+const int kMinutesTokenRefreshJitter = 5;
+
 #ifdef FIREBASE_EARLY_ACCESS_PREVIEW
 void InitializeUserDataPersist(AuthData* auth_data);
 void DestroyUserDataPersist(AuthData* auth_data);
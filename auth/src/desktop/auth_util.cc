@@ -15,6 +15,8 @@
 #include "auth/src/desktop/auth_util.h"
 
 #include "app/rest/transport_builder.h"
+#include "app/src/mutex.h"
+#include "app/src/scheduler.h"
 #include "app/src/variant_util.h"
 #include "auth/src/desktop/auth_desktop.h"
 #include "auth/src/desktop/credential_impl.h"
@@ -64,6 +66,52 @@ void EndAsyncFunction(void* auth_impl_void) {
   }
 }
 
+// Number of threads running the CallAsync functions of all the Auth instances.
+// Operations started beyond this wait for a thread to be free.
+static const int kAsyncExecutorThreadCount = 4;
+
+// Guards the two below.
+static Mutex g_async_executor_mutex;  // NOLINT
+static scheduler::Scheduler* g_async_executor = nullptr;
+static int g_async_executor_ref_count = 0;
+
+void InitializeAsyncExecutor() {
+  MutexLock lock(g_async_executor_mutex);
+  if (g_async_executor_ref_count++ == 0) {
+    g_async_executor = new scheduler::Scheduler(kAsyncExecutorThreadCount);
+  }
+}
+
+void TerminateAsyncExecutor() {
+  scheduler::Scheduler* executor = nullptr;
+  {
+    MutexLock lock(g_async_executor_mutex);
+    FIREBASE_ASSERT_RETURN_VOID(g_async_executor_ref_count > 0);
+    if (--g_async_executor_ref_count == 0) {
+      executor = g_async_executor;
+      g_async_executor = nullptr;
+    }
+  }
+  // Deleting the executor waits for the threads to finish what they run, so do
+  // it without the lock.
+  delete executor;
+}
+
+void ScheduleAsyncFunction(callback::Callback* callback) {
+  {
+    MutexLock lock(g_async_executor_mutex);
+    if (g_async_executor) {
+      g_async_executor->ScheduleUnordered(callback);
+      return;
+    }
+  }
+  // There is no executor once the last Auth instance is gone.  Run the
+  // callback here rather than drop it, as the operation's promise, and the
+  // count of operations in progress, are only settled by the callback.
+  callback->Run();
+  delete callback;
+}
+
 void WaitForAllAsyncToComplete(void* auth_impl_void) {
   auto auth_impl = static_cast<AuthImpl*>(auth_impl_void);
   for (;;) {
@@ -21,9 +21,9 @@
 #include "app/rest/request.h"
 #include "app/rest/transport_builder.h"
 #include "app/src/assert.h"
+#include "app/src/callback.h"
 #include "app/src/log.h"
 #include "app/src/semaphore.h"
-#include "app/src/thread.h"
 #include "auth/src/common.h"
 #include "auth/src/data.h"
 #include "auth/src/desktop/auth_constants.h"
@@ -62,8 +62,8 @@ void CompletePromise(Promise<void>* promise,
 template <typename T>
 void FailPromise(Promise<T>* promise, AuthError error_code);
 
-// Invokes the given callback on another thread and passes the rest of the
-// arguments to the invocation.
+// Invokes the given callback on the shared pool of threads used for Auth
+// operations and passes the rest of the arguments to the invocation.
 template <typename ResultT, typename RequestT>
 Future<ResultT> CallAsync(
     AuthData* auth_data, Promise<ResultT> promise,
@@ -76,6 +76,16 @@ void StartAsyncFunction(void* auth_impl_void);
 void EndAsyncFunction(void* auth_impl_void);
 void WaitForAllAsyncToComplete(void* auth_impl_void);
 
+// The pool of threads running the CallAsync functions is shared by all the
+// Auth instances, and bounds how many of them run at once.  Each Auth instance
+// holds a reference to it while it exists.
+void InitializeAsyncExecutor();
+void TerminateAsyncExecutor();
+
+// Runs the given callback on the shared pool of threads, and deletes it
+// afterwards.  Without a pool, the callback is run on the calling thread.
+void ScheduleAsyncFunction(callback::Callback* callback);
+
 // Sends the given request on the network and returns the response. The response
 // is cast to the specified T without any checks, so it's the caller's
 // responsibility to ensure the correct type is given.
@@ -99,14 +109,13 @@ inline Future<ResultT> CallAsync(
 
   StartAsyncFunction(auth_data->auth_impl);
   typedef AuthDataHandle<ResultT, RequestT> HandleT;
-  firebase::Thread(
+  ScheduleAsyncFunction(new callback::CallbackValue1<HandleT*>(
+      new HandleT(auth_data, promise, std::move(request), callback),
       [](HandleT* const raw_auth_data_handle) {
         std::unique_ptr<HandleT> handle(raw_auth_data_handle);
         handle->callback(handle.get());
         EndAsyncFunction(handle->auth_data->auth_impl);
-      },
-      new HandleT(auth_data, promise, std::move(request), callback))
-      .Detach();
+      }));
   return promise.future();
 }
 
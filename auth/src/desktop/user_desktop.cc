@@ -17,9 +17,10 @@
 #include <fstream>
 #include <memory>
 
+#include "app/memory/shared_ptr.h"
 #include "app/rest/transport_builder.h"
 #include "app/rest/util.h"
-#include "app/src/thread.h"
+#include "app/src/mutex.h"
 #include "auth/src/common.h"
 #include "auth/src/data.h"
 #include "auth/src/desktop/auth_data_handle.h"
@@ -83,47 +84,25 @@ void SignOutIfUserNoLongerValid(Auth* const auth, const AuthError error_code) {
 
 // Checks whether the given user has a non-expired ID token.
 // If current token is still good for at least 5 minutes, we re-use it.
-GetTokenResult GetTokenIfFresh(const UserView::Reader& user,
+GetTokenResult GetTokenIfFresh(const UserData& user,
                                const bool force_refresh) {
   if (force_refresh) {
     return GetTokenResult(kAuthErrorFailure);
   }
 
-  if (user.IsValid() && !user->id_token.empty() &&
-      user->access_token_expiration_date > std::time(nullptr) + 5 * 60) {
-    return GetTokenResult(user->id_token);
+  if (!user.id_token.empty() &&
+      user.access_token_expiration_date > std::time(nullptr) + 5 * 60) {
+    return GetTokenResult(user.id_token);
   }
   return GetTokenResult(kAuthErrorFailure);
 }
 
-// Makes sure that calling auth->current_user()->id_token() will result in
-// a token that is good for at least 5 minutes. Will fetch a new token from the
-// backend if necessary.
+// Exchanges the given refresh token for a new ID token, and stores the new
+// tokens in the current user.
 //
-// If force_refresh is given, then a new token will be fetched without checking
-// the current token at all.
-//
-// Note: this is a blocking call! The caller is supposed to call this function
-// on the appropriate thread.
-GetTokenResult EnsureFreshToken(AuthData* const auth_data,
-                                const bool force_refresh) {
-  FIREBASE_ASSERT_RETURN(GetTokenResult(kAuthErrorFailure), auth_data);
-
-  GetTokenResult old_token(kAuthErrorFailure);
-  std::string refresh_token;
-  const bool is_user_logged_in =
-      UserView::TryRead(auth_data, [&](const UserView::Reader& user) {
-        old_token = GetTokenIfFresh(user, force_refresh);
-        refresh_token = user->refresh_token;
-      });
-
-  if (!is_user_logged_in) {
-    return GetTokenResult(kAuthErrorNoSignedInUser);
-  }
-  if (old_token.IsValid()) {
-    return GetTokenResult(old_token.token());
-  }
-
+// Note: this is a blocking call!
+GetTokenResult RequestNewToken(AuthData* const auth_data,
+                               const std::string& refresh_token) {
   const SecureTokenRequest request(GetApiKey(*auth_data),
                                    refresh_token.c_str());
   auto response = GetResponse<SecureTokenResponse>(request);
@@ -150,6 +129,76 @@ GetTokenResult EnsureFreshToken(AuthData* const auth_data,
   return GetTokenResult(response.id_token());
 }
 
+// Same as RequestNewToken, but if a request for the same refresh token is
+// already in progress, waits for it and returns its result instead of sending
+// another one.
+//
+// Note: this is a blocking call!
+GetTokenResult RequestNewTokenOnce(AuthData* const auth_data,
+                                   const std::string& refresh_token) {
+  auto auth_impl = static_cast<AuthImpl*>(auth_data->auth_impl);
+
+  SharedPtr<TokenRefreshFlight> flight;
+  bool is_first_caller = false;
+  {
+    MutexLock lock(auth_impl->token_refresh_mutex);
+    flight = auth_impl->token_refresh_flight;
+    if (!flight || flight->refresh_token != refresh_token) {
+      flight = MakeShared<TokenRefreshFlight>();
+      flight->refresh_token = refresh_token;
+      auth_impl->token_refresh_flight = flight;
+      is_first_caller = true;
+    }
+  }
+
+  if (!is_first_caller) {
+    flight->done.Wait();
+    // Pass the wake-up on to the next waiter, if any.
+    flight->done.Post();
+    return flight->error == kAuthErrorNone ? GetTokenResult(flight->id_token)
+                                           : GetTokenResult(flight->error);
+  }
+
+  const GetTokenResult result = RequestNewToken(auth_data, refresh_token);
+  flight->error = result.error();
+  flight->id_token = result.token();
+  {
+    MutexLock lock(auth_impl->token_refresh_mutex);
+    // Callers coming from now on send a new request.
+    if (auth_impl->token_refresh_flight.get() == flight.get()) {
+      auth_impl->token_refresh_flight.reset();
+    }
+  }
+  flight->done.Post();
+  return result;
+}
+
+// Makes sure that calling auth->current_user()->id_token() will result in
+// a token that is good for at least 5 minutes. Will fetch a new token from the
+// backend if necessary.  Concurrent callers share a single request to the
+// backend.
+//
+// If force_refresh is given, then a new token will be fetched without checking
+// the current token at all.
+//
+// Note: this is a blocking call! The caller is supposed to call this function
+// on the appropriate thread.
+GetTokenResult EnsureFreshToken(AuthData* const auth_data,
+                                const bool force_refresh) {
+  FIREBASE_ASSERT_RETURN(GetTokenResult(kAuthErrorFailure), auth_data);
+
+  const SharedPtr<const UserData> user = UserView::GetSnapshot(auth_data);
+  if (!user) {
+    return GetTokenResult(kAuthErrorNoSignedInUser);
+  }
+  const GetTokenResult old_token = GetTokenIfFresh(*user, force_refresh);
+  if (old_token.IsValid()) {
+    return old_token;
+  }
+
+  return RequestNewTokenOnce(auth_data, user->refresh_token);
+}
+
 // Checks whether there is a currently logged in user. If no user is signed in,
 // fails the given promise and returns false. Otherwise, doesn't touch the
 // promise and returns true.
@@ -175,7 +224,8 @@ Future<ResultT> CallAsyncWithFreshToken(
   StartAsyncFunction(auth_data->auth_impl);
 
   typedef AuthDataHandle<ResultT, RequestT> HandleT;
-  firebase::Thread(
+  ScheduleAsyncFunction(new callback::CallbackValue1<HandleT*>(
+      new HandleT(auth_data, promise, std::move(request), callback),
       [](HandleT* const raw_auth_data_handle) {
         std::unique_ptr<HandleT> handle(raw_auth_data_handle);
 
@@ -190,9 +240,7 @@ Future<ResultT> CallAsyncWithFreshToken(
 
         handle->callback(handle.get());
         EndAsyncFunction(handle->auth_data->auth_impl);
-      },
-      new HandleT(auth_data, promise, std::move(request), callback))
-      .Detach();
+      }));
   return promise.LastResult();
 }
 
@@ -524,17 +572,13 @@ Future<std::string> User::GetTokenInternal(const bool force_refresh,
                                            const int future_identifier) {
   Promise<std::string> promise(&auth_data_->future_impl, future_identifier);
 
-  GetTokenResult current_token(kAuthErrorFailure);
-  const bool is_user_logged_in =
-      UserView::TryRead(auth_data_, [&](const UserView::Reader& user) {
-        current_token = GetTokenIfFresh(user, force_refresh);
-      });
-
-  if (!is_user_logged_in) {
+  const SharedPtr<const UserData> user = UserView::GetSnapshot(auth_data_);
+  if (!user) {
     auto future = promise.future();
     future.Release();
     return future;
   }
+  const GetTokenResult current_token = GetTokenIfFresh(*user, force_refresh);
   if (current_token.IsValid()) {
     promise.CompleteWithResult(current_token.token());
     return promise.future();
@@ -762,43 +806,43 @@ UserMetadata User::metadata() const {
 }
 
 bool User::is_email_verified() const {
-  const auto user = UserView::GetReader(auth_data_);
-  return user.IsValid() ? user->is_email_verified : false;
+  const auto user = UserView::GetSnapshot(auth_data_);
+  return user ? user->is_email_verified : false;
 }
 
 bool User::is_anonymous() const {
-  const auto user = UserView::GetReader(auth_data_);
-  return user.IsValid() ? user->is_anonymous : true;
+  const auto user = UserView::GetSnapshot(auth_data_);
+  return user ? user->is_anonymous : true;
 }
 
 std::string User::uid() const {
-  const auto user = UserView::GetReader(auth_data_);
-  return user.IsValid() ? user->uid : std::string();
+  const auto user = UserView::GetSnapshot(auth_data_);
+  return user ? user->uid : std::string();
 }
 
 std::string User::email() const {
-  const auto user = UserView::GetReader(auth_data_);
-  return user.IsValid() ? user->email : std::string();
+  const auto user = UserView::GetSnapshot(auth_data_);
+  return user ? user->email : std::string();
 }
 
 std::string User::display_name() const {
-  const auto user = UserView::GetReader(auth_data_);
-  return user.IsValid() ? user->display_name : std::string();
+  const auto user = UserView::GetSnapshot(auth_data_);
+  return user ? user->display_name : std::string();
 }
 
 std::string User::phone_number() const {
-  const auto user = UserView::GetReader(auth_data_);
-  return user.IsValid() ? user->phone_number : std::string();
+  const auto user = UserView::GetSnapshot(auth_data_);
+  return user ? user->phone_number : std::string();
 }
 
 std::string User::photo_url() const {
-  const auto user = UserView::GetReader(auth_data_);
-  return user.IsValid() ? user->photo_url : std::string();
+  const auto user = UserView::GetSnapshot(auth_data_);
+  return user ? user->photo_url : std::string();
 }
 
 std::string User::provider_id() const {
-  const auto user = UserView::GetReader(auth_data_);
-  return user.IsValid() ? user->provider_id : std::string();
+  const auto user = UserView::GetSnapshot(auth_data_);
+  return user ? user->provider_id : std::string();
 }
 
 // Not implemented
@@ -14,6 +14,8 @@
 
 #include "auth/src/desktop/user_view.h"
 
+#include "auth/src/desktop/auth_desktop.h"
+
 namespace firebase {
 namespace auth {
 
@@ -85,6 +87,7 @@ void UserView::ClearUser(AuthData* const auth_data,
     delete user;
   }
   auth_data->user_impl = nullptr;
+  PublishSnapshot(auth_data);
 
   DoResetUserInfos(auth_data, std::vector<UserInfoImpl>());
 }
@@ -123,6 +126,24 @@ UserView::Writer UserView::GetWriter(AuthData* const auth_data) {
   return Writer();
 }
 
+SharedPtr<const UserData> UserView::GetSnapshot(AuthData* const auth_data) {
+  FIREBASE_ASSERT_RETURN(SharedPtr<const UserData>(), auth_data);
+
+  auto auth_impl = static_cast<AuthImpl*>(auth_data->auth_impl);
+  if (!auth_impl) return SharedPtr<const UserData>();
+  return auth_impl->user_snapshot.load();
+}
+
+void UserView::PublishSnapshot(AuthData* const auth_data) {
+  auto auth_impl = static_cast<AuthImpl*>(auth_data->auth_impl);
+  if (!auth_impl) return;
+
+  const UserView* const user = CastToUser(auth_data);
+  auth_impl->user_snapshot.store(
+      user ? SharedPtr<const UserData>(new UserData(user->user_data_))
+           : SharedPtr<const UserData>());
+}
+
 UserView* UserView::CastToUser(AuthData* const auth_data) {
   FIREBASE_ASSERT_RETURN(nullptr, auth_data);
   return static_cast<UserView*>(auth_data->user_impl);
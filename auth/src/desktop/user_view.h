@@ -17,6 +17,7 @@
 
 #include <memory>
 #include <utility>
+#include "app/memory/shared_ptr.h"
 #include "app/src/assert.h"
 #include "app/src/mutex.h"
 #include "auth/src/common.h"
@@ -28,7 +29,9 @@ namespace firebase {
 namespace auth {
 
 // Intended to make accessing and modifying the currently signed-in user
-// thread-safe. All operations are protected by AuthData::future_impl.mutex().
+// thread-safe. All operations are protected by AuthData::future_impl.mutex(),
+// except for GetSnapshot which reads an immutable copy of the user published
+// whenever it is modified.
 class UserView {
  public:
   // Thread-safe read-only view of the currently signed-in user.
@@ -84,6 +87,7 @@ class UserView {
 
     ~Writer() {
       if (mutex_) {
+        UserView::PublishSnapshot(auth_data_);
         mutex_->Release();
       }
     }
@@ -155,11 +159,22 @@ class UserView {
   // Thread-safe.
   static Writer GetWriter(AuthData* auth_data);
 
+  // Returns a copy of the currently signed-in user, or null if there is none.
+  // Doesn't take any lock, so prefer this over GetReader for reading a few
+  // attributes on hot paths. The copy is immutable and isn't updated if the
+  // user is modified afterwards.
+  // Thread-safe.
+  static SharedPtr<const UserData> GetSnapshot(AuthData* auth_data);
+
  private:
   explicit UserView(const UserData& user_data) : user_data_(user_data) {}
 
   static UserView* CastToUser(AuthData* auth_data);
 
+  // Publishes a copy of the currently signed-in user for GetSnapshot. Must be
+  // called with AuthData::future_impl.mutex() held, after every modification.
+  static void PublishSnapshot(AuthData* auth_data);
+
   UserData user_data_;
 };
 
@@ -270,6 +270,14 @@ Future<void> DatabaseReference::UpdateChildrenLastResult() {
   return internal_ ? internal_->UpdateChildrenLastResult() : Future<void>();
 }
 
+void DatabaseReference::SetWriteCoalescingWindow(int milliseconds) {
+#if defined(FIREBASE_TARGET_DESKTOP)
+  if (internal_) internal_->SetWriteCoalescingWindow(milliseconds);
+#else
+  (void)milliseconds;
+#endif  // defined(FIREBASE_TARGET_DESKTOP)
+}
+
 std::string DatabaseReference::url() const {
   return internal_ ? internal_->GetUrl() : std::string();
 }
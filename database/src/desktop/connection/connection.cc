@@ -50,7 +50,7 @@ const char* const Connection::kServerHelloSessionId = "s";
 
 compat::Atomic<uint32_t> Connection::next_log_id_(0);
 
-Connection::Connection(scheduler::Scheduler* scheduler, const HostInfo& info,
+Connection::Connection(scheduler::Strand* scheduler, const HostInfo& info,
                        const char* opt_last_session_id,
                        ConnectionEventHandler* event_handler)
     : safe_this_(this),
@@ -60,7 +60,7 @@ Connection::Connection(scheduler::Scheduler* scheduler, const HostInfo& info,
       state_(kStateNone),
       ws_connected_(false),
       client_(nullptr),
-      expected_incoming_frames_(0) {
+      decoder_(nullptr) {
   assert(scheduler);
   assert(event_handler);
 
@@ -69,6 +69,9 @@ Connection::Connection(scheduler::Scheduler* scheduler, const HostInfo& info,
   log_id_stream << "[conn_" << next_log_id_.fetch_add(1) << "]";
   log_id_ = log_id_stream.str();
 
+  // Decode incoming messages in their own thread
+  decoder_ = MakeUnique<FrameDecoder>(log_id_, OnMessageDecoded, this);
+
   // Create web socket client regardless of its implementation
   client_ = CreateWebSocketClient(host_info_, this, opt_last_session_id);
 }
@@ -78,6 +81,14 @@ Connection::~Connection() {
   // executing code which requires reference to this.
   safe_this_.ClearReference();
 
+  // Stop the decoder first.  Otherwise the websocket thread could be stuck
+  // waiting for room in the decoder queue while the client is destroyed.
+  if (decoder_) {
+    decoder_->Shutdown();
+    LogDebug("%s Incoming message latency: %s", log_id_.c_str(),
+             decoder_->GetLatencyReport().c_str());
+  }
+
   // Destroy the client so that no more event will be triggered from this point.
   client_.reset(nullptr);
 
@@ -136,6 +147,35 @@ void Connection::Send(const Variant& message, bool is_sensitive) {
     return;
   }
 
+  std::vector<std::string> frames;
+  AppendFrames(message, is_sensitive, &frames);
+  client_->Send(frames);
+}
+
+void Connection::Send(const std::vector<OutgoingMessage>& messages) {
+  assert(client_);
+
+  if (state_ != kStateReady) {
+    LogError("%s Tried to send on an unconnected connection", log_id_.c_str());
+    return;
+  }
+
+  std::vector<std::string> frames;
+  frames.reserve(messages.size());
+  for (const OutgoingMessage& outgoing : messages) {
+    assert(!outgoing.message.is_null());
+    AppendFrames(outgoing.message, outgoing.is_sensitive, &frames);
+  }
+  if (messages.size() > 1) {
+    LogDebug("%s Sending %d messages in %d frames", log_id_.c_str(),
+             static_cast<int>(messages.size()),
+             static_cast<int>(frames.size()));
+  }
+  client_->Send(frames);
+}
+
+void Connection::AppendFrames(const Variant& message, bool is_sensitive,
+                              std::vector<std::string>* frames) {
   // Wrap into Firebase wire protocol Data Message format
   Variant request = Variant::EmptyMap();
   request.map()[kRequestType] = kRequestTypeData;
@@ -154,14 +194,14 @@ void Connection::Send(const Variant& message, bool is_sensitive) {
     // Send number of frames
     std::stringstream frame_size_str;
     frame_size_str << num_of_frame;
-    client_->Send(frame_size_str.str().c_str());
+    frames->push_back(frame_size_str.str());
 
     // Send individual frame
     for (int i = 0; i < to_send.length(); i += kMaxFrameSize) {
-      client_->Send(to_send.substr(i, kMaxFrameSize).c_str());
+      frames->push_back(to_send.substr(i, kMaxFrameSize));
     }
   } else {
-    client_->Send(to_send.c_str());
+    frames->push_back(Move(to_send));
   }
 }
 
@@ -195,109 +235,81 @@ void Connection::OnOpen() {
       }));
 }
 
-void Connection::OnMessage(const char* msg) {
+void Connection::OnMessage(const char* msg, size_t length) {
   LogDebug("%s websocket message received", log_id_.c_str());
-  scheduler_->Schedule(new callback::CallbackValue1String1<ConnectionRef>(
-      safe_this_, msg, [](ConnectionRef conn_ref, const char* msg) {
+  // Reassemble and parse the message in the decoder thread.  The decoded
+  // message comes back through OnMessageDecoded().
+  decoder_->PushFrame(msg, length);
+}
+
+void Connection::OnMessageDecoded(void* context) {
+  Connection* connection = static_cast<Connection*>(context);
+  connection->scheduler_->Schedule(new callback::CallbackValue1<ConnectionRef>(
+      connection->safe_this_, [](ConnectionRef conn_ref) {
         ConnectionRefLock lock(&conn_ref);
         auto connection = lock.GetReference();
         if (connection != nullptr) {
-          connection->HandleIncomingFrame(msg);
+          connection->HandleDecodedMessage();
         }
       }));
 }
 
 void Connection::OnClose() {
   LogDebug("%s websocket closed", log_id_.c_str());
-
-  scheduler_->Schedule(new callback::CallbackValue1<ConnectionRef>(
-      safe_this_, [](ConnectionRef conn_ref) {
-        ConnectionRefLock lock(&conn_ref);
-        auto connection = lock.GetReference();
-        if (connection != nullptr && connection->state_ != kStateDisconnected) {
-          // No need to do anything if Close() has been called already.
-          // Otherwise, the cause could be either connection failure or
-          // connection lost, depending on whether the web socket has already
-          // been connected or not.
-          DisconnectReason reason = connection->ws_connected_
-                                        ? kDisconnectReasonConnectionLost
-                                        : kDisconnectReasonConnectionFailed;
-          connection->Close(reason);
-        }
-      }));
+  // Handled once the messages received before are.
+  decoder_->PushMarker(kDecoderMarkerClosed);
 }
 
 void Connection::OnError(const WebSocketClientErrorData& error_data) {
   LogDebug("%s websocket error occurred.  Uri: %s", log_id_.c_str(),
            error_data.GetUri().c_str());
-
-  scheduler_->Schedule(new callback::CallbackValue1<ConnectionRef>(
-      safe_this_, [](ConnectionRef conn_ref) {
-        ConnectionRefLock lock(&conn_ref);
-        auto connection = lock.GetReference();
-        if (connection != nullptr) {
-          // If error occurs before the connection is opened, it is due to
-          // connection failed (ex. incorrect url).  Otherwise, it can be
-          // any lower-level error during connection.
-          DisconnectReason reason = connection->ws_connected_
-                                        ? kDisconnectReasonWebsocketError
-                                        : kDisconnectReasonConnectionFailed;
-          connection->Close(reason);
-        }
-      }));
+  // Handled once the messages received before are.
+  decoder_->PushMarker(kDecoderMarkerError);
 }
 
-void Connection::HandleIncomingFrame(const char* msg) {
-  if (state_ == kStateDisconnected) {
+void Connection::HandleDecodedMessage() {
+  Variant message_data;
+  int marker = 0;
+  if (!decoder_->PopMessage(&message_data, &marker)) {
     return;
   }
 
-  // Firebase server splits large message into multiple frames, the same way
-  // how client split large message into frames before sending.  If the received
-  // message is a number, this indicate how many frames to be expected in the
-  // future.
-  if (expected_incoming_frames_ > 0) {
-    // Add msg to buffer
-    incoming_buffer_ << msg;
-    --expected_incoming_frames_;
-
-    LogDebug("%s Received a frame (length: %d), %d more to come",
-             log_id_.c_str(), strlen(msg), expected_incoming_frames_);
-
-    // If buffer is complete, process it
-    if (expected_incoming_frames_ == 0) {
-      ProcessMessage(incoming_buffer_.str().c_str());
-    }
-  } else {
-    uint32_t num_of_frame = 0;
-    // The server is only supposed to send up to 9999 frames (i.e. length
-    // <= 4), but that isn't being enforced currently.  So allowing larger frame
-    // counts (length <= 6).
-    if (std::strlen(msg) <= 6) {
-      int32_t parse_value = strtol(msg, nullptr, 10);  // NOLINT
-      if (parse_value > 0) {
-        num_of_frame = parse_value;
-      }
-    }
-
-    if (num_of_frame > 0) {
-      LogDebug("%s Received a frame count. Expecting %d frames later",
-               log_id_.c_str(), num_of_frame);
+  switch (marker) {
+    case kDecoderMarkerClosed:
+      HandleWebSocketClosed();
+      return;
+    case kDecoderMarkerError:
+      HandleWebSocketError();
+      return;
+    default:
+      break;
+  }
 
-      // Start the buffer
-      expected_incoming_frames_ = num_of_frame;
-      incoming_buffer_.str("");
-    } else {
-      // Process it
-      ProcessMessage(msg);
-    }
+  if (state_ == kStateDisconnected) {
+    return;
   }
+
+  ProcessMessage(message_data);
 }
 
-void Connection::ProcessMessage(const char* message) {
-  Variant message_data = util::JsonToVariant(message);
-  LogDebug("%s ProcessMessage (length: %d)", log_id_.c_str(), strlen(message));
+void Connection::HandleWebSocketClosed() {
+  // No need to do anything if Close() has been called already.  Otherwise,
+  // the cause could be either connection failure or connection lost,
+  // depending on whether the web socket has already been connected or not.
+  if (state_ == kStateDisconnected) return;
+  Close(ws_connected_ ? kDisconnectReasonConnectionLost
+                      : kDisconnectReasonConnectionFailed);
+}
+
+void Connection::HandleWebSocketError() {
+  // If error occurs before the connection is opened, it is due to connection
+  // failed (ex. incorrect url).  Otherwise, it can be any lower-level error
+  // during connection.
+  Close(ws_connected_ ? kDisconnectReasonWebsocketError
+                      : kDisconnectReasonConnectionFailed);
+}
 
+void Connection::ProcessMessage(const Variant& message_data) {
   assert(!message_data.is_null());
 
   const auto& messageMap = message_data.map();
@@ -16,12 +16,15 @@
 #define FIREBASE_DATABASE_CLIENT_CPP_SRC_DESKTOP_CONNECTION_CONNECTION_H_
 
 #include <sstream>
+#include <string>
+#include <vector>
 
 #include "app/memory/atomic.h"
 #include "app/memory/unique_ptr.h"
 #include "app/src/include/firebase/variant.h"
 #include "app/src/safe_reference.h"
 #include "app/src/scheduler.h"
+#include "database/src/desktop/connection/frame_decoder.h"
 #include "database/src/desktop/connection/host_info.h"
 #include "database/src/desktop/connection/web_socket_client_interface.h"
 
@@ -46,9 +49,9 @@ class ConnectionEventHandler;
 // Currently it does not automatically disconnect itself if it has never been
 // used.  Also, it does not handle cache server.
 //
-// This class requires scheduler and expects all the public functions, except
-// for events from WebSocketClientEventHandler, are called from scheduler's
-// worker thread.
+// This class requires a scheduler strand and expects all the public functions,
+// except for events from WebSocketClientEventHandler, are called from that
+// strand.
 //
 // This class is designed to be disposable and non-reusable.  That is, once
 // disconnected, it is not able to reconnect again.  Simply create another
@@ -72,7 +75,7 @@ class Connection : public WebSocketClientEventHandler {
     kDisconnectReasonServerReset
   };
 
-  explicit Connection(scheduler::Scheduler* scheduler, const HostInfo& info,
+  explicit Connection(scheduler::Strand* scheduler, const HostInfo& info,
                       const char* opt_last_session_id,
                       ConnectionEventHandler* event_handler);
   ~Connection() override;
@@ -96,9 +99,24 @@ class Connection : public WebSocketClientEventHandler {
   // Expect to be called from scheduler thread
   void Send(const Variant& message, bool is_sensitive);
 
+  // A client data message queued to be sent by the batched Send() below.
+  struct OutgoingMessage {
+    OutgoingMessage(const Variant& message, bool is_sensitive)
+        : message(message), is_sensitive(is_sensitive) {}
+
+    Variant message;
+    bool is_sensitive;
+  };
+
+  // Send several client data messages to server, in order.  All the messages
+  // are serialized first and then handed to the websocket client together, so
+  // that a burst of requests costs a single wake-up of the websocket thread.
+  // Expect to be called from scheduler thread
+  void Send(const std::vector<OutgoingMessage>& messages);
+
   // BEGIN WebSocketClientEventHandler
   void OnOpen() override;
-  void OnMessage(const char* msg) override;
+  void OnMessage(const char* msg, size_t length) override;
   void OnClose() override;
   void OnError(const WebSocketClientErrorData& error_data) override;
   // END WebSocketClientEventHandler
@@ -116,11 +134,32 @@ class Connection : public WebSocketClientEventHandler {
     kStateDisconnected
   };
 
-  // Combine incoming frames into one message, if the message is too large
-  void HandleIncomingFrame(const char* msg);
+  // Websocket events passed through decoder_, so that they are handled after
+  // the messages received before them.
+  enum DecoderMarker {
+    kDecoderMarkerClosed = 1,
+    kDecoderMarkerError,
+  };
+
+  // Serialize a client data message and append the frames to send for it to
+  // frames.  Large messages are split into several frames, prefixed by the
+  // number of frames.
+  void AppendFrames(const Variant& message, bool is_sensitive,
+                    std::vector<std::string>* frames);
+
+  // Triggered from the decoder thread whenever a message is decoded.
+  static void OnMessageDecoded(void* context);
+
+  // Take the next decoded message or websocket event from decoder_ and
+  // process it.  Called in scheduler thread once per decoded message.
+  void HandleDecodedMessage();
+
+  // Close the connection after the websocket was closed or failed.
+  void HandleWebSocketClosed();
+  void HandleWebSocketError();
 
-  // Parse the message into data message or control message
-  void ProcessMessage(const char* message);
+  // Handle the parsed message as data message or control message
+  void ProcessMessage(const Variant& message_data);
 
   // Forward the data message to higher-level
   void OnDataMessage(const Variant& data);
@@ -182,9 +221,9 @@ class Connection : public WebSocketClientEventHandler {
   // Event handler for higher level
   ConnectionEventHandler* event_handler_;
 
-  // Scheduler to make sure all WebSocketClient events are handled in worker
-  // thread.
-  scheduler::Scheduler* scheduler_;
+  // Scheduler strand to make sure all WebSocketClient events are handled in
+  // order, in worker thread.
+  scheduler::Strand* scheduler_;
 
   // Host info for websocket url
   const HostInfo host_info_;
@@ -203,9 +242,8 @@ class Connection : public WebSocketClientEventHandler {
   // to access in scheduler thread.
   scheduler::RequestHandle keep_alive_handler_;
 
-  // Incoming message buffer
-  std::stringstream incoming_buffer_;
-  uint32_t expected_incoming_frames_;
+  // Reassembles and parses incoming frames off the scheduler thread.
+  UniquePtr<FrameDecoder> decoder_;
 };
 
 // Event Handler interface for higher-level class to implement.
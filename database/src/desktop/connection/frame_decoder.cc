@@ -0,0 +1,231 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "database/src/desktop/connection/frame_decoder.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <sstream>
+
+#include "app/src/log.h"
+#include "app/src/time.h"
+#include "app/src/variant_util.h"
+
+namespace firebase {
+namespace database {
+namespace internal {
+namespace connection {
+
+// Number of frames which can wait for the decoder thread.  Frames are at most
+// 16KB, so this bounds the backlog to a few MB.
+static const size_t kFrameQueueCapacity = 256;
+
+// Number of decoded messages which can wait for the scheduler thread.
+static const size_t kMessageQueueCapacity = 64;
+
+void LatencyHistogram::Record(uint64_t microseconds) {
+  int index = 0;
+  while (microseconds > 0 && index < kNumBuckets - 1) {
+    microseconds >>= 1;
+    ++index;
+  }
+  buckets_[index].fetch_add(1);
+  count_.fetch_add(1);
+}
+
+uint64_t LatencyHistogram::Percentile(double percentile) const {
+  uint64_t total = count();
+  if (total == 0) return 0;
+
+  uint64_t target = static_cast<uint64_t>(total * percentile / 100.0);
+  if (target == 0) target = 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    seen += bucket(i);
+    if (seen >= target) return 1ULL << i;
+  }
+  return 1ULL << (kNumBuckets - 1);
+}
+
+std::string LatencyHistogram::ToString() const {
+  std::stringstream ss;
+  ss << "n=" << count();
+  if (count() > 0) {
+    ss << " p50<" << Percentile(50) << "us"
+       << " p99<" << Percentile(99) << "us"
+       << " max<" << Percentile(100) << "us";
+  }
+  return ss.str();
+}
+
+FrameDecoder::FrameDecoder(const std::string& log_id,
+                           MessageReadyCallback ready_callback, void* context)
+    : log_id_(log_id),
+      ready_callback_(ready_callback),
+      context_(context),
+      frames_(kFrameQueueCapacity),
+      messages_(kMessageQueueCapacity),
+      expected_incoming_frames_(0),
+      thread_(nullptr) {
+  assert(ready_callback_);
+  thread_ = MakeUnique<Thread>(DecodeRoutine, this);
+}
+
+FrameDecoder::~FrameDecoder() { Shutdown(); }
+
+void FrameDecoder::PushFrame(const char* data, size_t length) {
+  frames_.Push(Frame(data, length, ::firebase::internal::Timer::GetTicks()));
+}
+
+void FrameDecoder::PushMarker(int marker) {
+  assert(marker != 0);
+  Frame frame;
+  frame.marker = marker;
+  frames_.Push(Move(frame));
+}
+
+bool FrameDecoder::PopMessage(Variant* message, int* marker) {
+  assert(message);
+  assert(marker);
+  DecodedMessage decoded;
+  if (!messages_.TryPop(&decoded)) return false;
+  *marker = decoded.marker;
+  if (decoded.marker != 0) return true;
+
+  histograms_[kStageDispatch].Record(TicksToMicroseconds(
+      ::firebase::internal::Timer::GetTicks() - decoded.decoded_ticks));
+  *message = Move(decoded.message);
+  return true;
+}
+
+void FrameDecoder::Shutdown() {
+  frames_.Close();
+  messages_.Close();
+  if (thread_) {
+    thread_->Join();
+    thread_.reset(nullptr);
+  }
+}
+
+std::string FrameDecoder::GetLatencyReport() const {
+  std::stringstream ss;
+  ss << "queued: " << histograms_[kStageQueued].ToString()
+     << ", decode: " << histograms_[kStageDecode].ToString()
+     << ", dispatch: " << histograms_[kStageDispatch].ToString();
+  return ss.str();
+}
+
+void FrameDecoder::DecodeRoutine(void* data) {
+  assert(data != nullptr);
+  FrameDecoder* decoder = static_cast<FrameDecoder*>(data);
+
+  Frame frame;
+  while (decoder->frames_.Pop(&frame)) {
+    if (!decoder->HandleFrame(&frame)) break;
+  }
+}
+
+bool FrameDecoder::HandleFrame(Frame* frame) {
+  if (frame->marker != 0) {
+    DecodedMessage decoded;
+    decoded.marker = frame->marker;
+    return Emit(&decoded);
+  }
+
+  uint64_t start_ticks = ::firebase::internal::Timer::GetTicks();
+  histograms_[kStageQueued].Record(
+      TicksToMicroseconds(start_ticks - frame->received_ticks));
+
+  // Firebase server splits large message into multiple frames, the same way
+  // how client split large message into frames before sending.  If the received
+  // message is a number, this indicate how many frames to be expected in the
+  // future.
+  if (expected_incoming_frames_ > 0) {
+    // The first frame is taken over as is, and its size is used to reserve
+    // room for the remaining ones, which are at most as large.
+    size_t frame_length = frame->data.size();
+    if (incoming_buffer_.empty()) {
+      incoming_buffer_.swap(frame->data);
+      incoming_buffer_.reserve(incoming_buffer_.size() *
+                               expected_incoming_frames_);
+    } else {
+      incoming_buffer_.append(frame->data);
+    }
+    --expected_incoming_frames_;
+
+    LogDebug("%s Received a frame (length: %d), %d more to come",
+             log_id_.c_str(), static_cast<int>(frame_length),
+             expected_incoming_frames_);
+
+    // If buffer is complete, process it
+    if (expected_incoming_frames_ == 0) {
+      std::string message;
+      message.swap(incoming_buffer_);
+      return EmitMessage(message);
+    }
+    return true;
+  }
+
+  uint32_t num_of_frame = 0;
+  // The server is only supposed to send up to 9999 frames (i.e. length
+  // <= 4), but that isn't being enforced currently.  So allowing larger frame
+  // counts (length <= 6).
+  if (frame->data.size() <= 6) {
+    int32_t parse_value = strtol(frame->data.c_str(), nullptr, 10);  // NOLINT
+    if (parse_value > 0) {
+      num_of_frame = parse_value;
+    }
+  }
+
+  if (num_of_frame > 0) {
+    LogDebug("%s Received a frame count. Expecting %d frames later",
+             log_id_.c_str(), num_of_frame);
+
+    // Start the buffer
+    expected_incoming_frames_ = num_of_frame;
+    incoming_buffer_.clear();
+    return true;
+  }
+  return EmitMessage(frame->data);
+}
+
+bool FrameDecoder::EmitMessage(const std::string& json) {
+  uint64_t start_ticks = ::firebase::internal::Timer::GetTicks();
+
+  DecodedMessage decoded;
+  decoded.message = util::JsonToVariant(json.c_str());
+  decoded.decoded_ticks = ::firebase::internal::Timer::GetTicks();
+  histograms_[kStageDecode].Record(
+      TicksToMicroseconds(decoded.decoded_ticks - start_ticks));
+  LogDebug("%s Decoded message (length: %d)", log_id_.c_str(),
+           static_cast<int>(json.size()));
+  return Emit(&decoded);
+}
+
+bool FrameDecoder::Emit(DecodedMessage* decoded) {
+  if (!messages_.Push(Move(*decoded))) return false;
+  ready_callback_(context_);
+  return true;
+}
+
+uint64_t FrameDecoder::TicksToMicroseconds(uint64_t ticks) {
+  return static_cast<uint64_t>(
+      static_cast<double>(ticks) *
+      ::firebase::internal::Timer::GetTickPeriod() * 1000000.0);
+}
+
+}  // namespace connection
+}  // namespace internal
+}  // namespace database
+}  // namespace firebase
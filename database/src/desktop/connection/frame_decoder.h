@@ -0,0 +1,185 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FIREBASE_DATABASE_CLIENT_CPP_SRC_DESKTOP_CONNECTION_FRAME_DECODER_H_
+#define FIREBASE_DATABASE_CLIENT_CPP_SRC_DESKTOP_CONNECTION_FRAME_DECODER_H_
+
+#include <cstddef>
+#include <string>
+
+#include "app/memory/atomic.h"
+#include "app/memory/unique_ptr.h"
+#include "app/src/include/firebase/variant.h"
+#include "app/src/thread.h"
+#include "database/src/desktop/connection/spsc_queue.h"
+
+namespace firebase {
+namespace database {
+namespace internal {
+namespace connection {
+
+// Histogram of latencies in microseconds, with power-of-two buckets.  Samples
+// can be recorded from one thread while being read from another.
+class LatencyHistogram {
+ public:
+  // Bucket i counts the samples in [2^(i-1), 2^i) microseconds, bucket 0 the
+  // samples under 1us and the last bucket everything from ~8s up.
+  static const int kNumBuckets = 25;
+
+  LatencyHistogram() {}
+
+  void Record(uint64_t microseconds);
+
+  // Total number of samples recorded.
+  uint64_t count() const { return count_.load(); }
+
+  // Number of samples in the given bucket.
+  uint64_t bucket(int index) const { return buckets_[index].load(); }
+
+  // Upper bound, in microseconds, of the bucket containing the given
+  // percentile (0-100) of the samples.  0 if there is no sample.
+  uint64_t Percentile(double percentile) const;
+
+  // Human-readable summary, ex. "n=12 p50<64us p99<1024us max<2048us".
+  std::string ToString() const;
+
+ private:
+  LatencyHistogram(const LatencyHistogram&) = delete;
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+  compat::Atomic<uint64_t> buckets_[kNumBuckets];
+  compat::Atomic<uint64_t> count_;
+};
+
+// Reassembles and decodes incoming websocket frames into Variants on a
+// dedicated thread, so that parsing a large payload does not hold up the
+// scheduler thread which runs view processing and raises events.
+//
+// Frames go from the websocket thread to the decoder thread, and decoded
+// messages from the decoder thread to the scheduler thread, through bounded
+// single-producer/single-consumer queues.  Both hand-offs are first-in
+// first-out, so messages come out in the order their frames came in.  When a
+// queue is full the producer waits, which pushes back on the socket instead of
+// buffering without limit.
+class FrameDecoder {
+ public:
+  // Stages timed by the latency histograms.
+  enum Stage {
+    // From the frame being received until the decoder thread picks it up.
+    kStageQueued = 0,
+    // Reassembling and parsing the message on the decoder thread.
+    kStageDecode,
+    // From the message being decoded until the scheduler thread takes it.
+    kStageDispatch,
+    kStageCount
+  };
+
+  // Called on the decoder thread once per decoded message.  The receiver
+  // should arrange for PopMessage() to be called once on the consumer thread.
+  typedef void (*MessageReadyCallback)(void* context);
+
+  FrameDecoder(const std::string& log_id, MessageReadyCallback ready_callback,
+               void* context);
+  ~FrameDecoder();
+
+  // FrameDecoder is neither copyable nor movable.
+  FrameDecoder(const FrameDecoder&) = delete;
+  FrameDecoder& operator=(const FrameDecoder&) = delete;
+
+  // Queue a frame to be decoded.  data does not need to be null-terminated and
+  // is copied.  Should only be called from the websocket thread.
+  void PushFrame(const char* data, size_t length);
+
+  // Queue a marker, such as the end of the connection, which is handed to the
+  // consumer after the messages of all the frames pushed before it.  marker
+  // must not be 0.  Should only be called from the websocket thread.
+  void PushMarker(int marker);
+
+  // Take the next decoded message or marker.  marker is set to 0 for a
+  // message.  A message which could not be parsed as Json is returned as Null.
+  // Should only be called from the consumer thread.  Returns false if the
+  // decoder is shut down.
+  bool PopMessage(Variant* message, int* marker);
+
+  // Stop the decoder thread and drop anything still queued.  No frame is
+  // accepted anymore after this.  Safe to call more than once.
+  void Shutdown();
+
+  const LatencyHistogram& histogram(Stage stage) const {
+    return histograms_[stage];
+  }
+
+  // Summary of all the latency histograms, for logging.
+  std::string GetLatencyReport() const;
+
+ private:
+  struct Frame {
+    Frame() : received_ticks(0), marker(0) {}
+    Frame(const char* data, size_t length, uint64_t ticks)
+        : data(data, length), received_ticks(ticks), marker(0) {}
+
+    std::string data;
+    uint64_t received_ticks;
+    // Non-zero for a marker, which has no data.
+    int marker;
+  };
+
+  struct DecodedMessage {
+    DecodedMessage() : decoded_ticks(0), marker(0) {}
+
+    Variant message;
+    uint64_t decoded_ticks;
+    int marker;
+  };
+
+  // Thread routine of the decoder thread.
+  static void DecodeRoutine(void* data);
+
+  // Handle one frame in the decoder thread.  Returns false once the output
+  // queue is closed.
+  bool HandleFrame(Frame* frame);
+
+  // Parse a complete message and hand it to the consumer.
+  bool EmitMessage(const std::string& json);
+
+  // Hand a decoded message or a marker to the consumer.
+  bool Emit(DecodedMessage* decoded);
+
+  static uint64_t TicksToMicroseconds(uint64_t ticks);
+
+  std::string log_id_;
+
+  MessageReadyCallback ready_callback_;
+  void* context_;
+
+  // Queues between the websocket thread and the decoder thread, and between
+  // the decoder thread and the consumer.
+  SpscQueue<Frame> frames_;
+  SpscQueue<DecodedMessage> messages_;
+
+  // Reassembly state.  Only accessed in the decoder thread.
+  std::string incoming_buffer_;
+  uint32_t expected_incoming_frames_;
+
+  LatencyHistogram histograms_[kStageCount];
+
+  UniquePtr<Thread> thread_;
+};
+
+}  // namespace connection
+}  // namespace internal
+}  // namespace database
+}  // namespace firebase
+
+#endif  // FIREBASE_DATABASE_CLIENT_CPP_SRC_DESKTOP_CONNECTION_FRAME_DECODER_H_
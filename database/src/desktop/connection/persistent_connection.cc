@@ -86,6 +86,8 @@ const char* PersistentConnection::kServerDataTag = "t";
 const char* PersistentConnection::kServerDataWarnings = "w";
 const char* PersistentConnection::kServerResponseData = "d";
 
+const int PersistentConnection::kMaxPutsInFlight = 256;
+
 compat::Atomic<uint32_t> PersistentConnection::next_log_id_(0);
 
 // Util function to print QuerySpec in debug logs.
@@ -99,7 +101,7 @@ std::string GetDebugQuerySpecString(const QuerySpec& query_spec) {
 PersistentConnection::PersistentConnection(
     App* app, const HostInfo& info,
     PersistentConnectionEventHandler* event_handler,
-    scheduler::Scheduler* scheduler)
+    scheduler::Strand* scheduler)
     : app_(app),
       safe_this_(this),
       scheduler_(scheduler),
@@ -111,7 +113,9 @@ PersistentConnection::PersistentConnection(
       next_request_id_(0),
       force_auth_refresh_(false),
       next_listen_id_(0),
-      next_write_id_(0) {
+      next_write_id_(0),
+      next_put_to_send_(0),
+      puts_in_flight_(0) {
   assert(app);
   assert(scheduler);
   assert(event_handler_);
@@ -273,6 +277,8 @@ void PersistentConnection::OnDisconnect(Connection::DisconnectReason reason) {
   realtime_.reset(nullptr);
 
   request_map_.clear();
+  outgoing_requests_.clear();
+  puts_in_flight_ = 0;
 
   // TODO(chkuang): Implement Idle Check
   // this.hasOnDisconnects = false;
@@ -726,7 +732,7 @@ void PersistentConnection::PutInternal(const char* action, const Path& path,
       MakeUnique<OutstandingPut>(action, request, response);
 
   if (CanSendWrites()) {
-    SendPut(write_id);
+    SendQueuedPuts();
   }
 }
 
@@ -737,14 +743,28 @@ void PersistentConnection::SendPut(uint64_t write_id) {
   assert(it_put != outstanding_puts_.end());
 
   it_put->second->MarkSent();
+  next_put_to_send_ = write_id + 1;
+  ++puts_in_flight_;
   SendSensitive(it_put->second->action.c_str(), false, it_put->second->data,
                 it_put->second->response,
                 &PersistentConnection::HandlePutResponse, write_id);
 }
 
+void PersistentConnection::SendQueuedPuts() {
+  for (auto it_put = outstanding_puts_.lower_bound(next_put_to_send_);
+       it_put != outstanding_puts_.end() && puts_in_flight_ < kMaxPutsInFlight;
+       ++it_put) {
+    SendPut(it_put->first);
+  }
+}
+
 void PersistentConnection::HandlePutResponse(const Variant& message,
                                              const ResponsePtr& response,
                                              uint64_t outstanding_id) {
+  // Every put sent over the current connection gets exactly one response,
+  // even if the put was purged in the meantime.
+  if (puts_in_flight_ > 0) --puts_in_flight_;
+
   auto it_put = outstanding_puts_.find(outstanding_id);
   if (it_put != outstanding_puts_.end()) {
     auto& put_ptr = it_put->second;
@@ -763,6 +783,10 @@ void PersistentConnection::HandlePutResponse(const Variant& message,
         "%s Ignore on complete for put (%llu) because it was removed already.",
         log_id_.c_str(), outstanding_id);
   }
+
+  if (CanSendWrites()) {
+    SendQueuedPuts();
+  }
 }
 
 void PersistentConnection::CancelSentTransactions() {
@@ -823,13 +847,34 @@ void PersistentConnection::SendSensitive(const char* action, bool sensitive,
   request.map()[kRequestNumber] = rn;
   request.map()[kRequestAction] = action;
   request.map()[kRequestPayload] = message;
-  realtime_->Send(request, sensitive);
+  // Queue the request and send it together with the other requests made during
+  // this scheduler tick.
+  if (outgoing_requests_.empty()) {
+    scheduler_->Schedule(
+        new callback::CallbackValue1<ThisRef>(safe_this_, [](ThisRef ref) {
+          ThisRefLock lock(&ref);
+          if (lock.GetReference() != nullptr) {
+            lock.GetReference()->FlushOutgoingRequests();
+          }
+        }));
+  }
+  outgoing_requests_.push_back(Connection::OutgoingMessage(request, sensitive));
 
   // TODO(chkuang): Add timeout handle
   request_map_[rn] =
       MakeUnique<RequestData>(Move(response), callback, outstanding_id);
 }
 
+void PersistentConnection::FlushOutgoingRequests() {
+  // The queue is cleared on disconnect, so anything left here belongs to the
+  // current connection.
+  if (outgoing_requests_.empty() || !realtime_) return;
+
+  std::vector<Connection::OutgoingMessage> requests;
+  requests.swap(outgoing_requests_);
+  realtime_->Send(requests);
+}
+
 void PersistentConnection::RestoreOutstandingRequests() {
   assert(connection_state_ == kConnected);
 
@@ -842,9 +887,8 @@ void PersistentConnection::RestoreOutstandingRequests() {
   }
 
   // Restore puts
-  for (auto& it_put : outstanding_puts_) {
-    SendPut(it_put.first);
-  }
+  next_put_to_send_ = 0;
+  SendQueuedPuts();
 
   // Restore disconnect operations
   while (!outstanding_ondisconnects_.empty()) {
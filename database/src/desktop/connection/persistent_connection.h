@@ -103,7 +103,7 @@ class PersistentConnection : public ConnectionEventHandler {
 
   explicit PersistentConnection(App* app, const HostInfo& info,
                                 PersistentConnectionEventHandler* event_handler,
-                                scheduler::Scheduler* scheduler);
+                                scheduler::Strand* scheduler);
   ~PersistentConnection();
 
   // PersistentConnection is neither copyable nor movable.
@@ -358,6 +358,11 @@ class PersistentConnection : public ConnectionEventHandler {
 
   void SendPut(uint64_t write_id);
 
+  // Send the outstanding puts which have not been sent over the current
+  // connection yet, in write id order, as long as fewer than
+  // kMaxPutsInFlight puts are waiting for a response.
+  void SendQueuedPuts();
+
   void HandlePutResponse(const Variant& message, const ResponsePtr& response,
                          uint64_t outstanding_id);
 
@@ -373,6 +378,9 @@ class PersistentConnection : public ConnectionEventHandler {
                      ResponsePtr response, ConnectionResponseHandler callback,
                      uint64_t outstanding_id);
 
+  // Send all the requests queued by SendSensitive() since the last flush.
+  void FlushOutgoingRequests();
+
   // Restore outstanding requests created when connection is not established,
   // or before auth token is accepted by the server after the connection is
   // established.
@@ -407,6 +415,11 @@ class PersistentConnection : public ConnectionEventHandler {
 
   static Error StatusStringToErrorCode(const std::string& status);
 
+  // Maximum number of put and merge requests sent to the server and still
+  // waiting for a response.  Later writes are held back until earlier ones
+  // are acknowledged so that a burst of writes does not flood the socket.
+  static const int kMaxPutsInFlight;
+
   // Wire protocol data message keys and values
   static const char* kRequestError;
   static const char* kRequestQueries;
@@ -470,9 +483,9 @@ class PersistentConnection : public ConnectionEventHandler {
       ThisRefLock;
   ThisRef safe_this_;
 
-  // Scheduler to make sure all Connection events are handled in worker
-  // thread.
-  scheduler::Scheduler* scheduler_;
+  // Scheduler strand to make sure all Connection events are handled in order,
+  // in worker thread.
+  scheduler::Strand* scheduler_;
 
   // Host info for websocket url
   const HostInfo host_info_;
@@ -493,6 +506,10 @@ class PersistentConnection : public ConnectionEventHandler {
   uint64_t next_request_id_;
   std::map<uint64_t, RequestDataPtr> request_map_;
 
+  // Requests waiting to be sent by FlushOutgoingRequests().  Requests made
+  // during the same scheduler tick are sent to the connection together.
+  std::vector<Connection::OutgoingMessage> outgoing_requests_;
+
   // Auth
   std::string auth_token_;
   bool force_auth_refresh_;
@@ -526,6 +543,13 @@ class PersistentConnection : public ConnectionEventHandler {
 
   // Next write id for put requests
   uint64_t next_write_id_;
+
+  // Lowest write id which has not been sent over the current connection yet.
+  uint64_t next_put_to_send_;
+
+  // Number of puts sent over the current connection and still waiting for a
+  // response.
+  int puts_in_flight_;
 };
 
 class PersistentConnectionEventHandler {
@@ -0,0 +1,130 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FIREBASE_DATABASE_CLIENT_CPP_SRC_DESKTOP_CONNECTION_SPSC_QUEUE_H_
+#define FIREBASE_DATABASE_CLIENT_CPP_SRC_DESKTOP_CONNECTION_SPSC_QUEUE_H_
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+#include "app/memory/atomic.h"
+#include "app/meta/move.h"
+#include "app/src/semaphore.h"
+
+namespace firebase {
+namespace database {
+namespace internal {
+namespace connection {
+
+// A bounded first-in-first-out queue shared by exactly one producer thread and
+// one consumer thread.
+//
+// Push() blocks while the queue is full and Pop() blocks while it is empty.
+// Each slot is only ever touched by one side at a time, so the slots and the
+// read/write positions need no lock; the two semaphores counting free and
+// used slots provide the synchronization between the threads.
+//
+// Close() wakes up both sides.  Once closed, Push() and Pop() return false
+// immediately and any item still in the queue is dropped.
+template <typename T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity)
+      : slots_(capacity),
+        read_index_(0),
+        write_index_(0),
+        free_slots_(static_cast<int>(capacity)),
+        used_slots_(0),
+        closed_(0) {
+    assert(capacity > 0);
+  }
+
+  // SpscQueue is neither copyable nor movable.
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  // Add an item to the back of the queue, waiting for a free slot if needed.
+  // Should only be called from the producer thread.  Returns false if the queue
+  // has been closed.
+  bool Push(T item) {
+    free_slots_.Wait();
+    if (IsClosed()) {
+      // Pass the wake-up on to the next waiter, if any.
+      free_slots_.Post();
+      return false;
+    }
+    slots_[write_index_] = Move(item);
+    write_index_ = (write_index_ + 1) % slots_.size();
+    used_slots_.Post();
+    return true;
+  }
+
+  // Remove the item at the front of the queue, waiting for one if needed.
+  // Should only be called from the consumer thread.  Returns false if the queue
+  // has been closed.
+  bool Pop(T* item) {
+    used_slots_.Wait();
+    return PopAcquired(item);
+  }
+
+  // Same as Pop() but returns false immediately if the queue is empty.
+  bool TryPop(T* item) {
+    if (!used_slots_.TryWait()) return false;
+    return PopAcquired(item);
+  }
+
+  // Close the queue and wake up both the producer and the consumer.  Can be
+  // called from any thread.
+  void Close() {
+    closed_.store(1);
+    free_slots_.Post();
+    used_slots_.Post();
+  }
+
+  bool IsClosed() const { return closed_.load() != 0; }
+
+ private:
+  bool PopAcquired(T* item) {
+    assert(item);
+    if (IsClosed()) {
+      used_slots_.Post();
+      return false;
+    }
+    *item = Move(slots_[read_index_]);
+    slots_[read_index_] = T();
+    read_index_ = (read_index_ + 1) % slots_.size();
+    free_slots_.Post();
+    return true;
+  }
+
+  std::vector<T> slots_;
+
+  // Only accessed by the consumer thread.
+  size_t read_index_;
+
+  // Only accessed by the producer thread.
+  size_t write_index_;
+
+  Semaphore free_slots_;
+  Semaphore used_slots_;
+  compat::Atomic<int32_t> closed_;
+};
+
+}  // namespace connection
+}  // namespace internal
+}  // namespace database
+}  // namespace firebase
+
+#endif  // FIREBASE_DATABASE_CLIENT_CPP_SRC_DESKTOP_CONNECTION_SPSC_QUEUE_H_
@@ -37,6 +37,8 @@ WebSocketClientImpl::WebSocketClientImpl(
       process_queue_async_(nullptr),
       callback_queue_(),
       callback_queue_mutex_(Mutex::kModeNonRecursive),
+      outgoing_messages_(),
+      outgoing_messages_mutex_(Mutex::kModeNonRecursive),
       is_destructing_(0),
       websocket_(nullptr),
       user_agent_(user_agent) {
@@ -139,15 +141,50 @@ void WebSocketClientImpl::CloseSync() {
 void WebSocketClientImpl::Send(const char* msg) {
   assert(msg != nullptr);
 
-  ScheduleOnce(
-      [](WebSocketClientImpl* client, int, const std::string& msg) {
-        if (client->IsWebSocketAvailable()) {
-          client->websocket_->send(msg.c_str());
-        } else {
-          LogWarning("Cannot send message.  websocket is not available");
-        }
-      },
-      0, msg);
+  std::string msg_string(msg);
+  QueueMessages(&msg_string, 1);
+}
+
+void WebSocketClientImpl::Send(const std::vector<std::string>& msgs) {
+  if (msgs.empty()) return;
+  QueueMessages(msgs.data(), msgs.size());
+}
+
+void WebSocketClientImpl::QueueMessages(const std::string* msgs,
+                                        size_t count) {
+  bool was_empty;
+  {
+    MutexLock lock(outgoing_messages_mutex_);
+    was_empty = outgoing_messages_.empty();
+    outgoing_messages_.insert(outgoing_messages_.end(), msgs, msgs + count);
+  }
+
+  // Only the first queued message needs to wake up the event loop. The
+  // messages queued after it are sent by the same callback.
+  if (was_empty) {
+    ScheduleOnce([](WebSocketClientImpl* client, int,
+                    const std::string&) { client->SendQueuedMessages(); },
+                 0, "");
+  }
+}
+
+void WebSocketClientImpl::SendQueuedMessages() {
+  std::vector<std::string> msgs;
+  {
+    MutexLock lock(outgoing_messages_mutex_);
+    msgs.swap(outgoing_messages_);
+  }
+
+  if (msgs.empty()) return;
+
+  if (IsWebSocketAvailable()) {
+    for (const std::string& msg : msgs) {
+      websocket_->send(msg.c_str());
+    }
+  } else {
+    LogWarning("Cannot send %d message(s).  websocket is not available",
+               static_cast<int>(msgs.size()));
+  }
 }
 
 void WebSocketClientImpl::OnError(void* data) {
@@ -199,8 +236,7 @@ void WebSocketClientImpl::OnMessage(ClientWebSocket* ws, char* message,
       static_cast<WebSocketClientImpl*>(ws->getUserData());
 
   if (client->handler_) {
-    std::string message_string(message, length);
-    client->handler_->OnMessage(message_string.c_str());
+    client->handler_->OnMessage(message, length);
   }
 }
 
@@ -17,6 +17,7 @@
 
 #include <string>
 #include <queue>
+#include <vector>
 #include "app/memory/atomic.h"
 #include "app/memory/unique_ptr.h"
 #include "app/src/mutex.h"
@@ -43,6 +44,7 @@ class WebSocketClientImpl : public WebSocketClientInterface {
   void Connect(int timeout_ms) override;
   void Close() override;
   void Send(const char* msg) override;
+  void Send(const std::vector<std::string>& msgs) override;
   // END WebSocketClientInterface
 
  private:
@@ -81,6 +83,14 @@ class WebSocketClientImpl : public WebSocketClientInterface {
   // Process callback queue in event loop thread
   static void ProcessCallbackQueue(uS::Async* async);
 
+  // Queue messages to be sent and, if nothing was queued yet, schedule
+  // SendQueuedMessages() in the event loop.  A burst of Send() calls between
+  // two iterations of the event loop only wakes the loop up once.
+  void QueueMessages(const std::string* msgs, size_t count);
+
+  // Send all the queued messages.  Should only be called in event loop thread.
+  void SendQueuedMessages();
+
   // Check if the websocket is available and not closed.
   // Only call this in event loop.
   bool IsWebSocketAvailable() const;
@@ -97,6 +107,14 @@ class WebSocketClientImpl : public WebSocketClientInterface {
 
   // The access point for uWebSockets which contains event loops and
   // different sockets.
+  //
+  // Note that messages are neither compressed nor expected to be compressed.
+  // The extension options passed to uWS::Hub only apply to server sockets, and
+  // the uWebSockets version used here always creates client sockets with
+  // permessage-deflate disabled and does not send or parse
+  // Sec-WebSocket-Extensions during the client handshake.  Advertising the
+  // extension through the extra headers in Connect() would make the server
+  // send frames with RSV1 set, which the client rejects as a protocol error.
   uWS::Hub hub_;
 
   // The handler to keep the event loop of hub_ alive even there is no
@@ -135,6 +153,13 @@ class WebSocketClientImpl : public WebSocketClientInterface {
   // Mutex to guard callback_queue_
   Mutex callback_queue_mutex_;
 
+  // Messages waiting to be sent in the event loop thread.
+  std::vector<std::string> outgoing_messages_;
+
+  // Mutex to guard outgoing_messages_.  Separate from callback_queue_mutex_
+  // since the latter is held while the queued callbacks are run.
+  Mutex outgoing_messages_mutex_;
+
   // Flagged when this object starts to be destructed.  This helps the other
   // thread to handle situation accordingly, ex. if the connection is
   // established after this object starts to be deleted.  Note that this flag is
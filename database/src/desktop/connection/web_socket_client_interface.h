@@ -15,7 +15,9 @@
 #ifndef FIREBASE_DATABASE_CLIENT_CPP_SRC_DESKTOP_CONNECTION_WEB_SOCKET_CLIENT_INTERFACE_H_
 #define FIREBASE_DATABASE_CLIENT_CPP_SRC_DESKTOP_CONNECTION_WEB_SOCKET_CLIENT_INTERFACE_H_
 
+#include <cstddef>
 #include <string>
+#include <vector>
 
 namespace firebase {
 namespace database {
@@ -37,6 +39,15 @@ class WebSocketClientInterface {
 
   // Request to send message to the connected server
   virtual void Send(const char* msg) = 0;
+
+  // Request to send several messages to the connected server, in order.
+  // Implementations can override this to hand the whole batch to the socket at
+  // once instead of one message at a time.
+  virtual void Send(const std::vector<std::string>& msgs) {
+    for (const std::string& msg : msgs) {
+      Send(msg.c_str());
+    }
+  }
 };
 
 // Context when OnError occurs.  Currently only contains the uri.
@@ -59,8 +70,10 @@ class WebSocketClientEventHandler {
   // Called when the connection is established
   virtual void OnOpen() = 0;
 
-  // Called when a message from the server is received
-  virtual void OnMessage(const char* msg) = 0;
+  // Called when a message from the server is received.  msg is not
+  // null-terminated and is only valid during the call, so the handler must copy
+  // whatever it needs to keep.
+  virtual void OnMessage(const char* msg, size_t length) = 0;
 
   // Called when the connection is closed
   virtual void OnClose() = 0;
@@ -28,7 +28,7 @@ CompoundWrite CompoundWrite::FromChildMerge(
     write_tree.SetValueAt(Path(string_variant_pair.first),
                           string_variant_pair.second);
   }
-  return CompoundWrite(write_tree);
+  return CompoundWrite(std::move(write_tree));
 }
 
 CompoundWrite CompoundWrite::FromVariantMerge(const Variant& merge) {
@@ -42,7 +42,7 @@ CompoundWrite CompoundWrite::FromVariantMerge(const Variant& merge) {
   } else {
     write_tree.set_value(merge);
   }
-  return CompoundWrite(write_tree);
+  return CompoundWrite(std::move(write_tree));
 }
 
 CompoundWrite CompoundWrite::FromPathMerge(
@@ -52,46 +52,16 @@ CompoundWrite CompoundWrite::FromPathMerge(
     write_tree.SetValueAt(string_variant_pair.first,
                           string_variant_pair.second);
   }
-  return CompoundWrite(write_tree);
+  return CompoundWrite(std::move(write_tree));
 }
 
 CompoundWrite CompoundWrite::EmptyWrite() { return CompoundWrite(); }
 
 CompoundWrite CompoundWrite::AddWrite(const Path& path,
                                       const Optional<Variant>& variant) const {
-  if (path.empty()) {
-    return CompoundWrite(Tree<Variant>(variant));
-  } else {
-    Optional<Path> root_most_path = write_tree_.FindRootMostPathWithValue(path);
-    if (root_most_path.has_value()) {
-      // GetRelative is guaranteed to succeed - the call to
-      // FindRootMostPathWithValue is always going to get the beginning segment
-      // of the path, so this call just gets the remainder.
-      // TODO(amablue): Consider making FindRootMostPathWithValue also return
-      // the remainder and not just the root most path.
-      Optional<Path> relative_path = Path::GetRelative(*root_most_path, path);
-      const Variant* value = write_tree_.GetValueAt(root_most_path.value());
-      std::vector<std::string> directories = relative_path->GetDirectories();
-      std::string back = directories.empty() ? "" : directories.back();
-      const Variant* internal_variant =
-          GetInternalVariant(value, relative_path->GetParent());
-      if (!relative_path->empty() && back == ".priority" &&
-          (internal_variant == nullptr || internal_variant->is_null())) {
-        // Ignore priority updates on empty variants
-        return *this;
-      } else {
-        CompoundWrite result = *this;
-        Variant updated_variant = *value;
-        *MakeVariantAtPath(&updated_variant, *relative_path) = *variant;
-        result.write_tree_.SetValueAt(*root_most_path, updated_variant);
-        return result;
-      }
-    } else {
-      CompoundWrite result = *this;
-      result.write_tree_.SetValueAt(path, variant);
-      return result;
-    }
-  }
+  CompoundWrite result(*this);
+  result.AddWriteInPlace(path, variant);
+  return result;
 }
 
 CompoundWrite CompoundWrite::AddWrite(const Path& path,
@@ -111,26 +81,93 @@ CompoundWrite CompoundWrite::AddWrite(const std::string& key,
 
 CompoundWrite CompoundWrite::AddWrites(const Path& path,
                                        const CompoundWrite& updates) const {
-  return updates.write_tree_.Fold(
-      *this, [&path](Path relative_path, Variant value, CompoundWrite accum) {
-        return accum.AddWrite(path.GetChild(relative_path),
-                              Optional<Variant>(value));
-      });
+  CompoundWrite result(*this);
+  result.AddWritesInPlace(path, updates);
+  return result;
 }
 
 CompoundWrite CompoundWrite::RemoveWrite(const Path& path) const {
+  CompoundWrite result(*this);
+  result.RemoveWriteInPlace(path);
+  return result;
+}
+
+void CompoundWrite::AddWriteInPlace(const Path& path,
+                                    const Optional<Variant>& variant) {
   if (path.empty()) {
-    return CompoundWrite();
-  } else {
-    CompoundWrite result(*this);
-    Tree<Variant>* subtree = result.write_tree_.GetChild(path);
-    if (subtree) {
-      subtree->children().clear();
-      subtree->value().reset();
+    write_tree_ = MakeShared<Tree<Variant>>(variant);
+    return;
+  }
+  Optional<Path> root_most_path = write_tree().FindRootMostPathWithValue(path);
+  if (root_most_path.has_value()) {
+    // GetRelative is guaranteed to succeed - the call to
+    // FindRootMostPathWithValue is always going to get the beginning segment
+    // of the path, so this call just gets the remainder.
+    // TODO(amablue): Consider making FindRootMostPathWithValue also return
+    // the remainder and not just the root most path.
+    Optional<Path> relative_path = Path::GetRelative(*root_most_path, path);
+    const Variant* value = write_tree().GetValueAt(root_most_path.value());
+    std::vector<std::string> directories = relative_path->GetDirectories();
+    std::string back = directories.empty() ? "" : directories.back();
+    const Variant* internal_variant =
+        GetInternalVariant(value, relative_path->GetParent());
+    if (!relative_path->empty() && back == ".priority" &&
+        (internal_variant == nullptr || internal_variant->is_null())) {
+      // Ignore priority updates on empty variants
+      return;
     }
-    return result;
+    Variant* updated_variant =
+        MutableWriteTree()->GetValueAt(root_most_path.value());
+    *MakeVariantAtPath(updated_variant, *relative_path) = *variant;
+  } else {
+    MutableWriteTree()->SetValueAt(path, variant);
+  }
+}
+
+void CompoundWrite::AddWriteInPlace(const Path& path, const Variant& value) {
+  AddWriteInPlace(path, Optional<Variant>(value));
+}
+
+void CompoundWrite::AddWritesInPlace(const Path& path,
+                                     const CompoundWrite& updates) {
+  if (&updates == this) {
+    // Iterate over a snapshot, as the tree is about to be modified.
+    CompoundWrite updates_copy(updates);
+    AddWritesInPlace(path, updates_copy);
+    return;
   }
-  return CompoundWrite();
+  updates.write_tree().Fold(
+      Path(),
+      [&path](const Path& relative_path, const Variant& value,
+              CompoundWrite* accum) {
+        accum->AddWriteInPlace(path.GetChild(relative_path), value);
+        return accum;
+      },
+      this);
+}
+
+void CompoundWrite::RemoveWriteInPlace(const Path& path) {
+  if (path.empty()) {
+    write_tree_.reset();
+  } else if (write_tree().GetChild(path) != nullptr) {
+    Tree<Variant>* subtree = MutableWriteTree()->GetChild(path);
+    subtree->children().clear();
+    subtree->value().reset();
+  }
+}
+
+Tree<Variant>* CompoundWrite::MutableWriteTree() {
+  if (!write_tree_) {
+    write_tree_ = MakeShared<Tree<Variant>>();
+  } else if (write_tree_.use_count() > 1) {
+    write_tree_ = MakeShared<Tree<Variant>>(*write_tree_);
+  }
+  return write_tree_.get();
+}
+
+const Tree<Variant>& CompoundWrite::EmptyTree() {
+  static const Tree<Variant>* empty_tree = new Tree<Variant>();
+  return *empty_tree;
 }
 
 bool CompoundWrite::HasCompleteWrite(const Path& path) const {
@@ -138,14 +175,14 @@ bool CompoundWrite::HasCompleteWrite(const Path& path) const {
 }
 
 const Optional<Variant>& CompoundWrite::GetRootWrite() const {
-  return write_tree_.value();
+  return write_tree().value();
 }
 
 Optional<Variant> CompoundWrite::GetCompleteVariant(const Path& path) const {
-  Optional<Path> root_most = write_tree_.FindRootMostPathWithValue(path);
+  Optional<Path> root_most = write_tree().FindRootMostPathWithValue(path);
   if (root_most.has_value()) {
     const Path& root_most_path = root_most.value();
-    const Variant* root_most_value = write_tree_.GetValueAt(root_most_path);
+    const Variant* root_most_value = write_tree().GetValueAt(root_most_path);
     Optional<Path> remaining_path = Path::GetRelative(root_most_path, path);
     return OptionalFromPointer(
         GetInternalVariant(root_most_value, *remaining_path));
@@ -158,14 +195,14 @@ std::vector<std::pair<Variant, Variant>> CompoundWrite::GetCompleteChildren()
     const {
   std::vector<std::pair<Variant, Variant>> children;
   if (GetRootWrite().has_value()) {
-    const Variant* value = GetVariantValue(&write_tree_.value().value());
+    const Variant* value = GetVariantValue(&write_tree().value().value());
     if (value->is_map()) {
       for (auto& entry : value->map()) {
         children.push_back(entry);
       }
     }
   } else {
-    for (auto& entry : write_tree_.children()) {
+    for (auto& entry : write_tree().children()) {
       const std::string& key = entry.first;
       const Tree<Variant>& subtree = entry.second;
       if (subtree.value().has_value()) {
@@ -185,7 +222,7 @@ CompoundWrite CompoundWrite::ChildCompoundWrite(const Path& path) const {
       return CompoundWrite(Tree<Variant>(shadowing_variant));
     } else {
       // Let the constructor extract the priority update.
-      const Tree<Variant>* subtree = write_tree_.GetChild(path);
+      const Tree<Variant>* subtree = write_tree().GetChild(path);
       return subtree ? CompoundWrite(*subtree) : CompoundWrite();
     }
   }
@@ -194,7 +231,7 @@ CompoundWrite CompoundWrite::ChildCompoundWrite(const Path& path) const {
 std::map<std::string, CompoundWrite> CompoundWrite::ChildCompoundWrites()
     const {
   std::map<std::string, CompoundWrite> children;
-  for (auto& key_subtree_pair : write_tree_.children()) {
+  for (auto& key_subtree_pair : write_tree().children()) {
     const std::string& key = key_subtree_pair.first;
     const Tree<Variant>& subtree = key_subtree_pair.second;
     children[key] = CompoundWrite(subtree);
@@ -202,10 +239,10 @@ std::map<std::string, CompoundWrite> CompoundWrite::ChildCompoundWrites()
   return children;
 }
 
-bool CompoundWrite::IsEmpty() const { return write_tree_.IsEmpty(); }
+bool CompoundWrite::IsEmpty() const { return write_tree().IsEmpty(); }
 
 Variant CompoundWrite::Apply(const Variant& variant) const {
-  return ApplySubtreeWrite(Path::GetRoot(), &write_tree_, variant);
+  return ApplySubtreeWrite(Path::GetRoot(), &write_tree(), variant);
 }
 
 Variant CompoundWrite::ApplySubtreeWrite(const Path& relative_path,
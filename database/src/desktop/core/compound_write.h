@@ -17,6 +17,8 @@
 
 #include <map>
 #include <string>
+#include <utility>
+#include "app/memory/shared_ptr.h"
 #include "app/src/include/firebase/variant.h"
 #include "app/src/path.h"
 #include "database/src/desktop/core/tree.h"
@@ -30,6 +32,11 @@ namespace internal {
 // multiple nested writes. At any given path there is only allowed to be one
 // write modifying that path. Any write to an existing path or shadowing an
 // existing path will modify that existing write to reflect the write added.
+//
+// Copies of a CompoundWrite share the same underlying tree, so copying one is
+// cheap. The tree is only duplicated when a CompoundWrite that shares it is
+// modified in place, which lets large writes be built up with the *InPlace
+// methods in linear time and then handed around by value.
 class CompoundWrite {
  public:
   CompoundWrite() : write_tree_() {}
@@ -37,7 +44,9 @@ class CompoundWrite {
   // Create a compound write from a tree of variants, where each variant in the
   // tree represents a write at that location.
   explicit CompoundWrite(const Tree<Variant>& write_tree)
-      : write_tree_(write_tree) {}
+      : write_tree_(MakeShared<Tree<Variant>>(write_tree)) {}
+  explicit CompoundWrite(Tree<Variant>&& write_tree)
+      : write_tree_(MakeShared<Tree<Variant>>(std::move(write_tree))) {}
 
   // Create a CompoundWrite from a map of strings (that represent database
   // Paths) to Variants, where each variant in the map represents a write at the
@@ -77,6 +86,14 @@ class CompoundWrite {
   // Returns the new WriteCompound with the removed path
   CompoundWrite RemoveWrite(const Path& path) const;
 
+  // Same as AddWrite, AddWrites and RemoveWrite, but modify this CompoundWrite
+  // instead of returning a new one. Prefer these when applying many writes in
+  // a row, as they avoid copying the tree for each write.
+  void AddWriteInPlace(const Path& path, const Optional<Variant>& value);
+  void AddWriteInPlace(const Path& path, const Variant& value);
+  void AddWritesInPlace(const Path& path, const CompoundWrite& updates);
+  void RemoveWriteInPlace(const Path& path);
+
   // Returns whether this CompoundWrite will fully overwrite a node at a given
   // location and can therefore be considered "complete".
   bool HasCompleteWrite(const Path& path) const;
@@ -107,10 +124,12 @@ class CompoundWrite {
   // writes from this CompoundWrite applied to the variant.
   Variant Apply(const Variant& variant) const;
 
-  const Tree<Variant>& write_tree() const { return write_tree_; }
+  const Tree<Variant>& write_tree() const {
+    return write_tree_ ? *write_tree_ : EmptyTree();
+  }
 
   bool operator==(const CompoundWrite& other) const {
-    return write_tree_ == other.write_tree_;
+    return write_tree() == other.write_tree();
   }
 
   bool operator!=(const CompoundWrite& other) const {
@@ -122,7 +141,16 @@ class CompoundWrite {
                             const Tree<Variant>* write_tree,
                             Variant node) const;
 
-  Tree<Variant> write_tree_;
+  // Return the tree for modification, first making a private copy of it if it
+  // is shared with any other CompoundWrite.
+  Tree<Variant>* MutableWriteTree();
+
+  static const Tree<Variant>& EmptyTree();
+
+  // The tree of writes. This may be shared between copies of this
+  // CompoundWrite and must not be modified except through MutableWriteTree().
+  // An empty pointer is equivalent to an empty tree.
+  SharedPtr<Tree<Variant>> write_tree_;
 };
 
 }  // namespace internal
@@ -39,7 +39,10 @@ using callback::NewCallback;
 namespace database {
 namespace internal {
 
-scheduler::Scheduler Repo::s_scheduler_;
+// Number of worker threads triggering the callbacks of all the Repos.
+static const int kSchedulerWorkerCount = 4;
+
+scheduler::Scheduler Repo::s_scheduler_(kSchedulerWorkerCount);
 
 // Transaction Response class to pass to PersistentConnection.
 // This is used to capture all the data to use when ResponseCallback is
@@ -71,6 +74,7 @@ class TransactionResponse : public connection::Response {
 
 Repo::Repo(App* app, DatabaseInternal* database, const char* url)
     : database_(database),
+      strand_(&s_scheduler_),
       host_info_(),
       connection_(),
       next_write_id_(0),
@@ -86,11 +90,11 @@ Repo::Repo(App* app, DatabaseInternal* database, const char* url)
   url_ = host_info_.ToString();
 
   connection_.reset(new connection::PersistentConnection(app, host_info_, this,
-                                                         &s_scheduler_));
+                                                         &strand_));
   connection_->ScheduleInitialize();
 
   // Kick off any expensive additional initialization
-  s_scheduler_.Schedule(NewCallback(
+  strand_.Schedule(NewCallback(
       [](ThisRef ref) {
         ThisRefLock lock(&ref);
         if (lock.GetReference() != nullptr) {
@@ -100,7 +104,12 @@ Repo::Repo(App* app, DatabaseInternal* database, const char* url)
       safe_this_));
 }
 
-Repo::~Repo() { safe_this_.ClearReference(); }
+Repo::~Repo() {
+  safe_this_.ClearReference();
+  // No callback runs on the strand anymore, and the writes still held back
+  // will never be sent.
+  CancelCoalescedWrites();
+}
 
 void Repo::AddEventCallback(UniquePtr<EventRegistration> event_registration) {
   PostEvents(server_sync_tree_->AddEventRegistration(Move(event_registration)));
@@ -162,7 +171,7 @@ void Repo::OnDisconnectSetValue(const SafeFutureHandle<void>& handle,
         response->MarkComplete();
       });
 
-  Repo::scheduler().Schedule(NewCallback(
+  strand_.Schedule(NewCallback(
       [](ThisRef ref, connection::ResponsePtr ptr) {
         ThisRefLock lock(&ref);
         if (lock.GetReference() != nullptr) {
@@ -191,7 +200,7 @@ void Repo::OnDisconnectCancel(const SafeFutureHandle<void>& handle,
         response->MarkComplete();
       });
 
-  Repo::scheduler().Schedule(NewCallback(
+  strand_.Schedule(NewCallback(
       [](ThisRef ref, connection::ResponsePtr ptr) {
         ThisRefLock lock(&ref);
         if (lock.GetReference() != nullptr) {
@@ -228,7 +237,7 @@ void Repo::OnDisconnectUpdate(const SafeFutureHandle<void>& handle,
         response->MarkComplete();
       });
 
-  Repo::scheduler().Schedule(NewCallback(
+  strand_.Schedule(NewCallback(
       [](ThisRef ref, connection::ResponsePtr ptr) {
         ThisRefLock lock(&ref);
         if (lock.GetReference() != nullptr) {
@@ -245,6 +254,7 @@ void Repo::OnDisconnectUpdate(const SafeFutureHandle<void>& handle,
 void Repo::PurgeOutstandingWrites() {
   std::vector<Event> events = server_sync_tree_->RemoveAllWrites();
   PostEvents(events);
+  CancelCoalescedWrites();
   // Abort any transactions
   AbortTransactions(Path(), kErrorWriteCanceled);
   // Remove outstanding writes from connection
@@ -256,21 +266,22 @@ void Repo::PurgeOutstandingWrites() {
 // triggered.
 class SetValueResponse : public connection::Response {
  public:
+  typedef std::pair<ReferenceCountedFutureImpl*, SafeFutureHandle<void>>
+      WriteFuture;
+
   SetValueResponse(const DatabaseInternal::ThisRef& database, const Path& path,
-                   WriteId write_id, ReferenceCountedFutureImpl* api,
-                   SafeFutureHandle<void> handle, ResponseCallback callback)
+                   WriteId write_id, std::vector<WriteFuture> futures,
+                   ResponseCallback callback)
       : connection::Response(callback),
         database_ref_(database),
         path_(path),
         write_id_(write_id),
-        api_(api),
-        handle_(handle) {}
+        futures_(std::move(futures)) {}
 
   DatabaseInternal::ThisRef& database_ref() { return database_ref_; }
   const Path& path() { return path_; }
   WriteId write_id() { return write_id_; }
-  ReferenceCountedFutureImpl* api() { return api_; }
-  SafeFutureHandle<void> handle() { return handle_; }
+  const std::vector<WriteFuture>& futures() { return futures_; }
 
  private:
   // Database reference
@@ -281,14 +292,19 @@ class SetValueResponse : public connection::Response {
 
   WriteId write_id_;
 
-  ReferenceCountedFutureImpl* api_;
-
-  SafeFutureHandle<void> handle_;
+  // The Future of the write, followed by the Futures of any writes that were
+  // coalesced into it.
+  std::vector<WriteFuture> futures_;
 };
 
 void Repo::SetValue(const Path& path, const Variant& new_data_unresolved,
                     ReferenceCountedFutureImpl* api,
-                    SafeFutureHandle<void> handle) {
+                    SafeFutureHandle<void> handle,
+                    scheduler::ScheduleTimeMs coalescing_window_ms) {
+  if (coalescing_window_ms == 0) {
+    FlushCoalescedWrites();
+  }
+
   Variant server_values = GenerateServerValues();
   Variant new_data =
       ResolveDeferredValueSnapshot(new_data_unresolved, server_values);
@@ -299,11 +315,58 @@ void Repo::SetValue(const Path& path, const Variant& new_data_unresolved,
       kPersist);
   PostEvents(events);
 
+  if (coalescing_window_ms == 0) {
+    SendSetValue(path, new_data_unresolved, write_id,
+                 std::vector<WriteFuture>{WriteFuture(api, handle)});
+  } else {
+    CoalescedWrite write(path, new_data_unresolved);
+    write.futures.push_back(WriteFuture(api, handle));
+
+    // Any held back write at or below this path has not reached the server and
+    // is completely shadowed by this one, so drop it and let this write carry
+    // its Futures. Removing a shadowed write raises no events and deletes its
+    // persisted record.
+    bool replaced_write = false;
+    for (auto it = coalesced_writes_.begin(); it != coalesced_writes_.end();) {
+      if (it->second.path.StartsWith(path)) {
+        PostEvents(
+            server_sync_tree_->AckUserWrite(it->first, kAckRevert, kPersist));
+        write.futures.insert(write.futures.end(), it->second.futures.begin(),
+                             it->second.futures.end());
+        it = coalesced_writes_.erase(it);
+        replaced_write = true;
+      } else {
+        ++it;
+      }
+    }
+    coalesced_writes_.insert(std::make_pair(write_id, std::move(write)));
+
+    // A replaced write already has a flush scheduled, which this write
+    // inherits, so it is never held back longer than the window.
+    if (!replaced_write) {
+      strand_.Schedule(NewCallback(
+                           [](ThisRef ref) {
+                             ThisRefLock lock(&ref);
+                             if (lock.GetReference() != nullptr) {
+                               lock.GetReference()->FlushCoalescedWrites();
+                             }
+                           },
+                           safe_this_),
+                       coalescing_window_ms);
+    }
+  }
+
+  Path affected_path = AbortTransactions(path, kErrorOverriddenBySet);
+  RerunTransactions(affected_path);
+}
+
+void Repo::SendSetValue(const Path& path, const Variant& data,
+                        WriteId write_id, std::vector<WriteFuture> futures) {
   connection_->Put(
-      path, new_data_unresolved,
+      path, data,
       MakeShared<SetValueResponse>(
-          DatabaseInternal::ThisRef(database_), path, write_id, api, handle,
-          [](const connection::ResponsePtr& ptr) {
+          DatabaseInternal::ThisRef(database_), path, write_id,
+          std::move(futures), [](const connection::ResponsePtr& ptr) {
             auto* response = static_cast<SetValueResponse*>(ptr.get());
             DatabaseInternal::ThisRefLock lock(&response->database_ref());
             DatabaseInternal* database = lock.GetReference();
@@ -311,13 +374,31 @@ void Repo::SetValue(const Path& path, const Variant& new_data_unresolved,
             repo->AckWriteAndRerunTransactions(response->write_id(),
                                                response->path(),
                                                response->GetErrorCode());
-            response->api()->Complete(
-                response->handle(), response->GetErrorCode(),
-                GetErrorMessage(response->GetErrorCode()));
+            for (const WriteFuture& future : response->futures()) {
+              future.first->Complete(
+                  future.second, response->GetErrorCode(),
+                  GetErrorMessage(response->GetErrorCode()));
+            }
           }));
+}
 
-  Path affected_path = AbortTransactions(path, kErrorOverriddenBySet);
-  RerunTransactions(affected_path);
+void Repo::FlushCoalescedWrites() {
+  std::map<WriteId, CoalescedWrite> writes;
+  writes.swap(coalesced_writes_);
+  for (auto& entry : writes) {
+    CoalescedWrite& write = entry.second;
+    SendSetValue(write.path, write.data, entry.first, std::move(write.futures));
+  }
+}
+
+void Repo::CancelCoalescedWrites() {
+  for (auto& entry : coalesced_writes_) {
+    for (const WriteFuture& future : entry.second.futures) {
+      future.first->Complete(future.second, kErrorWriteCanceled,
+                             GetErrorMessage(kErrorWriteCanceled));
+    }
+  }
+  coalesced_writes_.clear();
 }
 
 void Repo::UpdateChildren(const Path& path, const Variant& data,
@@ -330,6 +411,8 @@ void Repo::UpdateChildren(const Path& path, const Variant& data,
     return;
   }
 
+  FlushCoalescedWrites();
+
   // Start with our existing data and merge each child into it.
   // std::map<std::string, Variant> serverValues =
   const CompoundWrite& resolved = updates;
@@ -342,7 +425,8 @@ void Repo::UpdateChildren(const Path& path, const Variant& data,
   connection_->Merge(
       path, data,
       MakeShared<SetValueResponse>(
-          DatabaseInternal::ThisRef(database_), path, write_id, api, handle,
+          DatabaseInternal::ThisRef(database_), path, write_id,
+          std::vector<WriteFuture>{WriteFuture(api, handle)},
           [](const connection::ResponsePtr& ptr) {
             auto* response = static_cast<SetValueResponse*>(ptr.get());
             DatabaseInternal::ThisRefLock lock(&response->database_ref());
@@ -351,9 +435,9 @@ void Repo::UpdateChildren(const Path& path, const Variant& data,
             repo->AckWriteAndRerunTransactions(response->write_id(),
                                                response->path(),
                                                response->GetErrorCode());
-            response->api()->Complete(
-                response->handle(), response->GetErrorCode(),
-                GetErrorMessage(response->GetErrorCode()));
+            const WriteFuture& future = response->futures().front();
+            future.first->Complete(future.second, response->GetErrorCode(),
+                                   GetErrorMessage(response->GetErrorCode()));
           }));
 
   updates.write_tree().CallOnEach(
@@ -706,6 +790,10 @@ void Repo::SendTransactionQueue(const std::vector<TransactionDataPtr>& queue,
   LogDebug("SendTransactionQueue @ %s (# of transaction : %d)", path.c_str(),
            static_cast<int>(queue.size()));
 
+  // The transaction was run against local data that includes any held back
+  // writes, so they have to reach the server first.
+  FlushCoalescedWrites();
+
   std::vector<WriteId> sets_to_ignore;
   for (const TransactionDataPtr& transaction : queue) {
     sets_to_ignore.push_back(transaction->current_write_id);
@@ -939,7 +1027,7 @@ void Repo::RerunTransactionQueue(const std::vector<TransactionDataPtr>& queue,
       // Removing a callback can trigger pruning which can muck with
       // merged_data/visible_data (as it prunes data). So defer removing the
       // callback until later.
-      Repo::scheduler().Schedule(NewCallback(
+      strand_.Schedule(NewCallback(
           [](Repo* repo, TransactionDataPtr transaction) {
             repo->RemoveEventCallback(transaction->outstanding_listener.get(),
                                       QuerySpec(transaction->path));
@@ -15,6 +15,8 @@
 #ifndef FIREBASE_DATABASE_CLIENT_CPP_SRC_DESKTOP_CORE_REPO_H_
 #define FIREBASE_DATABASE_CLIENT_CPP_SRC_DESKTOP_CORE_REPO_H_
 
+#include <map>
+#include <utility>
 #include <vector>
 
 #include "app/memory/unique_ptr.h"
@@ -68,8 +70,13 @@ class Repo : public connection::PersistentConnectionEventHandler {
 
   void PurgeOutstandingWrites();
 
+  // Overwrite the data at the given path. If coalescing_window_ms is non-zero
+  // the write may be held back for up to that many milliseconds before it is
+  // sent, so that a later SetValue on the same path or one of its ancestors
+  // can replace it. Local events are raised immediately either way.
   void SetValue(const Path& path, const Variant& data,
-                ReferenceCountedFutureImpl* api, SafeFutureHandle<void> handle);
+                ReferenceCountedFutureImpl* api, SafeFutureHandle<void> handle,
+                scheduler::ScheduleTimeMs coalescing_window_ms = 0);
 
   void UpdateChildren(const Path& path, const Variant& data,
                       ReferenceCountedFutureImpl* api,
@@ -105,11 +112,48 @@ class Repo : public connection::PersistentConnectionEventHandler {
 
   const std::string& url() const { return url_; }
 
-  static scheduler::Scheduler& scheduler() { return s_scheduler_; }
+  // Strand for everything done on this Repo and its connection.  They run in
+  // order with each other, and in parallel with other Repos.
+  scheduler::Strand& strand() { return strand_; }
 
  private:
+  // The Future of a write request, completed when the server responds.
+  typedef std::pair<ReferenceCountedFutureImpl*, SafeFutureHandle<void>>
+      WriteFuture;
+
+  // A SetValue that has been applied locally but whose put is being held back
+  // so that later writes to the same location can replace it.
+  struct CoalescedWrite {
+    CoalescedWrite(const Path& path, const Variant& data)
+        : path(path), data(data), futures() {}
+
+    // Location of the write.
+    Path path;
+
+    // The data to send, with server values not yet resolved.
+    Variant data;
+
+    // The Future of this write followed by the Futures of every write it
+    // replaced. All of them complete with the result of the single put.
+    std::vector<WriteFuture> futures;
+  };
+
   WriteId GetNextWriteId();
 
+  // Send a put for an overwrite that has already been applied to the sync
+  // tree, completing every Future in futures once the server responds.
+  void SendSetValue(const Path& path, const Variant& data, WriteId write_id,
+                    std::vector<WriteFuture> futures);
+
+  // Send every write that is still being held back, in the order they were
+  // made. Must be called before any other write is sent so the server sees
+  // writes in the same order as the local cache.
+  void FlushCoalescedWrites();
+
+  // Complete the Futures of every write that is still being held back with
+  // kErrorWriteCanceled, and forget the writes.
+  void CancelCoalescedWrites();
+
   Path AbortTransactions(const Path& path, Error reason);
 
   void AbortTransactionsAtNode(Tree<std::vector<TransactionDataPtr>>* node,
@@ -158,6 +202,10 @@ class Repo : public connection::PersistentConnectionEventHandler {
   // destructor.
   static scheduler::Scheduler s_scheduler_;
 
+  // This Repo's strand of s_scheduler_.  Shared with connection_, which calls
+  // back into the Repo synchronously.
+  scheduler::Strand strand_;
+
   // Caches information about the connection to the host.
   connection::HostInfo host_info_;
 
@@ -173,6 +221,10 @@ class Repo : public connection::PersistentConnectionEventHandler {
 
   Tree<std::vector<TransactionDataPtr>> transaction_queue_tree_;
 
+  // Writes being held back by a coalescing window, keyed and therefore sent in
+  // order of WriteId.
+  std::map<WriteId, CoalescedWrite> coalesced_writes_;
+
   // Safe reference to this.  Set in constructor and cleared in destructor
   // Should be safe to be copied to any thread.
   ThisRef safe_this_;
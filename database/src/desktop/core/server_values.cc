@@ -79,14 +79,17 @@ Variant ResolveDeferredValueSnapshot(const Variant& data,
 
 CompoundWrite ResolveDeferredValueMerge(const CompoundWrite& merge,
                                         const Variant& server_values) {
-  return merge.write_tree().Fold(
+  CompoundWrite resolved_merge;
+  merge.write_tree().Fold(
       Path(),
       [&server_values](const Path& path, const Variant& child,
-                       const CompoundWrite& accum) {
-        return accum.AddWrite(
+                       CompoundWrite* accum) {
+        accum->AddWriteInPlace(
             path, ResolveDeferredValueSnapshot(child, server_values));
+        return accum;
       },
-      CompoundWrite());
+      &resolved_merge);
+  return resolved_merge;
 }
 
 }  // namespace internal
@@ -50,8 +50,9 @@ std::vector<Event> SyncTree::AckUserWrite(WriteId write_id, AckStatus revert,
       this->persistence_manager_->RemoveUserWrite(write_id);
     }
     // Need to move the write out, as it is about to be deleted.
-    UserWriteRecord write = std::move(*pending_write_tree_->GetWrite(write_id));
-    bool need_to_reevaluate = pending_write_tree_->RemoveWrite(write_id);
+    UserWriteRecord write;
+    bool need_to_reevaluate =
+        pending_write_tree_->RemoveWrite(write_id, &write);
     if (write.visible) {
       if (!revert) {
         // This is useful to predict what the server value will be at any given
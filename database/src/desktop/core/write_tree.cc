@@ -35,10 +35,12 @@ void WriteTree::AddOverwrite(const Path& path, const Variant& snap,
                              WriteId write_id, OverwriteVisibility visibility) {
   // Stacking an older write on top of newer ones.
   FIREBASE_DEV_ASSERT(write_id > last_write_id_);
-  all_writes_.push_back(
+  all_writes_.emplace_hint(
+      all_writes_.end(), write_id,
       UserWriteRecord(write_id, path, snap, visibility == kOverwriteVisible));
+  IndexWrite(write_id, std::vector<Path>{path});
   if (visibility == kOverwriteVisible) {
-    visible_writes_ = visible_writes_.AddWrite(path, snap);
+    visible_writes_.AddWriteInPlace(path, snap);
   }
   last_write_id_ = write_id;
 }
@@ -48,82 +50,75 @@ void WriteTree::AddMerge(const Path& path,
                          WriteId write_id) {
   // Stacking an older write on top of newer ones.
   FIREBASE_DEV_ASSERT(write_id > last_write_id_);
-  all_writes_.push_back(UserWriteRecord(write_id, path, changed_children));
-  visible_writes_ = visible_writes_.AddWrites(path, changed_children);
+  auto iter = all_writes_.emplace_hint(
+      all_writes_.end(), write_id,
+      UserWriteRecord(write_id, path, changed_children));
+  IndexWrite(write_id, GetWriteLocations(iter->second));
+  visible_writes_.AddWritesInPlace(path, changed_children);
   last_write_id_ = write_id;
 }
 
 UserWriteRecord* WriteTree::GetWrite(WriteId write_id) {
-  for (UserWriteRecord& record : all_writes_) {
-    if (record.write_id == write_id) {
-      return &record;
-    }
-  }
-  return nullptr;
+  auto iter = all_writes_.find(write_id);
+  return iter != all_writes_.end() ? &iter->second : nullptr;
 }
 
 std::vector<UserWriteRecord> WriteTree::PurgeAllWrites() {
-  std::vector<UserWriteRecord> purged_writes(all_writes_);
+  std::vector<UserWriteRecord> purged_writes;
+  purged_writes.reserve(all_writes_.size());
+  for (auto& entry : all_writes_) {
+    purged_writes.push_back(std::move(entry.second));
+  }
   // Reset everything.
   visible_writes_ = CompoundWrite();
   all_writes_.clear();
+  write_index_ = Tree<std::vector<WriteId>>();
   return purged_writes;
 }
 
 bool WriteTree::RemoveWrite(WriteId write_id) {
-  UserWriteRecord write_to_remove;
-  std::vector<UserWriteRecord>::iterator iter;
-  for (iter = all_writes_.begin(); iter != all_writes_.end(); ++iter) {
-    if (iter->write_id == write_id) {
-      write_to_remove = *iter;
-      break;
-    }
-  }
+  return RemoveWrite(write_id, nullptr);
+}
+
+bool WriteTree::RemoveWrite(WriteId write_id, UserWriteRecord* removed_write) {
+  auto iter = all_writes_.find(write_id);
   FIREBASE_DEV_ASSERT_MESSAGE(iter != all_writes_.end(),
                               "remove_write called with nonexistent write_id");
+  if (iter == all_writes_.end()) {
+    return false;
+  }
 
-  iter = all_writes_.erase(iter);
+  UserWriteRecord write_to_remove = std::move(iter->second);
+  all_writes_.erase(iter);
+  std::vector<Path> locations = GetWriteLocations(write_to_remove);
+  UnindexWrite(write_id, locations);
 
   bool removed_write_was_visible = write_to_remove.visible;
-  bool removed_write_overlaps_with_other_writes = false;
-
-  for (auto i = all_writes_.rbegin(); i != all_writes_.rend(); ++i) {
-    UserWriteRecord& current_write = *i;
-    if (current_write.visible) {
-      if (i.base() >= iter &&
-          RecordContainsPath(current_write, write_to_remove.path)) {
-        // The removed write was completely shadowed by a subsequent write.
-        removed_write_was_visible = false;
+  if (removed_write_was_visible) {
+    // The removed write is invisible if every location it modified has been
+    // completely shadowed by a subsequent write.
+    removed_write_was_visible = false;
+    for (const Path& location : locations) {
+      if (!IsShadowedByNewerWrite(location, write_id)) {
+        removed_write_was_visible = true;
         break;
-      } else if (write_to_remove.path.StartsWith(current_write.path)) {
-        // Either we're covering some writes or they're covering part of us
-        // (depending on which came first).
-        removed_write_overlaps_with_other_writes = true;
       }
     }
   }
 
-  if (!removed_write_was_visible) {
-    return false;
-  } else if (removed_write_overlaps_with_other_writes) {
-    // There's some shadowing going on. Just rebuild the visible writes from
-    // scratch.
-    ResetTree();
-    return true;
-  } else {
-    // There's no shadowing.  We can safely just remove the write(s) from
-    // visible_writes_.
-    if (write_to_remove.is_overwrite) {
-      visible_writes_ = visible_writes_.RemoveWrite(write_to_remove.path);
-    } else {
-      for (auto& entry : write_to_remove.merge.write_tree().children()) {
-        Path path(entry.first);
-        visible_writes_ =
-            visible_writes_.RemoveWrite(write_to_remove.path.GetChild(path));
-      }
+  if (removed_write_was_visible) {
+    // Either we're covering some writes or they're covering part of us
+    // (depending on which came first). Only the subtrees the write touched
+    // need to be layered again.
+    for (const Path& location : locations) {
+      RelayerVisibleWrites(location);
     }
-    return true;
   }
+
+  if (removed_write) {
+    *removed_write = std::move(write_to_remove);
+  }
+  return removed_write_was_visible;
 }
 
 Optional<Variant> WriteTree::GetCompleteWriteData(const Path& path) const {
@@ -203,8 +198,9 @@ Optional<Variant> WriteTree::CalcCompleteEventCache(
           return false;
         };
         Variant layered_cache;
-        CompoundWrite merge_at_path = LayerTree(
-            all_writes_, filter, (void*)(&filter_userdata), tree_path);
+        CompoundWrite merge_at_path =
+            LayerTree(GetOverlappingWriteIds(tree_path), filter,
+                      (void*)(&filter_userdata), tree_path);
         layered_cache = complete_server_cache != nullptr
                             ? *complete_server_cache
                             : Variant();
@@ -355,87 +351,199 @@ Optional<Variant> WriteTree::ShadowingWrite(const Path& path) const {
   return visible_writes_.GetCompleteVariant(path);
 }
 
-bool WriteTree::RecordContainsPath(const UserWriteRecord& write_record,
-                                   const Path& path) {
-  if (write_record.is_overwrite) {
-    return write_record.path.StartsWith(path);
+std::vector<Path> WriteTree::GetWriteLocations(
+    const UserWriteRecord& record) {
+  std::vector<Path> locations;
+  if (record.is_overwrite) {
+    locations.push_back(record.path);
   } else {
-    bool result = false;
-    write_record.merge.write_tree().CallOnEach(
-        Path(), [&](const Path& current_path, Variant) {
-          if (write_record.path.GetChild(current_path).StartsWith(path)) {
-            result = true;
-          }
+    record.merge.write_tree().CallOnEach(
+        Path(), [&](const Path& relative_path, const Variant&) {
+          locations.push_back(record.path.GetChild(relative_path));
         });
-    return result;
   }
+  return locations;
 }
 
-void WriteTree::ResetTree() {
-  visible_writes_ = LayerTree(all_writes_, DefaultFilter, nullptr, Path());
-  if (!all_writes_.empty()) {
-    last_write_id_ = all_writes_.back().write_id;
+void WriteTree::IndexWrite(WriteId write_id,
+                           const std::vector<Path>& locations) {
+  for (const Path& location : locations) {
+    Tree<std::vector<WriteId>>* node = write_index_.GetOrMakeSubtree(location);
+    if (!node->value().has_value()) {
+      node->set_value(std::vector<WriteId>());
+    }
+    // Writes are always added in ascending order, so appending keeps each
+    // list sorted.
+    node->value()->push_back(write_id);
+  }
+}
+
+void WriteTree::UnindexWrite(WriteId write_id,
+                             const std::vector<Path>& locations) {
+  for (const Path& location : locations) {
+    std::vector<std::string> directories = location.GetDirectories();
+    // Record the nodes along the path so empty ones can be pruned afterwards.
+    std::vector<Tree<std::vector<WriteId>>*> nodes;
+    nodes.push_back(&write_index_);
+    for (const std::string& directory : directories) {
+      Tree<std::vector<WriteId>>* child = nodes.back()->GetChild(directory);
+      if (child == nullptr) break;
+      nodes.push_back(child);
+    }
+    if (nodes.size() != directories.size() + 1) continue;
+
+    Optional<std::vector<WriteId>>& write_ids = nodes.back()->value();
+    if (!write_ids.has_value()) continue;
+    auto iter =
+        std::lower_bound(write_ids->begin(), write_ids->end(), write_id);
+    if (iter != write_ids->end() && *iter == write_id) {
+      write_ids->erase(iter);
+    }
+    if (write_ids->empty()) {
+      write_ids.reset();
+    }
+
+    for (size_t i = directories.size(); i > 0; --i) {
+      if (!nodes[i]->IsEmpty()) break;
+      nodes[i - 1]->children().erase(directories[i - 1]);
+    }
+  }
+}
+
+bool WriteTree::IsVisibleWrite(WriteId write_id) const {
+  auto iter = all_writes_.find(write_id);
+  return iter != all_writes_.end() && iter->second.visible;
+}
+
+bool WriteTree::IsShadowedByNewerWrite(const Path& path,
+                                       WriteId write_id) const {
+  const Tree<std::vector<WriteId>>* node = &write_index_;
+  std::vector<std::string> directories = path.GetDirectories();
+  for (auto iter = directories.begin(); /* see below for break */; ++iter) {
+    if (node->value().has_value()) {
+      const std::vector<WriteId>& write_ids = node->value().value();
+      for (auto id_iter = std::upper_bound(write_ids.begin(), write_ids.end(),
+                                           write_id);
+           id_iter != write_ids.end(); ++id_iter) {
+        if (IsVisibleWrite(*id_iter)) {
+          return true;
+        }
+      }
+    }
+    if (iter == directories.end()) break;
+    node = node->GetChild(*iter);
+    if (node == nullptr) break;
+  }
+  return false;
+}
+
+std::vector<WriteId> WriteTree::GetOverlappingWriteIds(const Path& path) const {
+  std::vector<WriteId> write_ids;
+  auto append = [&write_ids](const std::vector<WriteId>& ids) {
+    write_ids.insert(write_ids.end(), ids.begin(), ids.end());
+  };
+
+  // Writes above the path.
+  const Tree<std::vector<WriteId>>* node = &write_index_;
+  for (const std::string& directory : path.GetDirectories()) {
+    if (node->value().has_value()) append(node->value().value());
+    node = node->GetChild(directory);
+    if (node == nullptr) break;
+  }
+
+  // Writes at or below the path.
+  if (node != nullptr) {
+    node->CallOnEach(Path(),
+                     [&](const Path&, const std::vector<WriteId>& ids) {
+                       append(ids);
+                     });
+  }
+
+  // A merge shows up once for each of its children, so remove duplicates.
+  std::sort(write_ids.begin(), write_ids.end());
+  write_ids.erase(std::unique(write_ids.begin(), write_ids.end()),
+                  write_ids.end());
+  return write_ids;
+}
+
+void WriteTree::RelayerVisibleWrites(const Path& path) {
+  // Find the highest location at or above the path that still has a visible
+  // write. Everything above it is unaffected by the removal.
+  std::vector<std::string> directories = path.GetDirectories();
+  const Tree<std::vector<WriteId>>* node = &write_index_;
+  Path tree_root = path;
+  for (auto iter = directories.begin(); /* see below for break */; ++iter) {
+    if (node->value().has_value()) {
+      const std::vector<WriteId>& write_ids = node->value().value();
+      if (std::any_of(write_ids.begin(), write_ids.end(),
+                      [this](WriteId id) { return IsVisibleWrite(id); })) {
+        tree_root = Path(directories.begin(), iter);
+        break;
+      }
+    }
+    if (iter == directories.end()) break;
+    node = node->GetChild(*iter);
+    if (node == nullptr) break;
+  }
+
+  CompoundWrite layered =
+      LayerTree(GetOverlappingWriteIds(tree_root), DefaultFilter, nullptr,
+                tree_root);
+  if (tree_root.empty()) {
+    visible_writes_ = layered;
   } else {
-    last_write_id_ = -1L;
+    visible_writes_.RemoveWriteInPlace(tree_root);
+    visible_writes_.AddWritesInPlace(tree_root, layered);
   }
 }
 
-CompoundWrite WriteTree::LayerTree(const std::vector<UserWriteRecord>& writes,
+CompoundWrite WriteTree::LayerTree(const std::vector<WriteId>& write_ids,
                                    WriteTree::UserWriteRecordPredicateFn filter,
                                    void* filter_userdata,
-                                   const Path& tree_root) {
+                                   const Path& tree_root) const {
   CompoundWrite compound_write = CompoundWrite();
-  for (const UserWriteRecord& write : writes) {
+  for (WriteId write_id : write_ids) {
+    auto iter = all_writes_.find(write_id);
+    if (iter == all_writes_.end()) continue;
+    const UserWriteRecord& write = iter->second;
     // Theory, a later set will either:
     // a) abort a relevant transaction, so no need to worry about excluding it
     // from calculating that transaction
     // b) not be relevant to a transaction (separate branch), so again will
     // not affect the data for that transaction
     if (filter(write, filter_userdata)) {
-      Path write_path = write.path;
-      if (write.is_overwrite) {
-        if (tree_root.StartsWith(write_path)) {
-          Optional<Path> relative_path =
-              Path::GetRelative(tree_root, write_path);
-          compound_write =
-              compound_write.AddWrite(*relative_path, write.overwrite);
-        } else if (write_path.StartsWith(tree_root)) {
-          compound_write = compound_write.AddWrite(
-              Path(),
-              *GetInternalVariant(&write.overwrite,
-                                  *Path::GetRelative(write_path, tree_root)));
-        } else {
-          // There is no overlap between root path and write path, ignore
-          // write
-        }
-      } else {
-        if (tree_root.StartsWith(write_path)) {
-          Optional<Path> relative_path =
-              Path::GetRelative(tree_root, write_path);
-          compound_write =
-              compound_write.AddWrites(*relative_path, write.merge);
-        } else if (write_path.StartsWith(tree_root)) {
-          Optional<Path> relative_path =
-              Path::GetRelative(write_path, tree_root);
-          if (relative_path->empty()) {
-            compound_write = compound_write.AddWrites(Path(), write.merge);
-          } else {
-            Optional<Variant> deep_node =
-                write.merge.GetCompleteVariant(*relative_path);
-            if (deep_node.has_value()) {
-              compound_write = compound_write.AddWrite(Path(), deep_node);
-            }
-          }
-        } else {
-          // There is no overlap between root path and write path, ignore
-          // write
-        }
-      }
+      LayerWrite(write, tree_root, &compound_write);
     }
   }
   return compound_write;
 }
 
+void WriteTree::LayerWrite(const UserWriteRecord& write, const Path& tree_root,
+                           CompoundWrite* compound_write) {
+  if (write.path.StartsWith(tree_root)) {
+    // The write is at or below the root, so all of it applies.
+    Path relative_path = *Path::GetRelative(tree_root, write.path);
+    if (write.is_overwrite) {
+      compound_write->AddWriteInPlace(relative_path, write.overwrite);
+    } else {
+      compound_write->AddWritesInPlace(relative_path, write.merge);
+    }
+  } else if (tree_root.StartsWith(write.path)) {
+    // The write is above the root, so only the part of it below the root
+    // applies.
+    Path relative_path = *Path::GetRelative(write.path, tree_root);
+    if (write.is_overwrite) {
+      const Variant* child = GetInternalVariant(&write.overwrite, relative_path);
+      compound_write->AddWriteInPlace(Path(), child ? *child : kNullVariant);
+    } else {
+      compound_write->AddWritesInPlace(
+          Path(), write.merge.ChildCompoundWrite(relative_path));
+    }
+  } else {
+    // There is no overlap between root path and write path, ignore write
+  }
+}
+
 WriteTreeRef::WriteTreeRef(const Path& path, WriteTree* write_tree)
     : path_(path), write_tree_(write_tree) {}
 
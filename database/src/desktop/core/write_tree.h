@@ -15,6 +15,7 @@
 #ifndef FIREBASE_DATABASE_CLIENT_CPP_SRC_DESKTOP_CORE_WRITE_TREE_H_
 #define FIREBASE_DATABASE_CLIENT_CPP_SRC_DESKTOP_CORE_WRITE_TREE_H_
 
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
@@ -22,6 +23,7 @@
 #include "app/src/optional.h"
 #include "app/src/path.h"
 #include "database/src/desktop/core/compound_write.h"
+#include "database/src/desktop/core/tree.h"
 #include "database/src/desktop/persistence/persistence_storage_engine.h"
 #include "database/src/desktop/view/view_cache.h"
 
@@ -117,7 +119,8 @@ class WriteTree {
   // calculate the result of merging them with underlying server data (to create
   // "event cache" data). Pending writes are added with AddOverwrite() and
   // AddMerge(), and removed with RemoveWrite().
-  WriteTree() : visible_writes_(), all_writes_(), last_write_id_(-1L) {}
+  WriteTree()
+      : visible_writes_(), all_writes_(), write_index_(), last_write_id_(-1L) {}
 
   virtual ~WriteTree() {}
 
@@ -151,6 +154,10 @@ class WriteTree {
   // reevaluate / raise events as a result).
   bool RemoveWrite(WriteId write_id);
 
+  // Same as above, but if removed_write is not null the record of the removed
+  // write is moved into it.
+  bool RemoveWrite(WriteId write_id, UserWriteRecord* removed_write);
+
   // Return a complete snapshot for the given path if there's visible write data
   // at that path, else nullptr. No server data is considered.
   Optional<Variant> GetCompleteWriteData(const Path& path) const;
@@ -215,32 +222,62 @@ class WriteTree {
   virtual Optional<Variant> ShadowingWrite(const Path& path) const;
 
  private:
-  bool RecordContainsPath(const UserWriteRecord& write_record,
-                          const Path& path);
-
-  // Re-layer the writes and merges into a tree so we can efficiently calculate
-  // event snapshots
-  void ResetTree();
-
   typedef bool (*UserWriteRecordPredicateFn)(const UserWriteRecord& record,
                                              void* userdata);
 
-  // Static method. Given an array of WriteRecords, a filter for which ones to
+  // Returns the locations a write modifies. For an overwrite this is just the
+  // path of the write, for a merge it is the location of each merged child.
+  static std::vector<Path> GetWriteLocations(const UserWriteRecord& record);
+
+  // Add or remove the given write id at each of the given locations in
+  // write_index_. Nodes left empty by a removal are pruned so the index only
+  // ever grows with the number of live writes.
+  void IndexWrite(WriteId write_id, const std::vector<Path>& locations);
+  void UnindexWrite(WriteId write_id, const std::vector<Path>& locations);
+
+  // Returns true if the write with the given id is pending and visible.
+  bool IsVisibleWrite(WriteId write_id) const;
+
+  // Returns true if a visible write newer than write_id modifies the given
+  // path or one of its ancestors, completely shadowing anything older there.
+  bool IsShadowedByNewerWrite(const Path& path, WriteId write_id) const;
+
+  // Returns the ids of all writes modifying the given path, its ancestors or
+  // its descendants, in ascending order.
+  std::vector<WriteId> GetOverlappingWriteIds(const Path& path) const;
+
+  // Rebuild the part of visible_writes_ that may depend on the given path. The
+  // writes rooted at the highest visible write at or above the path are
+  // cleared and layered again, leaving the rest of the tree untouched.
+  void RelayerVisibleWrites(const Path& path);
+
+  // Given a list of WriteIds in ascending order, a filter for which ones to
   // include, and a path, construct a merge at that path.
-  static CompoundWrite LayerTree(const std::vector<UserWriteRecord>& writes,
-                                 UserWriteRecordPredicateFn filter,
-                                 void* userdata, const Path& tree_root);
+  CompoundWrite LayerTree(const std::vector<WriteId>& write_ids,
+                          UserWriteRecordPredicateFn filter, void* userdata,
+                          const Path& tree_root) const;
+
+  // Layer the part of a single write that lands at or below tree_root on top
+  // of compound_write.
+  static void LayerWrite(const UserWriteRecord& write, const Path& tree_root,
+                         CompoundWrite* compound_write);
 
   // A tree tracking the result of applying all visible writes. This does not
   // include transactions with apply_locally=false or writes that are completely
   // shadowed by other writes.
   CompoundWrite visible_writes_;
 
-  // A list of all pending writes, regardless of visibility and shadowed-ness.
-  // Used to calculate arbitrary sets of the changed data, such as hidden writes
-  // (from transactions) or changes with certain writes excluded (also used by
-  // transactions).
-  std::vector<UserWriteRecord> all_writes_;
+  // All pending writes, regardless of visibility and shadowed-ness, keyed by
+  // WriteId. Used to calculate arbitrary sets of the changed data, such as
+  // hidden writes (from transactions) or changes with certain writes excluded
+  // (also used by transactions).
+  std::map<WriteId, UserWriteRecord> all_writes_;
+
+  // An index of the pending writes by location. Each node holds, in ascending
+  // order, the ids of the writes that modify that exact location, so that
+  // shadowing and overlap queries only need to visit the nodes along a path
+  // instead of every pending write.
+  Tree<std::vector<WriteId>> write_index_;
 
   // The last WriteId seen by the tree through AddOverwrite or AddMerge. The
   // The WriteId passed to these functions should always be larger than the last
@@ -140,7 +140,7 @@ DatabaseReference DatabaseInternal::GetReferenceFromUrl(const char* url) const {
 }
 
 void DatabaseInternal::GoOffline() {
-  Repo::scheduler().Schedule(NewCallback(
+  repo_.strand().Schedule(NewCallback(
       [](ThisRef ref) {
         ThisRefLock lock(&ref);
         if (lock.GetReference() != nullptr) {
@@ -151,7 +151,7 @@ void DatabaseInternal::GoOffline() {
 }
 
 void DatabaseInternal::GoOnline() {
-  Repo::scheduler().Schedule(NewCallback(
+  repo_.strand().Schedule(NewCallback(
       [](ThisRef ref) {
         ThisRefLock lock(&ref);
         if (lock.GetReference() != nullptr) {
@@ -162,7 +162,7 @@ void DatabaseInternal::GoOnline() {
 }
 
 void DatabaseInternal::PurgeOutstandingWrites() {
-  Repo::scheduler().Schedule(NewCallback(
+  repo_.strand().Schedule(NewCallback(
       [](ThisRef ref) {
         ThisRefLock lock(&ref);
         if (lock.GetReference() != nullptr) {
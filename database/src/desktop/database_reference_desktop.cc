@@ -36,14 +36,16 @@ const char kVirtualChildKeyPriority[] = ".priority";
 
 DatabaseReferenceInternal::DatabaseReferenceInternal(DatabaseInternal* database,
                                                      const Path& path)
-    : QueryInternal(database, QuerySpec(path)) {
+    : QueryInternal(database, QuerySpec(path)),
+      write_coalescing_window_ms_(0) {
   database_->future_manager().AllocFutureApi(&future_api_id_,
                                              kDatabaseReferenceFnCount);
 }
 
 DatabaseReferenceInternal::DatabaseReferenceInternal(
     const DatabaseReferenceInternal& internal)
-    : QueryInternal(internal) {
+    : QueryInternal(internal),
+      write_coalescing_window_ms_(internal.write_coalescing_window_ms_) {
   database_->future_manager().AllocFutureApi(&future_api_id_,
                                              kDatabaseReferenceFnCount);
 }
@@ -51,12 +53,14 @@ DatabaseReferenceInternal::DatabaseReferenceInternal(
 DatabaseReferenceInternal& DatabaseReferenceInternal::operator=(
     const DatabaseReferenceInternal& internal) {
   QueryInternal::operator=(internal);
+  write_coalescing_window_ms_ = internal.write_coalescing_window_ms_;
   return *this;
 }
 
 #if defined(FIREBASE_USE_MOVE_OPERATORS) || defined(DOXYGEN)
 DatabaseReferenceInternal::DatabaseReferenceInternal(
-    DatabaseReferenceInternal&& internal) {
+    DatabaseReferenceInternal&& internal)
+    : write_coalescing_window_ms_(internal.write_coalescing_window_ms_) {
   database_->future_manager().MoveFutureApi(&internal.future_api_id_,
                                             &future_api_id_);
   QueryInternal::operator=(std::move(internal));
@@ -67,6 +71,7 @@ DatabaseReferenceInternal& DatabaseReferenceInternal::operator=(
   database_->future_manager().MoveFutureApi(&internal.future_api_id_,
                                             &future_api_id_);
   QueryInternal::operator=(std::move(internal));
+  write_coalescing_window_ms_ = internal.write_coalescing_window_ms_;
   return *this;
 }
 #endif  // defined(FIREBASE_USE_MOVE_OPERATORS) || defined(DOXYGEN)
@@ -111,12 +116,13 @@ Future<void> DatabaseReferenceInternal::RemoveValue() {
   SafeFutureHandle<void> handle =
       ref_future()->SafeAlloc<void>(kDatabaseReferenceFnRemoveValue);
 
-  Repo::scheduler().Schedule(NewCallback(
+  database_->repo()->strand().Schedule(NewCallback(
       [](Repo* repo, Path path, ReferenceCountedFutureImpl* api,
-         SafeFutureHandle<void> handle) {
-        repo->SetValue(path, Variant::Null(), api, handle);
+         SafeFutureHandle<void> handle, scheduler::ScheduleTimeMs window_ms) {
+        repo->SetValue(path, Variant::Null(), api, handle, window_ms);
       },
-      database_->repo(), query_spec_.path, ref_future(), handle));
+      database_->repo(), query_spec_.path, ref_future(), handle,
+      write_coalescing_window_ms_));
   return MakeFuture(ref_future(), handle);
 }
 
@@ -131,7 +137,7 @@ Future<DataSnapshot> DatabaseReferenceInternal::RunTransaction(
   SafeFutureHandle<DataSnapshot> handle = ref_future()->SafeAlloc<DataSnapshot>(
       kDatabaseReferenceFnRunTransaction, DataSnapshot(nullptr));
 
-  Repo::scheduler().Schedule(NewCallback(
+  database_->repo()->strand().Schedule(NewCallback(
       [](Repo* repo, Path path, DoTransactionWithContext transaction_function,
          void* context, void (*delete_context)(void*),
          bool trigger_local_events, ReferenceCountedFutureImpl* api,
@@ -161,13 +167,14 @@ Future<void> DatabaseReferenceInternal::SetPriority(const Variant& priority) {
     ref_future()->Complete(handle, kErrorInvalidVariantType,
                            kErrorMsgInvalidVariantForPriority);
   } else {
-    Repo::scheduler().Schedule(NewCallback(
+    database_->repo()->strand().Schedule(NewCallback(
         [](Repo* repo, Path path, Variant priority,
-           ReferenceCountedFutureImpl* api, SafeFutureHandle<void> handle) {
-          repo->SetValue(path, priority, api, handle);
+           ReferenceCountedFutureImpl* api, SafeFutureHandle<void> handle,
+           scheduler::ScheduleTimeMs window_ms) {
+          repo->SetValue(path, priority, api, handle, window_ms);
         },
         database_->repo(), query_spec_.path.GetChild(kPriorityKey), priority,
-        ref_future(), handle));
+        ref_future(), handle, write_coalescing_window_ms_));
   }
   return MakeFuture(ref_future(), handle);
 }
@@ -184,12 +191,14 @@ Future<void> DatabaseReferenceInternal::SetValue(const Variant& value) {
     ref_future()->Complete(handle, kErrorConflictingOperationInProgress,
                            kErrorMsgConflictSetValue);
   } else {
-    Repo::scheduler().Schedule(NewCallback(
+    database_->repo()->strand().Schedule(NewCallback(
         [](Repo* repo, Path path, Variant value,
-           ReferenceCountedFutureImpl* api, SafeFutureHandle<void> handle) {
-          repo->SetValue(path, value, api, handle);
+           ReferenceCountedFutureImpl* api, SafeFutureHandle<void> handle,
+           scheduler::ScheduleTimeMs window_ms) {
+          repo->SetValue(path, value, api, handle, window_ms);
         },
-        database_->repo(), query_spec_.path, value, ref_future(), handle));
+        database_->repo(), query_spec_.path, value, ref_future(), handle,
+        write_coalescing_window_ms_));
   }
   return MakeFuture(ref_future(), handle);
 }
@@ -230,13 +239,14 @@ Future<void> DatabaseReferenceInternal::SetValueAndPriority(
           std::make_pair(kVirtualChildKeyValue, value),
           std::make_pair(kVirtualChildKeyPriority, priority)};
     }
-    Repo::scheduler().Schedule(NewCallback(
+    database_->repo()->strand().Schedule(NewCallback(
         [](Repo* repo, Path path, Variant value_priority,
-           ReferenceCountedFutureImpl* api, SafeFutureHandle<void> handle) {
-          repo->SetValue(path, value_priority, api, handle);
+           ReferenceCountedFutureImpl* api, SafeFutureHandle<void> handle,
+           scheduler::ScheduleTimeMs window_ms) {
+          repo->SetValue(path, value_priority, api, handle, window_ms);
         },
         database_->repo(), query_spec_.path, value_priority, ref_future(),
-        handle));
+        handle, write_coalescing_window_ms_));
   }
   return MakeFuture(ref_future(), handle);
 }
@@ -253,7 +263,7 @@ Future<void> DatabaseReferenceInternal::UpdateChildren(const Variant& values) {
     ref_future()->Complete(handle, kErrorInvalidVariantType,
                            kErrorMsgInvalidVariantForUpdateChildren);
   } else {
-    Repo::scheduler().Schedule(NewCallback(
+    database_->repo()->strand().Schedule(NewCallback(
         [](Repo* repo, Path path, Variant values,
            ReferenceCountedFutureImpl* api, SafeFutureHandle<void> handle) {
           repo->UpdateChildren(path, values, api, handle);
@@ -268,6 +278,12 @@ Future<void> DatabaseReferenceInternal::UpdateChildrenLastResult() {
       ref_future()->LastResult(kDatabaseReferenceFnUpdateChildren));
 }
 
+void DatabaseReferenceInternal::SetWriteCoalescingWindow(int milliseconds) {
+  write_coalescing_window_ms_ =
+      milliseconds > 0 ? static_cast<scheduler::ScheduleTimeMs>(milliseconds)
+                       : 0;
+}
+
 DisconnectionHandler* DatabaseReferenceInternal::OnDisconnect() {
   return new DisconnectionHandler(
       new DisconnectionHandlerInternal(database_, query_spec_.path));
@@ -21,6 +21,7 @@
 #include "app/src/include/firebase/internal/common.h"
 #include "app/src/include/firebase/variant.h"
 #include "app/src/reference_counted_future_impl.h"
+#include "app/src/scheduler.h"
 #include "database/src/desktop/query_desktop.h"
 #include "database/src/include/firebase/database/disconnection.h"
 
@@ -90,6 +91,11 @@ class DatabaseReferenceInternal : public QueryInternal {
 
   Future<void> UpdateChildrenLastResult();
 
+  // Set how long SetValue, SetValueAndPriority, SetPriority and RemoveValue
+  // calls through this reference may be held back so that later writes to the
+  // same location can replace them. 0 sends every write immediately.
+  void SetWriteCoalescingWindow(int milliseconds);
+
   DisconnectionHandler* OnDisconnect();
 
   void GoOffline();
@@ -106,6 +112,10 @@ class DatabaseReferenceInternal : public QueryInternal {
   // instances, but have the same "this" pointer as one is a subclass of the
   // other.
   int future_api_id_;
+
+  // Maximum number of milliseconds writes through this reference are held
+  // back before being sent to the server.
+  scheduler::ScheduleTimeMs write_coalescing_window_ms_;
 };
 
 }  // namespace internal
@@ -152,7 +152,7 @@ void QueryInternal::RemoveAllValueListeners() {
 
 void QueryInternal::AddEventRegistration(
     UniquePtr<EventRegistration> registration) {
-  Repo::scheduler().Schedule(NewCallback(
+  database_->repo()->strand().Schedule(NewCallback(
       [](Repo* repo, UniquePtr<EventRegistration> registration) {
         repo->AddEventCallback(Move(registration));
       },
@@ -161,7 +161,7 @@ void QueryInternal::AddEventRegistration(
 
 void QueryInternal::RemoveEventRegistration(void* listener_ptr,
                                             const QuerySpec& query_spec) {
-  Repo::scheduler().Schedule(NewCallback(
+  database_->repo()->strand().Schedule(NewCallback(
       [](Repo* repo, void* listener_ptr, QuerySpec query_spec) {
         repo->RemoveEventCallback(listener_ptr, query_spec);
       },
@@ -201,7 +201,7 @@ DatabaseReferenceInternal* QueryInternal::GetReference() {
 }
 
 void QueryInternal::SetKeepSynchronized(bool keep_synchronized) {
-  Repo::scheduler().Schedule(NewCallback(
+  database_->repo()->strand().Schedule(NewCallback(
       [](Repo* repo, QuerySpec query_spec, bool keep_synchronized) {
         repo->SetKeepSynchronized(query_spec, keep_synchronized);
       },
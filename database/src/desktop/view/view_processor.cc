@@ -605,8 +605,7 @@ ViewCache ViewProcessor::ApplyServerMerge(const ViewCache& view_cache,
   if (path.empty()) {
     actual_merge = changed_children;
   } else {
-    actual_merge =
-        CompoundWrite::EmptyWrite().AddWrites(path, changed_children);
+    actual_merge.AddWritesInPlace(path, changed_children);
   }
   const Variant& server_node = view_cache.server_snap().variant();
   std::map<std::string, CompoundWrite> child_compound_writes =
@@ -676,9 +675,9 @@ ViewCache ViewProcessor::AckUserWrite(const ViewCache& view_cache,
       CompoundWrite changed_children = CompoundWrite::EmptyWrite();
       if (server_cache.variant().is_map()) {
         for (auto key_value : server_cache.variant().map()) {
-          CompoundWrite temp = changed_children.AddWrite(
-              key_value.first.AsString().mutable_string(), key_value.second);
-          changed_children = temp;
+          changed_children.AddWriteInPlace(
+              Path(key_value.first.AsString().mutable_string()),
+              key_value.second);
         }
       }
       return ApplyServerMerge(view_cache, ack_path, changed_children,
@@ -689,12 +688,13 @@ ViewCache ViewProcessor::AckUserWrite(const ViewCache& view_cache,
     }
   } else {
     // This is a merge.
-    CompoundWrite changed_children = affected_tree.Fold(
-        CompoundWrite::EmptyWrite(),
-        [&](Path merge_path, bool unused, const CompoundWrite& accum) {
+    CompoundWrite changed_children;
+    affected_tree.Fold(
+        &changed_children,
+        [&](Path merge_path, bool unused, CompoundWrite* accum) {
           Path server_cache_path = ack_path.GetChild(merge_path);
           if (server_cache.IsCompleteForPath(server_cache_path)) {
-            return accum.AddWrite(
+            accum->AddWriteInPlace(
                 merge_path, OptionalFromPointer(GetInternalVariant(
                                 &server_cache.variant(), server_cache_path)));
           }
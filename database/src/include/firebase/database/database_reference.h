@@ -408,6 +408,24 @@ class DatabaseReference : public Query {
   /// @returns Result of the most recent call to UpdateChildren().
   Future<void> UpdateChildrenLastResult();
 
+  /// @brief Allow writes made through this reference to be coalesced.
+  ///
+  /// When the window is greater than zero, SetValue(), SetValueAndPriority(),
+  /// SetPriority() and RemoveValue() are applied locally right away, but are
+  /// held back for up to the given number of milliseconds before being sent to
+  /// the server. A later write to the same location (or one of its parents)
+  /// within that window replaces the held back write, so only the final value
+  /// is sent. The Futures of replaced writes complete together with the write
+  /// that replaced them.
+  ///
+  /// @param[in] milliseconds Maximum time a write may be held back. 0, the
+  /// default, sends every write immediately.
+  ///
+  /// @note This setting is only copied to references created by copying this
+  /// one, not to references returned by Child() or Parent(). It currently has
+  /// no effect on Android and iOS.
+  void SetWriteCoalescingWindow(int milliseconds);
+
   /// @brief Get the absolute URL of this reference.
   ///
   /// @returns The absolute URL of the location this reference refers to.
@@ -28,6 +28,13 @@ class DataSnapshot;
 /// DatabaseReference::AddValueListener() or
 /// Query::AddValueListener(), and OnValueChanged() will be called
 /// once immediately, and again when the value changes.
+///
+/// @note On desktop, listener methods are called on a pool of threads shared
+/// by every Database instance, not on the thread which added the listener.
+/// The calls for one Database instance never overlap and arrive in order, but
+/// consecutive calls may come from different threads, so do not rely on
+/// thread-local state in them, and synchronize any data they share with
+/// other threads.
 class ValueListener {
  public:
   virtual ~ValueListener();
@@ -54,6 +61,9 @@ class ValueListener {
 /// location with Query::AddChildListener() or
 /// DatabaseReference::AddChildListener() and the appropriate method
 /// will be triggered when changes occur.
+///
+/// @note On desktop, listener methods are called on a pool of threads, in the
+/// same way as those of ValueListener.
 class ChildListener {
  public:
   virtual ~ChildListener();
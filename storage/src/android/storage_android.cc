@@ -139,6 +139,7 @@ StorageInternal::StorageInternal(App* app, const char* url) {
   if (!Initialize(app)) return;
   app_ = app;
   url_ = url ? url : "";
+  future_manager_.AllocFutureApi(this, kStorageFnCount);
 
   JNIEnv* env = app_->GetJNIEnv();
   jobject url_jstring = env->NewStringUTF(url_.c_str());
@@ -170,6 +171,7 @@ StorageInternal::~StorageInternal() {
   JNIEnv* env = app_->GetJNIEnv();
   env->DeleteGlobalRef(obj_);
   obj_ = nullptr;
+  future_manager_.ReleaseFutureApi(this);
   Terminate(app_);
   app_ = nullptr;
 
@@ -234,7 +236,7 @@ bool StorageInternal::InitializeEmbeddedClasses(App* app) {
        reinterpret_cast<void*>(
            &ControllerInternal::CppStorageListenerCallback)}};
   static JNINativeMethod kCppByteDownloader[] = {
-      {"writeBytes", "(JJJ[BJ)V",
+      {"writeBytes", "(JJJ[BJ)Z",
        reinterpret_cast<void*>(
            &StorageReferenceInternal::CppByteDownloaderWriteBytes)}};
   static JNINativeMethod kCppByteUploader[] = {
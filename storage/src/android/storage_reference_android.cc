@@ -105,6 +105,8 @@ enum StorageReferenceFn {
   kStorageReferenceFnUpdateMetadata,
   kStorageReferenceFnPutBytes,
   kStorageReferenceFnPutFile,
+  kStorageReferenceFnPutStream,
+  kStorageReferenceFnGetStream,
   kStorageReferenceFnCount,
 };
 
@@ -192,12 +194,32 @@ StorageReferenceInternal* StorageReferenceInternal::Child(
 
 namespace {
 
+// Producer of a PutStream() upload, passed to CppByteUploader in place of a
+// buffer, with a size of -1.
+struct UploadStream {
+  UploadStream(StreamProducer producer_, void* user_data_)
+      : producer(producer_), user_data(user_data_) {}
+  StreamProducer producer;
+  void* user_data;
+};
+
+// Consumer of a GetStream() download, passed to CppByteDownloader in place of
+// a buffer, with a size of -1.
+struct DownloadStream {
+  DownloadStream(StreamConsumer consumer_, void* user_data_)
+      : consumer(consumer_), user_data(user_data_) {}
+  StreamConsumer consumer;
+  void* user_data;
+};
+
 struct FutureCallbackData {
   FutureCallbackData(FutureHandle handle_, ReferenceCountedFutureImpl* impl_,
                      StorageInternal* storage_, StorageReferenceFn func_,
                      jobject listener_ = nullptr, void* dest_ = nullptr,
                      size_t size_ = 0, jobject cpp_byte_downloader_ = nullptr,
-                     jobject cpp_byte_uploader_ = nullptr)
+                     jobject cpp_byte_uploader_ = nullptr,
+                     UploadStream* upload_stream_ = nullptr,
+                     DownloadStream* download_stream_ = nullptr)
       : handle(handle_),
         impl(impl_),
         storage(storage_),
@@ -206,7 +228,9 @@ struct FutureCallbackData {
         dest(dest_),
         size(size_),
         cpp_byte_downloader(cpp_byte_downloader_),
-        cpp_byte_uploader(cpp_byte_uploader_) {}
+        cpp_byte_uploader(cpp_byte_uploader_),
+        upload_stream(upload_stream_),
+        download_stream(download_stream_) {}
   FutureHandle handle;
   ReferenceCountedFutureImpl* impl;
   StorageInternal* storage;
@@ -216,6 +240,10 @@ struct FutureCallbackData {
   size_t size;
   jobject cpp_byte_downloader;
   jobject cpp_byte_uploader;
+  // Deleted once the uploader has discarded its pointer to it.
+  UploadStream* upload_stream;
+  // Deleted once the downloader has discarded its pointer to it.
+  DownloadStream* download_stream;
 };
 
 }  // namespace
@@ -245,6 +273,7 @@ void StorageReferenceInternal::FutureCallback(JNIEnv* env, jobject result,
              status, code);
     if (data->func == kStorageReferenceFnPutFile ||
         data->func == kStorageReferenceFnPutBytes ||
+        data->func == kStorageReferenceFnPutStream ||
         data->func == kStorageReferenceFnGetMetadata ||
         data->func == kStorageReferenceFnUpdateMetadata) {
       // If it's a Future<Metadata> that failed, ensure that an invalid metadata
@@ -269,7 +298,7 @@ void StorageReferenceInternal::FutureCallback(JNIEnv* env, jobject result,
   } else if (result &&
              env->IsInstanceOf(
                  result, stream_download_task_task_snapshot::GetClass()) &&
-             data->dest != nullptr) {
+             (data->dest != nullptr || data->download_stream != nullptr)) {
     // Complete a Future<size_t>. We have previously also copied
     // bytes from a Java byte[] array via CppByteDownloader.
     LogDebug("FutureCallback: Completing a Future from a byte array.");
@@ -335,6 +364,8 @@ void StorageReferenceInternal::FutureCallback(JNIEnv* env, jobject result,
         cpp_byte_uploader::GetMethodId(cpp_byte_uploader::kDiscardPointers));
     env->DeleteGlobalRef(data->cpp_byte_uploader);
   }
+  delete data->upload_stream;
+  delete data->download_stream;
   delete data;
 
   util::CheckAndClearJniExceptions(env);
@@ -470,6 +501,50 @@ Future<size_t> StorageReferenceInternal::GetBytesLastResult() {
       future()->LastResult(kStorageReferenceFnGetBytes));
 }
 
+Future<size_t> StorageReferenceInternal::GetStream(StreamConsumer consumer,
+                                                   void* user_data,
+                                                   Listener* listener,
+                                                   Controller* controller_out) {
+  JNIEnv* env = storage_->app()->GetJNIEnv();
+  ReferenceCountedFutureImpl* future_impl = future();
+  FutureHandle handle =
+      future_impl->Alloc<size_t>(kStorageReferenceFnGetStream);
+  DownloadStream* download_stream = new DownloadStream(consumer, user_data);
+  // StreamDownloadTask reads the data on a background thread, which simply
+  // waits on the consumer, so a slow consumer holds off the download.
+  jobject byte_downloader_local = env->NewObject(
+      cpp_byte_downloader::GetClass(),
+      cpp_byte_downloader::GetMethodId(cpp_byte_downloader::kConstructor),
+      reinterpret_cast<jlong>(download_stream), static_cast<jlong>(-1));
+  jobject byte_downloader = env->NewGlobalRef(byte_downloader_local);
+  env->DeleteLocalRef(byte_downloader_local);
+
+  jobject task = env->CallObjectMethod(
+      obj_, storage_reference::GetMethodId(storage_reference::kGetStream),
+      byte_downloader);
+  jobject java_listener = AssignListenerToTask(listener, task);
+  util::RegisterCallbackOnPendingResultOrTask(
+      env, task, FutureCallback,
+      // FutureCallback will delete the newed FutureCallbackData, along with
+      // the stream.
+      reinterpret_cast<void*>(new FutureCallbackData(
+          handle, future(), storage_, kStorageReferenceFnGetStream,
+          java_listener, nullptr, 0, byte_downloader, nullptr, nullptr,
+          download_stream)),
+      kApiIdentifier);
+  if (controller_out) {
+    controller_out->internal_->AssignTask(storage_, task);
+  }
+  env->DeleteLocalRef(task);
+  util::CheckAndClearJniExceptions(env);
+  return GetStreamLastResult();
+}
+
+Future<size_t> StorageReferenceInternal::GetStreamLastResult() {
+  return static_cast<const Future<size_t>&>(
+      future()->LastResult(kStorageReferenceFnGetStream));
+}
+
 Future<std::string> StorageReferenceInternal::GetDownloadUrl() {
   JNIEnv* env = storage_->app()->GetJNIEnv();
   ReferenceCountedFutureImpl* future_impl = future();
@@ -626,6 +701,78 @@ Future<Metadata> StorageReferenceInternal::PutBytesLastResult() {
       future()->LastResult(kStorageReferenceFnPutBytes));
 }
 
+Future<Metadata> StorageReferenceInternal::PutStream(
+    StreamProducer producer, void* user_data, Listener* listener,
+    Controller* controller_out) {
+  return PutStream(producer, user_data, nullptr, listener, controller_out);
+}
+
+Future<Metadata> StorageReferenceInternal::PutStream(
+    StreamProducer producer, void* user_data, const Metadata* metadata,
+    Listener* listener, Controller* controller_out) {
+  if (metadata && metadata->is_valid()) {
+    metadata->internal_->CommitCustomMetadata();
+  }
+
+  JNIEnv* env = storage_->app()->GetJNIEnv();
+  ReferenceCountedFutureImpl* future_impl = future();
+  FutureHandle handle =
+      future_impl->Alloc<Metadata>(kStorageReferenceFnPutStream);
+  // An unbound CppByteUploader pulls the data from the producer as the Java
+  // SDK reads the stream.
+  UploadStream* upload_stream = new UploadStream(producer, user_data);
+  jobject uploader = env->NewObject(
+      cpp_byte_uploader::GetClass(),
+      cpp_byte_uploader::GetMethodId(cpp_byte_uploader::kConstructor),
+      reinterpret_cast<jlong>(upload_stream), static_cast<jlong>(-1),
+      static_cast<jlong>(0));
+  std::string exception_message = util::GetAndClearExceptionMessage(env);
+  if (exception_message.empty()) {
+    jobject task =
+        metadata
+            ? env->CallObjectMethod(
+                  obj_,
+                  storage_reference::GetMethodId(
+                      storage_reference::kPutStreamWithMetadata),
+                  uploader, metadata->internal_->obj())
+            : env->CallObjectMethod(
+                  obj_,
+                  storage_reference::GetMethodId(storage_reference::kPutStream),
+                  uploader);
+    exception_message = util::GetAndClearExceptionMessage(env);
+    if (exception_message.empty()) {
+      jobject java_listener = AssignListenerToTask(listener, task);
+      util::RegisterCallbackOnPendingResultOrTask(
+          env, task, FutureCallback,
+          // FutureCallback will delete the newed FutureCallbackData, and the
+          // stream along with it.
+          reinterpret_cast<void*>(new FutureCallbackData(
+              handle, future_impl, storage_, kStorageReferenceFnPutStream,
+              java_listener, nullptr, 0, nullptr, env->NewGlobalRef(uploader),
+              upload_stream)),
+          kApiIdentifier);
+      upload_stream = nullptr;
+      if (controller_out) controller_out->internal_->AssignTask(storage_, task);
+      env->DeleteLocalRef(task);
+    } else {
+      // The uploader must not call the producer once it is deleted.
+      env->CallVoidMethod(uploader, cpp_byte_uploader::GetMethodId(
+                                        cpp_byte_uploader::kDiscardPointers));
+    }
+    env->DeleteLocalRef(uploader);
+  }
+  delete upload_stream;
+  if (!exception_message.empty()) {
+    future_impl->Complete(handle, kErrorUnknown, exception_message.c_str());
+  }
+  return PutStreamLastResult();
+}
+
+Future<Metadata> StorageReferenceInternal::PutStreamLastResult() {
+  return static_cast<const Future<Metadata>&>(
+      future()->LastResult(kStorageReferenceFnPutStream));
+}
+
 Future<Metadata> StorageReferenceInternal::PutFile(const char* path,
                                                    Listener* listener,
                                                    Controller* controller_out) {
@@ -693,10 +840,21 @@ ReferenceCountedFutureImpl* StorageReferenceInternal::future() {
   return storage_->future_manager().GetFutureApi(this);
 }
 
-void StorageReferenceInternal::CppByteDownloaderWriteBytes(
+jboolean StorageReferenceInternal::CppByteDownloaderWriteBytes(
     JNIEnv* env, jclass clazz, jlong buffer_ptr, jlong buffer_size,
     jlong buffer_offset, jbyteArray byte_array, jlong num_bytes_to_copy) {
-  if (!buffer_ptr) return;
+  if (!buffer_ptr) return JNI_TRUE;
+  if (buffer_size < 0) {
+    // An unbound stream, handed to the consumer of GetStream().
+    DownloadStream* download_stream =
+        reinterpret_cast<DownloadStream*>(buffer_ptr);
+    jbyte* jbytes = env->GetByteArrayElements(byte_array, nullptr);
+    bool consumed = download_stream->consumer(
+        jbytes, static_cast<size_t>(num_bytes_to_copy),
+        download_stream->user_data);
+    env->ReleaseByteArrayElements(byte_array, jbytes, JNI_ABORT);
+    return consumed ? JNI_TRUE : JNI_FALSE;
+  }
   FIREBASE_ASSERT(buffer_offset + num_bytes_to_copy <= buffer_size);
 
   void* dest = reinterpret_cast<void*>(buffer_ptr);
@@ -704,6 +862,7 @@ void StorageReferenceInternal::CppByteDownloaderWriteBytes(
   memcpy(reinterpret_cast<void*>(buffer_ptr + buffer_offset),
          reinterpret_cast<void*>(jbytes), num_bytes_to_copy);
   env->ReleaseByteArrayElements(byte_array, jbytes, JNI_ABORT);
+  return JNI_TRUE;
 }
 
 jint StorageReferenceInternal::CppByteUploaderReadBytes(
@@ -711,11 +870,8 @@ jint StorageReferenceInternal::CppByteUploaderReadBytes(
     jlong cpp_buffer_offset, jobject bytes, jint bytes_offset,
     jint num_bytes_to_read) {
   if (!cpp_buffer_pointer) return -1;
-  // Right now we don't support unbound streaming.  Once a streaming callback is
-  // plumbed in, it can be called from here.
-  assert(cpp_buffer_size >= 0);
   jlong cpp_buffer_remaining = cpp_buffer_size - cpp_buffer_offset;
-  if (cpp_buffer_remaining == 0) return -1;
+  if (cpp_buffer_size >= 0 && cpp_buffer_remaining == 0) return -1;
   jbyteArray bytes_array_object = reinterpret_cast<jbyteArray>(bytes);
   jbyte* bytes_array = env->GetByteArrayElements(bytes_array_object, nullptr);
   if (!bytes_array) {
@@ -724,6 +880,22 @@ jint StorageReferenceInternal::CppByteUploaderReadBytes(
         "stream.");
     return -2;
   }
+  if (cpp_buffer_size < 0) {
+    // An unbound stream, read from the producer of PutStream().
+    UploadStream* upload_stream =
+        reinterpret_cast<UploadStream*>(cpp_buffer_pointer);
+    int64_t data_read = upload_stream->producer(
+        bytes_array + bytes_offset, static_cast<size_t>(num_bytes_to_read),
+        upload_stream->user_data);
+    env->ReleaseByteArrayElements(bytes_array_object, bytes_array,
+                                  data_read > 0 ? JNI_COMMIT : JNI_ABORT);
+    if (data_read == 0) return -1;
+    if (data_read < 0 || data_read > num_bytes_to_read) {
+      LogError("The producer of the stream failed, aborting this stream.");
+      return -2;
+    }
+    return static_cast<jint>(data_read);
+  }
   jint data_read =
       std::min(num_bytes_to_read, static_cast<jint>(cpp_buffer_remaining));
   LogDebug("Reading %d bytes from 0x%08x offset %d / %d into %d / %d",
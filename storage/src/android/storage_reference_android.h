@@ -78,6 +78,14 @@ class StorageReferenceInternal {
   // Returns the result of the most recent call to GetBytes();
   Future<size_t> GetBytesLastResult();
 
+  // Asynchronously downloads the object from this StorageReference, handing
+  // its data to a consumer.
+  Future<size_t> GetStream(StreamConsumer consumer, void* user_data,
+                           Listener* listener, Controller* controller_out);
+
+  // Returns the result of the most recent call to GetStream();
+  Future<size_t> GetStreamLastResult();
+
   // Asynchronously retrieves a long lived download URL with a revokable token.
   Future<std::string> GetDownloadUrl();
 
@@ -128,20 +136,37 @@ class StorageReferenceInternal {
   // Returns the result of the most recent call to PutFile();
   Future<Metadata> PutFileLastResult();
 
+  // Asynchronously uploads data pulled from a producer to the currently
+  // specified StorageReferenceInternal, without additional metadata.
+  Future<Metadata> PutStream(StreamProducer producer, void* user_data,
+                             Listener* listener, Controller* controller_out);
+
+  // Asynchronously uploads data pulled from a producer to the currently
+  // specified StorageReferenceInternal, with additional metadata.
+  Future<Metadata> PutStream(StreamProducer producer, void* user_data,
+                             const Metadata* metadata, Listener* listener,
+                             Controller* controller_out);
+
+  // Returns the result of the most recent call to PutStream();
+  Future<Metadata> PutStreamLastResult();
+
   // Initialize JNI bindings for this class.
   static bool Initialize(App* app);
   static void Terminate(App* app);
 
   // Called from the Java CppByteDownloader class, this simply writes some bytes
-  // into a buffer at the specified offset.
-  static void CppByteDownloaderWriteBytes(JNIEnv* env, jclass clazz,
-                                          jlong buffer_ptr, jlong buffer_size,
-                                          jlong buffer_offset,
-                                          jbyteArray byte_array,
-                                          jlong num_bytes_to_copy);
+  // into a buffer at the specified offset, or hands them to the consumer of an
+  // unbound stream.  Returns false if the consumer stopped the download.
+  static jboolean CppByteDownloaderWriteBytes(JNIEnv* env, jclass clazz,
+                                              jlong buffer_ptr,
+                                              jlong buffer_size,
+                                              jlong buffer_offset,
+                                              jbyteArray byte_array,
+                                              jlong num_bytes_to_copy);
 
   // Called from the Java CppByteUploader class, this simply reads some bytes
-  // from a C++ buffer into a Java buffer at the specified offset.
+  // from a C++ buffer into a Java buffer at the specified offset, or from the
+  // producer of an unbound stream.
   static jint CppByteUploaderReadBytes(JNIEnv* env, jclass clazz,
                                        jlong cpp_buffer_pointer,
                                        jlong cpp_buffer_size,
@@ -0,0 +1,199 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "storage/src/common/batch_internal.h"
+
+#include <string>
+
+#ifdef __APPLE__
+#include "TargetConditionals.h"
+#endif  // __APPLE__
+
+// StorageReferenceInternal is defined in these 3 files, one implementation for
+// each OS.
+#if defined(__ANDROID__)
+#include "storage/src/android/storage_reference_android.h"
+#elif TARGET_OS_IPHONE
+#include "storage/src/ios/storage_reference_ios.h"
+#else
+#include "storage/src/desktop/storage_reference_desktop.h"
+#endif  // defined(__ANDROID__), TARGET_OS_IPHONE
+
+namespace firebase {
+namespace storage {
+namespace internal {
+
+const int kMaxBatchConcurrency = 16;
+
+const char kInvalidReferenceMessage[] = "Invalid StorageReference.";
+
+void CompleteBatch(const std::vector<BatchResult>& results,
+                   SafeFutureHandle<std::vector<BatchResult>> handle,
+                   ReferenceCountedFutureImpl* future_api) {
+  const BatchResult* first_failure = nullptr;
+  size_t failures = 0;
+  for (const BatchResult& result : results) {
+    if (result.error == kErrorNone) continue;
+    if (!first_failure) first_failure = &result;
+    failures++;
+  }
+  if (!first_failure) {
+    future_api->CompleteWithResult(handle, kErrorNone, results);
+    return;
+  }
+  std::string message = std::to_string(failures) + " of " +
+                        std::to_string(results.size()) +
+                        " operations failed, the first one with: " +
+                        first_failure->error_message;
+  future_api->CompleteWithResult(handle, first_failure->error, message.c_str(),
+                                 results);
+}
+
+// Data of the completion callback of an operation.
+struct ReferenceBatchOperation {
+  ReferenceBatch* batch;
+  size_t index;
+};
+
+void ReferenceBatch::Start(
+    BatchOperationType type,
+    const std::vector<StorageReferenceInternal*>& references,
+    SafeFutureHandle<std::vector<BatchResult>> handle,
+    ReferenceCountedFutureImpl* future_api) {
+  ReferenceBatch* batch =
+      new ReferenceBatch(type, references, handle, future_api);
+  batch->Launch();
+}
+
+ReferenceBatch::ReferenceBatch(
+    BatchOperationType type,
+    const std::vector<StorageReferenceInternal*>& references,
+    SafeFutureHandle<std::vector<BatchResult>> handle,
+    ReferenceCountedFutureImpl* future_api)
+    : type_(type),
+      handle_(handle),
+      future_api_(future_api),
+      results_(references.size()),
+      next_(0),
+      completed_(0),
+      in_flight_(0),
+      launching_(0) {
+  for (StorageReferenceInternal* reference : references) {
+    references_.push_back(reference ? new StorageReferenceInternal(*reference)
+                                    : nullptr);
+  }
+}
+
+ReferenceBatch::~ReferenceBatch() {
+  for (StorageReferenceInternal* reference : references_) delete reference;
+}
+
+void ReferenceBatch::Launch() {
+  Acquire();
+  for (;;) {
+    size_t index;
+    {
+      MutexLock lock(mutex_);
+      if (in_flight_ >= kMaxBatchConcurrency || next_ >= references_.size()) {
+        break;
+      }
+      index = next_++;
+      in_flight_++;
+    }
+    Run(index);
+  }
+  Release();
+}
+
+void ReferenceBatch::Run(size_t index) {
+  StorageReferenceInternal* reference = references_[index];
+  if (!reference) {
+    BatchResult result;
+    result.error = kErrorUnknown;
+    result.error_message = kInvalidReferenceMessage;
+    Finished(index, result);
+    return;
+  }
+  ReferenceBatchOperation* operation = new ReferenceBatchOperation;
+  operation->batch = this;
+  operation->index = index;
+  switch (type_) {
+    case kBatchOperationDelete:
+      reference->Delete().OnCompletion(DeleteCompleted, operation);
+      break;
+    case kBatchOperationGetMetadata:
+      reference->GetMetadata().OnCompletion(GetMetadataCompleted, operation);
+      break;
+  }
+}
+
+void ReferenceBatch::Finished(size_t index, const BatchResult& result) {
+  {
+    MutexLock lock(mutex_);
+    results_[index] = result;
+    completed_++;
+    in_flight_--;
+  }
+  Launch();
+}
+
+void ReferenceBatch::Acquire() {
+  MutexLock lock(mutex_);
+  launching_++;
+}
+
+void ReferenceBatch::Release() {
+  bool complete;
+  {
+    MutexLock lock(mutex_);
+    launching_--;
+    complete = launching_ == 0 && completed_ == references_.size();
+  }
+  if (complete) {
+    CompleteBatch(results_, handle_, future_api_);
+    delete this;
+  }
+}
+
+void ReferenceBatch::DeleteCompleted(const Future<void>& result, void* data) {
+  ReferenceBatchOperation* operation =
+      static_cast<ReferenceBatchOperation*>(data);
+  BatchResult batch_result;
+  batch_result.error = static_cast<Error>(result.error());
+  if (result.error_message()) {
+    batch_result.error_message = result.error_message();
+  }
+  operation->batch->Finished(operation->index, batch_result);
+  delete operation;
+}
+
+void ReferenceBatch::GetMetadataCompleted(const Future<Metadata>& result,
+                                          void* data) {
+  ReferenceBatchOperation* operation =
+      static_cast<ReferenceBatchOperation*>(data);
+  BatchResult batch_result;
+  batch_result.error = static_cast<Error>(result.error());
+  if (result.error_message()) {
+    batch_result.error_message = result.error_message();
+  }
+  if (batch_result.error == kErrorNone && result.result()) {
+    batch_result.metadata = *result.result();
+  }
+  operation->batch->Finished(operation->index, batch_result);
+  delete operation;
+}
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace firebase
@@ -0,0 +1,108 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FIREBASE_STORAGE_CLIENT_CPP_SRC_COMMON_BATCH_INTERNAL_H_
+#define FIREBASE_STORAGE_CLIENT_CPP_SRC_COMMON_BATCH_INTERNAL_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "app/src/mutex.h"
+#include "app/src/reference_counted_future_impl.h"
+#include "storage/src/include/firebase/storage.h"
+
+namespace firebase {
+namespace storage {
+namespace internal {
+
+class StorageReferenceInternal;
+
+// Functions of Storage which return futures.
+enum StorageFn {
+  kStorageFnDeleteBatch = 0,
+  kStorageFnGetMetadataBatch,
+  kStorageFnCount,
+};
+
+// Operation applied to each object of a batch.
+enum BatchOperationType {
+  kBatchOperationDelete,
+  kBatchOperationGetMetadata,
+};
+
+// Maximum number of operations of a batch in flight at once.
+extern const int kMaxBatchConcurrency;
+
+// Error message of an operation on an invalid reference.
+extern const char kInvalidReferenceMessage[];
+
+// Complete the future of a batch with the results of its operations.
+void CompleteBatch(const std::vector<BatchResult>& results,
+                   SafeFutureHandle<std::vector<BatchResult>> handle,
+                   ReferenceCountedFutureImpl* future_api);
+
+// Runs a batch through the StorageReferenceInternal operations, with at most
+// kMaxBatchConcurrency of them in flight, for the platforms whose SDK pools
+// connections on its own.  The batch deletes itself once complete.
+class ReferenceBatch {
+ public:
+  // Copies the references, which may be null.  future_api must be allocated
+  // using FutureManager to ensure it remains valid while the handle isn't
+  // complete.
+  static void Start(BatchOperationType type,
+                    const std::vector<StorageReferenceInternal*>& references,
+                    SafeFutureHandle<std::vector<BatchResult>> handle,
+                    ReferenceCountedFutureImpl* future_api);
+
+ private:
+  ReferenceBatch(BatchOperationType type,
+                 const std::vector<StorageReferenceInternal*>& references,
+                 SafeFutureHandle<std::vector<BatchResult>> handle,
+                 ReferenceCountedFutureImpl* future_api);
+  ~ReferenceBatch();
+
+  // Start operations until kMaxBatchConcurrency of them are in flight.
+  void Launch();
+  // Start the operation on the given object.
+  void Run(size_t index);
+  // Record the result of an operation, and start the next one.
+  void Finished(size_t index, const BatchResult& result);
+
+  // Operations completing synchronously call back into Launch(), so the
+  // batch is only deleted once the outermost call returns.
+  void Acquire();
+  void Release();
+
+  static void DeleteCompleted(const Future<void>& result, void* data);
+  static void GetMetadataCompleted(const Future<Metadata>& result,
+                                   void* data);
+
+  BatchOperationType type_;
+  std::vector<StorageReferenceInternal*> references_;
+  SafeFutureHandle<std::vector<BatchResult>> handle_;
+  ReferenceCountedFutureImpl* future_api_;
+
+  Mutex mutex_;
+  std::vector<BatchResult> results_;
+  size_t next_;
+  size_t completed_;
+  int in_flight_;
+  int launching_;
+};
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace firebase
+
+#endif  // FIREBASE_STORAGE_CLIENT_CPP_SRC_COMMON_BATCH_INTERNAL_H_
@@ -84,6 +84,22 @@ int64_t Controller::total_byte_count() const {
   return internal_ ? internal_->total_byte_count() : 0;
 }
 
+double Controller::bytes_per_second() const {
+  return internal_ ? internal_->bytes_per_second() : 0;
+}
+
+double Controller::average_bytes_per_second() const {
+  return internal_ ? internal_->average_bytes_per_second() : 0;
+}
+
+double Controller::estimated_seconds_remaining() const {
+  return internal_ ? internal_->estimated_seconds_remaining() : -1;
+}
+
+int Controller::retry_count() const {
+  return internal_ ? internal_->retry_count() : 0;
+}
+
 StorageReference Controller::GetReference() const {
   return internal_ ? StorageReference(internal_->GetReference())
                    : StorageReference(nullptr);
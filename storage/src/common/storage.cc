@@ -24,6 +24,7 @@
 #include "app/src/include/firebase/app.h"
 #include "app/src/include/firebase/version.h"
 #include "app/src/util.h"
+#include "storage/src/common/batch_internal.h"
 #include "storage/src/common/storage_uri_parser.h"
 
 #ifdef __APPLE__
@@ -233,5 +234,77 @@ void Storage::set_max_operation_retry_time(double max_transfer_retry_seconds) {
     return internal_->set_max_operation_retry_time(max_transfer_retry_seconds);
 }
 
+int Storage::max_download_connections() {
+  return internal_ ? internal_->max_download_connections() : 0;
+}
+
+void Storage::set_max_download_connections(int max_download_connections) {
+  if (internal_)
+    internal_->set_max_download_connections(max_download_connections);
+}
+
+double Storage::progress_interval() {
+  return internal_ ? internal_->progress_interval() : 0;
+}
+
+void Storage::set_progress_interval(double progress_interval_seconds) {
+  if (internal_) internal_->set_progress_interval(progress_interval_seconds);
+}
+
+void Storage::set_download_cache(const char* directory,
+                                 int64_t max_size_bytes) {
+  if (internal_) internal_->set_download_cache(directory, max_size_bytes);
+}
+
+DownloadCacheStats Storage::download_cache_stats() {
+  return internal_ ? internal_->download_cache_stats() : DownloadCacheStats();
+}
+
+// Start a batch on the platform implementation of the given references.
+static Future<std::vector<BatchResult>> StartBatch(
+    internal::StorageInternal* storage_internal,
+    internal::BatchOperationType type, internal::StorageFn fn,
+    const std::vector<internal::StorageReferenceInternal*>& references) {
+  ReferenceCountedFutureImpl* future_api = storage_internal->future();
+  SafeFutureHandle<std::vector<BatchResult>> handle =
+      future_api->SafeAlloc<std::vector<BatchResult>>(fn);
+  storage_internal->RunBatch(type, references, handle);
+  return MakeFuture(future_api, handle);
+}
+
+Future<std::vector<BatchResult>> Storage::DeleteBatch(
+    const std::vector<StorageReference>& references) {
+  if (!internal_) return Future<std::vector<BatchResult>>();
+  std::vector<internal::StorageReferenceInternal*> reference_internals;
+  for (const StorageReference& reference : references) {
+    reference_internals.push_back(reference.internal_);
+  }
+  return StartBatch(internal_, internal::kBatchOperationDelete,
+                    internal::kStorageFnDeleteBatch, reference_internals);
+}
+
+Future<std::vector<BatchResult>> Storage::DeleteBatchLastResult() {
+  if (!internal_) return Future<std::vector<BatchResult>>();
+  return static_cast<const Future<std::vector<BatchResult>>&>(
+      internal_->future()->LastResult(internal::kStorageFnDeleteBatch));
+}
+
+Future<std::vector<BatchResult>> Storage::GetMetadataBatch(
+    const std::vector<StorageReference>& references) {
+  if (!internal_) return Future<std::vector<BatchResult>>();
+  std::vector<internal::StorageReferenceInternal*> reference_internals;
+  for (const StorageReference& reference : references) {
+    reference_internals.push_back(reference.internal_);
+  }
+  return StartBatch(internal_, internal::kBatchOperationGetMetadata,
+                    internal::kStorageFnGetMetadataBatch, reference_internals);
+}
+
+Future<std::vector<BatchResult>> Storage::GetMetadataBatchLastResult() {
+  if (!internal_) return Future<std::vector<BatchResult>>();
+  return static_cast<const Future<std::vector<BatchResult>>&>(
+      internal_->future()->LastResult(internal::kStorageFnGetMetadataBatch));
+}
+
 }  // namespace storage
 }  // namespace firebase
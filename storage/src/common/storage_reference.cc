@@ -167,6 +167,18 @@ Future<size_t> StorageReference::GetBytesLastResult() {
   return internal_ ? internal_->GetBytesLastResult() : Future<size_t>();
 }
 
+Future<size_t> StorageReference::GetStream(StreamConsumer consumer,
+                                           void* user_data, Listener* listener,
+                                           Controller* controller_out) {
+  return internal_ ? internal_->GetStream(consumer, user_data, listener,
+                                          controller_out)
+                   : Future<size_t>();
+}
+
+Future<size_t> StorageReference::GetStreamLastResult() {
+  return internal_ ? internal_->GetStreamLastResult() : Future<size_t>();
+}
+
 Future<std::string> StorageReference::GetDownloadUrl() {
   return internal_ ? internal_->GetDownloadUrl() : Future<std::string>();
 }
@@ -246,6 +258,30 @@ Future<Metadata> StorageReference::PutFileLastResult() {
   return internal_ ? internal_->PutFileLastResult() : Future<Metadata>();
 }
 
+Future<Metadata> StorageReference::PutStream(StreamProducer producer,
+                                             void* user_data,
+                                             Listener* listener,
+                                             Controller* controller_out) {
+  return internal_ ? internal_->PutStream(producer, user_data, listener,
+                                          controller_out)
+                   : Future<Metadata>();
+}
+
+Future<Metadata> StorageReference::PutStream(StreamProducer producer,
+                                             void* user_data,
+                                             const Metadata& metadata,
+                                             Listener* listener,
+                                             Controller* controller_out) {
+  AssertMetadataIsValid(metadata);
+  return internal_ ? internal_->PutStream(producer, user_data, &metadata,
+                                          listener, controller_out)
+                   : Future<Metadata>();
+}
+
+Future<Metadata> StorageReference::PutStreamLastResult() {
+  return internal_ ? internal_->PutStreamLastResult() : Future<Metadata>();
+}
+
 bool StorageReference::is_valid() const { return internal_ != nullptr; }
 
 }  // namespace storage
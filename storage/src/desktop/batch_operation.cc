@@ -0,0 +1,371 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "storage/src/desktop/batch_operation.h"
+
+#include <algorithm>
+#include <string>
+
+#include "app/src/log.h"
+#include "app/src/time.h"
+#include "storage/src/desktop/metadata_desktop.h"
+#include "storage/src/desktop/storage_desktop.h"
+#include "storage/src/desktop/storage_reference_desktop.h"
+
+namespace firebase {
+namespace storage {
+namespace internal {
+
+static const char kInvalidJsonResponse[] =
+    "The server did not return a valid JSON response.  "
+    "Contact Firebase support if this issue persists.";
+static const char kNoResponse[] = "The server could not be reached.";
+
+// Response to the request for one object of the batch.
+class BatchResponse : public TransferResponse {
+ public:
+  BatchResponse(BatchOperation* batch, size_t index)
+      : TransferResponse(nullptr),
+        batch_(batch),
+        index_(index),
+        finished_(false) {}
+
+ protected:
+  void Finish() override { batch_->ItemFinished(this); }
+
+ private:
+  friend class BatchOperation;
+
+  BatchOperation* batch_;
+  size_t index_;
+  // Set under the batch's mutex once the request is finished.
+  bool finished_;
+};
+
+BatchOperation::Item::Item(StorageReferenceInternal* reference_)
+    : reference(reference_),
+      done(false),
+      first_failure(0),
+      retry_delay(kInitialRetryDelayMilliseconds),
+      retry_time(0),
+      transport(nullptr) {}
+
+BatchOperation::Item::~Item() {}
+
+BatchOperation::BatchOperation(
+    BatchOperationType type,
+    const std::vector<StorageReferenceInternal*>& references,
+    SafeFutureHandle<std::vector<BatchResult>> handle,
+    ReferenceCountedFutureImpl* future_api)
+    : type_(type),
+      handle_(handle),
+      future_api_(future_api),
+      max_retry_milliseconds_(0),
+      results_(references.size()),
+      completed_(0),
+      paused_(false),
+      canceled_(false),
+      complete_(false),
+      wake_(0),
+      thread_(nullptr) {
+  for (StorageReferenceInternal* reference : references) {
+    items_.push_back(UniquePtr<Item>(new Item(
+        reference ? new StorageReferenceInternal(*reference) : nullptr)));
+    if (reference && max_retry_milliseconds_ == 0) {
+      max_retry_milliseconds_ = static_cast<uint64_t>(
+          reference->storage_internal()->max_operation_retry_time() * 1000.0);
+    }
+  }
+  size_t connections =
+      (std::min)(references.size(), static_cast<size_t>(kMaxBatchConcurrency));
+  for (size_t i = 0; i < connections; ++i) {
+    rest::TransportCurl* transport = new rest::TransportCurl();
+    transport->set_is_async(true);
+    transports_.push_back(UniquePtr<rest::TransportCurl>(transport));
+    free_transports_.push_back(transport);
+  }
+}
+
+BatchOperation::~BatchOperation() {
+  Cancel();
+  if (thread_) {
+    thread_->Join();
+    thread_.reset(nullptr);
+  }
+}
+
+void BatchOperation::Start() {
+  thread_ = MakeUnique<Thread>(BatchRoutine, this);
+}
+
+bool BatchOperation::Pause() {
+  MutexLock lock(mutex_);
+  if (canceled_ || complete_ || paused_) return false;
+  paused_ = true;
+  for (auto& item : items_) {
+    if (item->controller) item->controller->Pause();
+  }
+  return true;
+}
+
+bool BatchOperation::Resume() {
+  MutexLock lock(mutex_);
+  if (canceled_ || complete_ || !paused_) return false;
+  paused_ = false;
+  for (auto& item : items_) {
+    if (item->controller) item->controller->Resume();
+  }
+  wake_.Post();
+  return true;
+}
+
+bool BatchOperation::Cancel() {
+  MutexLock lock(mutex_);
+  if (canceled_ || complete_) return false;
+  canceled_ = true;
+  for (auto& item : items_) {
+    if (item->controller) item->controller->Cancel();
+  }
+  wake_.Post();
+  return true;
+}
+
+bool BatchOperation::is_paused() const {
+  MutexLock lock(mutex_);
+  return paused_;
+}
+
+int64_t BatchOperation::bytes_transferred() const {
+  MutexLock lock(mutex_);
+  return completed_;
+}
+
+int64_t BatchOperation::total_byte_count() const {
+  return static_cast<int64_t>(items_.size());
+}
+
+void BatchOperation::ItemFinished(BatchResponse* response) {
+  {
+    MutexLock lock(mutex_);
+    response->finished_ = true;
+  }
+  wake_.Post();
+}
+
+void BatchOperation::BatchRoutine(void* data) {
+  BatchOperation* batch = static_cast<BatchOperation*>(data);
+  batch->Run();
+}
+
+void BatchOperation::Run() {
+  for (size_t i = 0; i < items_.size(); ++i) {
+    if (!items_[i]->reference) {
+      Finish(i, kErrorUnknown, kInvalidReferenceMessage);
+    }
+  }
+
+  for (;;) {
+    bool paused;
+    {
+      MutexLock lock(mutex_);
+      if (canceled_ || completed_ == static_cast<int64_t>(items_.size())) {
+        break;
+      }
+      paused = paused_;
+    }
+
+    // Send a request for each object ready to go, as long as a connection is
+    // free.
+    uint64_t now = ::firebase::internal::GetTimestamp();
+    uint64_t next_retry_time = 0;
+    for (size_t i = 0; i < items_.size() && !paused; ++i) {
+      Item* item = items_[i].get();
+      if (item->done || item->transport) continue;
+      if (item->retry_time > now) {
+        if (next_retry_time == 0 || item->retry_time < next_retry_time) {
+          next_retry_time = item->retry_time;
+        }
+        continue;
+      }
+      if (free_transports_.empty()) break;
+      rest::TransportCurl* transport = free_transports_.back();
+      free_transports_.pop_back();
+      Send(i, transport);
+    }
+
+    if (next_retry_time) {
+      wake_.TimedWait(static_cast<int>(next_retry_time - now));
+    } else {
+      wake_.Wait();
+    }
+
+    // Handle the responses which came back.
+    for (size_t i = 0; i < items_.size(); ++i) {
+      Item* item = items_[i].get();
+      bool finished;
+      {
+        MutexLock lock(mutex_);
+        // Only a request in flight has a response left to handle: the
+        // response of a handled one stays around until it is sent again.
+        finished = item->transport && item->response->finished_;
+      }
+      if (finished) Handle(i);
+    }
+  }
+
+  bool canceled;
+  {
+    MutexLock lock(mutex_);
+    canceled = canceled_;
+  }
+  if (canceled) {
+    StopItems();
+    for (size_t i = 0; i < items_.size(); ++i) {
+      if (!items_[i]->done) Finish(i, kErrorCancelled, "");
+    }
+  }
+  Complete(canceled);
+}
+
+void BatchOperation::Complete(bool canceled) {
+  CompleteBatch(results_, handle_, future_api_);
+  {
+    MutexLock lock(mutex_);
+    complete_ = true;
+  }
+  Notify(Notifier::kUpdateCallbackTypeProgress);
+  Notify(canceled ? Notifier::kUpdateCallbackTypeCanceled
+                  : Notifier::kUpdateCallbackTypeComplete);
+}
+
+void BatchOperation::Send(size_t index, rest::TransportCurl* transport) {
+  Item* item = items_[index].get();
+  StorageReferenceInternal* reference = item->reference.get();
+  rest::Request* request = new rest::Request();
+  switch (type_) {
+    case kBatchOperationDelete:
+      reference->PrepareRequest(
+          request, reference->storageUri_.AsHttpUrl().c_str(), "DELETE");
+      break;
+    case kBatchOperationGetMetadata:
+      reference->PrepareRequest(
+          request, reference->storageUri_.AsHttpMetadataUrl().c_str(),
+          rest::util::kGet);
+      break;
+  }
+
+  MutexLock lock(mutex_);
+  // The previous request and response of the object, if any, are finished.
+  item->request.reset(request);
+  item->response.reset(new BatchResponse(this, index));
+  item->transport = transport;
+  transport->Perform(item->request.get(), item->response.get(),
+                     &item->controller);
+  if (paused_) item->controller->Pause();
+}
+
+void BatchOperation::Handle(size_t index) {
+  Item* item = items_[index].get();
+  BatchResponse* response = item->response.get();
+  {
+    MutexLock lock(mutex_);
+    free_transports_.push_back(item->transport);
+    item->transport = nullptr;
+    item->controller.reset();
+  }
+  if (response->canceled()) return;
+
+  int status = response->status();
+  if (status >= rest::util::HttpSuccess && status < 300) {
+    if (type_ == kBatchOperationGetMetadata) {
+      MetadataInternal* metadata_internal =
+          new MetadataInternal(item->reference->AsStorageReference());
+      if (!metadata_internal->ImportFromJson(response->GetBody())) {
+        // The request was successful, but it returned invalid metadata JSON.
+        delete metadata_internal;
+        Finish(index, kErrorUnknown, kInvalidJsonResponse);
+        return;
+      }
+      results_[index].metadata = MetadataInternal::AsMetadata(metadata_internal);
+    }
+    Finish(index, kErrorNone, std::string());
+    return;
+  }
+
+  std::string error_message;
+  StorageNetworkError network_error;
+  if (network_error.Parse(response->GetBody())) {
+    error_message = network_error.error_message();
+  } else {
+    error_message =
+        status == rest::util::HttpInvalid ? kNoResponse : kInvalidJsonResponse;
+  }
+  if (IsRetryableHttpStatus(status)) {
+    uint64_t now = ::firebase::internal::GetTimestamp();
+    if (item->first_failure == 0) item->first_failure = now;
+    if (now - item->first_failure < max_retry_milliseconds_) {
+      LogDebug("Batch operation on %s failed (%s), retrying in %dms.",
+               item->reference->full_path().c_str(), error_message.c_str(),
+               static_cast<int>(item->retry_delay));
+      item->retry_time = now + item->retry_delay;
+      item->retry_delay =
+          (std::min)(item->retry_delay * 2, kMaxRetryDelayMilliseconds);
+      CountRetry();
+      return;
+    }
+  }
+  Finish(index, HttpToErrorCode(status), error_message);
+}
+
+void BatchOperation::Finish(size_t index, Error error,
+                            const std::string& error_message) {
+  items_[index]->done = true;
+  results_[index].error = error;
+  results_[index].error_message = error_message;
+  {
+    MutexLock lock(mutex_);
+    completed_++;
+  }
+  Notify(Notifier::kUpdateCallbackTypeProgress);
+}
+
+void BatchOperation::StopItems() {
+  {
+    MutexLock lock(mutex_);
+    for (auto& item : items_) {
+      if (item->controller) item->controller->Cancel();
+    }
+  }
+  for (;;) {
+    bool in_flight = false;
+    {
+      MutexLock lock(mutex_);
+      for (auto& item : items_) {
+        if (!item->transport) continue;
+        if (item->response->finished_) {
+          item->transport = nullptr;
+          item->controller.reset();
+        } else {
+          in_flight = true;
+        }
+      }
+    }
+    if (!in_flight) break;
+    wake_.Wait();
+  }
+}
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace firebase
@@ -0,0 +1,156 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_BATCH_OPERATION_H_
+#define FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_BATCH_OPERATION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "app/memory/unique_ptr.h"
+#include "app/rest/controller_interface.h"
+#include "app/rest/request.h"
+#include "app/rest/transport_curl.h"
+#include "app/src/mutex.h"
+#include "app/src/reference_counted_future_impl.h"
+#include "app/src/semaphore.h"
+#include "app/src/thread.h"
+#include "storage/src/common/batch_internal.h"
+#include "storage/src/desktop/chunked_transfer.h"
+#include "storage/src/include/firebase/storage.h"
+
+namespace firebase {
+namespace storage {
+namespace internal {
+
+class BatchResponse;
+class StorageReferenceInternal;
+
+// Deletes or fetches the metadata of many objects, with up to
+// kMaxBatchConcurrency requests in flight at once.  Each concurrent request has
+// a transport of its own, which keeps its connection open from one object to
+// the next, so most requests skip the connection and TLS handshakes.
+//
+// A request which fails with a transient error is tried again, with backoff,
+// as long as the object has been failing for less than the maximum operation
+// retry time.  The other objects go on meanwhile.
+//
+// The requests are scheduled from a thread owned by this object.  The future
+// is completed and the notifier notified from that thread.
+class BatchOperation : public ChunkedTransfer {
+ public:
+  // Copies the references, which may be null.  future_api must be allocated
+  // using FutureManager to ensure it remains valid while the handle isn't
+  // complete.
+  BatchOperation(BatchOperationType type,
+                 const std::vector<StorageReferenceInternal*>& references,
+                 SafeFutureHandle<std::vector<BatchResult>> handle,
+                 ReferenceCountedFutureImpl* future_api);
+  // Cancels the batch if it is still in progress and waits for it to stop.
+  ~BatchOperation() override;
+
+  void Start() override;
+
+  // Pauses the batch, including all the requests in flight.
+  bool Pause() override;
+  bool Resume() override;
+  // Cancels the batch.  The objects not done yet are reported as canceled.
+  bool Cancel() override;
+  bool is_paused() const override;
+  // Progress is counted in objects rather than bytes.
+  int64_t bytes_transferred() const override;
+  int64_t total_byte_count() const override;
+
+ private:
+  friend class BatchResponse;
+
+  // The operation on one object.
+  struct Item {
+    // Defined where BatchResponse is complete.
+    explicit Item(StorageReferenceInternal* reference_);
+    ~Item();
+
+    UniquePtr<StorageReferenceInternal> reference;
+    bool done;
+    // When the object started failing, 0 while it is not, the delay before
+    // the next attempt, and the earliest time of that attempt.
+    uint64_t first_failure;
+    int64_t retry_delay;
+    uint64_t retry_time;
+    // Transport of the request in flight, if any.
+    rest::TransportCurl* transport;
+    UniquePtr<rest::Request> request;
+    UniquePtr<BatchResponse> response;
+    std::unique_ptr<rest::Controller> controller;
+  };
+
+  // Thread routine of the batch thread.
+  static void BatchRoutine(void* data);
+
+  // Run the operations until they are all done or the batch is canceled.
+  void Run();
+
+  // Complete the future and notify the update callback.
+  void Complete(bool canceled);
+
+  // Send the request for an object on the given transport.
+  void Send(size_t index, rest::TransportCurl* transport);
+  // Handle the response for an object, recording its result or scheduling
+  // another attempt.
+  void Handle(size_t index);
+  // Record the result of an object.
+  void Finish(size_t index, Error error, const std::string& error_message);
+
+  // Cancel the requests in flight and wait for them to finish.
+  void StopItems();
+
+  // Called by BatchResponse once its request is finished.
+  void ItemFinished(BatchResponse* response);
+
+  BatchOperationType type_;
+  SafeFutureHandle<std::vector<BatchResult>> handle_;
+  ReferenceCountedFutureImpl* future_api_;
+  uint64_t max_retry_milliseconds_;
+
+  // State of the batch.  Only accessed in the batch thread, except for items_
+  // which is modified there under mutex_.
+  std::vector<UniquePtr<Item>> items_;
+  std::vector<BatchResult> results_;
+  // Transports with no request in flight.
+  std::vector<rest::TransportCurl*> free_transports_;
+  // One transport per concurrent request, as a transport runs one request at
+  // a time.
+  std::vector<UniquePtr<rest::TransportCurl>> transports_;
+
+  // Guards the state shared with the controlling threads below.
+  mutable Mutex mutex_;
+  int64_t completed_;
+  bool paused_;
+  bool canceled_;
+  bool complete_;
+
+  // Posted when a request is finished, and to wake up the batch thread when
+  // the batch is resumed or canceled.
+  Semaphore wake_;
+
+  UniquePtr<Thread> thread_;
+};
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace firebase
+
+#endif  // FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_BATCH_OPERATION_H_
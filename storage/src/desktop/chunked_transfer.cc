@@ -0,0 +1,108 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "storage/src/desktop/chunked_transfer.h"
+
+#include <algorithm>
+#include <cctype>
+
+#include "app/rest/util.h"
+
+namespace firebase {
+namespace storage {
+namespace internal {
+
+const int64_t kInitialRetryDelayMilliseconds = 1000;
+const int64_t kMaxRetryDelayMilliseconds = 32000;
+
+// HTTP status codes which are worth retrying, in addition to 5xx ones.
+static const int kHttpRequestTimeout = 408;
+static const int kHttpTooManyRequests = 429;
+static const int kHttpServerError = 500;
+
+bool IsRetryableHttpStatus(int http_status) {
+  return http_status == rest::util::HttpInvalid ||
+         http_status == kHttpRequestTimeout ||
+         http_status == kHttpTooManyRequests ||
+         http_status >= kHttpServerError;
+}
+
+int ChunkedTransfer::retry_count() const {
+  MutexLock lock(retry_count_mutex_);
+  return retry_count_;
+}
+
+void ChunkedTransfer::CountRetry() {
+  MutexLock lock(retry_count_mutex_);
+  retry_count_++;
+}
+
+void ChunkedTransfer::set_update_callback(Notifier::UpdateCallback callback,
+                                          void* callback_data) {
+  MutexLock lock(notifier_mutex_);
+  notifier_.set_update_callback(callback, callback_data);
+}
+
+void ChunkedTransfer::Notify(Notifier::UpdateCallbackType update_type) {
+  MutexLock lock(notifier_mutex_);
+  switch (update_type) {
+    case Notifier::kUpdateCallbackTypeComplete:
+      notifier_.NotifyComplete();
+      break;
+    case Notifier::kUpdateCallbackTypeCanceled:
+      notifier_.NotifyCanceled();
+      break;
+    case Notifier::kUpdateCallbackTypeProgress:
+      notifier_.NotifyProgress();
+      break;
+  }
+}
+
+bool TransferResponse::ProcessHeader(const char* buffer, size_t length) {
+  std::string header(buffer, length);
+  size_t colon_index = header.find(rest::util::kHttpHeaderSeparator);
+  if (colon_index != std::string::npos) {
+    std::string key =
+        rest::util::TrimWhitespace(header.substr(0, colon_index));
+    std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+    std::string value =
+        rest::util::TrimWhitespace(header.substr(colon_index + 1));
+    // A header sent several times is the list of its values.
+    std::string& values = headers_[key];
+    values = values.empty() ? value : values + ", " + value;
+  }
+  return rest::Response::ProcessHeader(buffer, length);
+}
+
+void TransferResponse::MarkCompleted() {
+  rest::Response::MarkCompleted();
+  Finish();
+}
+
+void TransferResponse::MarkCanceled() {
+  rest::Response::MarkCanceled();
+  canceled_ = true;
+  Finish();
+}
+
+void TransferResponse::Finish() { done_->Post(); }
+
+std::string TransferResponse::header(const char* lower_case_name) const {
+  auto it = headers_.find(lower_case_name);
+  return it != headers_.end() ? it->second : std::string();
+}
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace firebase
@@ -0,0 +1,128 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_CHUNKED_TRANSFER_H_
+#define FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_CHUNKED_TRANSFER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "app/rest/response.h"
+#include "app/src/mutex.h"
+#include "app/src/semaphore.h"
+#include "storage/src/desktop/curl_requests.h"
+
+namespace firebase {
+namespace storage {
+namespace internal {
+
+// Delays between attempts of a failed request of a transfer.
+extern const int64_t kInitialRetryDelayMilliseconds;
+extern const int64_t kMaxRetryDelayMilliseconds;
+
+// Whether a request which failed with the given HTTP status, or 0 if the
+// server could not be reached, is worth trying again.
+bool IsRetryableHttpStatus(int http_status);
+
+// A transfer made of several requests, which RestOperation controls in place
+// of a single request.
+class ChunkedTransfer {
+ public:
+  ChunkedTransfer() : retry_count_(0) {}
+  virtual ~ChunkedTransfer() {}
+
+  // ChunkedTransfer is neither copyable nor movable.
+  ChunkedTransfer(const ChunkedTransfer&) = delete;
+  ChunkedTransfer& operator=(const ChunkedTransfer&) = delete;
+
+  // Start transferring.
+  virtual void Start() = 0;
+
+  // Pauses the transfer, including the requests in flight.
+  virtual bool Pause() = 0;
+  // Resumes the paused transfer.
+  virtual bool Resume() = 0;
+  // Cancels the transfer.
+  virtual bool Cancel() = 0;
+  // Returns true if the transfer is paused.
+  virtual bool is_paused() const = 0;
+  // Returns the number of bytes transferred so far.
+  virtual int64_t bytes_transferred() const = 0;
+  // Returns the total number of bytes to transfer, or -1 while it is unknown.
+  virtual int64_t total_byte_count() const = 0;
+
+  // Returns the number of requests retried after a failure so far.
+  int retry_count() const;
+
+  // Set the callback notified of progress and completion.  When this returns
+  // the previous callback is no longer running and will not be called again.
+  void set_update_callback(Notifier::UpdateCallback callback,
+                           void* callback_data);
+
+ protected:
+  // Notify the update callback.
+  void Notify(Notifier::UpdateCallbackType update_type);
+
+  // Count a request which is about to be retried.
+  void CountRetry();
+
+ private:
+  // Guards notifier_, which is notified while holding it.
+  Mutex notifier_mutex_;
+  Notifier notifier_;
+  mutable Mutex retry_count_mutex_;
+  int retry_count_;
+};
+
+// Response to one of the requests of a ChunkedTransfer.  Unlike
+// BlockingResponse it does not complete any future: the transfer reads the
+// status, headers and body to decide what to do next.
+class TransferResponse : public rest::Response {
+ public:
+  // `done` is posted once the response is complete or canceled, unless a
+  // subclass overrides Finish().
+  explicit TransferResponse(Semaphore* done)
+      : done_(done), canceled_(false) {}
+
+  // Also records the header in lower case, as HTTP/2 servers send lower case
+  // header names and HTTP/1.1 ones usually do not.  The values of a header
+  // sent several times are joined with commas.
+  bool ProcessHeader(const char* buffer, size_t length) override;
+
+  void MarkCompleted() override;
+  void MarkCanceled() override;
+
+  // Value of the given header, which must be passed in lower case, or an
+  // empty string if the server did not send it.
+  std::string header(const char* lower_case_name) const;
+
+  bool canceled() const { return canceled_; }
+
+ protected:
+  // Called once the response is complete or canceled.
+  virtual void Finish();
+
+ private:
+  Semaphore* done_;
+  bool canceled_;
+  std::map<std::string, std::string> headers_;
+};
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace firebase
+
+#endif  // FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_CHUNKED_TRANSFER_H_
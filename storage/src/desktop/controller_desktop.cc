@@ -79,6 +79,26 @@ int64_t ControllerInternal::total_byte_count() {
   return total;
 }
 
+double ControllerInternal::bytes_per_second() const {
+  MutexLock lock(mutex_);
+  return operation_ ? operation_->bytes_per_second() : 0;
+}
+
+double ControllerInternal::average_bytes_per_second() const {
+  MutexLock lock(mutex_);
+  return operation_ ? operation_->average_bytes_per_second() : 0;
+}
+
+double ControllerInternal::estimated_seconds_remaining() const {
+  MutexLock lock(mutex_);
+  return operation_ ? operation_->estimated_seconds_remaining() : -1;
+}
+
+int ControllerInternal::retry_count() const {
+  MutexLock lock(mutex_);
+  return operation_ ? operation_->retry_count() : 0;
+}
+
 // Returns the StorageReference associated with this Controller.
 StorageReferenceInternal* ControllerInternal::GetReference() const {
   MutexLock lock(mutex_);
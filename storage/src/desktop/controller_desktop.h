@@ -60,6 +60,17 @@ class ControllerInternal {
   // Returns the total bytes to be transferred.
   int64_t total_byte_count();
 
+  // Returns the throughput over the last progress interval, and smoothed over
+  // several, in bytes per second.
+  double bytes_per_second() const;
+  double average_bytes_per_second() const;
+
+  // Returns the estimated time to completion in seconds, or -1 if unknown.
+  double estimated_seconds_remaining() const;
+
+  // Returns the number of requests retried after a failure.
+  int retry_count() const;
+
   // Returns the StorageReference associated with this Controller.
   StorageReferenceInternal* GetReference() const;
 
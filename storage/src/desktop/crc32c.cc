@@ -0,0 +1,250 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "storage/src/desktop/crc32c.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define FIREBASE_STORAGE_CRC32C_X86 1
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif  // defined(_MSC_VER)
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define FIREBASE_STORAGE_CRC32C_ARM 1
+#include <arm_acle.h>
+#endif  // defined(__x86_64__) || defined(_M_X64)
+
+#if defined(FIREBASE_STORAGE_CRC32C_X86) && defined(__GNUC__)
+// Only the functions using the CRC32 instruction are built for SSE 4.2, so
+// that the library still runs on CPUs which lack it.
+#define FIREBASE_STORAGE_CRC32C_TARGET __attribute__((target("sse4.2")))
+#else
+#define FIREBASE_STORAGE_CRC32C_TARGET
+#endif  // defined(FIREBASE_STORAGE_CRC32C_X86) && defined(__GNUC__)
+
+namespace firebase {
+namespace storage {
+namespace internal {
+
+// The CRC32C polynomial, bit-reflected.
+static const uint32_t kPolynomial = 0x82f63b78;
+
+// The CRC32 instruction takes 3 cycles, but a new one can start every cycle.
+// Large inputs are split into 3 blocks of this size, checksummed side by side
+// and then combined.
+static const size_t kBlockSize = 4096;
+
+// Returns a * b modulo the polynomial, with bit-reflected operands.
+static uint32_t MultiplyModP(uint32_t a, uint32_t b) {
+  uint32_t m = 1u << 31;
+  uint32_t product = 0;
+  for (;;) {
+    if (a & m) {
+      product ^= b;
+      if ((a & (m - 1)) == 0) break;
+    }
+    m >>= 1;
+    b = b & 1 ? (b >> 1) ^ kPolynomial : b >> 1;
+  }
+  return product;
+}
+
+struct Crc32cTables {
+  Crc32cTables();
+
+  // Returns x^(n * 2^k) modulo the polynomial.
+  uint32_t PowerOfX(int64_t n, int k) const {
+    uint32_t power = 1u << 31;  // x^0
+    while (n) {
+      if (n & 1) power = MultiplyModP(powers_of_x[k & 31], power);
+      n >>= 1;
+      k++;
+    }
+    return power;
+  }
+
+  // Extend the unconditioned checksum `crc` with kBlockSize zero bytes.
+  uint32_t ShiftBlock(uint32_t crc) const {
+    return shift_block[0][crc & 0xff] ^ shift_block[1][(crc >> 8) & 0xff] ^
+           shift_block[2][(crc >> 16) & 0xff] ^ shift_block[3][crc >> 24];
+  }
+
+  // Slicing-by-8 tables: bytes[k][b] is the checksum of the byte b followed
+  // by k zero bytes.
+  uint32_t bytes[8][256];
+  // powers_of_x[k] is x^(2^k) modulo the polynomial.
+  uint32_t powers_of_x[32];
+  // Multiplication by x^(8 * kBlockSize), one table per byte of the operand.
+  uint32_t shift_block[4][256];
+};
+
+Crc32cTables::Crc32cTables() {
+  for (uint32_t n = 0; n < 256; ++n) {
+    uint32_t crc = n;
+    for (int i = 0; i < 8; ++i) {
+      crc = crc & 1 ? (crc >> 1) ^ kPolynomial : crc >> 1;
+    }
+    bytes[0][n] = crc;
+  }
+  for (uint32_t n = 0; n < 256; ++n) {
+    for (int k = 1; k < 8; ++k) {
+      bytes[k][n] = (bytes[k - 1][n] >> 8) ^ bytes[0][bytes[k - 1][n] & 0xff];
+    }
+  }
+  powers_of_x[0] = 1u << 30;  // x^1
+  for (int k = 1; k < 32; ++k) {
+    powers_of_x[k] = MultiplyModP(powers_of_x[k - 1], powers_of_x[k - 1]);
+  }
+  uint32_t shift = PowerOfX(kBlockSize, 3);
+  for (int i = 0; i < 4; ++i) {
+    for (uint32_t n = 0; n < 256; ++n) {
+      shift_block[i][n] = MultiplyModP(shift, n << (8 * i));
+    }
+  }
+}
+
+static const Crc32cTables& GetTables() {
+  static const Crc32cTables* tables = new Crc32cTables();
+  return *tables;
+}
+
+static uint32_t Load32(const uint8_t* data) {
+  return static_cast<uint32_t>(data[0]) |
+         static_cast<uint32_t>(data[1]) << 8 |
+         static_cast<uint32_t>(data[2]) << 16 |
+         static_cast<uint32_t>(data[3]) << 24;
+}
+
+// Extend an unconditioned checksum, 8 bytes at a time using the tables.
+static uint32_t ExtendWithTables(uint32_t crc, const uint8_t* data,
+                                 size_t length) {
+  const Crc32cTables& tables = GetTables();
+  while (length >= 8) {
+    uint32_t low = Load32(data) ^ crc;
+    uint32_t high = Load32(data + 4);
+    crc = tables.bytes[7][low & 0xff] ^ tables.bytes[6][(low >> 8) & 0xff] ^
+          tables.bytes[5][(low >> 16) & 0xff] ^ tables.bytes[4][low >> 24] ^
+          tables.bytes[3][high & 0xff] ^ tables.bytes[2][(high >> 8) & 0xff] ^
+          tables.bytes[1][(high >> 16) & 0xff] ^ tables.bytes[0][high >> 24];
+    data += 8;
+    length -= 8;
+  }
+  while (length--) {
+    crc = (crc >> 8) ^ tables.bytes[0][(crc ^ *data++) & 0xff];
+  }
+  return crc;
+}
+
+#if defined(FIREBASE_STORAGE_CRC32C_X86) || defined(FIREBASE_STORAGE_CRC32C_ARM)
+
+static uint64_t Load64(const uint8_t* data) {
+  uint64_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+FIREBASE_STORAGE_CRC32C_TARGET static uint32_t Crc32Byte(uint32_t crc,
+                                                         uint8_t value) {
+#if defined(FIREBASE_STORAGE_CRC32C_X86)
+  return _mm_crc32_u8(crc, value);
+#else
+  return __crc32cb(crc, value);
+#endif  // defined(FIREBASE_STORAGE_CRC32C_X86)
+}
+
+FIREBASE_STORAGE_CRC32C_TARGET static uint32_t Crc32Word(uint32_t crc,
+                                                         uint64_t value) {
+#if defined(FIREBASE_STORAGE_CRC32C_X86)
+  return static_cast<uint32_t>(_mm_crc32_u64(crc, value));
+#else
+  return __crc32cd(crc, value);
+#endif  // defined(FIREBASE_STORAGE_CRC32C_X86)
+}
+
+// Extend an unconditioned checksum with the CRC32 instruction.
+FIREBASE_STORAGE_CRC32C_TARGET static uint32_t ExtendWithInstructions(
+    uint32_t crc, const uint8_t* data, size_t length) {
+  while (length >= 3 * kBlockSize) {
+    const Crc32cTables& tables = GetTables();
+    uint32_t crc1 = 0;
+    uint32_t crc2 = 0;
+    const uint8_t* end = data + kBlockSize;
+    do {
+      crc = Crc32Word(crc, Load64(data));
+      crc1 = Crc32Word(crc1, Load64(data + kBlockSize));
+      crc2 = Crc32Word(crc2, Load64(data + 2 * kBlockSize));
+      data += 8;
+    } while (data < end);
+    crc = tables.ShiftBlock(tables.ShiftBlock(crc) ^ crc1) ^ crc2;
+    data += 2 * kBlockSize;
+    length -= 3 * kBlockSize;
+  }
+  while (length >= 8) {
+    crc = Crc32Word(crc, Load64(data));
+    data += 8;
+    length -= 8;
+  }
+  while (length--) crc = Crc32Byte(crc, *data++);
+  return crc;
+}
+
+static bool HasCrc32Instructions() {
+#if defined(FIREBASE_STORAGE_CRC32C_ARM)
+  return true;
+#elif defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 20)) != 0;
+#else
+  return __builtin_cpu_supports("sse4.2");
+#endif  // defined(FIREBASE_STORAGE_CRC32C_ARM)
+}
+
+#endif  // defined(FIREBASE_STORAGE_CRC32C_X86) ||
+        // defined(FIREBASE_STORAGE_CRC32C_ARM)
+
+uint32_t Crc32cExtend(uint32_t crc, const void* data, size_t length) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  crc = ~crc;
+#if defined(FIREBASE_STORAGE_CRC32C_X86) || defined(FIREBASE_STORAGE_CRC32C_ARM)
+  static const bool has_instructions = HasCrc32Instructions();
+  if (has_instructions) return ~ExtendWithInstructions(crc, bytes, length);
+#endif  // defined(FIREBASE_STORAGE_CRC32C_X86) ||
+        // defined(FIREBASE_STORAGE_CRC32C_ARM)
+  return ~ExtendWithTables(crc, bytes, length);
+}
+
+uint32_t Crc32cCombine(uint32_t crc1, uint32_t crc2, int64_t length2) {
+  if (length2 <= 0) return crc1;
+  return MultiplyModP(GetTables().PowerOfX(length2, 3), crc1) ^ crc2;
+}
+
+std::string Crc32cToBase64(uint32_t crc) {
+  static const char kAlphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  // 4 bytes make 5 full groups of 6 bits and 2 bits of a sixth, padded.
+  uint64_t bits = static_cast<uint64_t>(crc) << 4;
+  std::string encoded;
+  for (int shift = 30; shift >= 0; shift -= 6) {
+    encoded += kAlphabet[(bits >> shift) & 0x3f];
+  }
+  encoded += "==";
+  return encoded;
+}
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace firebase
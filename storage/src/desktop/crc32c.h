@@ -0,0 +1,48 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_CRC32C_H_
+#define FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_CRC32C_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace firebase {
+namespace storage {
+namespace internal {
+
+// CRC32C (Castagnoli) checksums, which Cloud Storage keeps for every object.
+//
+// The checksum is computed with the CRC32 instructions of the CPU where it has
+// them (SSE 4.2 on x86, the CRC extension on ARMv8), and with tables
+// otherwise.
+
+// Returns the CRC32C of some data followed by `length` more bytes, given the
+// CRC32C of the data.  The CRC32C of no data is 0.
+uint32_t Crc32cExtend(uint32_t crc, const void* data, size_t length);
+
+// Returns the CRC32C of two blocks of data one after the other, given the
+// CRC32C of each of them and the length of the second one.
+uint32_t Crc32cCombine(uint32_t crc1, uint32_t crc2, int64_t length2);
+
+// Returns the CRC32C in the form Cloud Storage reports it: base64 of the
+// big-endian checksum.
+std::string Crc32cToBase64(uint32_t crc);
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace firebase
+
+#endif  // FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_CRC32C_H_
@@ -13,6 +13,10 @@
 // limitations under the License.
 
 #include <stdio.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <random>
 #include <string>
 
 #include "storage/src/desktop/curl_requests.h"
@@ -29,6 +33,8 @@ namespace internal {
 static const char* kInvalidJsonResponse =
     "The server did not return a valid JSON response.  "
     "Contact Firebase support if this issue persists.";
+static const char* kUploadChecksumMismatch =
+    "The object stored by the server does not match the data uploaded.";
 
 // Utility function to map HTTP status requests onto Firebase Error Codes.
 // Note that the mapping is not 1:1, so not all Firebase error codes can be
@@ -56,6 +62,84 @@ Error HttpToErrorCode(int http_status) {
   }
 }
 
+// Generate a multipart boundary.  The content is streamed, so it can't be
+// checked for the boundary; a random one that long is not going to be in it.
+static std::string GenerateBoundary() {
+  static const char kDigits[] = "0123456789abcdef";
+  std::random_device random_device;
+  std::string boundary = "firebase-storage-";
+  for (int i = 0; i < 4; ++i) {
+    uint32_t value = random_device();
+    for (int j = 0; j < 8; ++j, value >>= 4) boundary += kDigits[value & 0xf];
+  }
+  return boundary;
+}
+
+MultipartBody::MultipartBody(const std::string& metadata_json,
+                             const char* content_type, rest::Request* content)
+    : boundary_(GenerateBoundary()), content_(content), offset_(0) {
+  options_.stream_post_fields = true;
+  header_ = "--" + boundary_ + "\r\n" + rest::util::kContentType + ": " +
+            rest::util::kApplicationJson + "; charset=utf-8\r\n\r\n" +
+            metadata_json + "\r\n--" + boundary_ + "\r\n" +
+            rest::util::kContentType + ": " + content_type + "\r\n\r\n";
+  trailer_ = "\r\n--" + boundary_ + "--";
+}
+
+// This object will assert if post fields are set.
+void MultipartBody::set_post_fields(const char* /*data*/, size_t /*size*/) {
+  assert(false);
+}
+
+void MultipartBody::set_post_fields(const char* /*data*/) { assert(false); }
+
+size_t MultipartBody::GetPostFieldsSize() const {
+  return header_.size() + content_->GetPostFieldsSize() + trailer_.size();
+}
+
+size_t MultipartBody::ReadBody(char* buffer, size_t length, bool* abort) {
+  *abort = false;
+  size_t read_size = 0;
+  // Copy what is left of the header.
+  if (offset_ < header_.size()) {
+    read_size = std::min(length, header_.size() - offset_);
+    memcpy(buffer, header_.data() + offset_, read_size);
+    offset_ += read_size;
+    if (read_size == length) return read_size;
+  }
+  // Then the content, until it runs out.
+  size_t content_size = content_->GetPostFieldsSize();
+  size_t content_end = header_.size() + content_size;
+  if (offset_ < content_end) {
+    size_t content_read = content_->ReadBody(
+        buffer + read_size, std::min(length - read_size, content_end - offset_),
+        abort);
+    if (*abort) return 0;
+    // The content ending early would make the body shorter than announced.
+    if (content_read == 0) {
+      *abort = true;
+      return 0;
+    }
+    read_size += content_read;
+    offset_ += content_read;
+    if (offset_ < content_end) return read_size;
+  }
+  // Then the trailer.
+  size_t trailer_offset = offset_ - content_end;
+  if (trailer_offset < trailer_.size() && read_size < length) {
+    size_t trailer_read =
+        std::min(length - read_size, trailer_.size() - trailer_offset);
+    memcpy(buffer + read_size, trailer_.data() + trailer_offset, trailer_read);
+    read_size += trailer_read;
+    offset_ += trailer_read;
+  }
+  return read_size;
+}
+
+std::string MultipartBody::content_type() const {
+  return "multipart/related; boundary=" + boundary_;
+}
+
 // ref_future must be allocated using FutureManager to ensure ref_future
 // remains valid while the future handle isn't complete.
 BlockingResponse::BlockingResponse(FutureHandle handle,
@@ -184,57 +268,6 @@ void EmptyResponse::MarkCompleted() {
   BlockingResponse::NotifyComplete();
 }
 
-GetFileResponse::GetFileResponse(const char* filename,
-                                 SafeFutureHandle<size_t> handle,
-                                 ReferenceCountedFutureImpl* ref_future)
-    : BlockingResponse(handle.get(), ref_future),
-      filename_(filename),
-      bytes_written_(0) {}
-
-// Since buffer may NOT necessarily end with \0, pass in length.
-bool GetFileResponse::ProcessBody(const char* buffer, size_t length) {
-  // Things are fine, send the received data to a file.
-  if (status() == rest::util::HttpSuccess) {
-    if (!file_.is_open()) {
-      // Writing in binary mode prevents Windows from converting characters such
-      // as "\n" to "\r\n".
-      file_.open(filename_, std::ios::out | std::ios::binary);
-    }
-    file_.write(buffer, length);
-    bytes_written_ += length;
-  } else {
-    // Things are not fine.  Send to a buffer so we can parse the error
-    // response later.
-    error_buffer_.append(buffer);
-  }
-  NotifyProgress();
-  return true;
-}
-
-void GetFileResponse::MarkCompleted() {
-  BlockingResponse::MarkCompleted();
-  SafeFutureHandle<size_t> future_handle_with_size(handle_);
-  if (status() == rest::util::HttpSuccess) {
-    file_.close();
-    ref_future_->CompleteWithResult(future_handle_with_size, kErrorNone,
-                                    bytes_written_);
-  } else {
-    StorageNetworkError response;
-    if (response.Parse(error_buffer_.c_str())) {
-      ref_future_->CompleteWithResult(
-          future_handle_with_size, HttpToErrorCode(status()),
-          response.error_message().c_str(), bytes_written_);
-    } else {
-      // No dice, couldn't parse the bytes we got.
-      ref_future_->CompleteWithResult(future_handle_with_size,
-                                      HttpToErrorCode(status()),
-                                      kInvalidJsonResponse, bytes_written_);
-    }
-  }
-  NotifyProgress();
-  BlockingResponse::NotifyComplete();
-}
-
 ReturnedMetadataResponse::ReturnedMetadataResponse(
     SafeFutureHandle<Metadata> handle, ReferenceCountedFutureImpl* ref_future,
     const StorageReference& storage_reference)
@@ -253,13 +286,18 @@ void ReturnedMetadataResponse::MarkCompleted() {
   if (status() == rest::util::HttpSuccess) {
     MetadataInternal* metadata_internal =
         new MetadataInternal(storage_reference_);
-    if (metadata_internal->ImportFromJson(buffer_.c_str())) {
-      ref_future_->CompleteWithResult(
-          handle, kErrorNone, MetadataInternal::AsMetadata(metadata_internal));
-    } else {
+    if (!metadata_internal->ImportFromJson(buffer_.c_str())) {
       // The HTTP request was successful, but it returned invalid metadata JSON.
       ref_future_->Complete(handle, kErrorUnknown, kInvalidJsonResponse);
       delete metadata_internal;
+    } else if (!expected_crc32c_.empty() &&
+               !metadata_internal->crc32c().empty() &&
+               metadata_internal->crc32c() != expected_crc32c_) {
+      ref_future_->Complete(handle, kErrorUnknown, kUploadChecksumMismatch);
+      delete metadata_internal;
+    } else {
+      ref_future_->CompleteWithResult(
+          handle, kErrorNone, MetadataInternal::AsMetadata(metadata_internal));
     }
   } else {
     StorageNetworkError response;
@@ -15,8 +15,9 @@
 #ifndef FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_CURL_REQUESTS_H_
 #define FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_CURL_REQUESTS_H_
 
-#include <fstream>
+#include <string>
 
+#include "app/memory/unique_ptr.h"
 #include "app/rest/request_binary.h"
 #include "app/rest/request_file.h"
 #include "app/rest/response_binary.h"
@@ -36,6 +37,9 @@ namespace firebase {
 namespace storage {
 namespace internal {
 
+// Map an HTTP status code onto the closest Firebase Storage error code.
+Error HttpToErrorCode(int http_status);
+
 // Notifies a subscriber via Notifier::UpdateCallback of UpdateCallbackType
 // events (completion, cancelation and progress of a transfer).
 class Notifier {
@@ -142,6 +146,45 @@ class RequestFile : public rest::RequestFile {
   FIREBASE_STORAGE_REQUEST_CLASS_BODY(rest::RequestFile);
 };
 
+// Streams a multipart/related upload body: a JSON part with the metadata of
+// the object, followed by the content read from another request.  The content
+// is read as the transport sends it, so it is never held in memory as a whole.
+class MultipartBody : public rest::Request {
+ public:
+  // Takes ownership of content.
+  MultipartBody(const std::string& metadata_json, const char* content_type,
+                rest::Request* content);
+
+  // This object will assert if post fields are set.
+  void set_post_fields(const char* data, size_t size) override;
+  void set_post_fields(const char* data) override;
+
+  size_t GetPostFieldsSize() const override;
+  size_t ReadBody(char* buffer, size_t length, bool* abort) override;
+
+  // Value of the Content-Type header to send with this body.
+  std::string content_type() const;
+
+ private:
+  std::string boundary_;
+  // Everything before and after the content.
+  std::string header_;
+  std::string trailer_;
+  UniquePtr<rest::Request> content_;
+  // Number of bytes of the body read so far.
+  size_t offset_;
+};
+
+// Uploads metadata and content in one request.
+class RequestMultipart : public MultipartBody {
+ public:
+  RequestMultipart(const std::string& metadata_json, const char* content_type,
+                   rest::Request* content)
+      : MultipartBody(metadata_json, content_type, content) {}
+
+  FIREBASE_STORAGE_REQUEST_CLASS_BODY(MultipartBody);
+};
+
 // TODO(b/68854714): merge with the blocking response in query_desktop.
 // b/68854714
 class BlockingResponse : public rest::Response {
@@ -216,23 +259,6 @@ class GetBytesResponse : public BlockingResponse {
   size_t buffer_index_;
 };
 
-// Response for downloading a storage resource directly into a file.
-// Primarily useful because it doesn't have to fit in memory - the pieces get
-// shoved into an fstream as they are received.
-class GetFileResponse : public BlockingResponse {
- public:
-  GetFileResponse(const char* filename, SafeFutureHandle<size_t> handle,
-                  ReferenceCountedFutureImpl* ref_future);
-  bool ProcessBody(const char* buffer, size_t length) override;
-  void MarkCompleted() override;
-
- private:
-  std::string filename_;
-  std::string error_buffer_;
-  std::fstream file_;
-  size_t bytes_written_;
-};
-
 // Response for any operation that returns a blob of text that we need
 // to interpret as metadata.
 class ReturnedMetadataResponse : public BlockingResponse {
@@ -243,9 +269,16 @@ class ReturnedMetadataResponse : public BlockingResponse {
   bool ProcessBody(const char* buffer, size_t length) override;
   void MarkCompleted() override;
 
+  // Fail unless the object has this base64 CRC32C, for a response to an
+  // upload.
+  void set_expected_crc32c(const std::string& crc32c) {
+    expected_crc32c_ = crc32c;
+  }
+
  private:
   std::string buffer_;
   StorageReference storage_reference_;
+  std::string expected_crc32c_;
 };
 
 // Utility class for parsing a Storage REST error response (in JSON form) and
@@ -0,0 +1,451 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "storage/src/desktop/download_cache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <direct.h>
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif  // defined(_WIN32)
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <vector>
+
+#include "app/src/log.h"
+#include "app/src/time.h"
+
+namespace firebase {
+namespace storage {
+namespace internal {
+
+// Name of the file listing the cached objects, in the cache directory.
+static const char kIndexFileName[] = "index";
+// Name of the file the index is written to before it replaces the old one.
+static const char kNewIndexFileName[] = "index.new";
+// Extension of the files objects are downloaded into before being cached.
+static const char kDownloadExtension[] = ".download";
+// Prefixes of the content files, see ContentFileName().
+static const char kMd5ContentPrefix[] = "md5-";
+static const char kEtagContentPrefix[] = "etag-";
+// Downloads which have not written to their file for this long are
+// considered abandoned.  Another cache on the same directory may be
+// downloading into the more recent ones.
+static const int64_t kAbandonedDownloadSeconds = 60 * 60;
+// Time after which a hit alone causes the index to be saved.
+static const uint64_t kIndexSaveIntervalMilliseconds = 60 * 1000;
+
+static const char kCacheControlMaxAge[] = "max-age=";
+static const char kCacheControlNoCache[] = "no-cache";
+static const char kCacheControlNoStore[] = "no-store";
+
+MappedFile::~MappedFile() { Close(); }
+
+#if defined(_WIN32)
+
+bool MappedFile::Open(const char* filename) {
+  Close();
+  HANDLE file = CreateFileA(filename, GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) return false;
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size)) {
+    CloseHandle(file);
+    return false;
+  }
+  // An empty file can not be mapped, and does not need to be.
+  if (file_size.QuadPart > 0) {
+    HANDLE mapping =
+        CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* view =
+        mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    // The view keeps the file mapped.
+    if (mapping) CloseHandle(mapping);
+    CloseHandle(file);
+    if (!view) return false;
+    data_ = static_cast<const char*>(view);
+  } else {
+    CloseHandle(file);
+  }
+  size_ = static_cast<size_t>(file_size.QuadPart);
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_) UnmapViewOfFile(data_);
+  data_ = nullptr;
+  size_ = 0;
+}
+
+static bool MakeDirectory(const std::string& directory) {
+  return _mkdir(directory.c_str()) == 0 || errno == EEXIST;
+}
+
+static bool ReplaceFile(const std::string& from, const std::string& to) {
+  return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+static void ListDirectory(const std::string& directory,
+                          std::vector<std::string>* file_names) {
+  WIN32_FIND_DATAA find_data;
+  HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &find_data);
+  if (find == INVALID_HANDLE_VALUE) return;
+  do {
+    if (!(find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+      file_names->push_back(find_data.cFileName);
+    }
+  } while (FindNextFileA(find, &find_data));
+  FindClose(find);
+}
+
+#else
+
+bool MappedFile::Open(const char* filename) {
+  Close();
+  int file = open(filename, O_RDONLY);
+  if (file < 0) return false;
+  struct stat file_stat;
+  if (fstat(file, &file_stat) != 0) {
+    close(file);
+    return false;
+  }
+  // An empty file can not be mapped, and does not need to be.
+  if (file_stat.st_size > 0) {
+    void* data = mmap(nullptr, static_cast<size_t>(file_stat.st_size),
+                      PROT_READ, MAP_PRIVATE, file, 0);
+    // The mapping keeps the file open.
+    close(file);
+    if (data == MAP_FAILED) return false;
+    data_ = static_cast<const char*>(data);
+  } else {
+    close(file);
+  }
+  size_ = static_cast<size_t>(file_stat.st_size);
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_) munmap(const_cast<char*>(data_), size_);
+  data_ = nullptr;
+  size_ = 0;
+}
+
+static bool MakeDirectory(const std::string& directory) {
+  return mkdir(directory.c_str(), 0700) == 0 || errno == EEXIST;
+}
+
+static bool ReplaceFile(const std::string& from, const std::string& to) {
+  return rename(from.c_str(), to.c_str()) == 0;
+}
+
+static void ListDirectory(const std::string& directory,
+                          std::vector<std::string>* file_names) {
+  DIR* dir = opendir(directory.c_str());
+  if (!dir) return;
+  while (struct dirent* entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name != "." && name != "..") file_names->push_back(name);
+  }
+  closedir(dir);
+}
+
+#endif  // defined(_WIN32)
+
+DownloadCache::DownloadCache(const std::string& directory, int64_t max_size)
+    : directory_(directory),
+      max_size_(max_size),
+      size_(0),
+      download_count_(0),
+      index_changed_(false),
+      index_save_time_(0) {
+  if (!MakeDirectory(directory_)) {
+    LogWarning("Could not create the download cache directory %s.",
+               directory_.c_str());
+  }
+  MutexLock lock(mutex_);
+  Load();
+  DeleteUnusedFiles();
+  // The limit may have been lowered since the cache was last used.
+  Evict();
+  index_save_time_ = ::firebase::internal::GetTimestamp();
+}
+
+DownloadCache::~DownloadCache() {
+  MutexLock lock(mutex_);
+  if (index_changed_) Save();
+}
+
+bool DownloadCache::Find(const std::string& key, Entry* entry) const {
+  MutexLock lock(mutex_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) return false;
+  *entry = it->second;
+  return true;
+}
+
+bool DownloadCache::Read(const std::string& key, const Entry& entry,
+                         MappedFile* content) {
+  if (content->Open(PathOf(entry.content_file).c_str()) &&
+      static_cast<int64_t>(content->size()) == entry.size) {
+    return true;
+  }
+  LogDebug("Dropping %s from the download cache, its content is gone.",
+           key.c_str());
+  MutexLock lock(mutex_);
+  auto it = entries_.find(key);
+  if (it != entries_.end() && it->second.content_file == entry.content_file) {
+    Remove(it);
+    Save();
+  }
+  return false;
+}
+
+std::string DownloadCache::NewDownloadPath() {
+  MutexLock lock(mutex_);
+  std::stringstream name;
+  name << ::firebase::internal::GetTimestamp() << "-" << ++download_count_
+       << kDownloadExtension;
+  return PathOf(name.str());
+}
+
+void DownloadCache::Insert(const std::string& key, const Entry& entry,
+                           const std::string& download_path) {
+  Entry new_entry = entry;
+  new_entry.content_file = ContentFileName(entry);
+  new_entry.access_time = ::firebase::internal::GetTimestamp();
+
+  MutexLock lock(mutex_);
+  if (new_entry.size > max_size_) {
+    remove(download_path.c_str());
+    return;
+  }
+  if (content_files_.find(new_entry.content_file) != content_files_.end()) {
+    // Another object has the same content.
+    remove(download_path.c_str());
+  } else {
+    std::string path = PathOf(new_entry.content_file);
+    remove(path.c_str());
+    if (rename(download_path.c_str(), path.c_str()) != 0) {
+      LogDebug("Could not add %s to the download cache.", key.c_str());
+      remove(download_path.c_str());
+      return;
+    }
+    size_ += new_entry.size;
+  }
+  // Count the new entry first, so that replacing an entry with the same
+  // content keeps the content.
+  content_files_[new_entry.content_file]++;
+  auto it = entries_.find(key);
+  if (it != entries_.end()) Remove(it);
+  entries_[key] = new_entry;
+  Evict();
+  Save();
+}
+
+void DownloadCache::RecordHit(const std::string& key,
+                              uint64_t expiration_time, int64_t size) {
+  MutexLock lock(mutex_);
+  stats_.hits++;
+  stats_.bytes_saved += size;
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    uint64_t now = ::firebase::internal::GetTimestamp();
+    it->second.access_time = now;
+    it->second.expiration_time = expiration_time;
+    // Losing a hit only makes the entry look older, or be checked with the
+    // server once more, so it is not worth rewriting the index every time.
+    index_changed_ = true;
+    if (now - index_save_time_ >= kIndexSaveIntervalMilliseconds) Save();
+  }
+}
+
+void DownloadCache::RecordMiss() {
+  MutexLock lock(mutex_);
+  stats_.misses++;
+}
+
+DownloadCacheStats DownloadCache::stats() const {
+  MutexLock lock(mutex_);
+  return stats_;
+}
+
+uint64_t DownloadCache::ExpirationTime(const std::string& cache_control,
+                                       uint64_t now) {
+  std::string directives = cache_control;
+  std::transform(directives.begin(), directives.end(), directives.begin(),
+                 ::tolower);
+  if (directives.find(kCacheControlNoCache) != std::string::npos) return 0;
+  size_t max_age = directives.find(kCacheControlMaxAge);
+  if (max_age == std::string::npos) return 0;
+  int64_t seconds = strtoll(  // NOLINT
+      directives.c_str() + max_age + sizeof(kCacheControlMaxAge) - 1, nullptr,
+      10);
+  return seconds > 0 ? now + static_cast<uint64_t>(seconds) * 1000 : 0;
+}
+
+bool DownloadCache::IsCacheable(const std::string& cache_control) {
+  std::string directives = cache_control;
+  std::transform(directives.begin(), directives.end(), directives.begin(),
+                 ::tolower);
+  return directives.find(kCacheControlNoStore) == std::string::npos;
+}
+
+std::string DownloadCache::ContentFileName(const Entry& entry) {
+  if (!entry.md5_hash.empty()) {
+    // Base64 with the characters which are not safe in file names replaced.
+    std::string name = kMd5ContentPrefix;
+    for (char c : entry.md5_hash) {
+      if (c == '+') {
+        name += '-';
+      } else if (c == '/') {
+        name += '_';
+      } else if (c != '=') {
+        name += c;
+      }
+    }
+    return name;
+  }
+  // Without a hash of the content, the version of the object stands for it.
+  std::stringstream name;
+  name << kEtagContentPrefix << std::hex
+       << std::hash<std::string>()(entry.etag + "/" + entry.generation) << "-"
+       << std::dec << entry.size;
+  return name.str();
+}
+
+std::string DownloadCache::PathOf(const std::string& file_name) const {
+  return directory_ + "/" + file_name;
+}
+
+void DownloadCache::Load() {
+  std::ifstream file(PathOf(kIndexFileName).c_str());
+  if (!file.is_open()) return;
+  // One line per entry, with tab separated fields.  The keys are URLs, so
+  // they contain neither tabs nor line breaks.
+  std::string line;
+  while (std::getline(file, line)) {
+    std::vector<std::string> fields;
+    std::stringstream line_stream(line);
+    std::string field;
+    while (std::getline(line_stream, field, '\t')) fields.push_back(field);
+    if (fields.size() != 8) continue;
+    Entry entry;
+    entry.etag = fields[1];
+    entry.generation = fields[2];
+    entry.md5_hash = fields[3];
+    entry.content_file = fields[4];
+    entry.size = strtoll(fields[5].c_str(), nullptr, 10);  // NOLINT
+    entry.expiration_time = strtoull(fields[6].c_str(), nullptr, 10);  // NOLINT
+    entry.access_time = strtoull(fields[7].c_str(), nullptr, 10);  // NOLINT
+    if (entries_.find(fields[0]) != entries_.end()) continue;
+    if (content_files_[entry.content_file]++ == 0) size_ += entry.size;
+    entries_[fields[0]] = entry;
+  }
+}
+
+void DownloadCache::Save() {
+  index_changed_ = false;
+  index_save_time_ = ::firebase::internal::GetTimestamp();
+  std::string new_index_path = PathOf(kNewIndexFileName);
+  bool saved;
+  {
+    std::ofstream file(new_index_path.c_str(), std::ios::out | std::ios::trunc);
+    for (auto& it : entries_) {
+      const Entry& entry = it.second;
+      file << it.first << "\t" << entry.etag << "\t" << entry.generation
+           << "\t" << entry.md5_hash << "\t" << entry.content_file << "\t"
+           << entry.size << "\t" << entry.expiration_time << "\t"
+           << entry.access_time << "\n";
+    }
+    file.close();
+    saved = !file.fail();
+  }
+  // The old index stays in place unless the new one was written whole.
+  if (!saved || !ReplaceFile(new_index_path, PathOf(kIndexFileName))) {
+    remove(new_index_path.c_str());
+    LogDebug("Could not save the download cache index in %s.",
+             directory_.c_str());
+  }
+}
+
+void DownloadCache::DeleteUnusedFiles() {
+  std::vector<std::string> file_names;
+  ListDirectory(directory_, &file_names);
+  time_t now = time(nullptr);
+  for (const std::string& name : file_names) {
+    // Only touch the files the cache names, whatever else is in the
+    // directory.
+    bool is_download =
+        name.size() > sizeof(kDownloadExtension) - 1 &&
+        name.compare(name.size() - (sizeof(kDownloadExtension) - 1),
+                     std::string::npos, kDownloadExtension) == 0;
+    bool is_content = name.compare(0, sizeof(kMd5ContentPrefix) - 1,
+                                   kMd5ContentPrefix) == 0 ||
+                      name.compare(0, sizeof(kEtagContentPrefix) - 1,
+                                   kEtagContentPrefix) == 0;
+    std::string path = PathOf(name);
+    if (is_download) {
+      struct stat file_stat;
+      if (stat(path.c_str(), &file_stat) != 0 ||
+          now - file_stat.st_mtime < kAbandonedDownloadSeconds) {
+        continue;
+      }
+    } else if (!is_content ||
+               content_files_.find(name) != content_files_.end()) {
+      if (name != kNewIndexFileName) continue;
+    }
+    LogDebug("Deleting %s from the download cache, it is not used.",
+             name.c_str());
+    remove(path.c_str());
+  }
+}
+
+void DownloadCache::Remove(std::map<std::string, Entry>::iterator it) {
+  const Entry& entry = it->second;
+  auto content_file = content_files_.find(entry.content_file);
+  if (content_file != content_files_.end() && --content_file->second == 0) {
+    content_files_.erase(content_file);
+    remove(PathOf(entry.content_file).c_str());
+    size_ -= entry.size;
+  }
+  entries_.erase(it);
+}
+
+void DownloadCache::Evict() {
+  while (size_ > max_size_ && !entries_.empty()) {
+    auto oldest = entries_.begin();
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+      if (it->second.access_time < oldest->second.access_time) oldest = it;
+    }
+    Remove(oldest);
+  }
+}
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace firebase
@@ -0,0 +1,170 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_DOWNLOAD_CACHE_H_
+#define FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_DOWNLOAD_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "app/src/mutex.h"
+#include "storage/src/include/firebase/storage/common.h"
+
+namespace firebase {
+namespace storage {
+namespace internal {
+
+// Read-only view of a whole file, mapped in memory.
+class MappedFile {
+ public:
+  MappedFile() : data_(nullptr), size_(0) {}
+  ~MappedFile();
+
+  // MappedFile is neither copyable nor movable.
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Map the given file.  Returns false if it could not be read.
+  bool Open(const char* filename);
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  void Close();
+
+  const char* data_;
+  size_t size_;
+};
+
+// Cache of downloaded objects on disk, shared by the downloads of a Storage
+// instance.
+//
+// Each object is recorded under its URL, with the version the server
+// returned it at.  The content itself is stored in a file named after its
+// MD5 hash when the server sends one, so objects with the same content share
+// it.  The least recently used objects are dropped once the content exceeds
+// the size limit.  The list of objects is kept in an index file in the cache
+// directory, so the cache outlives the process.  The index is replaced as a
+// whole, so a crash leaves either the old or the new one.  Only recording a
+// hit does not save it right away: it is saved with the next change, at most
+// once per minute otherwise, and when the cache is destroyed.
+//
+// Files left in the directory by downloads which never completed, or whose
+// entries are gone from the index, are deleted when the cache is loaded.
+//
+// All methods are thread safe.
+class DownloadCache {
+ public:
+  // An object in the cache.
+  struct Entry {
+    Entry() : size(0), expiration_time(0), access_time(0) {}
+
+    // Version of the object the content is from.  The ETag is sent back to
+    // the server to check whether the content is still current.
+    std::string etag;
+    std::string generation;
+    std::string md5_hash;
+    // Name of the file which holds the content, in the cache directory.
+    std::string content_file;
+    int64_t size;
+    // Time until which the content can be used without checking with the
+    // server, as allowed by the Cache-Control header of the object.
+    uint64_t expiration_time;
+    // Time the entry was last used, for eviction.
+    uint64_t access_time;
+  };
+
+  // Use the given directory, which is created if it does not exist, keeping
+  // up to max_size bytes of content in it.
+  DownloadCache(const std::string& directory, int64_t max_size);
+  // Saves the index if a hit was not saved yet.
+  ~DownloadCache();
+
+  // Find the entry of an object.  Returns false if it is not cached.
+  bool Find(const std::string& key, Entry* entry) const;
+
+  // Map the content of an entry in memory.  Returns false, and drops the
+  // entry, if the content can not be read.
+  bool Read(const std::string& key, const Entry& entry, MappedFile* content);
+
+  // Returns the path of a new file in the cache directory to download an
+  // object into, before handing it to Insert().
+  std::string NewDownloadPath();
+
+  // Add or replace the entry of an object, taking the content from the
+  // given downloaded file.  The entry is dropped again if it exceeds the size
+  // of the cache on its own.
+  void Insert(const std::string& key, const Entry& entry,
+              const std::string& download_path);
+
+  // Record that an entry was used instead of downloading `size` bytes, and
+  // when it now expires.
+  void RecordHit(const std::string& key, uint64_t expiration_time,
+                 int64_t size);
+  // Record that an object had to be downloaded.
+  void RecordMiss();
+
+  DownloadCacheStats stats() const;
+
+  // Time until which content can be used without checking with the server,
+  // given the Cache-Control header sent with it.  Returns 0 if it must be
+  // checked every time.
+  static uint64_t ExpirationTime(const std::string& cache_control,
+                                 uint64_t now);
+
+  // Whether content sent with the given Cache-Control header may be stored.
+  static bool IsCacheable(const std::string& cache_control);
+
+  // Name of the file which holds the content of an object with the given
+  // entry.
+  static std::string ContentFileName(const Entry& entry);
+
+ private:
+  std::string PathOf(const std::string& file_name) const;
+
+  // Read and write the index file.
+  void Load();
+  void Save();
+  // Delete the files of the cache directory which no entry uses.
+  void DeleteUnusedFiles();
+
+  // Drop an entry, and its content if no other entry uses it.
+  void Remove(std::map<std::string, Entry>::iterator it);
+  // Drop the least recently used entries until the content fits.
+  void Evict();
+
+  std::string directory_;
+  int64_t max_size_;
+
+  mutable Mutex mutex_;
+  std::map<std::string, Entry> entries_;
+  // Number of entries using each content file.
+  std::map<std::string, int> content_files_;
+  // Size of all the content files.
+  int64_t size_;
+  int download_count_;
+  DownloadCacheStats stats_;
+  // Whether entries changed since the index was saved, and when it was.
+  bool index_changed_;
+  uint64_t index_save_time_;
+};
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace firebase
+
+#endif  // FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_DOWNLOAD_CACHE_H_
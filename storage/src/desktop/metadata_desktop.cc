@@ -45,6 +45,7 @@ const char* MetadataInternal::kMetadataKey = "metadata";
 const char* MetadataInternal::kContentTypeKey = "contentType";
 const char* MetadataInternal::kDownloadTokensKey = "downloadTokens";
 const char* MetadataInternal::kMd5HashKey = "md5Hash";
+const char* MetadataInternal::kCrc32cKey = "crc32c";
 const char* MetadataInternal::kSizeKey = "size";
 const char* MetadataInternal::kTimeUpdatedKey = "updated";
 const char* MetadataInternal::kTimeCreatedKey = "timeCreated";
@@ -87,6 +88,7 @@ MetadataInternal& MetadataInternal::operator=(
   updated_time_ = metadata.updated_time_;
   size_bytes_ = metadata.size_bytes_;
   md5_hash_ = metadata.md5_hash_;
+  crc32c_ = metadata.crc32c_;
   content_disposition_ = metadata.content_disposition_;
   content_encoding_ = metadata.content_encoding_;
   content_language_ = metadata.content_language_;
@@ -116,6 +118,7 @@ MetadataInternal& MetadataInternal::operator=(MetadataInternal&& other) {
   updated_time_ = other.updated_time_;
   size_bytes_ = other.size_bytes_;
   md5_hash_ = std::move(other.md5_hash_);
+  crc32c_ = std::move(other.crc32c_);
   content_disposition_ = std::move(other.content_disposition_);
   content_encoding_ = std::move(other.content_encoding_);
   content_language_ = std::move(other.content_language_);
@@ -220,6 +223,7 @@ bool MetadataInternal::ImportFromJson(const char* json) {
 
   size_bytes_ = LookUpInt64(&root, kSizeKey);
   md5_hash_ = LookUpString(&root, kMd5HashKey);
+  crc32c_ = LookUpString(&root, kCrc32cKey);
   content_disposition_ = LookUpString(&root, kContentDispositionKey);
   content_encoding_ = LookUpString(&root, kContentEncodingKey);
   content_language_ = LookUpString(&root, kContentLanguageKey);
@@ -0,0 +1,1172 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "storage/src/desktop/parallel_download.h"
+
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif  // _FILE_OFFSET_BITS
+#include <stdio.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif  // defined(_WIN32)
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <string>
+
+#include "app/src/log.h"
+#include "app/src/time.h"
+#include "storage/src/desktop/crc32c.h"
+#include "storage/src/desktop/storage_desktop.h"
+#include "storage/src/desktop/storage_reference_desktop.h"
+
+namespace firebase {
+namespace storage {
+namespace internal {
+
+// Size of the first range, requested before the size of the object is known,
+// when there are other connections to split the object between.  Objects up
+// to that size are downloaded in a single request.
+static const int64_t kFirstPartSize = 1024 * 1024;
+// End of a range which extends to the end of the object, whatever its size.
+static const int64_t kEndOfObject = (std::numeric_limits<int64_t>::max)();
+// Bounds of the size of the other ranges.  The object is split evenly between
+// the connections within these bounds.  A single connection fetches the rest
+// of the object at once.
+static const int64_t kMinPartSize = 1024 * 1024;
+static const int64_t kMaxPartSize = 16 * 1024 * 1024;
+// Size of the writes of an object served from the cache, so that a slow sink
+// can hold them off.
+static const int64_t kCacheWriteSize = 1024 * 1024;
+
+// Bytes a StreamDownloadSink queues before it reports itself full, and the
+// number of bytes it has to get back under before it takes more.
+static const int64_t kStreamHighWaterMark = 4 * 1024 * 1024;
+static const int64_t kStreamLowWaterMark = 1024 * 1024;
+
+static const int kHttpPartialContent = 206;
+static const int kHttpNotModified = 304;
+static const int kHttpPreconditionFailed = 412;
+static const int kHttpRangeNotSatisfiable = 416;
+
+// Response headers, in lower case.
+static const char kContentRangeHeader[] = "content-range";
+static const char kContentLengthHeader[] = "content-length";
+static const char kETagHeader[] = "etag";
+static const char kCacheControlHeader[] = "cache-control";
+static const char kGenerationHeader[] = "x-goog-generation";
+// Hashes of the content, "crc32c=<base64>, md5=<base64>".
+static const char kHashHeader[] = "x-goog-hash";
+static const char kMd5HashPrefix[] = "md5=";
+static const char kCrc32cHashPrefix[] = "crc32c=";
+// Encoding of the object as stored, when it is decompressed on the way, in
+// which case the hashes are those of the stored data.
+static const char kStoredContentEncodingHeader[] =
+    "x-goog-stored-content-encoding";
+
+// Keys of the session file.
+static const char kSessionObjectKey[] = "object";
+static const char kSessionETagKey[] = "etag";
+static const char kSessionSizeKey[] = "size";
+static const char kSessionBytesKey[] = "bytes";
+
+// How often the session is saved while data comes in.
+static const int kSessionSaveIntervalMilliseconds = 1000;
+
+static const char kInvalidJsonResponse[] =
+    "The server did not return a valid JSON response.  "
+    "Contact Firebase support if this issue persists.";
+static const char kNoResponse[] = "The server could not be reached.";
+static const char kWriteFailed[] = "Could not write the downloaded data.";
+static const char kChecksumMismatch[] =
+    "The downloaded data does not match the checksum of the object.";
+
+// Read the size of the object from a Content-Range header, either
+// "bytes <first>-<last>/<size>" or "bytes */<size>".  Returns -1 if the header
+// does not tell.
+static int64_t ParseObjectSize(const std::string& content_range) {
+  size_t slash = content_range.find('/');
+  if (slash == std::string::npos) return -1;
+  const char* size_string = content_range.c_str() + slash + 1;
+  char* size_end = nullptr;
+  int64_t size = strtoll(size_string, &size_end, 10);  // NOLINT
+  return size_end == size_string ? -1 : size;
+}
+
+// Read the base64 hash with the given prefix, such as "md5=", from an
+// x-goog-hash header, or an empty string if the header does not have it.
+static std::string ParseHash(const std::string& hashes, const char* prefix) {
+  size_t begin = hashes.find(prefix);
+  if (begin == std::string::npos) return std::string();
+  begin += strlen(prefix);
+  size_t end = hashes.find(',', begin);
+  return rest::util::TrimWhitespace(hashes.substr(
+      begin, end == std::string::npos ? std::string::npos : end - begin));
+}
+
+// Receives one range of the object, writing it to the sink as it comes.
+class RangeResponse : public TransferResponse {
+ public:
+  // Data is written from `begin` up to `end` for a partial response, and up
+  // to the capacity of the sink for a full one.
+  RangeResponse(ParallelDownload* download, int64_t begin, int64_t end)
+      : TransferResponse(nullptr),
+        download_(download),
+        begin_(begin),
+        end_(end),
+        bytes_written_(0),
+        crc32c_(0),
+        finished_(false),
+        truncated_(false),
+        write_failed_(false) {}
+
+  bool ProcessBody(const char* buffer, size_t length) override;
+
+ protected:
+  void Finish() override { download_->PartFinished(this); }
+
+ private:
+  friend class ParallelDownload;
+
+  ParallelDownload* download_;
+  int64_t begin_;
+  int64_t end_;
+  // Updated under the download's mutex, as data is written.
+  int64_t bytes_written_;
+  // CRC32C of the data written.
+  uint32_t crc32c_;
+  // Set under the download's mutex once the request is finished.
+  bool finished_;
+  // Whether the response was cut short on purpose, as the server sent more
+  // than was asked for.
+  bool truncated_;
+  bool write_failed_;
+};
+
+bool RangeResponse::ProcessBody(const char* buffer, size_t length) {
+  int64_t limit;
+  if (status() == kHttpPartialContent) {
+    limit = end_;
+  } else if (status() == rest::util::HttpSuccess && begin_ == 0) {
+    // The server sent the whole object.
+    limit = download_->sink_->capacity();
+  } else {
+    // Keep the body, to read the error from it.
+    return rest::Response::ProcessBody(buffer, length);
+  }
+
+  int64_t offset = begin_ + bytes_written_;
+  size_t write_length = length;
+  if (limit >= 0 && offset + static_cast<int64_t>(length) > limit) {
+    write_length = static_cast<size_t>((std::max)(limit - offset, int64_t()));
+    truncated_ = true;
+  }
+  if (write_length) {
+    if (!download_->sink_->Write(offset, buffer, write_length)) {
+      write_failed_ = true;
+      return false;
+    }
+    download_->CacheData(offset, buffer, write_length);
+    crc32c_ = Crc32cExtend(crc32c_, buffer, write_length);
+    download_->AddProgress(this, write_length);
+    if (download_->sink_->full()) download_->Throttle();
+  }
+  return !truncated_;
+}
+
+bool BufferDownloadSink::Write(int64_t offset, const char* data,
+                               size_t length) {
+  if (offset < 0 || static_cast<uint64_t>(offset) + length > buffer_size_) {
+    return false;
+  }
+  memcpy(buffer_ + offset, data, length);
+  return true;
+}
+
+#if defined(_WIN32)
+
+FileDownloadSink::FileDownloadSink(const char* filename)
+    : filename_(filename), file_(nullptr), failed_(false) {}
+
+FileDownloadSink::~FileDownloadSink() {
+  if (file_) fclose(file_);
+}
+
+bool FileDownloadSink::Open() {
+  if (!file_ && !failed_) {
+    // Writing in binary mode prevents Windows from converting characters such
+    // as "\n" to "\r\n".  The file is kept if it exists, Truncate() drops
+    // what is not wanted.
+    file_ = fopen(filename_.c_str(), "r+b");
+    if (!file_) file_ = fopen(filename_.c_str(), "w+b");
+    failed_ = file_ == nullptr;
+  }
+  return !failed_;
+}
+
+bool FileDownloadSink::Truncate(int64_t size) {
+  return Open() && _chsize_s(_fileno(file_), size) == 0;
+}
+
+bool FileDownloadSink::Write(int64_t offset, const char* data, size_t length) {
+  if (!Open()) return false;
+  return _fseeki64(file_, offset, SEEK_SET) == 0 &&
+         fwrite(data, 1, length, file_) == length;
+}
+
+bool FileDownloadSink::Close() {
+  if (!Open()) return false;
+  bool closed = fclose(file_) == 0;
+  file_ = nullptr;
+  return closed;
+}
+
+#else
+
+FileDownloadSink::FileDownloadSink(const char* filename)
+    : filename_(filename), file_(-1), failed_(false) {}
+
+FileDownloadSink::~FileDownloadSink() {
+  if (file_ >= 0) close(file_);
+}
+
+bool FileDownloadSink::Open() {
+  if (file_ < 0 && !failed_) {
+    // The file is kept if it exists, Truncate() drops what is not wanted.
+    file_ = open(filename_.c_str(), O_WRONLY | O_CREAT, 0666);
+    failed_ = file_ < 0;
+  }
+  return !failed_;
+}
+
+bool FileDownloadSink::Truncate(int64_t size) {
+  return Open() && ftruncate(file_, size) == 0;
+}
+
+bool FileDownloadSink::Write(int64_t offset, const char* data, size_t length) {
+  if (!Open()) return false;
+  // The ranges arrive in any order, so each write says where it goes instead
+  // of seeking the file.
+  while (length) {
+    ssize_t written = pwrite(file_, data, length, offset);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += written;
+    length -= written;
+    offset += written;
+  }
+  return true;
+}
+
+bool FileDownloadSink::Close() {
+  if (!Open()) return false;
+  bool closed = close(file_) == 0;
+  file_ = -1;
+  return closed;
+}
+
+#endif  // defined(_WIN32)
+
+StreamDownloadSink::StreamDownloadSink(StreamConsumer consumer,
+                                       void* user_data)
+    : consumer_(consumer),
+      user_data_(user_data),
+      drained_callback_(nullptr),
+      drained_callback_data_(nullptr),
+      next_offset_(0),
+      queued_bytes_(0),
+      full_(false),
+      failed_(false),
+      closing_(false),
+      stopping_(false),
+      data_available_(0),
+      thread_(nullptr) {
+  thread_ = MakeUnique<Thread>(DeliverRoutine, this);
+}
+
+StreamDownloadSink::~StreamDownloadSink() { StopDelivering(true); }
+
+bool StreamDownloadSink::full() const {
+  MutexLock lock(mutex_);
+  return full_;
+}
+
+void StreamDownloadSink::set_drained_callback(void (*callback)(void* data),
+                                              void* data) {
+  MutexLock lock(mutex_);
+  drained_callback_ = callback;
+  drained_callback_data_ = data;
+}
+
+bool StreamDownloadSink::Truncate(int64_t size) {
+  MutexLock lock(mutex_);
+  return size == next_offset_;
+}
+
+bool StreamDownloadSink::Write(int64_t offset, const char* data,
+                               size_t length) {
+  {
+    MutexLock lock(mutex_);
+    if (failed_ || closing_ || offset != next_offset_) return false;
+    blocks_.push_back(std::string(data, length));
+    next_offset_ += length;
+    queued_bytes_ += length;
+    if (queued_bytes_ >= kStreamHighWaterMark) full_ = true;
+  }
+  data_available_.Post();
+  return true;
+}
+
+bool StreamDownloadSink::Close() {
+  StopDelivering(false);
+  MutexLock lock(mutex_);
+  return !failed_;
+}
+
+void StreamDownloadSink::StopDelivering(bool drop) {
+  if (!thread_) return;
+  {
+    MutexLock lock(mutex_);
+    closing_ = true;
+    stopping_ = drop;
+  }
+  data_available_.Post();
+  thread_->Join();
+  thread_.reset(nullptr);
+}
+
+void StreamDownloadSink::DeliverRoutine(void* data) {
+  static_cast<StreamDownloadSink*>(data)->Deliver();
+}
+
+void StreamDownloadSink::Deliver() {
+  for (;;) {
+    data_available_.Wait();
+    std::string block;
+    {
+      MutexLock lock(mutex_);
+      if (stopping_) return;
+      if (blocks_.empty()) {
+        if (closing_) return;
+        continue;
+      }
+      block.swap(blocks_.front());
+      blocks_.pop_front();
+    }
+    bool consumed = consumer_(block.data(), block.size(), user_data_);
+    void (*drained_callback)(void* data) = nullptr;
+    void* drained_callback_data = nullptr;
+    {
+      MutexLock lock(mutex_);
+      queued_bytes_ -= block.size();
+      if (!consumed) {
+        // Let the download go on, so that it fails on the next write.
+        failed_ = true;
+        blocks_.clear();
+        queued_bytes_ = 0;
+      }
+      if (full_ && queued_bytes_ < kStreamLowWaterMark) {
+        full_ = false;
+        drained_callback = drained_callback_;
+        drained_callback_data = drained_callback_data_;
+      }
+    }
+    if (drained_callback) drained_callback(drained_callback_data);
+    if (!consumed) return;
+  }
+}
+
+int64_t FileDownloadSink::stored_size() const {
+  std::ifstream file(filename_.c_str(), std::ios::binary | std::ios::ate);
+  if (!file.is_open()) return 0;
+  int64_t size = static_cast<int64_t>(file.tellg());
+  return size > 0 ? size : 0;
+}
+
+ParallelDownload::Part::Part(int64_t begin_, int64_t end_)
+    : start(begin_),
+      begin(begin_),
+      end(end_),
+      crc32c(0),
+      retry_time(0),
+      transport(nullptr) {}
+
+ParallelDownload::Part::~Part() {}
+
+ParallelDownload::ParallelDownload(const StorageReferenceInternal& reference,
+                                   DownloadSink* sink,
+                                   const std::string& session_file,
+                                   int connections,
+                                   SafeFutureHandle<size_t> handle,
+                                   ReferenceCountedFutureImpl* future_api)
+    : reference_(new StorageReferenceInternal(reference)),
+      sink_(sink),
+      session_file_(session_file),
+      connections_((std::max)(connections, 1)),
+      handle_(handle),
+      future_api_(future_api),
+      first_failure_(0),
+      retry_delay_(kInitialRetryDelayMilliseconds),
+      max_retry_milliseconds_(0),
+      gave_up_(false),
+      resumed_(false),
+      session_save_time_(0),
+      session_bytes_(-1),
+      has_cached_entry_(false),
+      served_from_cache_(false),
+      cache_write_failed_(false),
+      object_size_(-1),
+      total_size_(-1),
+      bytes_received_(0),
+      paused_(false),
+      throttled_(false),
+      canceled_(false),
+      complete_(false),
+      wake_(0),
+      thread_(nullptr) {
+  sink_->set_drained_callback(SinkDrained, this);
+  for (int i = 0; i < connections_; ++i) {
+    rest::TransportCurl* transport = new rest::TransportCurl();
+    transport->set_is_async(true);
+    transports_.push_back(UniquePtr<rest::TransportCurl>(transport));
+  }
+}
+
+ParallelDownload::~ParallelDownload() {
+  Cancel();
+  if (thread_) {
+    thread_->Join();
+    thread_.reset(nullptr);
+  }
+  // The sink may call back into this until it is gone.
+  sink_.reset(nullptr);
+}
+
+void ParallelDownload::Start() {
+  thread_ = MakeUnique<Thread>(DownloadRoutine, this);
+}
+
+bool ParallelDownload::Pause() {
+  MutexLock lock(mutex_);
+  if (canceled_ || complete_ || paused_) return false;
+  paused_ = true;
+  for (auto& part : parts_) {
+    if (part->controller) part->controller->Pause();
+  }
+  return true;
+}
+
+bool ParallelDownload::Resume() {
+  MutexLock lock(mutex_);
+  if (canceled_ || complete_ || !paused_) return false;
+  paused_ = false;
+  if (!throttled_) {
+    for (auto& part : parts_) {
+      if (part->controller) part->controller->Resume();
+    }
+  }
+  wake_.Post();
+  return true;
+}
+
+bool ParallelDownload::Cancel() {
+  MutexLock lock(mutex_);
+  if (canceled_ || complete_) return false;
+  canceled_ = true;
+  for (auto& part : parts_) {
+    if (part->controller) part->controller->Cancel();
+  }
+  wake_.Post();
+  return true;
+}
+
+bool ParallelDownload::is_paused() const {
+  MutexLock lock(mutex_);
+  return paused_;
+}
+
+int64_t ParallelDownload::bytes_transferred() const {
+  MutexLock lock(mutex_);
+  return bytes_received_;
+}
+
+int64_t ParallelDownload::total_byte_count() const {
+  MutexLock lock(mutex_);
+  return total_size_;
+}
+
+void ParallelDownload::AddProgress(RangeResponse* response, size_t length) {
+  {
+    MutexLock lock(mutex_);
+    response->bytes_written_ += length;
+    bytes_received_ += length;
+  }
+  Notify(Notifier::kUpdateCallbackTypeProgress);
+}
+
+void ParallelDownload::PartFinished(RangeResponse* response) {
+  {
+    MutexLock lock(mutex_);
+    response->finished_ = true;
+  }
+  wake_.Post();
+}
+
+void ParallelDownload::DownloadRoutine(void* data) {
+  ParallelDownload* download = static_cast<ParallelDownload*>(data);
+  Error error = download->Download();
+  download->FinishCaching(error);
+  download->Complete(error);
+}
+
+void ParallelDownload::Complete(Error error) {
+  int64_t bytes_received;
+  {
+    MutexLock lock(mutex_);
+    bytes_received = bytes_received_;
+  }
+  if (error == kErrorNone) {
+    future_api_->CompleteWithResult(handle_, kErrorNone,
+                                    static_cast<size_t>(bytes_received));
+  } else if (error == kErrorCancelled) {
+    future_api_->Complete(handle_, kErrorCancelled);
+  } else {
+    future_api_->CompleteWithResult(handle_, error, error_message_.c_str(),
+                                    static_cast<size_t>(bytes_received));
+  }
+  {
+    MutexLock lock(mutex_);
+    complete_ = true;
+  }
+  Notify(Notifier::kUpdateCallbackTypeProgress);
+  Notify(error == kErrorCancelled ? Notifier::kUpdateCallbackTypeCanceled
+                                  : Notifier::kUpdateCallbackTypeComplete);
+}
+
+Error ParallelDownload::Download() {
+  max_retry_milliseconds_ = static_cast<uint64_t>(
+      reference_->storage_internal()->max_download_retry_time() * 1000.0);
+
+  cache_ = reference_->storage_internal()->download_cache();
+  if (cache_) {
+    cache_key_ = reference_->storageUri_.AsHttpUrl();
+    has_cached_entry_ = cache_->Find(cache_key_, &cached_entry_);
+    // Use the cached object without asking the server while it is allowed
+    // to.
+    Error error;
+    if (has_cached_entry_ &&
+        cached_entry_.expiration_time > ::firebase::internal::GetTimestamp() &&
+        ServeFromCache(cached_entry_.expiration_time, &error)) {
+      RemoveSession();
+      if (error == kErrorNone && !sink_->Close()) {
+        error_message_ = kWriteFailed;
+        error = kErrorUnknown;
+      }
+      return error;
+    }
+  }
+
+  int64_t first_part_begin = LoadSession();
+  if (!sink_->Truncate(first_part_begin)) {
+    error_message_ = kWriteFailed;
+    return kErrorUnknown;
+  }
+  // Only an object downloaded from the start can be cached.
+  if (cache_ && first_part_begin == 0) {
+    cache_path_ = cache_->NewDownloadPath();
+    cache_sink_.reset(new FileDownloadSink(cache_path_.c_str()));
+  }
+  int64_t first_part_end = FirstPartEnd(first_part_begin);
+  {
+    MutexLock lock(mutex_);
+    if (first_part_end == 0) {
+      // Nothing fits in the buffer.
+      total_size_ = 0;
+      return kErrorNone;
+    }
+    bytes_received_ = first_part_begin;
+    parts_.push_back(
+        UniquePtr<Part>(new Part(first_part_begin, first_part_end)));
+  }
+
+  bool in_order = sink_->in_order();
+  for (;;) {
+    bool paused;
+    {
+      MutexLock lock(mutex_);
+      if (canceled_) break;
+      if (throttled_ && !sink_->full()) {
+        throttled_ = false;
+        if (!paused_) {
+          for (auto& part : parts_) {
+            if (part->controller) part->controller->Resume();
+          }
+        }
+      }
+      paused = paused_ || throttled_;
+    }
+
+    // Send a request for each part ready to go, as long as a connection is
+    // free.  Only the first part is known until its response comes back.
+    uint64_t now = ::firebase::internal::GetTimestamp();
+    uint64_t next_retry_time = 0;
+    for (size_t i = 0; i < parts_.size() && !paused; ++i) {
+      Part* part = parts_[i].get();
+      if (part->transport || part->begin >= part->end) continue;
+      if (part->retry_time > now) {
+        if (next_retry_time == 0 || part->retry_time < next_retry_time) {
+          next_retry_time = part->retry_time;
+        }
+        // The next parts wait for this one if the sink takes data in order.
+        if (in_order) break;
+        continue;
+      }
+      rest::TransportCurl* free_transport = nullptr;
+      for (auto& transport : transports_) {
+        bool in_use = false;
+        for (auto& other : parts_) in_use |= other->transport == transport.get();
+        if (!in_use) {
+          free_transport = transport.get();
+          break;
+        }
+      }
+      if (!free_transport) break;
+      SendPart(part, free_transport);
+    }
+
+    if (parts_.empty()) break;
+    // Wake up in time for the next retry, and to save the session as data
+    // comes in.
+    int timeout = -1;
+    if (next_retry_time) timeout = static_cast<int>(next_retry_time - now);
+    if (!session_file_.empty() && !etag_.empty() &&
+        (timeout < 0 || timeout > kSessionSaveIntervalMilliseconds)) {
+      timeout = kSessionSaveIntervalMilliseconds;
+    }
+    if (timeout >= 0) {
+      wake_.TimedWait(timeout);
+    } else {
+      wake_.Wait();
+    }
+
+    // Handle the responses which came back, and drop the parts which are done.
+    for (size_t i = 0; i < parts_.size();) {
+      Part* part = parts_[i].get();
+      bool finished;
+      {
+        MutexLock lock(mutex_);
+        // Only a request in flight has a response left to handle: the
+        // response of a handled one stays around until the part is sent
+        // again.
+        finished = part->transport && part->response->finished_;
+      }
+      if (finished) {
+        Error error = HandlePart(part);
+        if (error != kErrorNone) {
+          StopParts();
+          if (gave_up_) {
+            SaveSession();
+          } else {
+            RemoveSession();
+          }
+          return error;
+        }
+      }
+      if (!part->transport && total_size_ >= 0 && part->begin >= part->end) {
+        AddPartChecksum(*part);
+        MutexLock lock(mutex_);
+        parts_.erase(parts_.begin() + i);
+      } else {
+        ++i;
+      }
+    }
+
+    if (::firebase::internal::GetTimestamp() - session_save_time_ >=
+        static_cast<uint64_t>(kSessionSaveIntervalMilliseconds)) {
+      SaveSession();
+    }
+  }
+
+  {
+    MutexLock lock(mutex_);
+    if (canceled_) {
+      StopParts();
+      RemoveSession();
+      return kErrorCancelled;
+    }
+  }
+  RemoveSession();
+  if (!VerifyChecksum()) {
+    error_message_ = kChecksumMismatch;
+    return kErrorUnknown;
+  }
+  if (!sink_->Close()) {
+    error_message_ = kWriteFailed;
+    return kErrorUnknown;
+  }
+  return kErrorNone;
+}
+
+void ParallelDownload::SendPart(Part* part, rest::TransportCurl* transport) {
+  rest::Request* request = new rest::Request();
+  reference_->PrepareRequest(
+      request, reference_->storageUri_.AsHttpUrl().c_str(), rest::util::kGet);
+  std::string range = "bytes=" + std::to_string(part->begin) + "-";
+  if (part->end != kEndOfObject) range += std::to_string(part->end - 1);
+  request->add_header("Range", range.c_str());
+  // Fail rather than mix the data of different versions of the object.
+  if (!etag_.empty()) request->add_header("If-Match", etag_.c_str());
+  // Until the object is known, the cached one may be current.
+  if (has_cached_entry_ && total_size_ < 0) {
+    request->add_header("If-None-Match", cached_entry_.etag.c_str());
+  }
+
+  MutexLock lock(mutex_);
+  // The previous request and response of the part, if any, are finished.
+  part->request.reset(request);
+  part->response.reset(new RangeResponse(this, part->begin, part->end));
+  part->transport = transport;
+  transport->Perform(part->request.get(), part->response.get(),
+                     &part->controller);
+  if (paused_ || throttled_) part->controller->Pause();
+}
+
+Error ParallelDownload::HandlePart(Part* part) {
+  RangeResponse* response = part->response.get();
+  {
+    MutexLock lock(mutex_);
+    part->transport = nullptr;
+    part->controller.reset();
+    part->begin += response->bytes_written_;
+  }
+  part->crc32c = Crc32cCombine(part->crc32c, response->crc32c_,
+                               response->bytes_written_);
+  if (response->canceled()) return kErrorCancelled;
+  if (response->write_failed_) {
+    error_message_ = kWriteFailed;
+    return kErrorUnknown;
+  }
+
+  int status = response->status();
+  bool whole_object = status == rest::util::HttpSuccess && response->begin_ == 0;
+  if (status == kHttpPartialContent || whole_object) {
+    if (total_size_ < 0 && !SplitObject(part)) {
+      error_message_ = "The server did not return the size of the object.";
+      return kErrorUnknown;
+    }
+    if (part->begin < part->end) {
+      // The connection dropped before the end of the range.
+      error_message_ = kNoResponse;
+      return RetryPart(part) ? kErrorNone : kErrorUnknown;
+    }
+    first_failure_ = 0;
+    retry_delay_ = kInitialRetryDelayMilliseconds;
+    return kErrorNone;
+  }
+  if (status == rest::util::HttpSuccess) {
+    error_message_ = "The server did not return the requested range.";
+    return kErrorUnknown;
+  }
+  if (status == kHttpNotModified && has_cached_entry_ && total_size_ < 0) {
+    Error error;
+    if (ServeFromCache(
+            DownloadCache::ExpirationTime(response->header(kCacheControlHeader),
+                                          ::firebase::internal::GetTimestamp()),
+            &error)) {
+      MutexLock lock(mutex_);
+      part->end = part->begin;
+      return error;
+    }
+    // The cached content is gone, download the object instead.
+    part->retry_time = 0;
+    return kErrorNone;
+  }
+  if (status == kHttpRangeNotSatisfiable && total_size_ < 0) {
+    // The first byte asked for is past the end of the object: either the
+    // object is empty, or a resumed download already has all of it.
+    int64_t object_size =
+        ParseObjectSize(response->header(kContentRangeHeader));
+    if (object_size < 0 && part->begin == 0) object_size = 0;
+    if (object_size == part->begin) {
+      MutexLock lock(mutex_);
+      total_size_ = object_size;
+      part->end = part->begin;
+      return kErrorNone;
+    }
+  }
+  if ((status == kHttpPreconditionFailed ||
+       status == kHttpRangeNotSatisfiable) &&
+      resumed_) {
+    Restart(part);
+    return kErrorNone;
+  }
+  if (status == kHttpPreconditionFailed) {
+    error_message_ = "The object changed while it was being downloaded.";
+    return kErrorUnknown;
+  }
+
+  Error error = HttpToErrorCode(status);
+  StorageNetworkError network_error;
+  if (network_error.Parse(response->GetBody())) {
+    error_message_ = network_error.error_message();
+  } else {
+    error_message_ =
+        status == rest::util::HttpInvalid ? kNoResponse : kInvalidJsonResponse;
+  }
+  if (IsRetryableHttpStatus(status) && RetryPart(part)) return kErrorNone;
+  return error;
+}
+
+bool ParallelDownload::RetryPart(Part* part) {
+  uint64_t now = ::firebase::internal::GetTimestamp();
+  if (first_failure_ == 0) first_failure_ = now;
+  if (now - first_failure_ >= max_retry_milliseconds_) {
+    gave_up_ = true;
+    return false;
+  }
+  LogDebug("Download of bytes %lld-%lld of %s failed (%s), retrying in %dms.",
+           static_cast<long long>(part->begin),  // NOLINT
+           static_cast<long long>(part->end),    // NOLINT
+           reference_->full_path().c_str(), error_message_.c_str(),
+           static_cast<int>(retry_delay_));
+  part->retry_time = now + retry_delay_;
+  retry_delay_ = (std::min)(retry_delay_ * 2, kMaxRetryDelayMilliseconds);
+  CountRetry();
+  return true;
+}
+
+bool ParallelDownload::SplitObject(Part* first_part) {
+  RangeResponse* response = first_part->response.get();
+  int64_t capacity = sink_->capacity();
+  int64_t object_size = -1;
+  if (response->status() == kHttpPartialContent) {
+    object_size = ParseObjectSize(response->header(kContentRangeHeader));
+  } else if (response->truncated_) {
+    // The object does not fit, only what does is wanted anyway.
+    object_size = capacity;
+  } else {
+    std::string content_length = response->header(kContentLengthHeader);
+    object_size = content_length.empty()
+                      ? first_part->begin
+                      : strtoll(content_length.c_str(), nullptr, 10);  // NOLINT
+  }
+  if (object_size < 0) return false;
+
+  int64_t size =
+      capacity >= 0 ? (std::min)(object_size, capacity) : object_size;
+  {
+    MutexLock lock(mutex_);
+    total_size_ = size;
+    if (response->status() == kHttpPartialContent) {
+      first_part->end = (std::min)(first_part->end, size);
+    } else {
+      // Everything was asked for in the first request.
+      first_part->end = size;
+    }
+    int64_t remaining = size - first_part->end;
+    int64_t part_size = remaining;
+    if (connections_ > 1) {
+      part_size = (remaining + connections_ - 1) / connections_;
+      part_size = (std::max)(kMinPartSize, (std::min)(part_size, kMaxPartSize));
+    }
+    for (int64_t begin = first_part->end; begin < size; begin += part_size) {
+      parts_.push_back(UniquePtr<Part>(
+          new Part(begin, (std::min)(begin + part_size, size))));
+    }
+  }
+  etag_ = response->header(kETagHeader);
+  resumed_ = false;
+  object_size_ = object_size;
+  std::string stored_encoding = response->header(kStoredContentEncodingHeader);
+  if (stored_encoding.empty() || stored_encoding == "identity") {
+    expected_crc32c_ =
+        ParseHash(response->header(kHashHeader), kCrc32cHashPrefix);
+  }
+  if (cache_) {
+    cache_->RecordMiss();
+    new_entry_.etag = etag_;
+    new_entry_.generation = response->header(kGenerationHeader);
+    new_entry_.md5_hash =
+        ParseHash(response->header(kHashHeader), kMd5HashPrefix);
+    cache_control_ = response->header(kCacheControlHeader);
+  }
+  Notify(Notifier::kUpdateCallbackTypeProgress);
+  return true;
+}
+
+int64_t ParallelDownload::FirstPartEnd(int64_t begin) const {
+  int64_t capacity = sink_->capacity();
+  if (connections_ == 1) return capacity >= 0 ? capacity : kEndOfObject;
+  int64_t end = begin + kFirstPartSize;
+  return capacity >= 0 ? (std::min)(end, capacity) : end;
+}
+
+void ParallelDownload::Restart(Part* first_part) {
+  LogDebug("%s changed since it was partly downloaded, starting over.",
+           reference_->full_path().c_str());
+  RemoveSession();
+  etag_.clear();
+  resumed_ = false;
+  session_bytes_ = -1;
+  part_checksums_.clear();
+  {
+    MutexLock lock(mutex_);
+    bytes_received_ = 0;
+    first_part->start = 0;
+    first_part->begin = 0;
+    first_part->crc32c = 0;
+    first_part->end = FirstPartEnd(0);
+    first_part->retry_time = 0;
+  }
+  if (!sink_->Truncate(0)) {
+    // Writing will fail, and end the download.
+    LogDebug("Could not truncate the partly downloaded data of %s.",
+             reference_->full_path().c_str());
+  }
+  Notify(Notifier::kUpdateCallbackTypeProgress);
+}
+
+bool ParallelDownload::ServeFromCache(uint64_t expiration_time,
+                                      Error* error) {
+  MappedFile content;
+  if (!cache_->Read(cache_key_, cached_entry_, &content)) {
+    has_cached_entry_ = false;
+    return false;
+  }
+  served_from_cache_ = true;
+  int64_t size = static_cast<int64_t>(content.size());
+  int64_t capacity = sink_->capacity();
+  if (capacity >= 0) size = (std::min)(size, capacity);
+  *error = kErrorNone;
+  if (!sink_->Truncate(0)) {
+    error_message_ = kWriteFailed;
+    *error = kErrorUnknown;
+  }
+  for (int64_t offset = 0; offset < size && *error == kErrorNone;
+       offset += kCacheWriteSize) {
+    size_t length =
+        static_cast<size_t>((std::min)(size - offset, kCacheWriteSize));
+    if (!sink_->Write(offset, content.data() + offset, length)) {
+      error_message_ = kWriteFailed;
+      *error = kErrorUnknown;
+    } else if (!WaitForSink()) {
+      *error = kErrorCancelled;
+    }
+  }
+  {
+    MutexLock lock(mutex_);
+    total_size_ = size;
+    bytes_received_ = *error == kErrorNone ? size : 0;
+  }
+  if (*error == kErrorNone) {
+    cache_->RecordHit(cache_key_, expiration_time, size);
+    LogDebug("Served %s from the download cache.",
+             reference_->full_path().c_str());
+  }
+  Notify(Notifier::kUpdateCallbackTypeProgress);
+  return true;
+}
+
+void ParallelDownload::CacheData(int64_t offset, const char* data,
+                                 size_t length) {
+  if (cache_sink_ && !cache_write_failed_ &&
+      !cache_sink_->Write(offset, data, length)) {
+    cache_write_failed_ = true;
+  }
+}
+
+void ParallelDownload::FinishCaching(Error error) {
+  if (!cache_sink_) return;
+  bool closed = cache_sink_->Close();
+  cache_sink_.reset(nullptr);
+  // Only keep a whole object, which can be checked with the server later.
+  if (error == kErrorNone && closed && !served_from_cache_ &&
+      !cache_write_failed_ && !new_entry_.etag.empty() &&
+      total_size_ == object_size_ &&
+      DownloadCache::IsCacheable(cache_control_)) {
+    new_entry_.size = object_size_;
+    new_entry_.expiration_time = DownloadCache::ExpirationTime(
+        cache_control_, ::firebase::internal::GetTimestamp());
+    cache_->Insert(cache_key_, new_entry_, cache_path_);
+  } else {
+    remove(cache_path_.c_str());
+  }
+}
+
+bool ParallelDownload::WaitForSink() {
+  while (sink_->full()) {
+    {
+      MutexLock lock(mutex_);
+      if (canceled_) return false;
+    }
+    wake_.Wait();
+  }
+  return true;
+}
+
+void ParallelDownload::Throttle() {
+  {
+    MutexLock lock(mutex_);
+    if (throttled_) return;
+    throttled_ = true;
+    for (auto& part : parts_) {
+      if (part->controller) part->controller->Pause();
+    }
+  }
+  // The sink may have drained already, let the download thread check.
+  wake_.Post();
+}
+
+void ParallelDownload::SinkDrained(void* data) {
+  static_cast<ParallelDownload*>(data)->wake_.Post();
+}
+
+void ParallelDownload::AddPartChecksum(const Part& part) {
+  part_checksums_[part.start] = std::make_pair(part.end, part.crc32c);
+}
+
+bool ParallelDownload::VerifyChecksum() const {
+  if (expected_crc32c_.empty() || served_from_cache_ ||
+      total_size_ != object_size_) {
+    return true;
+  }
+  // The parts are combined in order.  A download resumed from a session only
+  // has the checksum of what it fetched itself.
+  int64_t checked_size = 0;
+  uint32_t crc32c = 0;
+  for (auto& part : part_checksums_) {
+    if (part.first != checked_size) return true;
+    crc32c = Crc32cCombine(crc32c, part.second.second,
+                           part.second.first - part.first);
+    checked_size = part.second.first;
+  }
+  if (checked_size != object_size_) return true;
+  if (Crc32cToBase64(crc32c) == expected_crc32c_) return true;
+  LogWarning("Download of %s does not match its checksum.",
+             reference_->full_path().c_str());
+  return false;
+}
+
+void ParallelDownload::StopParts() {
+  {
+    MutexLock lock(mutex_);
+    for (auto& part : parts_) {
+      if (part->controller) part->controller->Cancel();
+    }
+  }
+  for (;;) {
+    bool in_flight = false;
+    {
+      MutexLock lock(mutex_);
+      for (auto& part : parts_) {
+        if (!part->transport) continue;
+        if (part->response->finished_) {
+          part->transport = nullptr;
+          part->controller.reset();
+          part->begin += part->response->bytes_written_;
+        } else {
+          in_flight = true;
+        }
+      }
+    }
+    if (!in_flight) break;
+    wake_.Wait();
+  }
+}
+
+int64_t ParallelDownload::ContiguousBytes() const {
+  MutexLock lock(mutex_);
+  int64_t contiguous = total_size_;
+  for (auto& part : parts_) {
+    int64_t begin = part->begin;
+    if (part->transport) begin += part->response->bytes_written_;
+    if (begin < part->end && (contiguous < 0 || begin < contiguous)) {
+      contiguous = begin;
+    }
+  }
+  return contiguous;
+}
+
+int64_t ParallelDownload::LoadSession() {
+  if (session_file_.empty()) return 0;
+  std::ifstream file(session_file_.c_str());
+  if (!file.is_open()) return 0;
+
+  std::map<std::string, std::string> values;
+  std::string line;
+  while (std::getline(file, line)) {
+    size_t separator = line.find('=');
+    if (separator == std::string::npos) continue;
+    values[line.substr(0, separator)] = line.substr(separator + 1);
+  }
+  // Only resume a download of the same object, and only trust as much of the
+  // data as both the session and the sink have.
+  int64_t bytes = strtoll(values[kSessionBytesKey].c_str(),  // NOLINT
+                          nullptr, 10);
+  bytes = (std::min)(bytes, sink_->stored_size());
+  if (values[kSessionObjectKey] != reference_->storageUri_.AsHttpUrl() ||
+      values[kSessionETagKey].empty() || bytes <= 0) {
+    LogDebug("Ignoring download session in %s which is for another object.",
+             session_file_.c_str());
+    return 0;
+  }
+  etag_ = values[kSessionETagKey];
+  resumed_ = true;
+  LogDebug("Resuming download of %s from byte %lld.",
+           reference_->full_path().c_str(),
+           static_cast<long long>(bytes));  // NOLINT
+  return bytes;
+}
+
+void ParallelDownload::SaveSession() {
+  session_save_time_ = ::firebase::internal::GetTimestamp();
+  if (session_file_.empty() || etag_.empty()) return;
+  int64_t bytes = ContiguousBytes();
+  if (bytes == session_bytes_) return;
+  std::ofstream file(session_file_.c_str(), std::ios::out | std::ios::trunc);
+  if (file.is_open()) {
+    file << kSessionObjectKey << "=" << reference_->storageUri_.AsHttpUrl()
+         << "\n"
+         << kSessionETagKey << "=" << etag_ << "\n"
+         << kSessionSizeKey << "=" << total_size_ << "\n"
+         << kSessionBytesKey << "=" << bytes << "\n";
+  }
+  if (file.good()) {
+    session_bytes_ = bytes;
+  } else {
+    LogDebug("Could not save download session to %s, the download will not "
+             "be resumable after a restart.",
+             session_file_.c_str());
+  }
+}
+
+void ParallelDownload::RemoveSession() {
+  if (!session_file_.empty()) remove(session_file_.c_str());
+  session_bytes_ = -1;
+}
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace firebase
@@ -0,0 +1,413 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_PARALLEL_DOWNLOAD_H_
+#define FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_PARALLEL_DOWNLOAD_H_
+
+#include <stdio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "app/memory/shared_ptr.h"
+#include "app/memory/unique_ptr.h"
+#include "app/rest/controller_interface.h"
+#include "app/rest/request.h"
+#include "app/rest/transport_curl.h"
+#include "app/src/mutex.h"
+#include "app/src/reference_counted_future_impl.h"
+#include "app/src/semaphore.h"
+#include "app/src/thread.h"
+#include "storage/src/desktop/chunked_transfer.h"
+#include "storage/src/desktop/download_cache.h"
+#include "storage/src/include/firebase/storage/common.h"
+#include "storage/src/include/firebase/storage/storage_reference.h"
+
+namespace firebase {
+namespace storage {
+namespace internal {
+
+class RangeResponse;
+class StorageReferenceInternal;
+
+// Where the bytes of a download go.  Writes may come in any order, unless the
+// sink says otherwise, but never from more than one thread at a time.
+class DownloadSink {
+ public:
+  virtual ~DownloadSink() {}
+
+  // Maximum number of bytes the sink can take, or -1 if there is no limit.
+  virtual int64_t capacity() const { return -1; }
+
+  // Whether the data has to be written in order, from the first byte on.
+  virtual bool in_order() const { return false; }
+
+  // Whether the sink holds as much data as it takes until it catches up.
+  // While it does, the download holds off the requests in flight.
+  virtual bool full() const { return false; }
+
+  // Set the function called once the sink is no longer full.
+  virtual void set_drained_callback(void (*callback)(void* data), void* data) {}
+
+  // Number of bytes the sink already holds, from an earlier download.
+  virtual int64_t stored_size() const { return 0; }
+
+  // Drop whatever the sink holds past `size` bytes.  Called before the first
+  // write, with the number of bytes kept from an earlier download.
+  virtual bool Truncate(int64_t size) { return true; }
+
+  // Store `length` bytes at `offset`.  Returns false if they could not be
+  // stored.
+  virtual bool Write(int64_t offset, const char* data, size_t length) = 0;
+
+  // Called once all the data was written.  Returns false if it could not be
+  // stored.
+  virtual bool Close() { return true; }
+};
+
+// Downloads into a buffer owned by the caller.
+class BufferDownloadSink : public DownloadSink {
+ public:
+  BufferDownloadSink(void* buffer, size_t buffer_size)
+      : buffer_(static_cast<char*>(buffer)), buffer_size_(buffer_size) {}
+
+  int64_t capacity() const override { return buffer_size_; }
+  bool Write(int64_t offset, const char* data, size_t length) override;
+
+ private:
+  char* buffer_;
+  size_t buffer_size_;
+};
+
+// Downloads into a file, which is created if it does not exist.  Each write
+// goes straight to its offset in the file.
+class FileDownloadSink : public DownloadSink {
+ public:
+  explicit FileDownloadSink(const char* filename);
+  ~FileDownloadSink() override;
+
+  int64_t stored_size() const override;
+  bool Truncate(int64_t size) override;
+  bool Write(int64_t offset, const char* data, size_t length) override;
+  bool Close() override;
+
+ private:
+  bool Open();
+
+  std::string filename_;
+#if defined(_WIN32)
+  FILE* file_;
+#else
+  int file_;
+#endif  // defined(_WIN32)
+  bool failed_;
+};
+
+// Hands the data to a consumer, in order, from a thread owned by the sink.
+// Writes only queue the data, so a slow consumer never holds up the transport
+// thread.  Instead, the sink reports itself full once the queue grows past a
+// high-water mark, until the consumer brings it back under a low-water mark.
+class StreamDownloadSink : public DownloadSink {
+ public:
+  StreamDownloadSink(StreamConsumer consumer, void* user_data);
+  // Stops handing data to the consumer, dropping whatever is still queued.
+  ~StreamDownloadSink() override;
+
+  bool in_order() const override { return true; }
+  bool full() const override;
+  void set_drained_callback(void (*callback)(void* data), void* data) override;
+  // Data already given to the consumer can not be taken back.
+  bool Truncate(int64_t size) override;
+  // Fails once the consumer stopped the download.
+  bool Write(int64_t offset, const char* data, size_t length) override;
+  // Waits until the consumer was given all the data.
+  bool Close() override;
+
+ private:
+  // Thread routine of the thread calling the consumer.
+  static void DeliverRoutine(void* data);
+  void Deliver();
+  // Stop the thread calling the consumer once the queue is empty, or right
+  // away if `drop` is true.
+  void StopDelivering(bool drop);
+
+  StreamConsumer consumer_;
+  void* user_data_;
+  void (*drained_callback_)(void* data);
+  void* drained_callback_data_;
+
+  // Guards the state below, shared with the thread calling the consumer.
+  mutable Mutex mutex_;
+  std::deque<std::string> blocks_;
+  int64_t next_offset_;
+  int64_t queued_bytes_;
+  bool full_;
+  // Whether the consumer stopped the download.
+  bool failed_;
+  bool closing_;
+  bool stopping_;
+
+  // Posted once per block queued, and to stop the thread.
+  Semaphore data_available_;
+  UniquePtr<Thread> thread_;
+};
+
+// Downloads an object over several connections at once, each fetching a range
+// of its bytes.  A single stream rarely fills a link with a long round trip,
+// several do.
+//
+// The first request asks for the first range only, and learns the size of the
+// object from the response.  The rest of the object is then split into parts
+// fetched by up to `connections` concurrent requests, all of them pinned to the
+// version of the object the first response came from.  With a single
+// connection there is nothing to split, and the first request asks for the
+// whole object.  A part whose request
+// fails is fetched again from the first byte it is missing, so a dropped
+// connection only costs the bytes it had in flight.
+//
+// When given a session file, the download records in it the version of the
+// object and how much of it the sink holds, as the data comes in.  If the
+// download is given up or the process exits, a later download of the same
+// object to the same sink picks up from there, provided the object did not
+// change in the meantime.
+//
+// A sink which takes the data in order gets it one part after the other, so
+// it is only given a single connection.  While the sink is full, the requests
+// in flight are paused, so that the data waits on the server rather than in
+// memory.
+//
+// The CRC32C of the data is computed as it comes, part by part, and checked
+// against the one the server reports for the object, unless only some of the
+// object was downloaded by this object.
+//
+// When the Storage instance has a download cache, a cached object is served
+// from it, after asking the server whether it changed unless its
+// Cache-Control allows otherwise.  An object downloaded from the start is
+// also written to a new cache file as it comes, and added to the cache once
+// complete.
+//
+// The requests are scheduled from a thread owned by this object.  The data is
+// written, the future completed and the notifier notified from that thread or
+// from the transport's.
+class ParallelDownload : public ChunkedTransfer {
+ public:
+  // Takes ownership of sink.  The reference is copied.  session_file may be
+  // empty, in which case an interrupted download starts over.  future_api
+  // must be allocated using FutureManager to ensure it remains valid while
+  // the handle isn't complete.
+  ParallelDownload(const StorageReferenceInternal& reference,
+                   DownloadSink* sink, const std::string& session_file,
+                   int connections, SafeFutureHandle<size_t> handle,
+                   ReferenceCountedFutureImpl* future_api);
+  // Cancels the download if it is still in progress and waits for it to stop.
+  ~ParallelDownload() override;
+
+  void Start() override;
+
+  // Pauses the download, including all the requests in flight.
+  bool Pause() override;
+  bool Resume() override;
+  bool Cancel() override;
+  bool is_paused() const override;
+  // Returns the number of bytes received and written so far.
+  int64_t bytes_transferred() const override;
+  // Returns the number of bytes to download, or -1 until the first response
+  // tells.
+  int64_t total_byte_count() const override;
+
+ private:
+  friend class RangeResponse;
+
+  // A range of the object, fetched by one request at a time.
+  struct Part {
+    // Defined where RangeResponse is complete.
+    Part(int64_t begin_, int64_t end_);
+    ~Part();
+
+    // First byte of the range, next byte to fetch, and the end of the range.
+    // Until the size of the object is known, the end of the first part is
+    // only what was asked for.
+    int64_t start;
+    int64_t begin;
+    int64_t end;
+    // CRC32C of the bytes from start to begin.
+    uint32_t crc32c;
+    // Earliest time at which the part can be requested again after a failure.
+    uint64_t retry_time;
+    // Transport of the request in flight, if any.
+    rest::TransportCurl* transport;
+    UniquePtr<rest::Request> request;
+    UniquePtr<RangeResponse> response;
+    std::unique_ptr<rest::Controller> controller;
+  };
+
+  // Thread routine of the download thread.
+  static void DownloadRoutine(void* data);
+
+  // Download the object and return the error code of the download.  On
+  // failure error_message_ describes the error.
+  Error Download();
+
+  // Complete the future and notify the update callback.
+  void Complete(Error error);
+
+  // Send the request for a part on the given transport.
+  void SendPart(Part* part, rest::TransportCurl* transport);
+  // Handle the response to a part.  Returns kErrorNone if the part is done or
+  // will be retried, the error which ends the download otherwise.
+  Error HandlePart(Part* part);
+  // Schedule another attempt at a part which failed.  Returns false if the
+  // download has been failing for too long.
+  bool RetryPart(Part* part);
+  // Read the size of the object from the response to the first part, and
+  // split the rest of the object in parts.  Returns false if the response
+  // does not tell the size.
+  bool SplitObject(Part* first_part);
+  // Returns the end of the range the first request asks for, when it starts
+  // at `begin`.
+  int64_t FirstPartEnd(int64_t begin) const;
+  // Start over from the first byte, as the object of a resumed download
+  // changed.
+  void Restart(Part* first_part);
+
+  // Write the cached content of the object to the sink, and record it as
+  // expiring at the given time.  Returns false if the content is gone, in
+  // which case the object has to be downloaded.  Sets *error if the content
+  // could not be written.
+  bool ServeFromCache(uint64_t expiration_time, Error* error);
+  // Write data to the file to add to the cache.
+  void CacheData(int64_t offset, const char* data, size_t length);
+  // Add the downloaded object to the cache if it was downloaded whole.
+  void FinishCaching(Error error);
+
+  // Record the checksum of a part which is done.
+  void AddPartChecksum(const Part& part);
+  // Returns false if the data downloaded does not match the checksum of the
+  // object.  Only the data of a whole object can be checked.
+  bool VerifyChecksum() const;
+
+  // Wait until the sink is no longer full.  Returns false if the download
+  // was canceled meanwhile.
+  bool WaitForSink();
+  // Pause the requests in flight as the sink is full.
+  void Throttle();
+  // Called by the sink once it is no longer full.
+  static void SinkDrained(void* data);
+
+  // Cancel the requests in flight and wait for them to finish.
+  void StopParts();
+
+  // Number of bytes from the start of the object which the sink holds.
+  int64_t ContiguousBytes() const;
+
+  // Load the session from the session file.  Returns the number of bytes to
+  // keep from an earlier download, 0 if there is no session for the object.
+  int64_t LoadSession();
+  // Save the session to the session file, if the version of the object is
+  // known.
+  void SaveSession();
+  // Remove the session file.
+  void RemoveSession();
+
+  // Called by RangeResponse as data is written.
+  void AddProgress(RangeResponse* response, size_t length);
+  // Called by RangeResponse once its request is finished.
+  void PartFinished(RangeResponse* response);
+
+  UniquePtr<StorageReferenceInternal> reference_;
+  UniquePtr<DownloadSink> sink_;
+  std::string session_file_;
+  int connections_;
+  SafeFutureHandle<size_t> handle_;
+  ReferenceCountedFutureImpl* future_api_;
+
+  // State of the download.  Only accessed in the download thread, except for
+  // parts_ which is modified there under mutex_.
+  std::vector<UniquePtr<Part>> parts_;
+  // ETag of the object, used to make sure all parts come from the same
+  // version of it.
+  std::string etag_;
+  // Base64 CRC32C of the object, as reported by the server, empty if it can
+  // not be checked.
+  std::string expected_crc32c_;
+  // Checksums of the parts which are done, by first byte, along with the end
+  // of each part.
+  std::map<int64_t, std::pair<int64_t, uint32_t>> part_checksums_;
+  std::string error_message_;
+  // When the download started failing, 0 while it is not, the delay before
+  // the next attempt, and how long to keep trying.
+  uint64_t first_failure_;
+  int64_t retry_delay_;
+  uint64_t max_retry_milliseconds_;
+  // Whether the download gave up after failing for too long, in which case
+  // the session is kept.
+  bool gave_up_;
+  // Whether the download picked up a session, until the size of the object
+  // is known.
+  bool resumed_;
+  // When the session was last saved, and how many bytes it recorded.
+  uint64_t session_save_time_;
+  int64_t session_bytes_;
+  // The cache of the Storage instance, empty if downloads are not cached,
+  // and the key of the object in it.
+  SharedPtr<DownloadCache> cache_;
+  std::string cache_key_;
+  // The entry of the object in the cache, if any, is checked with the server
+  // by the first request.
+  bool has_cached_entry_;
+  DownloadCache::Entry cached_entry_;
+  bool served_from_cache_;
+  // File receiving a copy of the object to add to the cache, with the entry
+  // and Cache-Control header the first response came with.  The copy is
+  // written from the transport thread.
+  UniquePtr<DownloadSink> cache_sink_;
+  std::string cache_path_;
+  bool cache_write_failed_;
+  DownloadCache::Entry new_entry_;
+  std::string cache_control_;
+  // Size of the object, which may be more than total_size_ if the sink can
+  // not take all of it.
+  int64_t object_size_;
+  // One transport per connection, as a transport runs one request at a time.
+  std::vector<UniquePtr<rest::TransportCurl>> transports_;
+
+  // Guards the state shared with the controlling threads below.
+  mutable Mutex mutex_;
+  // Number of bytes to download, -1 until known.
+  int64_t total_size_;
+  int64_t bytes_received_;
+  bool paused_;
+  // Whether the requests in flight are paused as the sink is full, which is
+  // independent of paused_.
+  bool throttled_;
+  bool canceled_;
+  bool complete_;
+
+  // Posted when a request is finished, and to wake up the download thread when
+  // the download is resumed or canceled, or the sink drained.
+  Semaphore wake_;
+
+  UniquePtr<Thread> thread_;
+};
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace firebase
+
+#endif  // FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_PARALLEL_DOWNLOAD_H_
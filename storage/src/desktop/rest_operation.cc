@@ -14,10 +14,14 @@
 
 #include "storage/src/desktop/rest_operation.h"
 
+#include <algorithm>
+#include <cmath>
 #include <memory>
 
 #include "app/rest/transport_curl.h"
 #include "app/src/mutex.h"
+#include "app/src/time.h"
+#include "storage/src/desktop/chunked_transfer.h"
 #include "storage/src/desktop/controller_desktop.h"
 #include "storage/src/desktop/curl_requests.h"
 #include "storage/src/desktop/storage_desktop.h"
@@ -29,6 +33,10 @@ namespace firebase {
 namespace storage {
 namespace internal {
 
+// Time constant of the smoothed throughput: a sample this old weighs about a
+// third of what it did when it was taken, whatever the progress interval.
+static const double kThroughputSmoothingSeconds = 3.0;
+
 RestOperation::RestOperation(StorageInternal* storage_internal,
                              const StorageReference& storage_reference,
                              rest::Request* request, Notifier* request_notifier,
@@ -40,7 +48,16 @@ RestOperation::RestOperation(StorageInternal* storage_internal,
       response_(response),
       listener_(nullptr),
       handle_(handle),
-      is_complete_(false) {
+      transfer_(nullptr),
+      is_complete_(false),
+      progress_interval_milliseconds_(static_cast<uint64_t>(
+          storage_internal->progress_interval() * 1000.0)),
+      sample_time_(::firebase::internal::GetTimestamp()),
+      sample_bytes_(0),
+      has_sample_(false),
+      bytes_per_second_(0),
+      average_bytes_per_second_(0),
+      progress_pending_(false) {
   // Notify this operation when the response reports progress and clean up if
   // the response completes.
   response_->set_update_callback(
@@ -48,10 +65,11 @@ RestOperation::RestOperation(StorageInternal* storage_internal,
         RestOperation* operation = reinterpret_cast<RestOperation*>(data);
         switch (update_type) {
           case Notifier::kUpdateCallbackTypeProgress:
-            operation->NotifyListenerOfProgress();
+            operation->NotifyListenerOfProgress(false);
             break;
           case Notifier::kUpdateCallbackTypeComplete:
           case Notifier::kUpdateCallbackTypeCanceled:
+            operation->NotifyListenerOfProgress(true);
             // The caller will set the response to completed which will allow
             // StorageInternal::CleanupOperations() to delete this operation.
             operation->is_complete_ = true;
@@ -63,7 +81,7 @@ RestOperation::RestOperation(StorageInternal* storage_internal,
       [](Notifier::UpdateCallbackType update_type, void* data) {
         RestOperation* operation = reinterpret_cast<RestOperation*>(data);
         if (update_type == Notifier::kUpdateCallbackTypeProgress) {
-          operation->NotifyListenerOfProgress();
+          operation->NotifyListenerOfProgress(false);
         }
       },
       this);
@@ -75,24 +93,83 @@ RestOperation::RestOperation(StorageInternal* storage_internal,
   // construction is finished.
   MutexLock lock(mutex_);
   transport_.Perform(*request_, response_.get(), &rest_controller_);
+  Register(storage_reference, controller_out);
+}
 
+RestOperation::RestOperation(StorageInternal* storage_internal,
+                             const StorageReference& storage_reference,
+                             ChunkedTransfer* transfer, Listener* listener,
+                             Controller* controller_out)
+    : storage_internal_(storage_internal),
+      request_(nullptr),
+      request_notifier_(nullptr),
+      response_(nullptr),
+      listener_(nullptr),
+      handle_(),
+      transfer_(transfer),
+      is_complete_(false),
+      progress_interval_milliseconds_(static_cast<uint64_t>(
+          storage_internal->progress_interval() * 1000.0)),
+      sample_time_(::firebase::internal::GetTimestamp()),
+      sample_bytes_(0),
+      has_sample_(false),
+      bytes_per_second_(0),
+      average_bytes_per_second_(0),
+      progress_pending_(false) {
+  // The transfer reports the progress of all its requests, and its completion.
+  transfer_->set_update_callback(
+      [](Notifier::UpdateCallbackType update_type, void* data) {
+        RestOperation* operation = reinterpret_cast<RestOperation*>(data);
+        switch (update_type) {
+          case Notifier::kUpdateCallbackTypeProgress:
+            operation->NotifyListenerOfProgress(false);
+            break;
+          case Notifier::kUpdateCallbackTypeComplete:
+          case Notifier::kUpdateCallbackTypeCanceled:
+            operation->NotifyListenerOfProgress(true);
+            // The transfer is complete, which allows
+            // StorageInternal::CleanupOperations() to delete this operation.
+            operation->is_complete_ = true;
+            break;
+        }
+      },
+      this);
+
+  set_listener(listener);
+
+  // Acquire the mutex to prevent operation from being completed before
+  // construction is finished.
+  MutexLock lock(mutex_);
+  transfer_->Start();
+  Register(storage_reference, controller_out);
+}
+
+void RestOperation::Register(const StorageReference& storage_reference,
+                             Controller* controller_out) {
   // rest::TransportCurl owns the rest::Controller pointer so as long as this
   // object is alive and rest::Controller is valid.
   controller_.internal_->Initialize(storage_reference, this);
   storage_internal_->cleanup().RegisterObject(this, [](void* operation) {
     delete reinterpret_cast<RestOperation*>(operation);
   });
-  storage_internal->AddOperation(this);
+  storage_internal_->AddOperation(this);
   if (controller_out) *controller_out = controller_;
 }
 
 RestOperation::~RestOperation() {
+  // The transfer notifies this object while holding its own lock, so stop the
+  // notifications before acquiring mutex_.
+  if (transfer_) transfer_->set_update_callback(nullptr, nullptr);
   MutexLock lock(mutex_);
-  // Clear the update callback to avoid deleting the operation while it's being
-  // deleted.
-  response_->set_update_callback(nullptr, nullptr);
-  request_notifier_->set_update_callback(nullptr, nullptr);
-  rest_controller_->Cancel();
+  if (transfer_) {
+    transfer_->Cancel();
+  } else {
+    // Clear the update callback to avoid deleting the operation while it's
+    // being deleted.
+    response_->set_update_callback(nullptr, nullptr);
+    request_notifier_->set_update_callback(nullptr, nullptr);
+    rest_controller_->Cancel();
+  }
   cleanup().CleanupAll();
   storage_internal_->cleanup().UnregisterObject(this);
   storage_internal_->RemoveOperation(this);
@@ -101,7 +178,7 @@ RestOperation::~RestOperation() {
 
 bool RestOperation::Pause() {
   MutexLock lock(mutex_);
-  bool paused = rest_controller_->Pause();
+  bool paused = transfer_ ? transfer_->Pause() : rest_controller_->Pause();
   if (paused && listener_) {
     listener_->OnPaused(&controller_);
   }
@@ -110,27 +187,58 @@ bool RestOperation::Pause() {
 
 bool RestOperation::Resume() {
   MutexLock lock(mutex_);
-  return rest_controller_->Resume();
+  bool resumed = transfer_ ? transfer_->Resume() : rest_controller_->Resume();
+  if (resumed) {
+    // The time spent paused does not count towards the throughput.
+    sample_time_ = ::firebase::internal::GetTimestamp();
+    sample_bytes_ = bytes_transferred();
+  }
+  return resumed;
 }
 
 bool RestOperation::Cancel() {
   MutexLock lock(mutex_);
-  return rest_controller_->Cancel();
+  return transfer_ ? transfer_->Cancel() : rest_controller_->Cancel();
 }
 
 bool RestOperation::is_paused() const {
   MutexLock lock(mutex_);
-  return rest_controller_->IsPaused();
+  return transfer_ ? transfer_->is_paused() : rest_controller_->IsPaused();
 }
 
 int64_t RestOperation::bytes_transferred() const {
   MutexLock lock(mutex_);
-  return rest_controller_->BytesTransferred();
+  return transfer_ ? transfer_->bytes_transferred()
+                 : rest_controller_->BytesTransferred();
 }
 
 int64_t RestOperation::total_byte_count() const {
   MutexLock lock(mutex_);
-  return rest_controller_->TransferSize();
+  return transfer_ ? transfer_->total_byte_count()
+                 : rest_controller_->TransferSize();
+}
+
+double RestOperation::bytes_per_second() const {
+  MutexLock lock(mutex_);
+  return bytes_per_second_;
+}
+
+double RestOperation::average_bytes_per_second() const {
+  MutexLock lock(mutex_);
+  return average_bytes_per_second_;
+}
+
+double RestOperation::estimated_seconds_remaining() const {
+  MutexLock lock(mutex_);
+  int64_t total = total_byte_count();
+  if (total < 0 || average_bytes_per_second_ <= 0) return -1;
+  int64_t remaining = (std::max)(total - bytes_transferred(), int64_t(0));
+  return remaining / average_bytes_per_second_;
+}
+
+int RestOperation::retry_count() const {
+  MutexLock lock(mutex_);
+  return transfer_ ? transfer_->retry_count() : 0;
 }
 
 // Whether this operation is complete and can be deleted.
@@ -139,12 +247,40 @@ bool RestOperation::is_complete() const {
   return is_complete_;
 }
 
-// Notify the listener of progress.
-void RestOperation::NotifyListenerOfProgress() {
+void RestOperation::NotifyListenerOfProgress(bool final) {
   MutexLock lock(mutex_);
+  uint64_t now = ::firebase::internal::GetTimestamp();
+  if (final) {
+    if (!progress_pending_) return;
+  } else if (now - sample_time_ < progress_interval_milliseconds_) {
+    progress_pending_ = true;
+    return;
+  }
+  progress_pending_ = false;
+  SampleThroughput(now);
   if (listener_) listener_->impl_->NotifyProgress(&controller_);
 }
 
+void RestOperation::SampleThroughput(uint64_t now) {
+  int64_t bytes = bytes_transferred();
+  if (now <= sample_time_) return;
+  double seconds = (now - sample_time_) / 1000.0;
+  // A transfer which starts over reports fewer bytes than before.
+  bytes_per_second_ = (std::max)(bytes - sample_bytes_, int64_t(0)) / seconds;
+  if (has_sample_) {
+    // Each sample weighs by its duration, so that the smoothing does not
+    // depend on the progress interval.
+    double weight = 1.0 - std::exp(-seconds / kThroughputSmoothingSeconds);
+    average_bytes_per_second_ +=
+        weight * (bytes_per_second_ - average_bytes_per_second_);
+  } else {
+    average_bytes_per_second_ = bytes_per_second_;
+    has_sample_ = true;
+  }
+  sample_time_ = now;
+  sample_bytes_ = bytes;
+}
+
 void RestOperation::set_listener(Listener* listener) {
   if (listener) listener->impl_->set_rest_operation(this);
   MutexLock lock(mutex_);
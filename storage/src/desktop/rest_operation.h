@@ -37,9 +37,16 @@ namespace internal {
 
 class BlockingResponse;
 class Notifier;
+class ChunkedTransfer;
 
 // Structure containing the data we need to keep track of, (and later clean up)
 // when we spin up a new async request.
+//
+// The transport reports progress as often as it moves data, which on a fast
+// link is thousands of times a second.  The listener is notified at most once
+// per progress interval of the Storage instance, and once more when the
+// operation completes if progress was held back.  The throughput is sampled
+// at each notification.
 class RestOperation {
  private:
   // See Start().
@@ -49,6 +56,12 @@ class RestOperation {
                 BlockingResponse* response, Listener* listener,
                 FutureHandle handle, Controller* controller_out);
 
+  // See StartTransfer().
+  RestOperation(StorageInternal* storage_internal,
+                const StorageReference& storage_reference,
+                ChunkedTransfer* transfer, Listener* listener,
+                Controller* controller_out);
+
  public:
   ~RestOperation();
 
@@ -67,6 +80,14 @@ class RestOperation {
   int64_t bytes_transferred() const;
   // Returns the total bytes to be transferred.
   int64_t total_byte_count() const;
+  // Returns the throughput over the last progress interval, and smoothed over
+  // several, in bytes per second.
+  double bytes_per_second() const;
+  double average_bytes_per_second() const;
+  // Returns the estimated time to completion in seconds, or -1 if unknown.
+  double estimated_seconds_remaining() const;
+  // Returns the number of requests retried after a failure.
+  int retry_count() const;
 
   // Set the listener for this operation.
   void set_listener(Listener* listener);
@@ -75,8 +96,17 @@ class RestOperation {
   bool is_complete() const;
 
  private:
-  // Notify the listener of progress.
-  void NotifyListenerOfProgress();
+  // Notify the listener of progress, unless it was notified less than a
+  // progress interval ago.  When `final`, only notify it of progress which
+  // was held back.
+  void NotifyListenerOfProgress(bool final);
+
+  // Measure the throughput since the last sample.
+  void SampleThroughput(uint64_t now);
+
+  // Hand this object over to storage_internal and set up the controller.
+  void Register(const StorageReference& storage_reference,
+                Controller* controller_out);
 
  public:
   // Takes ownership of request and response, copies storage_reference
@@ -98,6 +128,19 @@ class RestOperation {
                       // storage_internal.
   }
 
+  // Same as Start() for a transfer made of several requests.  Takes ownership
+  // of transfer and starts it.
+  static void StartTransfer(StorageInternal* storage_internal,
+                            const StorageReference& storage_reference,
+                            ChunkedTransfer* transfer, Listener* listener,
+                            Controller* controller_out) {
+    RestOperation* operation =
+        new RestOperation(storage_internal, storage_reference, transfer,
+                          listener, controller_out);
+    (void)operation;  // After creation the operation is owned by
+                      // storage_internal.
+  }
+
  private:
   StorageInternal* storage_internal_;
   UniquePtr<rest::Request> request_;
@@ -110,9 +153,23 @@ class RestOperation {
   CleanupNotifier cleanup_;
   rest::TransportCurl transport_;
   std::unique_ptr<rest::Controller> rest_controller_;
+  // Set instead of the request, response and controller above for a transfer
+  // made of several requests.
+  UniquePtr<ChunkedTransfer> transfer_;
   // Storage controller that delegates to this object.
   storage::Controller controller_;
   bool is_complete_;
+
+  // Progress notifications, guarded by mutex_.
+  uint64_t progress_interval_milliseconds_;
+  // Time and bytes transferred of the last throughput sample.
+  uint64_t sample_time_;
+  int64_t sample_bytes_;
+  bool has_sample_;
+  double bytes_per_second_;
+  double average_bytes_per_second_;
+  // Whether progress was reported since the listener was last notified.
+  bool progress_pending_;
 };
 
 }  // namespace internal
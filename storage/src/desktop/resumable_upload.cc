@@ -0,0 +1,696 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "storage/src/desktop/resumable_upload.h"
+
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif  // _FILE_OFFSET_BITS
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include "app/rest/request_binary.h"
+#include "app/rest/util.h"
+#include "app/src/log.h"
+#include "app/src/time.h"
+#include "storage/src/desktop/crc32c.h"
+#include "storage/src/desktop/metadata_desktop.h"
+#include "storage/src/desktop/storage_desktop.h"
+#include "storage/src/desktop/storage_reference_desktop.h"
+
+// Map to POSIX compliant fseek on Windows.
+#ifdef _WIN32
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif  // _WIN32
+
+namespace firebase {
+namespace storage {
+namespace internal {
+
+const int64_t kResumableUploadThreshold = 5 * 1024 * 1024;
+
+// Chunks have to be a multiple of this size, except for the last one, unless
+// the server asks for another granularity.
+static const int64_t kDefaultChunkGranularity = 256 * 1024;
+// Size of the first chunk, before any throughput has been measured.
+static const int64_t kInitialChunkSize = 1024 * 1024;
+// Chunks are read in memory, so this bounds the memory used by an upload.
+static const int64_t kMaxChunkSize = 32 * 1024 * 1024;
+// Chunks are sized to take about this long to send.  Long enough for the
+// round trip of each chunk not to matter, short enough not to lose much when
+// a chunk fails.
+static const int64_t kTargetChunkMilliseconds = 3000;
+
+// Size of the blocks read from the producer of a stream.
+static const size_t kStreamReadSize = 64 * 1024;
+
+// Status of a request to an upload session which has expired or was canceled,
+// along with 404.
+static const int kHttpGone = 410;
+
+// Request headers of the protocol.
+static const char kUploadProtocolHeader[] = "X-Goog-Upload-Protocol";
+static const char kUploadCommandHeader[] = "X-Goog-Upload-Command";
+static const char kUploadOffsetHeader[] = "X-Goog-Upload-Offset";
+static const char kUploadContentLengthHeader[] =
+    "X-Goog-Upload-Header-Content-Length";
+static const char kUploadContentTypeHeader[] =
+    "X-Goog-Upload-Header-Content-Type";
+// Response headers of the protocol, in lower case.
+static const char kUploadUrlHeader[] = "x-goog-upload-url";
+static const char kUploadStatusHeader[] = "x-goog-upload-status";
+static const char kUploadSizeReceivedHeader[] = "x-goog-upload-size-received";
+static const char kUploadChunkGranularityHeader[] =
+    "x-goog-upload-chunk-granularity";
+
+static const char kUploadStatusActive[] = "active";
+static const char kUploadStatusFinal[] = "final";
+
+// Keys of the session file.
+static const char kSessionUrlKey[] = "url";
+static const char kSessionObjectKey[] = "object";
+static const char kSessionSizeKey[] = "size";
+static const char kSessionModificationTimeKey[] = "modified";
+static const char kSessionGranularityKey[] = "granularity";
+
+static const char kInvalidJsonResponse[] =
+    "The server did not return a valid JSON response.  "
+    "Contact Firebase support if this issue persists.";
+static const char kNoResponse[] = "The server could not be reached.";
+static const char kUploadChecksumMismatch[] =
+    "The object stored by the server does not match the data uploaded.";
+
+// Sends one chunk of data, keeping count of the bytes read by the transport.
+class ChunkRequest : public rest::RequestBinary {
+ public:
+  ChunkRequest(const char* data, size_t size, ResumableUpload* upload)
+      : rest::RequestBinary(data, size), upload_(upload) {}
+
+  size_t ReadBody(char* buffer, size_t length, bool* abort) override {
+    size_t read_size = rest::RequestBinary::ReadBody(buffer, length, abort);
+    upload_->AddChunkProgress(read_size);
+    return read_size;
+  }
+
+ private:
+  ResumableUpload* upload_;
+};
+
+int64_t BufferUploadSource::Read(int64_t offset, size_t length,
+                                 const char** data) {
+  if (offset < 0 || static_cast<uint64_t>(offset) > buffer_size_) return -1;
+  *data = buffer_ + offset;
+  return static_cast<int64_t>(
+      (std::min)(length, buffer_size_ - static_cast<size_t>(offset)));
+}
+
+FileUploadSource::FileUploadSource(const char* filename)
+    : file_(fopen(filename, "rb")), file_size_(0), modification_time_(0) {
+  if (file_ && fseeko(file_, 0, SEEK_END) == 0) {
+    file_size_ = static_cast<int64_t>(ftello(file_));
+  } else if (file_) {
+    fclose(file_);
+    file_ = nullptr;
+  }
+  struct stat file_stat;
+  if (file_ && stat(filename, &file_stat) == 0) {
+    modification_time_ = static_cast<int64_t>(file_stat.st_mtime);
+  }
+}
+
+FileUploadSource::~FileUploadSource() {
+  if (file_) fclose(file_);
+}
+
+int64_t FileUploadSource::Read(int64_t offset, size_t length,
+                               const char** data) {
+  if (!file_ || offset < 0 || offset > file_size_) return -1;
+  length = static_cast<size_t>(
+      (std::min)(static_cast<int64_t>(length), file_size_ - offset));
+  chunk_.resize(length);
+  if (fseeko(file_, offset, SEEK_SET) != 0) return -1;
+  if (length > 0 && fread(&chunk_[0], 1, length, file_) != length) {
+    return -1;
+  }
+  *data = chunk_.data();
+  return static_cast<int64_t>(length);
+}
+
+int64_t StreamUploadSource::Read(int64_t offset, size_t length,
+                                 const char** data) {
+  if (failed_ || offset < buffer_offset_ ||
+      offset > buffer_offset_ + static_cast<int64_t>(buffer_.size())) {
+    return -1;
+  }
+  // What comes before the offset will not be asked for again.
+  buffer_.erase(0, static_cast<size_t>(offset - buffer_offset_));
+  buffer_offset_ = offset;
+  // Read past the requested length, so that the end of the data is known by
+  // the time the last chunk is sent.
+  while (size_ < 0 && buffer_.size() <= length) {
+    size_t buffered = buffer_.size();
+    buffer_.resize(buffered + kStreamReadSize);
+    int64_t read = producer_(&buffer_[buffered], kStreamReadSize, user_data_);
+    if (read < 0 || read > static_cast<int64_t>(kStreamReadSize)) {
+      LogDebug("The producer of the data to upload failed.");
+      failed_ = true;
+      return -1;
+    }
+    buffer_.resize(buffered + static_cast<size_t>(read));
+    if (read == 0) size_ = buffer_offset_ + static_cast<int64_t>(buffered);
+  }
+  *data = buffer_.data();
+  return static_cast<int64_t>((std::min)(length, buffer_.size()));
+}
+
+ResumableUpload::ResumableUpload(const StorageReferenceInternal& reference,
+                                 UploadSource* source,
+                                 const std::string& session_file,
+                                 const std::string& metadata_json,
+                                 const std::string& content_type,
+                                 SafeFutureHandle<Metadata> handle,
+                                 ReferenceCountedFutureImpl* future_api)
+    : reference_(new StorageReferenceInternal(reference)),
+      source_(source),
+      session_file_(session_file),
+      metadata_json_(metadata_json),
+      content_type_(content_type),
+      handle_(handle),
+      future_api_(future_api),
+      resumed_session_(false),
+      chunk_granularity_(kDefaultChunkGranularity),
+      chunk_size_(kInitialChunkSize),
+      crc32c_(0),
+      hashed_bytes_(0),
+      verify_(true),
+      error_(kErrorNone),
+      committed_(0),
+      chunk_bytes_sent_(0),
+      sending_chunk_(false),
+      paused_(false),
+      canceled_(false),
+      complete_(false),
+      request_(nullptr),
+      response_(nullptr),
+      response_done_(0),
+      wake_(0),
+      thread_(nullptr) {
+  transport_.set_is_async(true);
+}
+
+ResumableUpload::~ResumableUpload() {
+  Cancel();
+  if (thread_) {
+    thread_->Join();
+    thread_.reset(nullptr);
+  }
+}
+
+void ResumableUpload::Start() {
+  thread_ = MakeUnique<Thread>(UploadRoutine, this);
+}
+
+bool ResumableUpload::Pause() {
+  MutexLock lock(mutex_);
+  if (canceled_ || complete_ || paused_) return false;
+  paused_ = true;
+  if (rest_controller_) rest_controller_->Pause();
+  return true;
+}
+
+bool ResumableUpload::Resume() {
+  MutexLock lock(mutex_);
+  if (canceled_ || complete_ || !paused_) return false;
+  paused_ = false;
+  if (rest_controller_) rest_controller_->Resume();
+  wake_.Post();
+  return true;
+}
+
+bool ResumableUpload::Cancel() {
+  MutexLock lock(mutex_);
+  if (canceled_ || complete_) return false;
+  canceled_ = true;
+  if (rest_controller_) rest_controller_->Cancel();
+  wake_.Post();
+  return true;
+}
+
+bool ResumableUpload::is_paused() const {
+  MutexLock lock(mutex_);
+  return paused_;
+}
+
+int64_t ResumableUpload::bytes_transferred() const {
+  MutexLock lock(mutex_);
+  return committed_ + (sending_chunk_ ? chunk_bytes_sent_ : 0);
+}
+
+void ResumableUpload::AddChunkProgress(size_t length) {
+  {
+    MutexLock lock(mutex_);
+    chunk_bytes_sent_ += length;
+  }
+  Notify(Notifier::kUpdateCallbackTypeProgress);
+}
+
+void ResumableUpload::UploadRoutine(void* data) {
+  ResumableUpload* upload = static_cast<ResumableUpload*>(data);
+  upload->Complete(upload->Upload());
+}
+
+void ResumableUpload::Complete(Error error) {
+  if (error == kErrorNone) {
+    MetadataInternal* metadata_internal =
+        new MetadataInternal(reference_->AsStorageReference());
+    if (!metadata_internal->ImportFromJson(result_.c_str())) {
+      // The object was created, but its metadata could not be read.
+      future_api_->Complete(handle_, kErrorUnknown, kInvalidJsonResponse);
+      delete metadata_internal;
+    } else if (!MatchesUpload(*metadata_internal)) {
+      LogWarning("Upload of %s does not match its checksum.",
+                 reference_->full_path().c_str());
+      future_api_->Complete(handle_, kErrorUnknown, kUploadChecksumMismatch);
+      delete metadata_internal;
+    } else {
+      future_api_->CompleteWithResult(
+          handle_, kErrorNone, MetadataInternal::AsMetadata(metadata_internal));
+    }
+  } else if (error == kErrorCancelled) {
+    future_api_->Complete(handle_, kErrorCancelled);
+  } else {
+    future_api_->Complete(handle_, error, error_message_.c_str());
+  }
+  {
+    MutexLock lock(mutex_);
+    complete_ = true;
+  }
+  Notify(Notifier::kUpdateCallbackTypeProgress);
+  Notify(error == kErrorCancelled ? Notifier::kUpdateCallbackTypeCanceled
+                                  : Notifier::kUpdateCallbackTypeComplete);
+}
+
+Error ResumableUpload::Upload() {
+  // A session loaded from the file has to be queried for where to resume.
+  bool query = LoadSession();
+  uint64_t max_retry_milliseconds = static_cast<uint64_t>(
+      reference_->storage_internal()->max_upload_retry_time() * 1000.0);
+  // When the upload started failing, 0 while it is not.
+  uint64_t first_failure = 0;
+  int64_t retry_delay = kInitialRetryDelayMilliseconds;
+  for (;;) {
+    if (!WaitWhilePaused()) return kErrorCancelled;
+
+    StepResult step;
+    if (upload_url_.empty()) {
+      step = StartSession();
+    } else if (query) {
+      step = QuerySession();
+    } else {
+      step = SendChunk();
+    }
+
+    if (step == kStepRestart) {
+      LogDebug("Upload session for %s is gone, starting a new one.",
+               reference_->full_path().c_str());
+      bool resumed_session = resumed_session_;
+      RemoveSession();
+      upload_url_.clear();
+      resumed_session_ = false;
+      query = false;
+      {
+        MutexLock lock(mutex_);
+        committed_ = 0;
+      }
+      Notify(Notifier::kUpdateCallbackTypeProgress);
+      // An expired session from the file is the expected case.  Anything else
+      // is retried like any failure, so that it can not loop.
+      if (resumed_session) continue;
+    }
+
+    switch (step) {
+      case kStepContinue:
+        query = false;
+        resumed_session_ = false;
+        first_failure = 0;
+        retry_delay = kInitialRetryDelayMilliseconds;
+        break;
+      case kStepFinal:
+        RemoveSession();
+        return kErrorNone;
+      case kStepFailed:
+        RemoveSession();
+        return error_;
+      case kStepCanceled:
+        RemoveSession();
+        return kErrorCancelled;
+      case kStepRestart:
+      case kStepRetry: {
+        uint64_t now = ::firebase::internal::GetTimestamp();
+        if (first_failure == 0) first_failure = now;
+        if (now - first_failure >= max_retry_milliseconds) {
+          // Give up, but keep the session so a later upload can resume it.
+          return error_;
+        }
+        LogDebug("Upload of %s failed (%s), retrying in %dms.",
+                 reference_->full_path().c_str(), error_message_.c_str(),
+                 static_cast<int>(retry_delay));
+        // Whatever was in flight may or may not have been committed.
+        query = !upload_url_.empty();
+        chunk_size_ = RoundChunkSize(chunk_size_ / 2);
+        CountRetry();
+        if (!WaitForRetry(retry_delay)) return kErrorCancelled;
+        retry_delay = (std::min)(retry_delay * 2, kMaxRetryDelayMilliseconds);
+        break;
+      }
+    }
+  }
+}
+
+ResumableUpload::StepResult ResumableUpload::StartSession() {
+  rest::Request* request = new rest::Request();
+  reference_->PrepareRequest(
+      request, reference_->storageUri_.AsHttpUploadUrl().c_str(),
+      rest::util::kPost);
+  request->add_header(kUploadProtocolHeader, "resumable");
+  request->add_header(kUploadCommandHeader, "start");
+  // The size of a stream is only given by the last chunk.
+  if (source_->size() >= 0) {
+    request->add_header(kUploadContentLengthHeader,
+                        std::to_string(source_->size()).c_str());
+  }
+  request->add_header(kUploadContentTypeHeader, content_type_.c_str());
+  // The metadata is set along with the object, which saves updating it once
+  // the upload is complete.
+  request->add_header(rest::util::kContentType, rest::util::kApplicationJson);
+  request->set_post_fields(metadata_json_.c_str(), metadata_json_.size());
+  if (!Send(request)) return kStepCanceled;
+  if (response_->status() != rest::util::HttpSuccess) {
+    return HandleFailure(false);
+  }
+
+  upload_url_ = response_->header(kUploadUrlHeader);
+  if (upload_url_.empty()) {
+    error_ = kErrorUnknown;
+    error_message_ = "The server did not start an upload session.";
+    return kStepFailed;
+  }
+  int64_t granularity = strtoll(  // NOLINT
+      response_->header(kUploadChunkGranularityHeader).c_str(), nullptr, 10);
+  if (granularity > 0) chunk_granularity_ = granularity;
+  chunk_size_ = RoundChunkSize(chunk_size_);
+  SaveSession();
+  return kStepContinue;
+}
+
+ResumableUpload::StepResult ResumableUpload::QuerySession() {
+  rest::Request* request = new rest::Request();
+  reference_->PrepareRequest(request, upload_url_.c_str(), rest::util::kPost);
+  request->add_header(kUploadCommandHeader, "query");
+  if (!Send(request)) return kStepCanceled;
+  if (response_->status() != rest::util::HttpSuccess) {
+    return HandleFailure(true);
+  }
+
+  std::string upload_status = response_->header(kUploadStatusHeader);
+  if (upload_status == kUploadStatusFinal) return FetchMetadata();
+  if (upload_status != kUploadStatusActive) return kStepRestart;
+
+  std::string size_received = response_->header(kUploadSizeReceivedHeader);
+  int64_t received = strtoll(size_received.c_str(), nullptr, 10);  // NOLINT
+  if (size_received.empty() || received < 0 ||
+      (source_->size() >= 0 && received > source_->size())) {
+    error_ = kErrorUnknown;
+    error_message_ = "The server did not report the progress of the upload.";
+    return kStepRetry;
+  }
+  {
+    MutexLock lock(mutex_);
+    committed_ = received;
+  }
+  Notify(Notifier::kUpdateCallbackTypeProgress);
+  return kStepContinue;
+}
+
+ResumableUpload::StepResult ResumableUpload::SendChunk() {
+  int64_t offset = committed_;
+  CatchUpChecksum(offset);
+  const char* data = nullptr;
+  int64_t length = source_->Read(offset, static_cast<size_t>(chunk_size_),
+                                 &data);
+  if (length < 0) {
+    error_ = kErrorUnknown;
+    error_message_ = "Could not read the data to upload.";
+    return kStepFailed;
+  }
+  UpdateChecksum(offset, data, length);
+  // The size of a stream is known once the chunk which reaches its end is
+  // read.
+  bool finalize = offset + length == source_->size();
+
+  ChunkRequest* request =
+      new ChunkRequest(data, static_cast<size_t>(length), this);
+  reference_->PrepareRequest(request, upload_url_.c_str(), rest::util::kPost);
+  request->add_header(kUploadCommandHeader,
+                      finalize ? "upload, finalize" : "upload");
+  request->add_header(kUploadOffsetHeader, std::to_string(offset).c_str());
+  {
+    MutexLock lock(mutex_);
+    chunk_bytes_sent_ = 0;
+    sending_chunk_ = true;
+  }
+  uint64_t start = ::firebase::internal::GetTimestamp();
+  bool sent = Send(request);
+  uint64_t elapsed = ::firebase::internal::GetTimestamp() - start;
+  bool succeeded = sent && response_->status() == rest::util::HttpSuccess;
+  {
+    MutexLock lock(mutex_);
+    sending_chunk_ = false;
+    if (succeeded) committed_ = offset + length;
+  }
+  if (!sent) return kStepCanceled;
+  Notify(Notifier::kUpdateCallbackTypeProgress);
+  if (!succeeded) return HandleFailure(true);
+
+  if (response_->header(kUploadStatusHeader) == kUploadStatusFinal) {
+    result_ = response_->GetBody();
+    return kStepFinal;
+  }
+  if (finalize) {
+    error_ = kErrorUnknown;
+    error_message_ = "The server did not complete the upload.";
+    return kStepFailed;
+  }
+  AdaptChunkSize(length, elapsed);
+  return kStepContinue;
+}
+
+ResumableUpload::StepResult ResumableUpload::FetchMetadata() {
+  rest::Request* request = new rest::Request();
+  reference_->PrepareRequest(
+      request, reference_->storageUri_.AsHttpMetadataUrl().c_str(),
+      rest::util::kGet);
+  if (!Send(request)) return kStepCanceled;
+  if (response_->status() != rest::util::HttpSuccess) {
+    return HandleFailure(false);
+  }
+  if (source_->size() >= 0) {
+    CatchUpChecksum(source_->size());
+    MutexLock lock(mutex_);
+    committed_ = source_->size();
+  }
+  result_ = response_->GetBody();
+  return kStepFinal;
+}
+
+void ResumableUpload::UpdateChecksum(int64_t offset, const char* data,
+                                     int64_t length) {
+  int64_t skip = hashed_bytes_ - offset;
+  if (!verify_ || skip < 0 || skip >= length) return;
+  crc32c_ =
+      Crc32cExtend(crc32c_, data + skip, static_cast<size_t>(length - skip));
+  hashed_bytes_ = offset + length;
+}
+
+void ResumableUpload::CatchUpChecksum(int64_t offset) {
+  while (verify_ && hashed_bytes_ < offset) {
+    const char* data = nullptr;
+    int64_t length = source_->Read(
+        hashed_bytes_,
+        static_cast<size_t>((std::min)(offset - hashed_bytes_, kMaxChunkSize)),
+        &data);
+    if (length <= 0) {
+      // A stream can not be read again, the data is left unchecked.
+      verify_ = false;
+      break;
+    }
+    UpdateChecksum(hashed_bytes_, data, length);
+  }
+}
+
+bool ResumableUpload::MatchesUpload(const MetadataInternal& metadata) const {
+  int64_t size = metadata.size_bytes();
+  if (size >= 0 && source_->size() >= 0 && size != source_->size()) {
+    return false;
+  }
+  if (!verify_ || size != hashed_bytes_ || metadata.crc32c().empty()) {
+    return true;
+  }
+  return Crc32cToBase64(crc32c_) == metadata.crc32c();
+}
+
+bool ResumableUpload::Send(rest::Request* request) {
+  {
+    MutexLock lock(mutex_);
+    // The previous request and response are complete by now.
+    request_.reset(request);
+    if (canceled_) return false;
+    response_.reset(new TransferResponse(&response_done_));
+    transport_.Perform(request_.get(), response_.get(), &rest_controller_);
+    if (paused_) rest_controller_->Pause();
+  }
+  response_done_.Wait();
+  MutexLock lock(mutex_);
+  rest_controller_.reset();
+  return !canceled_ && !response_->canceled();
+}
+
+ResumableUpload::StepResult ResumableUpload::HandleFailure(
+    bool session_request) {
+  int status = response_->status();
+  error_ = HttpToErrorCode(status);
+  StorageNetworkError network_error;
+  if (network_error.Parse(response_->GetBody())) {
+    error_message_ = network_error.error_message();
+  } else {
+    error_message_ =
+        status == rest::util::HttpInvalid ? kNoResponse : kInvalidJsonResponse;
+  }
+
+  // The session the request was sent to has expired or was canceled.
+  if (session_request &&
+      (status == rest::util::HttpNotFound || status == kHttpGone)) {
+    return kStepRestart;
+  }
+  if (IsRetryableHttpStatus(status)) return kStepRetry;
+  return kStepFailed;
+}
+
+void ResumableUpload::AdaptChunkSize(int64_t length,
+                                     uint64_t elapsed_milliseconds) {
+  // Grow at most twofold at once, so a chunk which went unusually fast does
+  // not lead to one which takes far too long.
+  int64_t target = chunk_size_ * 2;
+  if (elapsed_milliseconds > 0) {
+    target = (std::min)(target, length * kTargetChunkMilliseconds /
+                                    static_cast<int64_t>(elapsed_milliseconds));
+  }
+  chunk_size_ = RoundChunkSize(target);
+}
+
+int64_t ResumableUpload::RoundChunkSize(int64_t size) const {
+  size = (std::min)(size, kMaxChunkSize);
+  size -= size % chunk_granularity_;
+  return (std::max)(size, chunk_granularity_);
+}
+
+bool ResumableUpload::WaitWhilePaused() {
+  for (;;) {
+    {
+      MutexLock lock(mutex_);
+      if (canceled_) return false;
+      if (!paused_) return true;
+    }
+    wake_.Wait();
+  }
+}
+
+bool ResumableUpload::WaitForRetry(int64_t milliseconds) {
+  uint64_t end = ::firebase::internal::GetTimestamp() + milliseconds;
+  for (;;) {
+    {
+      MutexLock lock(mutex_);
+      if (canceled_) return false;
+    }
+    uint64_t now = ::firebase::internal::GetTimestamp();
+    if (now >= end) return true;
+    wake_.TimedWait(static_cast<int>(end - now));
+  }
+}
+
+bool ResumableUpload::LoadSession() {
+  if (session_file_.empty()) return false;
+  std::ifstream file(session_file_.c_str());
+  if (!file.is_open()) return false;
+
+  std::map<std::string, std::string> values;
+  std::string line;
+  while (std::getline(file, line)) {
+    size_t separator = line.find('=');
+    if (separator == std::string::npos) continue;
+    values[line.substr(0, separator)] = line.substr(separator + 1);
+  }
+  // Only resume a session uploading the same data to the same object.
+  if (values[kSessionUrlKey].empty() ||
+      values[kSessionObjectKey] != reference_->storageUri_.AsHttpUploadUrl() ||
+      values[kSessionSizeKey] != std::to_string(source_->size()) ||
+      values[kSessionModificationTimeKey] !=
+          std::to_string(source_->modification_time())) {
+    LogDebug("Ignoring upload session in %s which is for other data.",
+             session_file_.c_str());
+    return false;
+  }
+  upload_url_ = values[kSessionUrlKey];
+  int64_t granularity = strtoll(  // NOLINT
+      values[kSessionGranularityKey].c_str(), nullptr, 10);
+  if (granularity > 0) chunk_granularity_ = granularity;
+  chunk_size_ = RoundChunkSize(chunk_size_);
+  resumed_session_ = true;
+  LogDebug("Resuming upload of %s from session in %s.",
+           reference_->full_path().c_str(), session_file_.c_str());
+  return true;
+}
+
+void ResumableUpload::SaveSession() {
+  if (session_file_.empty()) return;
+  std::ofstream file(session_file_.c_str(), std::ios::out | std::ios::trunc);
+  if (file.is_open()) {
+    file << kSessionUrlKey << "=" << upload_url_ << "\n"
+         << kSessionObjectKey << "="
+         << reference_->storageUri_.AsHttpUploadUrl() << "\n"
+         << kSessionSizeKey << "=" << source_->size() << "\n"
+         << kSessionModificationTimeKey << "=" << source_->modification_time()
+         << "\n"
+         << kSessionGranularityKey << "=" << chunk_granularity_ << "\n";
+  }
+  if (!file.good()) {
+    LogDebug("Could not save upload session to %s, the upload will not be "
+             "resumable after a restart.",
+             session_file_.c_str());
+  }
+}
+
+void ResumableUpload::RemoveSession() {
+  if (!session_file_.empty()) remove(session_file_.c_str());
+}
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace firebase
@@ -0,0 +1,312 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_RESUMABLE_UPLOAD_H_
+#define FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_RESUMABLE_UPLOAD_H_
+
+#include <stdio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "app/memory/unique_ptr.h"
+#include "app/rest/controller_interface.h"
+#include "app/rest/request.h"
+#include "app/rest/transport_curl.h"
+#include "app/src/mutex.h"
+#include "app/src/reference_counted_future_impl.h"
+#include "app/src/semaphore.h"
+#include "app/src/thread.h"
+#include "storage/src/desktop/chunked_transfer.h"
+#include "storage/src/desktop/curl_requests.h"
+#include "storage/src/include/firebase/storage/common.h"
+#include "storage/src/include/firebase/storage/metadata.h"
+#include "storage/src/include/firebase/storage/storage_reference.h"
+
+namespace firebase {
+namespace storage {
+namespace internal {
+
+class MetadataInternal;
+class StorageReferenceInternal;
+
+// Uploads at least this large use the resumable upload protocol.  Smaller
+// ones are sent in a single request.
+extern const int64_t kResumableUploadThreshold;
+
+// Where the bytes of a resumable upload come from.
+class UploadSource {
+ public:
+  virtual ~UploadSource() {}
+
+  // Total number of bytes to upload, or -1 while it is unknown: the size of a
+  // stream is only known once all of it was read.
+  virtual int64_t size() const = 0;
+
+  // Get up to `length` bytes starting at `offset`, fewer only at the end of the
+  // data.  The data remains valid until the next call.  Returns the number of
+  // bytes, or -1 if the data could not be read.
+  virtual int64_t Read(int64_t offset, size_t length, const char** data) = 0;
+
+  // Last modification time of the data, if known, used to tell whether a
+  // persisted session still refers to the same data.
+  virtual int64_t modification_time() const { return 0; }
+};
+
+// Uploads from a buffer owned by the caller.
+class BufferUploadSource : public UploadSource {
+ public:
+  BufferUploadSource(const void* buffer, size_t buffer_size)
+      : buffer_(static_cast<const char*>(buffer)), buffer_size_(buffer_size) {}
+
+  int64_t size() const override { return buffer_size_; }
+  int64_t Read(int64_t offset, size_t length, const char** data) override;
+
+ private:
+  const char* buffer_;
+  size_t buffer_size_;
+};
+
+// Uploads from a file, reading one chunk at a time.
+class FileUploadSource : public UploadSource {
+ public:
+  explicit FileUploadSource(const char* filename);
+  ~FileUploadSource() override;
+
+  // Whether the file could be opened.
+  bool IsFileOpen() const { return file_ != nullptr; }
+
+  int64_t size() const override { return file_size_; }
+  int64_t Read(int64_t offset, size_t length, const char** data) override;
+  int64_t modification_time() const override { return modification_time_; }
+
+ private:
+  FILE* file_;
+  int64_t file_size_;
+  int64_t modification_time_;
+  std::string chunk_;
+};
+
+// Uploads data pulled from a producer function.  Only the data from the offset
+// of the last read on is kept, so the upload can not go back any further: the
+// server has committed what comes before.
+class StreamUploadSource : public UploadSource {
+ public:
+  StreamUploadSource(StreamProducer producer, void* user_data)
+      : producer_(producer),
+        user_data_(user_data),
+        buffer_offset_(0),
+        size_(-1),
+        failed_(false) {}
+
+  int64_t size() const override { return size_; }
+  int64_t Read(int64_t offset, size_t length, const char** data) override;
+
+ private:
+  StreamProducer producer_;
+  void* user_data_;
+  // Data read from the producer, from buffer_offset_ on.
+  std::string buffer_;
+  int64_t buffer_offset_;
+  // -1 until the producer reports the end of the data.
+  int64_t size_;
+  bool failed_;
+};
+
+// Uploads an object with the resumable upload protocol: a first request starts
+// an upload session, and the data is then sent in chunks, each of which the
+// server commits before the next one is sent.  A chunk that fails is not lost
+// work for the ones before it: the session is queried for the amount of data
+// the server committed and the upload carries on from there.
+//
+// Chunks are sized from the throughput measured on the previous ones, so that
+// each takes about the same time whatever the link.  When the size of the data
+// is not known in advance, the chunk which reaches its end finalizes the
+// upload.
+//
+// When given a session file, the session is saved in it once started and
+// removed when the upload completes or fails for good.  If the upload is
+// interrupted, or the process exits, the next upload of the same data to the
+// same object picks up the session from the file and resumes it.
+//
+// The CRC32C of the data is computed as the chunks are read, and the upload
+// fails if it does not match the one of the object the server created.
+//
+// The requests are sent one after the other from a thread owned by this
+// object.  The future is completed, and the notifier notified, from that
+// thread or from the transport's.
+class ResumableUpload : public ChunkedTransfer {
+ public:
+  // Takes ownership of source.  The reference is copied.  metadata_json is
+  // the metadata of the object, sent when the session is started, and
+  // content_type the type of the data.  future_api must be allocated using
+  // FutureManager to ensure it remains valid while the handle isn't complete.
+  ResumableUpload(const StorageReferenceInternal& reference,
+                  UploadSource* source, const std::string& session_file,
+                  const std::string& metadata_json,
+                  const std::string& content_type,
+                  SafeFutureHandle<Metadata> handle,
+                  ReferenceCountedFutureImpl* future_api);
+  // Cancels the upload if it is still in progress and waits for it to stop.
+  ~ResumableUpload() override;
+
+  void Start() override;
+
+  // Pauses the upload.  The chunk in flight, if any, is paused as well.
+  bool Pause() override;
+  bool Resume() override;
+  bool Cancel() override;
+  bool is_paused() const override;
+  // Returns the number of bytes committed by the server, plus those of the
+  // chunk in flight read by the transport.
+  int64_t bytes_transferred() const override;
+  int64_t total_byte_count() const override { return source_->size(); }
+
+ private:
+  friend class ChunkRequest;
+
+  // Outcome of one request of the upload.
+  enum StepResult {
+    // The request succeeded, carry on with the next one.
+    kStepContinue,
+    // The object has been created.
+    kStepFinal,
+    // The request failed but may succeed if tried again.
+    kStepRetry,
+    // The session is gone, a new one has to be started.
+    kStepRestart,
+    // The upload failed.
+    kStepFailed,
+    // The upload was canceled.
+    kStepCanceled,
+  };
+
+  // Thread routine of the upload thread.
+  static void UploadRoutine(void* data);
+
+  // Upload the data and return the error code of the upload.  On success
+  // result_ is set to the JSON metadata of the object, otherwise
+  // error_message_ describes the error.
+  Error Upload();
+
+  // Complete the future and notify the update callback.
+  void Complete(Error error);
+
+  // Start a new session.
+  StepResult StartSession();
+  // Ask the server how much data it committed.
+  StepResult QuerySession();
+  // Send the next chunk of data.
+  StepResult SendChunk();
+  // Fetch the metadata of the object, for a session which the server reports
+  // as complete.
+  StepResult FetchMetadata();
+
+  // Perform the request and wait for its response, which is then available in
+  // response_.  Takes ownership of the request.  Returns false if the upload
+  // was canceled.
+  bool Send(rest::Request* request);
+
+  // Determine what to do after a request which did not succeed, and set
+  // error_ and error_message_ accordingly.  session_request is whether the
+  // request was sent to the upload session.
+  StepResult HandleFailure(bool session_request);
+
+  // Size the next chunk from the time it took to send the last one.
+  void AdaptChunkSize(int64_t length, uint64_t elapsed_milliseconds);
+  // Clamp the chunk size to the allowed range and granularity.
+  int64_t RoundChunkSize(int64_t size) const;
+
+  // Wait until the upload is not paused.  Returns false if it was canceled.
+  bool WaitWhilePaused();
+  // Wait for the given time, or less if the upload is canceled.  Returns false
+  // if it was canceled.
+  bool WaitForRetry(int64_t milliseconds);
+
+  // Load the session from the session file.  Returns false if there is none
+  // for this upload.
+  bool LoadSession();
+  void SaveSession();
+  void RemoveSession();
+
+  // Called by ChunkRequest as the transport reads the chunk.
+  void AddChunkProgress(size_t length);
+
+  // Extend the checksum with the data read at offset, past what it covers.
+  void UpdateChecksum(int64_t offset, const char* data, int64_t length);
+  // Extend the checksum up to offset with data read from the source, for an
+  // upload which resumed past what it covers.  Must be called before reading
+  // a chunk, as it invalidates the data read.
+  void CatchUpChecksum(int64_t offset);
+  // Returns false if the object the server created does not match the data.
+  bool MatchesUpload(const MetadataInternal& metadata) const;
+
+  UniquePtr<StorageReferenceInternal> reference_;
+  UniquePtr<UploadSource> source_;
+  std::string session_file_;
+  std::string metadata_json_;
+  std::string content_type_;
+  SafeFutureHandle<Metadata> handle_;
+  ReferenceCountedFutureImpl* future_api_;
+
+  // Session state.  Only accessed in the upload thread.
+  std::string upload_url_;
+  // Whether the session was loaded from the session file and has not been
+  // used yet.
+  bool resumed_session_;
+  int64_t chunk_granularity_;
+  int64_t chunk_size_;
+  // CRC32C of the data from its start up to hashed_bytes_, which is only
+  // checked if verify_ is still set when the upload is complete.
+  uint32_t crc32c_;
+  int64_t hashed_bytes_;
+  bool verify_;
+  // Outcome of the upload.
+  std::string result_;
+  Error error_;
+  std::string error_message_;
+
+  // Guards the state shared with the controlling threads below.
+  mutable Mutex mutex_;
+  // Bytes committed by the server.
+  int64_t committed_;
+  // Bytes of the chunk in flight read by the transport so far.
+  int64_t chunk_bytes_sent_;
+  // Whether a chunk is in flight.
+  bool sending_chunk_;
+  bool paused_;
+  bool canceled_;
+  bool complete_;
+  // Controller of the request in flight, if any.
+  std::unique_ptr<rest::Controller> rest_controller_;
+
+  // Request in flight, or the last one sent.
+  UniquePtr<rest::Request> request_;
+  UniquePtr<TransferResponse> response_;
+  rest::TransportCurl transport_;
+  // Posted when a response is complete.
+  Semaphore response_done_;
+  // Posted to wake up the upload thread when it is paused or waiting to retry.
+  Semaphore wake_;
+
+  UniquePtr<Thread> thread_;
+};
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace firebase
+
+#endif  // FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_RESUMABLE_UPLOAD_H_
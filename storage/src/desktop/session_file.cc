@@ -0,0 +1,126 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "storage/src/desktop/session_file.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <unistd.h>
+#endif  // defined(_WIN32)
+
+#include <cstdint>
+#include <cstdio>
+
+#include "app/src/log.h"
+
+namespace firebase {
+namespace storage {
+namespace internal {
+
+// Directory of the sessions, in the user's cache directory.
+static const char kSessionDirectoryName[] = "firebase_storage_sessions";
+
+#if defined(_WIN32)
+
+static std::string UserCacheDirectory() {
+  const char* local_app_data = getenv("LOCALAPPDATA");
+  return local_app_data ? local_app_data : "";
+}
+
+static bool MakePrivateDirectory(const std::string& directory) {
+  // Directories in the local application data inherit its access rights,
+  // which are the user's only.
+  return _mkdir(directory.c_str()) == 0 || errno == EEXIST;
+}
+
+static std::string AbsolutePath(const std::string& path) {
+  char absolute_path[_MAX_PATH];
+  return _fullpath(absolute_path, path.c_str(), sizeof(absolute_path))
+             ? absolute_path
+             : path;
+}
+
+#else
+
+static std::string UserCacheDirectory() {
+#if !defined(__APPLE__)
+  const char* xdg_cache_home = getenv("XDG_CACHE_HOME");
+  if (xdg_cache_home && xdg_cache_home[0] == '/') return xdg_cache_home;
+#endif  // !defined(__APPLE__)
+  const char* home = getenv("HOME");
+  if (!home || home[0] != '/') return "";
+#if defined(__APPLE__)
+  return std::string(home) + "/Library/Caches";
+#else
+  std::string cache_directory = std::string(home) + "/.cache";
+  // Unlike the home directory, the cache directory may not exist yet.
+  if (mkdir(cache_directory.c_str(), 0700) != 0 && errno != EEXIST) return "";
+  return cache_directory;
+#endif  // defined(__APPLE__)
+}
+
+static bool MakePrivateDirectory(const std::string& directory) {
+  if (mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) return false;
+  // The directory may have been there already, only use it if it is the
+  // user's own and nobody else can get in.
+  struct stat directory_stat;
+  return lstat(directory.c_str(), &directory_stat) == 0 &&
+         S_ISDIR(directory_stat.st_mode) &&
+         directory_stat.st_uid == getuid() &&
+         (directory_stat.st_mode & 077) == 0;
+}
+
+static std::string AbsolutePath(const std::string& path) {
+  if (path.empty() || path[0] == '/') return path;
+  char working_directory[4096];
+  if (!getcwd(working_directory, sizeof(working_directory))) return path;
+  return std::string(working_directory) + "/" + path;
+}
+
+#endif  // defined(_WIN32)
+
+// 64-bit FNV-1a, which unlike std::hash is the same in every build, so that
+// a session is found again by the next version of the application.
+static uint64_t HashPath(const std::string& path) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (unsigned char c : path) {
+    hash = (hash ^ c) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+std::string SessionFilePath(const std::string& path, const char* extension) {
+  std::string cache_directory = UserCacheDirectory();
+  if (cache_directory.empty()) return std::string();
+  std::string directory = cache_directory + "/" + kSessionDirectoryName;
+  if (!MakePrivateDirectory(directory)) {
+    LogDebug("Could not use %s for transfer sessions, transfers will not be "
+             "resumable after a restart.",
+             directory.c_str());
+    return std::string();
+  }
+  char name[17];
+  snprintf(name, sizeof(name), "%016llx",
+           static_cast<unsigned long long>(  // NOLINT
+               HashPath(AbsolutePath(path))));
+  return directory + "/" + name + extension;
+}
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace firebase
@@ -0,0 +1,38 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_SESSION_FILE_H_
+#define FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_SESSION_FILE_H_
+
+#include <string>
+
+namespace firebase {
+namespace storage {
+namespace internal {
+
+// Returns the name of the file which keeps the session of a transfer to or
+// from the local file `path`.
+//
+// Sessions hold URLs which grant access to the object, so they are kept in a
+// directory of the user's cache which only the user can access, named after a
+// hash of the absolute path with `extension` appended.  Returns an empty
+// string if that directory cannot be used, in which case the session is not
+// saved.
+std::string SessionFilePath(const std::string& path, const char* extension);
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace firebase
+
+#endif  // FIREBASE_STORAGE_CLIENT_CPP_SRC_DESKTOP_SESSION_FILE_H_
@@ -23,6 +23,7 @@
 #include "app/src/app_common.h"
 #include "app/src/function_registry.h"
 #include "app/src/include/firebase/app.h"
+#include "storage/src/desktop/batch_operation.h"
 #include "storage/src/desktop/rest_operation.h"
 #include "storage/src/desktop/storage_reference_desktop.h"
 
@@ -39,11 +40,14 @@ StorageInternal::StorageInternal(App* app, const char* url) {
     if (bucket) url_ = std::string(kGsScheme) + bucket;
   }
   root_ = StoragePath(url_);
+  future_manager_.AllocFutureApi(this, kStorageFnCount);
 
   // LINT.IfChange
   max_download_retry_time_ = 600.0;
   max_operation_retry_time_ = 120.0;
   max_upload_retry_time_ = 600.0;
+  max_download_connections_ = 1;
+  progress_interval_ = 0.1;
   // LINT.ThenChange(//depot_android_gmscore_dev/\
   //            client/firebase-storage-api/src/com/google/firebase/\
   //            storage/FirebaseStorage.java,
@@ -66,6 +70,7 @@ StorageInternal::StorageInternal(App* app, const char* url) {
 
 StorageInternal::~StorageInternal() {
   cleanup().CleanupAll();
+  future_manager_.ReleaseFutureApi(this);
   firebase::rest::CleanupTransportCurl();
   firebase::rest::util::Terminate();
   // Stop the token auto-update thread in Auth.
@@ -102,6 +107,39 @@ std::string StorageInternal::GetAuthToken() {
   return result;
 }
 
+void StorageInternal::set_download_cache(const char* directory,
+                                         int64_t max_size_bytes) {
+  SharedPtr<DownloadCache> cache;
+  if (directory && *directory) {
+    cache = MakeShared<DownloadCache>(directory, max_size_bytes);
+  }
+  MutexLock lock(download_cache_mutex_);
+  download_cache_ = cache;
+}
+
+SharedPtr<DownloadCache> StorageInternal::download_cache() {
+  MutexLock lock(download_cache_mutex_);
+  return download_cache_;
+}
+
+DownloadCacheStats StorageInternal::download_cache_stats() {
+  SharedPtr<DownloadCache> cache = download_cache();
+  return cache ? cache->stats() : DownloadCacheStats();
+}
+
+void StorageInternal::RunBatch(
+    BatchOperationType type,
+    const std::vector<StorageReferenceInternal*>& references,
+    SafeFutureHandle<std::vector<BatchResult>> handle) {
+  // The operation is registered under the root of the bucket, as it is not
+  // tied to any one object.
+  StorageReferenceInternal root(url_, this);
+  RestOperation::StartTransfer(
+      this, root.AsStorageReference(),
+      new BatchOperation(type, references, handle, future()), nullptr,
+      nullptr);
+}
+
 // Add an operation to the list of outstanding operations.
 void StorageInternal::AddOperation(RestOperation* operation) {
   MutexLock lock(operations_mutex_);
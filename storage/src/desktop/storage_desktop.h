@@ -18,8 +18,12 @@
 #include <string>
 #include <vector>
 
+#include "app/memory/shared_ptr.h"
 #include "app/src/future_manager.h"
 #include "app/src/mutex.h"
+#include "app/src/reference_counted_future_impl.h"
+#include "storage/src/common/batch_internal.h"
+#include "storage/src/desktop/download_cache.h"
 #include "storage/src/desktop/storage_path.h"
 #include "storage/src/desktop/storage_reference_desktop.h"
 #include "storage/src/include/firebase/storage/common.h"
@@ -79,6 +83,41 @@ class StorageInternal {
     max_operation_retry_time_ = max_operation_retry_time;
   }
 
+  // Returns the maximum number of connections used to download an object.
+  int max_download_connections() { return max_download_connections_; }
+
+  // Sets the maximum number of connections used to download an object.
+  void set_max_download_connections(int max_download_connections) {
+    max_download_connections_ =
+        max_download_connections > 0 ? max_download_connections : 1;
+  }
+
+  // Returns the minimum time (in seconds) between two progress notifications
+  // of an operation.
+  double progress_interval() { return progress_interval_; }
+
+  // Sets the minimum time (in seconds) between two progress notifications of
+  // an operation.
+  void set_progress_interval(double progress_interval) {
+    progress_interval_ = progress_interval > 0 ? progress_interval : 0;
+  }
+
+  // Keep downloaded objects in a cache in the given directory, or stop
+  // caching them if it is empty.
+  void set_download_cache(const char* directory, int64_t max_size_bytes);
+
+  // Returns the download cache, which is empty if objects are not cached.
+  SharedPtr<DownloadCache> download_cache();
+
+  // Returns the statistics of the download cache.
+  DownloadCacheStats download_cache_stats();
+
+  // Delete or fetch the metadata of the given objects, completing the handle
+  // with the result of each of them.
+  void RunBatch(BatchOperationType type,
+                const std::vector<StorageReferenceInternal*>& references,
+                SafeFutureHandle<std::vector<BatchResult>> handle);
+
   // Whether this object was successfully initialized by the constructor.
   bool initialized() const { return app_ != nullptr; }
 
@@ -87,6 +126,11 @@ class StorageInternal {
   FutureManager& future_manager() { return future_manager_; }
   CleanupNotifier& cleanup() { return cleanup_; }
 
+  // Returns the future API of the batch operations.
+  ReferenceCountedFutureImpl* future() {
+    return future_manager_.GetFutureApi(this);
+  }
+
   // Fetches the auth token (if available) from app via the function callback
   // registry.  If not available, it returns an empty string.
   std::string GetAuthToken();
@@ -113,10 +157,16 @@ class StorageInternal {
   double max_download_retry_time_;
   double max_operation_retry_time_;
   double max_upload_retry_time_;
+  int max_download_connections_;
+  double progress_interval_;
   StoragePath root_;
 
   CleanupNotifier cleanup_;
   std::string user_agent_;
+  Mutex download_cache_mutex_;
+  // Downloads in progress hold a reference, so that the cache can be replaced
+  // while they run.
+  SharedPtr<DownloadCache> download_cache_;
   Mutex operations_mutex_;
   std::vector<RestOperation*> operations_;
 };
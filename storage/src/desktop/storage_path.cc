@@ -113,6 +113,19 @@ std::string StoragePath::AsHttpMetadataUrl() const {
   return result;
 }
 
+std::string StoragePath::AsHttpUploadUrl() const {
+  // The object is named in the query rather than in the path.
+  static const char* kUploadBucketEnd = "/o?name=";
+  // Construct the URL.  Final format is:
+  // https://[projectname].googleapis.com/v0/b/[bucket]/o?name=[path]
+  std::string result = kHttpsScheme;
+  result += kBucketStartString;
+  result += bucket_;
+  result += kUploadBucketEnd;
+  result += rest::util::EncodeUrl(path_.str());
+  return result;
+}
+
 }  // namespace internal
 }  // namespace storage
 }  // namespace firebase
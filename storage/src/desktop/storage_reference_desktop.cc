@@ -24,11 +24,17 @@
 #include "app/rest/transport_curl.h"
 #include "app/rest/util.h"
 #include "app/src/app_common.h"
+#include "app/src/assert.h"
 #include "app/src/include/firebase/app.h"
 #include "app/src/thread.h"
 #include "storage/src/common/common_internal.h"
 #include "storage/src/desktop/controller_desktop.h"
+#include "storage/src/desktop/crc32c.h"
 #include "storage/src/desktop/metadata_desktop.h"
+#include "storage/src/desktop/parallel_download.h"
+#include "storage/src/desktop/resumable_upload.h"
+#include "storage/src/desktop/rest_operation.h"
+#include "storage/src/desktop/session_file.h"
 #include "storage/src/desktop/storage_desktop.h"
 #include "storage/src/include/firebase/storage.h"
 #include "storage/src/include/firebase/storage/common.h"
@@ -46,6 +52,8 @@ enum StorageReferenceFn {
   kStorageReferenceFnUpdateMetadata,
   kStorageReferenceFnPutBytes,
   kStorageReferenceFnPutFile,
+  kStorageReferenceFnPutStream,
+  kStorageReferenceFnGetStream,
   kStorageReferenceFnCount,
 };
 
@@ -121,6 +129,14 @@ void StorageReferenceInternal::RestCall(rest::Request* request,
 const char kFileProtocol[] = "file://";
 const int kFileProtocolLength = 7;
 
+// Extension of the files which hold the session of a file upload, see
+// SessionFilePath().
+const char kUploadSessionExtension[] = ".fbupload";
+
+// Extension of the files which record how much of an object a file being
+// downloaded holds, see SessionFilePath().
+const char kDownloadSessionExtension[] = ".fbdownload";
+
 // Remove the "file://" header from any file paths we are given.  (Desktop
 // targets don't need them when opening files through stdio.)
 std::string StripProtocol(std::string s) {
@@ -130,84 +146,13 @@ std::string StripProtocol(std::string s) {
   return s;
 }
 
-// Data structure used by SetupMetadataChain.  (See below.)  Basically all the
-// data that needs to be preserved throughout the chain of OnCompletion calls.
-// Is deleted by the final call.
-struct MetadataChainData {
-  MetadataChainData(SafeFutureHandle<Metadata> handle_,
-                    const Metadata* metadata_,
-                    const StorageReference& storage_ref_,
-                    ReferenceCountedFutureImpl* original_future_)
-      : handle(handle_),
-        storage_ref(storage_ref_),
-        original_future(original_future_) {
-    if (metadata_) metadata = *metadata_;
-    MetadataSetDefaults(&metadata);
-  }
-  // Reference to the future that is performing an operation before updating
-  // metadata on the storage object.  We hold a reference to the future here
-  // to stop the future API from being cleaned up by the future manager.
-  Future<Metadata> inner_future;
-  SafeFutureHandle<Metadata> handle;
-  Metadata metadata;
-  // A temporary, internal copy of the storage ref that started the chain.
-  // Used to hide internal futures from the user.
-  StorageReference storage_ref;
-  // The future implementation of the original caller.  Needed to complete
-  // the future returned to the user.
-  ReferenceCountedFutureImpl* original_future;
-};
-
-// Convenience function for handling operations that need to update a file
-// on storage, and then update the metadata as well, as part of the same
-// operation.  Both PutFile and PutBytes have a version that needs this.
-// Basically just chains futures together via OnCompletion callbacks, but
-// has a few tricky bits, where it uses a copy of the original reference
-// to hide the internal futures from the user, so the user can just deal with
-// one external future.  (Which is completed by the OnCompletion chain when
-// all of the operations have concluded.)
-void StorageReferenceInternal::SetupMetadataChain(
-    Future<Metadata> starting_future, MetadataChainData* data) {
-  data->inner_future = starting_future;
-  starting_future.OnCompletion(
-      [](const Future<Metadata>& result, void* data) {
-        MetadataChainData* on_completion_data =
-            static_cast<MetadataChainData*>(data);
-
-        if (result.error() != 0 ||
-            !on_completion_data->storage_ref.is_valid()) {
-          // The putfile failed.  Return with the error.
-          on_completion_data->original_future->Complete(
-              on_completion_data->handle, result.error(),
-              result.error_message());
-          delete on_completion_data;
-        } else {
-          // The putfile succeeded.  Now try setting the metadata of the object
-          // we just created.
-          Future<Metadata> metadata_future =
-              on_completion_data->storage_ref.internal_->UpdateMetadata(
-                  &on_completion_data->metadata);
-
-          metadata_future.OnCompletion(
-              [](const Future<Metadata>& result, void* data) {
-                auto on_completion_data = static_cast<MetadataChainData*>(data);
-                if (result.error() != 0) {
-                  // Setting metadata failed.  Return the error.
-                  on_completion_data->original_future->Complete(
-                      on_completion_data->handle, result.error(),
-                      result.error_message());
-                } else {
-                  // Metadata update succeedeed.  Return in triumph.
-                  on_completion_data->original_future->CompleteWithResult(
-                      on_completion_data->handle, kErrorNone,
-                      *(result.result()));
-                }
-                delete on_completion_data;
-              },
-              data);
-        }
-      },
-      data);
+// Copy of the metadata to upload an object with, with defaults for the fields
+// which are not set.
+static Metadata MetadataWithDefaults(const Metadata* metadata) {
+  Metadata result;
+  if (metadata) result = *metadata;
+  MetadataSetDefaults(&result);
+  return result;
 }
 
 // Deletes the object at the current path.
@@ -251,6 +196,41 @@ void StorageReferenceInternal::PrepareRequest(rest::Request* request,
                       storage_->user_agent().c_str());
 }
 
+void StorageReferenceInternal::SendMultipartUpload(
+    rest::Request* content, const Metadata& metadata,
+    const std::string& crc32c, SafeFutureHandle<Metadata> handle,
+    ReferenceCountedFutureImpl* future_api, Listener* listener,
+    Controller* controller_out) {
+  ReturnedMetadataResponse* response =
+      new ReturnedMetadataResponse(handle, future_api, AsStorageReference());
+  response->set_expected_crc32c(crc32c);
+
+  // The metadata goes in the same request as the content, so the object is
+  // created with it in a single round trip.
+  RequestMultipart* request = new RequestMultipart(
+      metadata.internal_->ExportAsJson(), metadata.content_type(), content);
+  PrepareRequest(request, storageUri_.AsHttpUploadUrl().c_str(),
+                 rest::util::kPost);
+  request->add_header("X-Goog-Upload-Protocol", "multipart");
+  request->add_header(rest::util::kContentType,
+                      request->content_type().c_str());
+  RestCall(request, request->notifier(), response, handle.get(), listener,
+           controller_out);
+}
+
+void StorageReferenceInternal::StartResumableUpload(
+    UploadSource* source, const std::string& session_file,
+    const Metadata& metadata, SafeFutureHandle<Metadata> handle,
+    ReferenceCountedFutureImpl* future_api, Listener* listener,
+    Controller* controller_out) {
+  RestOperation::StartTransfer(
+      storage_, AsStorageReference(),
+      new ResumableUpload(*this, source, session_file,
+                          metadata.internal_->ExportAsJson(),
+                          metadata.content_type(), handle, future_api),
+      listener, controller_out);
+}
+
 // Asynchronously downloads the object from this StorageReference.
 Future<size_t> StorageReferenceInternal::GetFile(const char* path,
                                                  Listener* listener,
@@ -258,13 +238,16 @@ Future<size_t> StorageReferenceInternal::GetFile(const char* path,
   auto* future_api = future();
   auto handle = future_api->SafeAlloc<size_t>(kStorageReferenceFnGetFile);
   std::string final_path = StripProtocol(path);
-  GetFileResponse* response =
-      new GetFileResponse(final_path.c_str(), handle, future_api);
-
-  storage::internal::Request* request = new storage::internal::Request();
-  PrepareRequest(request, storageUri_.AsHttpUrl().c_str(), rest::util::kGet);
-  RestCall(request, request->notifier(), response, handle.get(), listener,
-           controller_out);
+  // The file is fetched in ranges, so that an interrupted download picks up
+  // from the data already in the file rather than starting over.
+  std::string session_file =
+      SessionFilePath(final_path, kDownloadSessionExtension);
+  RestOperation::StartTransfer(
+      storage_, AsStorageReference(),
+      new ParallelDownload(*this, new FileDownloadSink(final_path.c_str()),
+                           session_file, storage_->max_download_connections(),
+                           handle, future_api),
+      listener, controller_out);
 
   return GetFileLastResult();
 }
@@ -281,6 +264,15 @@ Future<size_t> StorageReferenceInternal::GetBytes(void* buffer,
                                                   Controller* controller_out) {
   auto* future_api = future();
   auto handle = future_api->SafeAlloc<size_t>(kStorageReferenceFnGetBytes);
+  int connections = storage_->max_download_connections();
+  if (connections > 1 || storage_->download_cache()) {
+    RestOperation::StartTransfer(
+        storage_, AsStorageReference(),
+        new ParallelDownload(*this, new BufferDownloadSink(buffer, buffer_size),
+                             std::string(), connections, handle, future_api),
+        listener, controller_out);
+    return GetBytesLastResult();
+  }
 
   GetBytesResponse* response =
       new GetBytesResponse(buffer, buffer_size, handle, future_api);
@@ -299,6 +291,30 @@ Future<size_t> StorageReferenceInternal::GetBytesLastResult() {
       future()->LastResult(kStorageReferenceFnGetBytes));
 }
 
+// Asynchronously downloads the object from this StorageReference, handing its
+// data to the consumer as it comes.
+Future<size_t> StorageReferenceInternal::GetStream(StreamConsumer consumer,
+                                                   void* user_data,
+                                                   Listener* listener,
+                                                   Controller* controller_out) {
+  auto* future_api = future();
+  auto handle = future_api->SafeAlloc<size_t>(kStorageReferenceFnGetStream);
+  // The consumer takes the data in order, so there is no point in fetching
+  // several ranges at once.
+  RestOperation::StartTransfer(
+      storage_, AsStorageReference(),
+      new ParallelDownload(*this, new StreamDownloadSink(consumer, user_data),
+                           std::string(), 1, handle, future_api),
+      listener, controller_out);
+  return GetStreamLastResult();
+}
+
+// Returns the result of the most recent call to GetStream();
+Future<size_t> StorageReferenceInternal::GetStreamLastResult() {
+  return static_cast<const Future<size_t>&>(
+      future()->LastResult(kStorageReferenceFnGetStream));
+}
+
 // Asynchronously uploads data to the currently specified StorageReference,
 // without additional metadata.
 Future<Metadata> StorageReferenceInternal::PutBytes(
@@ -307,44 +323,25 @@ Future<Metadata> StorageReferenceInternal::PutBytes(
   return PutBytes(buffer, buffer_size, nullptr, listener, controller_out);
 }
 
-Future<Metadata> StorageReferenceInternal::PutBytesInternal(
-    const void* buffer, size_t buffer_size, Listener* listener,
-    Controller* controller_out) {
-  auto* future_api = future();
-  auto handle = future_api->SafeAlloc<Metadata>(kStorageReferenceFnPutBytes);
-
-  ReturnedMetadataResponse* response =
-      new ReturnedMetadataResponse(handle, future_api, AsStorageReference());
-
-  storage::internal::RequestBinary* request =
-      new storage::internal::RequestBinary(static_cast<const char*>(buffer),
-                                           buffer_size);
-  PrepareRequest(request, storageUri_.AsHttpUrl().c_str(), rest::util::kPost);
-
-  RestCall(request, request->notifier(), response, handle.get(), listener,
-           controller_out);
-  return PutBytesLastResult();
-}
-
 // Asynchronously uploads data to the currently specified StorageReference,
 // with metadata included.
 Future<Metadata> StorageReferenceInternal::PutBytes(
     const void* buffer, size_t buffer_size, const Metadata* metadata,
     Listener* listener, Controller* controller_out) {
-  // This is the handle for the actual future returned to the user.
   auto* future_api = future();
   auto handle = future_api->SafeAlloc<Metadata>(kStorageReferenceFnPutBytes);
-  MetadataChainData* data =
-      new MetadataChainData(handle, metadata, AsStorageReference(), future_api);
-  // This is the future to do the actual putfile.  Note that it is on a
-  // different storage reference than the original, so the caller of this
-  // function can't access it via PutFileLastResult.
-  Future<Metadata> putbytes_internal =
-      data->storage_ref.internal_->PutBytesInternal(buffer, buffer_size,
-                                                    listener, controller_out);
-
-  SetupMetadataChain(putbytes_internal, data);
+  Metadata upload_metadata = MetadataWithDefaults(metadata);
 
+  if (static_cast<int64_t>(buffer_size) >= kResumableUploadThreshold) {
+    StartResumableUpload(new BufferUploadSource(buffer, buffer_size),
+                         std::string(), upload_metadata, handle, future_api,
+                         listener, controller_out);
+  } else {
+    SendMultipartUpload(
+        new rest::RequestBinary(static_cast<const char*>(buffer), buffer_size),
+        upload_metadata, Crc32cToBase64(Crc32cExtend(0, buffer, buffer_size)),
+        handle, future_api, listener, controller_out);
+  }
   return PutBytesLastResult();
 }
 
@@ -355,57 +352,47 @@ Future<Metadata> StorageReferenceInternal::PutBytesLastResult() {
 
 // Asynchronously uploads data to the currently specified StorageReference,
 // without additional metadata.
-// Currently not terribly efficient about it.
-// TODO(b/69434445): Make this more efficient. b/69434445
 Future<Metadata> StorageReferenceInternal::PutFile(const char* path,
                                                    Listener* listener,
                                                    Controller* controller_out) {
   return PutFile(path, nullptr, listener, controller_out);
 }
 
-Future<Metadata> StorageReferenceInternal::PutFileInternal(
-    const char* path, Listener* listener, Controller* controller_out) {
-  auto* future_api = future();
-  auto handle = future_api->SafeAlloc<Metadata>(kStorageReferenceFnPutFile);
-
-  // Open the file, calculate the length.
-  storage::internal::RequestFile* request(
-      new storage::internal::RequestFile(StripProtocol(path).c_str(), 0));
-  if (!request->IsFileOpen()) {
-    delete request;
-    future_api->Complete(handle, kErrorUnknown, "Could not read file.");
-  } else {
-    // Everything is good.  Fire off the request.
-    ReturnedMetadataResponse* response =
-        new ReturnedMetadataResponse(handle, future_api, AsStorageReference());
-
-    PrepareRequest(request, storageUri_.AsHttpUrl().c_str(), rest::util::kPost);
-    RestCall(request, request->notifier(), response, handle.get(), listener,
-             controller_out);
-  }
-
-  return PutFileLastResult();
-}
-
 // Asynchronously uploads data to the currently specified StorageReference,
-// without additional metadata.
+// with metadata included.
 Future<Metadata> StorageReferenceInternal::PutFile(const char* path,
                                                    const Metadata* metadata,
                                                    Listener* listener,
                                                    Controller* controller_out) {
-  // This is the handle for the actual future returned to the user.
   auto* future_api = future();
   auto handle = future_api->SafeAlloc<Metadata>(kStorageReferenceFnPutFile);
-  MetadataChainData* data =
-      new MetadataChainData(handle, metadata, AsStorageReference(), future_api);
-  // This is the future to do the actual putfile.  Note that it is on a
-  // different storage reference than the original, so the caller of this
-  // function can't access it via PutFileLastResult.
-  Future<Metadata> putfile_internal =
-      data->storage_ref.internal_->PutFileInternal(path, listener,
-                                                   controller_out);
+  Metadata upload_metadata = MetadataWithDefaults(metadata);
 
-  SetupMetadataChain(putfile_internal, data);
+  std::string filename = StripProtocol(path);
+  FileUploadSource* source = new FileUploadSource(filename.c_str());
+  if (!source->IsFileOpen()) {
+    delete source;
+    future_api->Complete(handle, kErrorUnknown, "Could not read file.");
+  } else if (source->size() >= kResumableUploadThreshold) {
+    // Large files are sent in chunks, and the upload session is kept so that
+    // an interrupted upload can be resumed.
+    StartResumableUpload(source,
+                         SessionFilePath(filename, kUploadSessionExtension),
+                         upload_metadata, handle, future_api, listener,
+                         controller_out);
+  } else {
+    // Small files are read whole anyway, the checksum costs little more.
+    const char* data = nullptr;
+    int64_t size = source->Read(0, static_cast<size_t>(source->size()), &data);
+    std::string crc32c =
+        size == source->size()
+            ? Crc32cToBase64(Crc32cExtend(0, data, static_cast<size_t>(size)))
+            : std::string();
+    delete source;
+    SendMultipartUpload(new rest::RequestFile(filename.c_str(), 0),
+                        upload_metadata, crc32c, handle, future_api, listener,
+                        controller_out);
+  }
 
   return PutFileLastResult();
 }
@@ -416,6 +403,38 @@ Future<Metadata> StorageReferenceInternal::PutFileLastResult() {
       future()->LastResult(kStorageReferenceFnPutFile));
 }
 
+// Asynchronously uploads data pulled from a producer to the currently
+// specified StorageReference, without additional metadata.
+Future<Metadata> StorageReferenceInternal::PutStream(
+    StreamProducer producer, void* user_data, Listener* listener,
+    Controller* controller_out) {
+  return PutStream(producer, user_data, nullptr, listener, controller_out);
+}
+
+// Asynchronously uploads data pulled from a producer to the currently
+// specified StorageReference, with metadata included.
+Future<Metadata> StorageReferenceInternal::PutStream(
+    StreamProducer producer, void* user_data, const Metadata* metadata,
+    Listener* listener, Controller* controller_out) {
+  auto* future_api = future();
+  auto handle = future_api->SafeAlloc<Metadata>(kStorageReferenceFnPutStream);
+  Metadata upload_metadata = MetadataWithDefaults(metadata);
+
+  // The size of the data is unknown, so it is always sent in chunks.  Only the
+  // chunk in flight is held in memory.  There is no session file, as the
+  // stream could not be read again after a restart.
+  StartResumableUpload(new StreamUploadSource(producer, user_data),
+                       std::string(), upload_metadata, handle, future_api,
+                       listener, controller_out);
+  return PutStreamLastResult();
+}
+
+// Returns the result of the most recent call to PutStream();
+Future<Metadata> StorageReferenceInternal::PutStreamLastResult() {
+  return static_cast<const Future<Metadata>&>(
+      future()->LastResult(kStorageReferenceFnPutStream));
+}
+
 // Retrieves metadata associated with an object at this StorageReference.
 Future<Metadata> StorageReferenceInternal::GetMetadata() {
   auto* future_api = future();
@@ -445,7 +464,13 @@ Future<Metadata> StorageReferenceInternal::UpdateMetadata(
   auto* future_api = future();
   auto handle =
       future_api->SafeAlloc<Metadata>(kStorageReferenceFnUpdateMetadata);
+  SendUpdateMetadata(metadata, future_api, handle);
+  return UpdateMetadataLastResult();
+}
 
+void StorageReferenceInternal::SendUpdateMetadata(
+    const Metadata* metadata, ReferenceCountedFutureImpl* future_api,
+    SafeFutureHandle<Metadata> handle) {
   ReturnedMetadataResponse* response =
       new ReturnedMetadataResponse(handle, future_api, AsStorageReference());
 
@@ -458,8 +483,6 @@ Future<Metadata> StorageReferenceInternal::UpdateMetadata(
 
   RestCall(request, request->notifier(), response, handle.get(), nullptr,
            nullptr);
-
-  return UpdateMetadataLastResult();
 }
 
 // Returns the result of the most recent call to UpdateMetadata();
@@ -484,10 +507,12 @@ Future<std::string> StorageReferenceInternal::GetDownloadUrl() {
     SafeFutureHandle<std::string> handle;
   };
 
-  // Set the Metadata Callback.  The callback we return to the user is
-  // separate from the metadata one, and we just mark the returned future
-  // complete in the metadata onCompletion handler.
-  metadata_future.OnCompletion(
+  // Chain a continuation to the metadata future.  It leaves alone the
+  // completion callback of the metadata future, which the user may have set
+  // through GetMetadataLastResult(), and just marks the returned future
+  // complete.
+  future_api->Then(
+      SafeFutureHandle<Metadata>(metadata_future.GetHandle()),
       [](const Future<Metadata>& result, void* data) {
         auto on_completion_data = UniquePtr<GetUrlOnCompletionData>(
             static_cast<GetUrlOnCompletionData*>(data));
@@ -29,8 +29,9 @@ namespace storage {
 namespace internal {
 
 class BlockingResponse;
-class MetadataChainData;
 class Notifier;
+class ResumableUpload;
+class UploadSource;
 
 class StorageReferenceInternal {
  public:
@@ -81,6 +82,14 @@ class StorageReferenceInternal {
   // Returns the result of the most recent call to GetBytes();
   Future<size_t> GetBytesLastResult();
 
+  // Asynchronously downloads the object from this StorageReference, handing
+  // its data to a consumer.
+  Future<size_t> GetStream(StreamConsumer consumer, void* user_data,
+                           Listener* listener, Controller* controller_out);
+
+  // Returns the result of the most recent call to GetStream();
+  Future<size_t> GetStreamLastResult();
+
   // Asynchronously retrieves a long lived download URL with a revokable token.
   Future<std::string> GetDownloadUrl();
 
@@ -126,6 +135,20 @@ class StorageReferenceInternal {
   // Returns the result of the most recent call to Write();
   Future<Metadata> PutFileLastResult();
 
+  // Asynchronously uploads data pulled from a producer to the currently
+  // specified StorageReference, without additional metadata.
+  Future<Metadata> PutStream(StreamProducer producer, void* user_data,
+                             Listener* listener, Controller* controller_out);
+
+  // Asynchronously uploads data pulled from a producer to the currently
+  // specified StorageReference, with additional metadata.
+  Future<Metadata> PutStream(StreamProducer producer, void* user_data,
+                             const Metadata* metadata, Listener* listener,
+                             Controller* controller_out);
+
+  // Returns the result of the most recent call to PutStream();
+  Future<Metadata> PutStreamLastResult();
+
   // Pointer to the StorageInternal instance we are a part of.
   StorageInternal* storage_internal() const { return storage_; }
 
@@ -134,13 +157,21 @@ class StorageReferenceInternal {
   StorageReference AsStorageReference() const;
 
  private:
-  // Upload data without metadata.
-  Future<Metadata> PutBytesInternal(const void* buffer, size_t buffer_size,
-                                    Listener* listener,
-                                    Controller* controller_out);
-  // Upload file without metadata.
-  Future<Metadata> PutFileInternal(const char* path, Listener* listener,
-                                   Controller* controller_out);
+  // Upload the content read from the request along with its metadata in a
+  // single request.  Takes ownership of content.  crc32c is the base64
+  // CRC32C of the content, checked against the object created unless empty.
+  void SendMultipartUpload(rest::Request* content, const Metadata& metadata,
+                           const std::string& crc32c,
+                           SafeFutureHandle<Metadata> handle,
+                           ReferenceCountedFutureImpl* future_api,
+                           Listener* listener, Controller* controller_out);
+  // Upload the data from source in chunks.  Takes ownership of source.
+  void StartResumableUpload(UploadSource* source,
+                            const std::string& session_file,
+                            const Metadata& metadata,
+                            SafeFutureHandle<Metadata> handle,
+                            ReferenceCountedFutureImpl* future_api,
+                            Listener* listener, Controller* controller_out);
 
   void RestCall(rest::Request* request, internal::Notifier* request_notifier,
                 BlockingResponse* response, FutureHandle handle,
@@ -149,8 +180,11 @@ class StorageReferenceInternal {
   void PrepareRequest(rest::Request* request, const char* url,
                       const char* method);
 
-  void SetupMetadataChain(Future<Metadata> starting_future,
-                          MetadataChainData* data);
+  // Send a request to update the metadata of the object, which completes
+  // `handle` in `future_api` with the result.
+  void SendUpdateMetadata(const Metadata* metadata,
+                          ReferenceCountedFutureImpl* future_api,
+                          SafeFutureHandle<Metadata> handle);
 
   ReferenceCountedFutureImpl* future();
 
@@ -160,6 +194,10 @@ class StorageReferenceInternal {
 
   StorageInternal* storage_;
   StoragePath storageUri_;
+
+  friend class BatchOperation;
+  friend class ParallelDownload;
+  friend class ResumableUpload;
 };
 
 }  // namespace internal
@@ -16,6 +16,7 @@
 #define FIREBASE_STORAGE_CLIENT_CPP_SRC_INCLUDE_FIREBASE_STORAGE_H_
 
 #include <string>
+#include <vector>
 
 #include "firebase/app.h"
 #include "firebase/internal/common.h"
@@ -43,6 +44,21 @@ class MetadataInternal;
 
 class StorageReference;
 
+/// @brief Outcome of the operation on one object of a batch.
+///
+/// @see Storage::DeleteBatch(), Storage::GetMetadataBatch()
+struct BatchResult {
+  BatchResult() : error(kErrorNone) {}
+
+  /// Error of the operation, kErrorNone if it succeeded.
+  Error error;
+  /// Description of the error, empty if the operation succeeded.
+  std::string error_message;
+  /// Metadata of the object, for Storage::GetMetadataBatch(). Invalid if the
+  /// operation failed.
+  Metadata metadata;
+};
+
 #ifndef SWIG
 /// @brief Entry point for the Firebase C++ SDK for Cloud Storage.
 ///
@@ -135,6 +151,85 @@ class Storage {
   /// download if a failure occurs. Defaults to 120 seconds (2 minutes).
   void set_max_operation_retry_time(double max_transfer_retry_seconds);
 
+  /// @brief Returns the maximum number of connections used to download a
+  /// single object.
+  int max_download_connections();
+  /// @brief Sets the maximum number of connections used to download a single
+  /// object with GetFile() or GetBytes(). Above 1, large objects are fetched
+  /// as several byte ranges in parallel, which is faster on links with a long
+  /// round trip. Defaults to 1.
+  ///
+  /// @note Only used on desktop; the Android and iOS SDKs manage their own
+  /// connections.
+  void set_max_download_connections(int max_download_connections);
+
+  /// @brief Returns the minimum time between two progress callbacks of an
+  /// operation, in seconds.
+  double progress_interval();
+  /// @brief Sets the minimum time between two calls to Listener::OnProgress()
+  /// for an operation. Progress is measured as often as the transfer reports
+  /// it, and the throughput is sampled at each callback. The progress at the
+  /// end of an operation is always reported. 0 reports every step of the
+  /// transfer. Defaults to 0.1 seconds.
+  ///
+  /// @note Only used on desktop; the Android and iOS SDKs pace their own
+  /// progress events.
+  void set_progress_interval(double progress_interval_seconds);
+
+  /// @brief Keeps the objects downloaded with GetFile() and GetBytes() in a
+  /// cache on disk.
+  ///
+  /// A cached object is served from disk. If the object's Cache-Control
+  /// metadata allows it, this happens without contacting the server. Otherwise
+  /// the server is asked whether the object changed since it was cached, and
+  /// the object is only downloaded again if it did. The least recently used
+  /// objects are dropped once the cache exceeds its size limit. The cache
+  /// persists across runs. Disabled by default.
+  ///
+  /// @param[in] directory Directory to keep the cache in, created if it does
+  /// not exist. nullptr or an empty string disables the cache.
+  /// @param[in] max_size_bytes Maximum size of the cached objects.
+  ///
+  /// @note Only used on desktop; the Android and iOS SDKs manage their own
+  /// caching.
+  void set_download_cache(const char* directory, int64_t max_size_bytes);
+  /// @brief Returns statistics of the download cache since it was enabled.
+  DownloadCacheStats download_cache_stats();
+
+  /// @brief Deletes many objects at once.
+  ///
+  /// Deleting objects one by one with StorageReference::Delete() waits for a
+  /// round trip to the server per object. A batch keeps up to 16 deletions
+  /// in flight at once, over connections which are kept open for the whole
+  /// batch. Failed deletions are retried within max_operation_retry_time().
+  ///
+  /// @param[in] references Objects to delete.
+  ///
+  /// @returns A future which completes once every object was processed, with
+  /// one result per reference, in the same order. The error of the future is
+  /// the error of the first operation which failed, kErrorNone if they all
+  /// succeeded.
+  Future<std::vector<BatchResult>> DeleteBatch(
+      const std::vector<StorageReference>& references);
+  /// @brief Returns the result of the most recent call to DeleteBatch().
+  Future<std::vector<BatchResult>> DeleteBatchLastResult();
+
+  /// @brief Fetches the metadata of many objects at once.
+  ///
+  /// Works like DeleteBatch(), fetching the metadata of each object as
+  /// StorageReference::GetMetadata() does.
+  ///
+  /// @param[in] references Objects to fetch the metadata of.
+  ///
+  /// @returns A future which completes once every object was processed, with
+  /// one result per reference, in the same order. The error of the future is
+  /// the error of the first operation which failed, kErrorNone if they all
+  /// succeeded.
+  Future<std::vector<BatchResult>> GetMetadataBatch(
+      const std::vector<StorageReference>& references);
+  /// @brief Returns the result of the most recent call to GetMetadataBatch().
+  Future<std::vector<BatchResult>> GetMetadataBatchLastResult();
+
  private:
   /// @cond FIREBASE_APP_INTERNAL
   friend class Metadata;
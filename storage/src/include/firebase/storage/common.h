@@ -15,6 +15,8 @@
 #ifndef FIREBASE_STORAGE_CLIENT_CPP_SRC_INCLUDE_FIREBASE_STORAGE_COMMON_H_
 #define FIREBASE_STORAGE_CLIENT_CPP_SRC_INCLUDE_FIREBASE_STORAGE_COMMON_H_
 
+#include <stdint.h>
+
 namespace firebase {
 namespace storage {
 
@@ -56,6 +58,20 @@ enum Error {
 /// @returns Statically-allocated string describing the error.
 const char* GetErrorMessage(Error error);
 
+/// @brief Statistics of the download cache of a Storage instance.
+///
+/// @see Storage::set_download_cache()
+struct DownloadCacheStats {
+  DownloadCacheStats() : hits(0), misses(0), bytes_saved(0) {}
+
+  /// Number of downloads served from the cache.
+  int64_t hits;
+  /// Number of downloads which could not be served from the cache.
+  int64_t misses;
+  /// Number of bytes read from the cache instead of downloaded.
+  int64_t bytes_saved;
+};
+
 }  // namespace storage
 }  // namespace firebase
 
@@ -114,6 +114,39 @@ class Controller {
   /// the size of the transfer is unknown.
   int64_t total_byte_count() const;
 
+  /// @brief Returns the throughput of the transfer over the last progress
+  /// interval (see Storage::set_progress_interval()).
+  ///
+  /// @returns The throughput in bytes per second, 0 until it is measured.
+  ///
+  /// @note Only measured on desktop; 0 on Android and iOS.
+  double bytes_per_second() const;
+
+  /// @brief Returns the throughput of the transfer smoothed over the last few
+  /// seconds, which varies less than bytes_per_second() on a busy link.
+  ///
+  /// @returns The throughput in bytes per second, 0 until it is measured.
+  ///
+  /// @note Only measured on desktop; 0 on Android and iOS.
+  double average_bytes_per_second() const;
+
+  /// @brief Returns the estimated time until the transfer completes, from the
+  /// bytes left and the smoothed throughput.
+  ///
+  /// @returns The estimated time in seconds, or -1 if it is unknown: before
+  /// the throughput is measured, or when the size of the transfer is unknown.
+  ///
+  /// @note Only estimated on desktop; -1 on Android and iOS.
+  double estimated_seconds_remaining() const;
+
+  /// @brief Returns the number of requests of the operation which were tried
+  /// again after a failure so far.
+  ///
+  /// @returns The number of retries.
+  ///
+  /// @note Only counted on desktop; 0 on Android and iOS.
+  int retry_count() const;
+
   /// @brief Returns the StorageReference associated with this Controller.
   ///
   /// @returns The StorageReference associated with this Controller.
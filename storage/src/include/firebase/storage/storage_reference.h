@@ -15,6 +15,8 @@
 #ifndef FIREBASE_STORAGE_CLIENT_CPP_SRC_INCLUDE_FIREBASE_STORAGE_STORAGE_REFERENCE_H_
 #define FIREBASE_STORAGE_CLIENT_CPP_SRC_INCLUDE_FIREBASE_STORAGE_STORAGE_REFERENCE_H_
 
+#include <stdint.h>
+
 #include <string>
 #include <vector>
 
@@ -38,6 +40,38 @@ class StorageReferenceInternal;
 }  // namespace internal
 /// @endcond FIREBASE_APP_INTERNAL
 
+/// @brief Produces the data of an upload started with
+/// StorageReference::PutStream().
+///
+/// The function is called from a thread of the SDK, one call at a time, until
+/// it reports the end of the data.
+///
+/// @param[out] buffer Buffer to copy the next bytes of the data into.
+/// @param[in] buffer_size Size of the buffer.
+/// @param[in] user_data The user data passed to PutStream().
+///
+/// @returns The number of bytes copied into the buffer, at most buffer_size.
+/// 0 reports the end of the data, and a negative value an error, which fails
+/// the upload.
+typedef int64_t (*StreamProducer)(void* buffer, size_t buffer_size,
+                                  void* user_data);
+
+/// @brief Consumes the data of a download started with
+/// StorageReference::GetStream().
+///
+/// The function is called from a thread of the SDK, one call at a time, with
+/// the blocks of the object in order. The download holds off while the
+/// consumer falls behind, so a slow consumer does not make the data pile up in
+/// memory.
+///
+/// @param[in] data The next bytes of the object.
+/// @param[in] size Number of bytes in data.
+/// @param[in] user_data The user data passed to GetStream().
+///
+/// @returns true to go on with the download, false to stop it, which fails
+/// the download.
+typedef bool (*StreamConsumer)(const void* data, size_t size, void* user_data);
+
 #ifndef SWIG
 /// Represents a reference to a Cloud Storage object.
 /// Developers can upload and download objects, get/set object metadata, and
@@ -185,6 +219,36 @@ class StorageReference {
   /// @returns The result of the most recent call to GetBytes();
   Future<size_t> GetBytesLastResult();
 
+  /// @brief Asynchronously downloads the object from this StorageReference,
+  /// handing its data to a consumer as it arrives.
+  ///
+  /// Unlike GetBytes(), the size of the object does not need to be known and
+  /// the object is never held in memory as a whole, so large objects can be
+  /// fed to a parser or a decompressor as they download.
+  ///
+  /// @param[in] consumer Function called for each block of data. It must
+  /// remain valid for the duration of the transfer.
+  /// @param[in] user_data Passed to every call of the consumer.
+  /// @param[in] listener A listener that will respond to events on this read
+  /// operation. If not nullptr, a listener that will respond to events on this
+  /// read operation. The caller is responsible for allocating and deallocating
+  /// the listener. The same listener can be used for multiple operations.
+  /// @param[out] controller_out Controls the read operation, providing the
+  /// ability to pause, resume or cancel an ongoing read operation. If not
+  /// nullptr, this method will output a Controller here that you can use to
+  /// control the read operation.
+  ///
+  /// @returns A future that returns the number of bytes read. It completes
+  /// once the consumer was given all of them.
+  Future<size_t> GetStream(StreamConsumer consumer, void* user_data,
+                           Listener* listener = nullptr,
+                           Controller* controller_out = nullptr);
+
+  /// @brief Returns the result of the most recent call to GetStream();
+  ///
+  /// @returns The result of the most recent call to GetStream();
+  Future<size_t> GetStreamLastResult();
+
   /// @brief Asynchronously retrieves a long lived download URL with a revokable
   /// token.
   ///
@@ -329,6 +393,63 @@ class StorageReference {
   /// @returns The result of the most recent call to PutFile();
   Future<Metadata> PutFileLastResult();
 
+  /// @brief Asynchronously uploads data pulled from a producer function to the
+  /// currently specified StorageReference, without additional metadata.
+  ///
+  /// The data is requested from the producer as the upload goes, so data
+  /// generated on the fly does not have to be held in memory or written to a
+  /// file first. The size of the data does not need to be known in advance.
+  ///
+  /// @note On iOS the data is gathered in memory before it is sent, as the
+  /// native SDK only uploads from memory or from a file.
+  ///
+  /// @param[in] producer Function called for each block of data. It must
+  /// remain valid for the duration of the transfer.
+  /// @param[in] user_data Passed to every call of the producer.
+  /// @param[in] listener A listener that will respond to events on this read
+  /// operation. If not nullptr, a listener that will respond to events on this
+  /// write operation. The caller is responsible for allocating and deallocating
+  /// the listener. The same listener can be used for multiple operations.
+  /// @param[out] controller_out Controls the write operation, providing the
+  /// ability to pause, resume or cancel an ongoing write operation. If not
+  /// nullptr, this method will output a Controller here that you can use to
+  /// control the write operation.
+  ///
+  /// @returns A future that returns the Metadata.
+  Future<Metadata> PutStream(StreamProducer producer, void* user_data,
+                             Listener* listener = nullptr,
+                             Controller* controller_out = nullptr);
+
+  /// @brief Asynchronously uploads data pulled from a producer function to the
+  /// currently specified StorageReference, with additional metadata.
+  ///
+  /// @param[in] producer Function called for each block of data. It must
+  /// remain valid for the duration of the transfer.
+  /// @param[in] user_data Passed to every call of the producer.
+  /// @param[in] metadata Metadata containing additional information (MIME type,
+  /// etc.) about the object being uploaded.
+  /// @param[in] listener A listener that will respond to events on this read
+  /// operation. If not nullptr, a listener that will respond to events on this
+  /// write operation. The caller is responsible for allocating and deallocating
+  /// the listener. The same listener can be used for multiple operations.
+  /// @param[out] controller_out Controls the write operation, providing the
+  /// ability to pause, resume or cancel an ongoing write operation. If not
+  /// nullptr, this method will output a Controller here that you can use to
+  /// control the write operation.
+  ///
+  /// @returns A future that returns the Metadata.
+  ///
+  /// @see PutStream(StreamProducer, void*, Listener*, Controller*)
+  Future<Metadata> PutStream(StreamProducer producer, void* user_data,
+                             const Metadata& metadata,
+                             Listener* listener = nullptr,
+                             Controller* controller_out = nullptr);
+
+  /// @brief Returns the result of the most recent call to PutStream();
+  ///
+  /// @returns The result of the most recent call to PutStream();
+  Future<Metadata> PutStreamLastResult();
+
   /// @brief Returns true if this StorageReference is valid, false if it is not
   /// valid. An invalid StorageReference indicates that the reference is
   /// uninitialized (created with the default constructor) or that there was an
@@ -58,6 +58,13 @@ class ControllerInternal {
   // Returns the total bytes to be transferred.
   int64_t total_byte_count() const;
 
+  // Throughput and retries are only measured on desktop, the native SDK does
+  // not report them.
+  double bytes_per_second() const { return 0; }
+  double average_bytes_per_second() const { return 0; }
+  double estimated_seconds_remaining() const { return -1; }
+  int retry_count() const { return 0; }
+
   // Returns the StorageReference associated with this Controller.
   StorageReferenceInternal *_Nullable GetReference() const;
 
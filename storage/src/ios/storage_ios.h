@@ -17,6 +17,7 @@
 
 #include <map>
 #include <set>
+#include <vector>
 
 #include <dispatch/dispatch.h>
 
@@ -25,7 +26,10 @@
 #include "app/src/future_manager.h"
 #include "app/src/include/firebase/app.h"
 #include "app/src/mutex.h"
+#include "app/src/reference_counted_future_impl.h"
 #include "app/src/util_ios.h"
+#include "storage/src/common/batch_internal.h"
+#include "storage/src/include/firebase/storage/common.h"
 #include "storage/src/include/firebase/storage/storage_reference.h"
 
 #ifdef __OBJC__
@@ -113,8 +117,42 @@ class StorageInternal {
   // if a failure occurs.
   void set_max_operation_retry_time(double max_transfer_retry_seconds);
 
+  // The number of download connections is only used on desktop, the native
+  // SDK manages its own.
+  int max_download_connections() const { return max_download_connections_; }
+  void set_max_download_connections(int max_download_connections) {
+    max_download_connections_ = max_download_connections;
+  }
+
+  // The progress interval is only used on desktop, the native SDK paces its
+  // own progress events.
+  double progress_interval() const { return progress_interval_; }
+  void set_progress_interval(double progress_interval) {
+    progress_interval_ = progress_interval;
+  }
+
+  // The download cache is only used on desktop, the native SDK caches on its
+  // own.
+  void set_download_cache(const char* directory, int64_t max_size_bytes) {}
+  DownloadCacheStats download_cache_stats() const {
+    return DownloadCacheStats();
+  }
+
   FutureManager& future_manager() { return future_manager_; }
 
+  // Returns the future API of the batch operations.
+  ReferenceCountedFutureImpl* future() {
+    return future_manager_.GetFutureApi(this);
+  }
+
+  // Delete or fetch the metadata of the given objects through the native
+  // SDK, which pools connections on its own.
+  void RunBatch(BatchOperationType type,
+                const std::vector<StorageReferenceInternal*>& references,
+                SafeFutureHandle<std::vector<BatchResult>> handle) {
+    ReferenceBatch::Start(type, references, handle, future());
+  }
+
   // Whether this object was successfully initialized by the constructor.
   bool initialized() const;
 
@@ -148,6 +186,9 @@ class StorageInternal {
 
   std::string url_;
 
+  int max_download_connections_ = 1;
+  double progress_interval_ = 0.1;
+
   CleanupNotifier cleanup_;
 };
 
@@ -61,6 +61,7 @@ StorageInternal::StorageInternal(App* app, const char* url)
       impl_(new FIRStoragePointer(nil)),
       session_fetcher_service_(new FIRCPPGTMSessionFetcherServicePointer(nil)) {
   url_ = url ? url : "";
+  future_manager_.AllocFutureApi(this, kStorageFnCount);
   FIRApp* fir_app = static_cast<FIRAppPointer*>(app->data_)->ptr;
   if (url_.empty()) {
     impl_.reset(new FIRStoragePointer([FIRStorage storageForApp:fir_app]));
@@ -83,6 +84,7 @@ StorageInternal::StorageInternal(App* app, const char* url)
 }
 
 StorageInternal::~StorageInternal() {
+  future_manager_.ReleaseFutureApi(this);
   // Destructor is necessary for ARC garbage collection.
 }
 
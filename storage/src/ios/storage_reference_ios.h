@@ -101,6 +101,16 @@ class StorageReferenceInternal {
   // Returns the result of the most recent call to GetBytes();
   Future<size_t> GetBytesLastResult();
 
+  // Asynchronously downloads the object from this StorageReferenceInternal,
+  // handing its data to a consumer.
+  Future<size_t> GetStream(StreamConsumer _Nonnull consumer,
+                           void* _Nullable user_data,
+                           Listener* _Nullable listener,
+                           Controller* _Nullable controller_out);
+
+  // Returns the result of the most recent call to GetStream();
+  Future<size_t> GetStreamLastResult();
+
   // Asynchronously retrieves a long lived download URL with a revokable token.
   Future<std::string> GetDownloadUrl();
 
@@ -159,6 +169,24 @@ class StorageReferenceInternal {
   // Returns the result of the most recent call to PutFile();
   Future<Metadata> PutFileLastResult();
 
+  // Asynchronously uploads data pulled from a producer to the currently
+  // specified StorageReferenceInternal, without additional metadata.
+  Future<Metadata> PutStream(StreamProducer _Nonnull producer,
+                             void* _Nullable user_data,
+                             Listener* _Nullable listener,
+                             Controller* _Nullable controller_out);
+
+  // Asynchronously uploads data pulled from a producer to the currently
+  // specified StorageReferenceInternal, with additional metadata.
+  Future<Metadata> PutStream(StreamProducer _Nonnull producer,
+                             void* _Nullable user_data,
+                             const Metadata* _Nullable metadata,
+                             Listener* _Nullable listener,
+                             Controller* _Nullable controller_out);
+
+  // Returns the result of the most recent call to PutStream();
+  Future<Metadata> PutStreamLastResult();
+
   // StorageInternal instance we are associated with.
   StorageInternal* _Nullable storage_internal() const { return storage_; }
 
@@ -168,11 +196,14 @@ class StorageReferenceInternal {
       FIRStorageObservableTask<FIRStorageTaskManagement>* _Nonnull task,
       Listener* _Nullable listener, StorageInternal* _Nullable storage);
 
-  // Create a download task that will stream data into the specified buffer.
+  // Create a download task that will stream data into the specified buffer, or
+  // to the consumer if there is one, in which case the completion is not given
+  // the data.
   FIRStorageDownloadTask* _Nonnull CreateStreamingDownloadTask(
       FIRStorageReference* _Nonnull impl, StorageInternal* _Nonnull storage,
-      FIRStorageVoidDataError _Nonnull completion, void* _Nonnull buffer,
-      size_t buffer_size);
+      FIRStorageVoidDataError _Nonnull completion, void* _Nullable buffer,
+      size_t buffer_size, StreamConsumer _Nullable consumer,
+      void* _Nullable user_data);
 
   FIRStorageReference* _Nullable impl() const { return impl_->ptr; }
 #endif  // __OBJC__
@@ -85,6 +85,8 @@ enum StorageReferenceFn {
   kStorageReferenceFnUpdateMetadata,
   kStorageReferenceFnPutBytes,
   kStorageReferenceFnPutFile,
+  kStorageReferenceFnPutStream,
+  kStorageReferenceFnGetStream,
   kStorageReferenceFnCount,
 };
 
@@ -209,7 +211,7 @@ Future<size_t> StorageReferenceInternal::GetFileLastResult() {
 
 FIRStorageDownloadTask* StorageReferenceInternal::CreateStreamingDownloadTask(
     FIRStorageReference* impl, StorageInternal* storage, FIRStorageVoidDataError completion,
-    void* buffer, size_t buffer_size) {
+    void* buffer, size_t buffer_size, StreamConsumer consumer, void* user_data) {
   FIRCPPGTMSessionFetcherService* session_fetcher_service = storage->session_fetcher_service();
   FIRCPPStorageDownloadTask* task =
       [[FIRCPPStorageDownloadTask alloc] initWithReference:impl
@@ -225,9 +227,11 @@ FIRStorageDownloadTask* StorageReferenceInternal::CreateStreamingDownloadTask(
   [task observeStatus:FIRStorageTaskStatusSuccess
               handler:^(FIRStorageTaskSnapshot* _Nonnull snapshot) {
                 dispatch_async(callbackQueue, ^{
-                  completion([NSData dataWithBytesNoCopy:buffer
-                                                  length:task.bufferDownloadOffset
-                                            freeWhenDone:NO],
+                  // A stream has no buffer, the consumer already has the data.
+                  completion(consumer ? nil
+                                      : [NSData dataWithBytesNoCopy:buffer
+                                                             length:task.bufferDownloadOffset
+                                                       freeWhenDone:NO],
                              nil);
                 });
               }];
@@ -241,14 +245,25 @@ FIRStorageDownloadTask* StorageReferenceInternal::CreateStreamingDownloadTask(
   GTMSessionFetcherAccumulateDataBlock accumulate_data_block = ^(
       NSData* GTM_NULLABLE_TYPE received_buffer) {
     if (received_buffer) {
-      if (task.bufferDownloadOffset == task.bufferSize) {
+      if (!consumer && task.bufferDownloadOffset == task.bufferSize) {
         return;
       }
 
       // NSData can reference non-contiguous memory so copy each data range from the object.
       size_t previousDownloadOffset = task.bufferDownloadOffset;
+      __block BOOL consumed = YES;
       [received_buffer enumerateByteRangesUsingBlock:^(const void* data_bytes,
                                                        NSRange data_byte_range, BOOL* stop) {
+        if (consumer) {
+          // The fetcher waits on the consumer, so a slow consumer holds off the download.
+          if (!consumer(data_bytes, data_byte_range.length, user_data)) {
+            consumed = NO;
+            *stop = YES;
+            return;
+          }
+          task.bufferDownloadOffset += data_byte_range.length;
+          return;
+        }
         size_t space_remaining = task.bufferSize - task.bufferDownloadOffset;
         size_t data_byte_range_size = data_byte_range.length;
         size_t copy_size;
@@ -275,8 +290,17 @@ FIRStorageDownloadTask* StorageReferenceInternal::CreateStreamingDownloadTask(
         });
       }
 
-      // If the buffer is now full, stop downloading.
-      if (task.bufferSize == task.bufferDownloadOffset) {
+      if (!consumed) {
+        // The consumer stopped the download.
+        [task.fetcher stopFetching];
+        dispatch_async(callbackQueue, ^{
+          completion(nil, [NSError errorWithDomain:FIRStorageErrorDomain
+                                              code:FIRStorageErrorCodeUnknown
+                                          userInfo:nil]);
+          task.fetcher.accumulateDataBlock = nil;
+        });
+      } else if (!consumer && task.bufferSize == task.bufferDownloadOffset) {
+        // If the buffer is now full, stop downloading.
         [task.fetcher stopFetching];
         dispatch_async(callbackQueue, ^{
           // NOTE: We can allocate NSData without copying the input buffer as we know that
@@ -337,8 +361,8 @@ Future<size_t> StorageReferenceInternal::GetBytes(void* buffer, size_t buffer_si
   util::DispatchAsyncSafeMainQueue(^() {
     // TODO(smiles): Add streaming callback so that the user can actually stream data rather
     // than providing the entire buffer to upload.
-    FIRStorageDownloadTask* download_task =
-        CreateStreamingDownloadTask(my_impl, storage, completion, buffer, buffer_size);
+    FIRStorageDownloadTask* download_task = CreateStreamingDownloadTask(
+        my_impl, storage, completion, buffer, buffer_size, nullptr, nullptr);
     if (listener) listener->impl_->AttachTask(storage, download_task);
     if (controller_out) {
       controller_out->internal_->set_pending_valid(false);
@@ -352,6 +376,60 @@ Future<size_t> StorageReferenceInternal::GetBytesLastResult() {
   return static_cast<const Future<size_t>&>(future()->LastResult(kStorageReferenceFnGetBytes));
 }
 
+Future<size_t> StorageReferenceInternal::GetStream(StreamConsumer consumer, void* user_data,
+                                                   Listener* listener, Controller* controller_out) {
+  ReferenceCountedFutureImpl* future_impl = future();
+  SafeFutureHandle<size_t> handle = future_impl->SafeAlloc<size_t>(kStorageReferenceFnGetStream);
+  // The stream has no buffer to tell its length, so the bytes are counted by a controller.
+  ControllerInternal* local_controller = new ControllerInternal();
+  __block BOOL completed = NO;
+  FIRStorageVoidDataError completion = ^(NSData* _Nullable data, NSError* _Nullable error) {
+    if (completed) {
+      return;
+    }
+    completed = YES;
+    Error error_code = NSErrorToErrorCode(error);
+    const char* error_string = GetErrorMessage(error_code);
+    if (error == nil) {
+      size_t bytes_transferred = static_cast<size_t>(local_controller->bytes_transferred());
+      future_impl->CompleteWithResult(handle, error_code, error_string, bytes_transferred);
+    } else {
+      future_impl->Complete(handle, error_code, error_string);
+    }
+    {
+      MutexLock mutex(controller_init_mutex_);
+      delete local_controller;
+    }
+    if (listener) listener->impl_->DetachTask();
+  };
+
+  if (controller_out) {
+    controller_out->internal_->set_pending_valid(true);
+  }
+  // Cache a copy of the impl and storage, in case this is destroyed before the thread runs.
+  FIRStorageReference* my_impl = impl();
+  StorageInternal* storage = storage_;
+  util::DispatchAsyncSafeMainQueue(^() {
+    FIRStorageDownloadTask* download_task;
+    {
+      MutexLock mutex(controller_init_mutex_);
+      download_task = CreateStreamingDownloadTask(my_impl, storage, completion, nullptr, 0,
+                                                  consumer, user_data);
+      local_controller->AssignTask(storage, download_task);
+    }
+    if (listener) listener->impl_->AttachTask(storage, download_task);
+    if (controller_out) {
+      controller_out->internal_->set_pending_valid(false);
+      controller_out->internal_->AssignTask(storage, download_task);
+    }
+  });
+  return GetStreamLastResult();
+}
+
+Future<size_t> StorageReferenceInternal::GetStreamLastResult() {
+  return static_cast<const Future<size_t>&>(future()->LastResult(kStorageReferenceFnGetStream));
+}
+
 Future<std::string> StorageReferenceInternal::GetDownloadUrl() {
   ReferenceCountedFutureImpl* future_impl = future();
   SafeFutureHandle<std::string> handle =
@@ -580,6 +658,88 @@ Future<Metadata> StorageReferenceInternal::PutFileLastResult() {
   return static_cast<const Future<Metadata>&>(future()->LastResult(kStorageReferenceFnPutFile));
 }
 
+Future<Metadata> StorageReferenceInternal::PutStream(
+    StreamProducer producer, void* user_data, Listener* listener, Controller* controller_out) {
+  return PutStream(producer, user_data, nullptr, listener, controller_out);
+}
+
+Future<Metadata> StorageReferenceInternal::PutStream(
+    StreamProducer producer, void* user_data, const Metadata* metadata, Listener* listener,
+    Controller* controller_out) {
+  ReferenceCountedFutureImpl* future_impl = future();
+  SafeFutureHandle<Metadata> handle =
+      future_impl->SafeAlloc<Metadata>(kStorageReferenceFnPutStream);
+  StorageInternal* storage = storage_;
+  __block BOOL completed = NO;
+  FIRStorageVoidMetadataError completion =
+      ^(FIRStorageMetadata *resultant_metadata, NSError *error) {
+    if (completed) return;
+    completed = YES;
+    Error error_code = NSErrorToErrorCode(error);
+    const char* error_string = GetErrorMessage(error_code);
+    if (error == nil) {
+      future_impl->CompleteWithResult(
+          handle, error_code, error_string,
+          Metadata(new MetadataInternal(
+              storage, MakeUnique<FIRStorageMetadataPointer>(resultant_metadata))));
+    } else {
+      future_impl->CompleteWithResult(handle, error_code, error_string, Metadata(nullptr));
+    }
+    if (listener) listener->impl_->DetachTask();
+  };
+  FIRStorageMetadata *metadata_impl = nil;
+  Metadata local_metadata;
+  if (metadata) local_metadata = *metadata;
+  metadata = &local_metadata;
+  internal::MetadataSetDefaults(&local_metadata);
+  if (metadata->is_valid()) {
+    metadata->internal_->CommitCustomMetadata();
+    metadata_impl = metadata->internal_->impl();
+  }
+  if (controller_out) {
+    controller_out->internal_->set_pending_valid(true);
+  }
+  // Cache a copy of the impl, in case this is destroyed before the thread runs.
+  FIRStorageReference* my_impl = impl();
+  // FIRStorageReference only uploads from memory or from a file, so the stream is gathered in
+  // memory first, away from the main queue as the producer may block.
+  dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+      static const size_t kReadSize = 64 * 1024;
+      NSMutableData* data = [NSMutableData data];
+      for (;;) {
+        NSUInteger buffered = data.length;
+        [data setLength:buffered + kReadSize];
+        int64_t read = producer(static_cast<char*>(data.mutableBytes) + buffered, kReadSize,
+                                user_data);
+        if (read < 0 || read > static_cast<int64_t>(kReadSize)) {
+          future_impl->CompleteWithResult(handle, kErrorUnknown,
+                                          "The producer of the stream failed.", Metadata(nullptr));
+          if (controller_out) controller_out->internal_->set_pending_valid(false);
+          return;
+        }
+        [data setLength:buffered + static_cast<NSUInteger>(read)];
+        if (read == 0) break;
+      }
+      util::DispatchAsyncSafeMainQueue(^() {
+          FIRStorageUploadTask* upload_task = [my_impl putData:data
+                                                      metadata:metadata_impl
+                                                    completion:completion];
+          if (listener) {
+            listener->impl_->AttachTask(storage, upload_task);
+          }
+          if (controller_out) {
+            controller_out->internal_->set_pending_valid(false);
+            controller_out->internal_->AssignTask(storage, upload_task);
+          }
+      });
+  });
+  return PutStreamLastResult();
+}
+
+Future<Metadata> StorageReferenceInternal::PutStreamLastResult() {
+  return static_cast<const Future<Metadata>&>(future()->LastResult(kStorageReferenceFnPutStream));
+}
+
 ReferenceCountedFutureImpl* StorageReferenceInternal::future() {
   return storage_->future_manager().GetFutureApi(this);
 }
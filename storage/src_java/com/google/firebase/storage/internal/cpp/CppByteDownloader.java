@@ -26,6 +26,8 @@ public class CppByteDownloader implements StreamDownloadTask.StreamProcessor {
 
   /**
    * Construct a CppByteDownloader. First parameter is a C++ pointers, second is a number of bytes.
+   * If cppBufferSize is < 0 the data is handed to the C++ implementation as it comes, without a
+   * bound, and cppBufferPointer points to the object that takes it.
    */
   public CppByteDownloader(long cppBufferPointer, long cppBufferSize) {
     this.cppBufferPointer = cppBufferPointer;
@@ -48,8 +50,10 @@ public class CppByteDownloader implements StreamDownloadTask.StreamProcessor {
       int bytesRead;
       byte[] bytes = new byte[16384];
       while ((bytesRead = stream.read(bytes, 0, bytes.length)) != -1) {
-        if (bufferOffset + bytesRead <= this.cppBufferSize) {
-          writeBytesToBuffer(bufferOffset, bytes, bytesRead);
+        if (this.cppBufferSize < 0 || bufferOffset + bytesRead <= this.cppBufferSize) {
+          if (!writeBytesToBuffer(bufferOffset, bytes, bytesRead)) {
+            throw new IOException("The consumer of the stream stopped the download.");
+          }
           bufferOffset += bytesRead;
         } else {
           throw new IndexOutOfBoundsException("The maximum allowed buffer size was exceeded.");
@@ -60,14 +64,16 @@ public class CppByteDownloader implements StreamDownloadTask.StreamProcessor {
     }
   }
 
-  public void writeBytesToBuffer(long bufferOffset, byte[] bytes, long numBytes) {
+  /** Returns false if the C++ implementation stopped the download. */
+  public boolean writeBytesToBuffer(long bufferOffset, byte[] bytes, long numBytes) {
     synchronized (lockObject) {
       if (this.cppBufferPointer != 0) {
-        writeBytes(this.cppBufferPointer, this.cppBufferSize, bufferOffset, bytes, numBytes);
+        return writeBytes(this.cppBufferPointer, this.cppBufferSize, bufferOffset, bytes, numBytes);
       }
     }
+    return true;
   }
 
-  private static native void writeBytes(
+  private static native boolean writeBytes(
       long cppBufferPointer, long cppBufferSize, long cppBufferOffset, byte[] bytes, long numBytes);
 }